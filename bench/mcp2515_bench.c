@@ -0,0 +1,376 @@
+/**
+ * @file mcp2515_bench.c
+ * @brief Benchmark of the SPI cost of the driver APIs against the simulated chip.
+ *
+ * Every case is run through the real driver code with the simulator linked in as the platform abstraction
+ * layer. The simulator counts chip select windows and SPI bytes; the time per operation is then modelled for
+ * several SPI clocks as (bytes * 8 / f_spi) + (windows * chip select overhead).
+ *
+ * Usage : mcp2515_bench [--csv]
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../mcp2515_driver.h"
+#include "../mcp2515_monitor.h"
+#include "../mcp2515_signal.h"
+#include "../sim/mcp2515_sim.h"
+
+/**
+ * @brief Time spent per chip select window on top of the clocked bytes, in nanoseconds. It covers the
+ * chip select setup and hold times of the MCP2515 and the GPIO toggling of a typical MCU.
+*/
+#define BENCH_CS_OVERHEAD_NS 500
+
+/**
+ * @brief Number of iterations used to measure the host CPU time of a case.
+*/
+#define BENCH_ITERATIONS 200000
+
+/**
+ * @brief Frames put on the saturated bus by the monitor benchmark.
+*/
+#define BENCH_MONITOR_FRAMES 20000
+
+/**
+ * @brief Frames decoded per pass by the signal benchmark, and passes timed.
+*/
+#define BENCH_SIGNAL_FRAMES 1024
+#define BENCH_SIGNAL_PASSES 1000
+
+static const uint32_t _spi_clocks[] = { 1000000, 4000000, 8000000, 10000000 };
+#define BENCH_NUM_CLOCKS ( sizeof(_spi_clocks) / sizeof(_spi_clocks[0]) )
+
+typedef struct BENCH_CASE
+{
+	const char *name;
+	uint8_t dlc;
+	void (*prepare)(uint8_t);
+	void (*run)(uint8_t);
+}BENCH_CASE;
+
+typedef struct BENCH_RESULT
+{
+	SIM_SPI_STATS spi;
+	double host_ns;
+}BENCH_RESULT;
+
+static unsigned char _data[8] = { 0X11, 0X22, 0X33, 0X44, 0X55, 0X66, 0X77, 0X88 };
+
+static CAN_MONITOR _mon;
+static MON_FRAME _mon_ring[64];
+
+
+
+/* CASES ********************************************************************************************************************/
+
+static void prepareNone(uint8_t _dlc)
+{
+	(void)_dlc;
+}
+
+static void prepareRxStandard(uint8_t _dlc)
+{
+	CAN_FRAME _f = { can_standard, 0, 0X123, _dlc, {0,0,0,0,0,0,0,0} };
+	memcpy( _f.DATA, _data, 8 );
+	simInjectFrame( &_f );
+}
+
+static void prepareRxExtended(uint8_t _dlc)
+{
+	CAN_FRAME _f = { can_extended, 0, 0X18FEF100, _dlc, {0,0,0,0,0,0,0,0} };
+	memcpy( _f.DATA, _data, 8 );
+	simInjectFrame( &_f );
+}
+
+static void runTransmit(uint8_t _dlc)
+{
+	canTransmit( 0, _dlc, _data );
+}
+
+static void runTransmitSID(uint8_t _dlc)
+{
+	canTransmit_wSID( 0, 0X123, _dlc, _data );
+}
+
+static void runTransmitEID(uint8_t _dlc)
+{
+	canTransmit_wEID( 0, 0X18FEF100, _dlc, _data );
+}
+
+static void runTransmitRemoteSID(uint8_t _dlc)
+{
+	(void)_dlc;
+	canTransmitRemote_wSID( 0, 0X123 );
+}
+
+static void runTransmitRemoteEID(uint8_t _dlc)
+{
+	(void)_dlc;
+	canTransmitRemote_wEID( 0, 0X18FEF100 );
+}
+
+static void runReceive(uint8_t _dlc)
+{
+	(void)_dlc;
+	if( canIsFilledRX(0) )
+	{
+		CAN_FRAME _f = canGetFrame_wID(0);
+		(void)_f;
+		enableRX(0);
+	}
+}
+
+static void runServiceRX(uint8_t _dlc)
+{
+	(void)_dlc;
+	canServiceRX( 0, 0 );
+}
+
+static void prepareMonStandard(uint8_t _dlc)
+{
+	monBegin( &_mon, _mon_ring, 64 );
+	prepareRxStandard( _dlc );
+}
+
+static void prepareMonExtended(uint8_t _dlc)
+{
+	monBegin( &_mon, _mon_ring, 64 );
+	prepareRxExtended( _dlc );
+}
+
+static void runMonService(uint8_t _dlc)
+{
+	(void)_dlc;
+	monService( &_mon );
+}
+
+static const BENCH_CASE _cases[] =
+{
+	{ "canTransmit",            0, prepareNone,       runTransmit },
+	{ "canTransmit",            4, prepareNone,       runTransmit },
+	{ "canTransmit",            8, prepareNone,       runTransmit },
+	{ "canTransmit_wSID",       0, prepareNone,       runTransmitSID },
+	{ "canTransmit_wSID",       4, prepareNone,       runTransmitSID },
+	{ "canTransmit_wSID",       8, prepareNone,       runTransmitSID },
+	{ "canTransmit_wEID",       0, prepareNone,       runTransmitEID },
+	{ "canTransmit_wEID",       4, prepareNone,       runTransmitEID },
+	{ "canTransmit_wEID",       8, prepareNone,       runTransmitEID },
+	{ "canTransmitRemote_wSID", 0, prepareNone,       runTransmitRemoteSID },
+	{ "canTransmitRemote_wEID", 0, prepareNone,       runTransmitRemoteEID },
+	{ "rx_std",                 0, prepareRxStandard, runReceive },
+	{ "rx_std",                 4, prepareRxStandard, runReceive },
+	{ "rx_std",                 8, prepareRxStandard, runReceive },
+	{ "rx_ext",                 8, prepareRxExtended, runReceive },
+	{ "canServiceRX_std",       0, prepareRxStandard, runServiceRX },
+	{ "canServiceRX_std",       4, prepareRxStandard, runServiceRX },
+	{ "canServiceRX_std",       8, prepareRxStandard, runServiceRX },
+	{ "canServiceRX_ext",       8, prepareRxExtended, runServiceRX },
+	{ "monService_std",         0, prepareMonStandard, runMonService },
+	{ "monService_std",         8, prepareMonStandard, runMonService },
+	{ "monService_ext",         8, prepareMonExtended, runMonService },
+};
+#define BENCH_NUM_CASES ( sizeof(_cases) / sizeof(_cases[0]) )
+/*************************************************************************************************************************/
+
+
+
+static double nowNs(void)
+{
+	struct timespec _ts;
+	clock_gettime( CLOCK_MONOTONIC, &_ts );
+	return (double)_ts.tv_sec * 1e9 + (double)_ts.tv_nsec;
+}
+
+/**
+ * @brief Runs one case : a single counted run for the SPI cost, then a timed loop for the host CPU cost.
+*/
+static void benchRun(const BENCH_CASE *_c, BENCH_RESULT *_r)
+{
+	simReset();
+	canDisableFilterRX(0);
+	canDisableFilterRX(1);
+	canRequestMode( mcp_normal_mode );
+
+	_c->prepare( _c->dlc );
+	simClearStats();
+	_c->run( _c->dlc );
+	simGetStats( &_r->spi );
+
+	double _total = 0;
+	for(uint32_t i=0; i<BENCH_ITERATIONS; i++)
+	{
+		_c->prepare( _c->dlc );
+		double _t0 = nowNs();
+		_c->run( _c->dlc );
+		_total += nowNs() - _t0;
+	}
+	_r->host_ns = _total / BENCH_ITERATIONS;
+}
+
+/**
+ * @brief Runs the monitor on a bus saturated with back to back frames at 1 Mbit/s : _period_us is the bus time of
+ * one frame without stuff bits. monService() is called as soon as the interrupt of the chip is pending, so the
+ * interrupt latency of a real MCU comes on top of the modelled SPI time.
+*/
+static void benchMonitor(uint32_t _clock, uint8_t _dlc, uint32_t _period_us, MON_STATS *_out)
+{
+	CAN_FRAME _f = { can_standard, 0, 0X123, _dlc, {0,0,0,0,0,0,0,0} };
+	CAN_FRAME _rx;
+	memcpy( _f.DATA, _data, 8 );
+
+	simReset();
+	simSetSpiClock( _clock );
+	monBegin( &_mon, _mon_ring, 64 );
+
+	simSetBusTraffic( &_f, _period_us );
+	uint32_t _end = pal_get_time_us() + BENCH_MONITOR_FRAMES * _period_us;
+	while( pal_get_time_us() < _end )
+	{
+		if( sim_regs[CANINTF] & sim_regs[CANINTE] )
+			monService( &_mon );
+		else
+			simAdvanceTime( 1 );
+		while( monRead( &_mon, &_rx, 0 ) );
+	}
+	simSetBusTraffic( 0, 0 );
+
+	*_out = _mon.stats;
+}
+
+/**
+ * @brief Decodes six signals per frame, mixed byte orders and signedness, from an array of CAN_FRAME : with
+ * sigDecodeBatch() over frames of one ID, and with sigLookup() and sigDecode() per frame over frames of 64 IDs.
+ * Host CPU time only, the chip is not involved.
+*/
+static void benchSignals(double *_batch_ns, double *_lookup_ns)
+{
+	static const SIG_DEF _defs[6] =
+	{
+		{ 0, 16, SIG_LITTLE_ENDIAN, 0, 0.125f, 0 },
+		{ 16, 8, SIG_LITTLE_ENDIAN, 1, 1, -40 },
+		{ 24, 4, SIG_LITTLE_ENDIAN, 0, 1, 0 },
+		{ 28, 12, SIG_LITTLE_ENDIAN, 1, 0.1f, 0 },
+		{ 47, 10, SIG_BIG_ENDIAN, 0, 0.5f, -100 },
+		{ 56, 8, SIG_LITTLE_ENDIAN, 0, 0.4f, 0 },
+	};
+	static CAN_FRAME _frames[BENCH_SIGNAL_FRAMES];
+	static SIG_VALUE _out[BENCH_SIGNAL_FRAMES * 6];
+	SIG_PLAN _plan[6];
+	SIG_MESSAGE _msgs[64];
+	volatile SIG_VALUE _sink = 0;
+
+	sigCompile( _defs, 6, _plan );
+	for(uint8_t m=0; m<64; m++)
+		sigMessage( &_msgs[m], can_standard, 0X100 + 3 * m, _plan, 6 );
+	sigSort( _msgs, 64 );
+	for(uint32_t i=0; i<BENCH_SIGNAL_FRAMES; i++)
+	{
+		_frames[i].type = can_standard;
+		_frames[i].ID = 0X100 + 3 * ( ( i * 37 ) % 64 );
+		for(uint8_t j=0; j<8; j++)
+			_frames[i].DATA[j] = (unsigned char)( i * 31 + j * 7 );
+	}
+
+	double _t0 = nowNs();
+	for(uint32_t p=0; p<BENCH_SIGNAL_PASSES; p++)
+	{
+		sigDecodeBatch( &_msgs[0], _frames[0].DATA, sizeof(CAN_FRAME), BENCH_SIGNAL_FRAMES, _out );
+		_sink += _out[p % ( BENCH_SIGNAL_FRAMES * 6 )];
+	}
+	*_batch_ns = ( nowNs() - _t0 ) / ( (double)BENCH_SIGNAL_PASSES * BENCH_SIGNAL_FRAMES );
+
+	_t0 = nowNs();
+	for(uint32_t p=0; p<BENCH_SIGNAL_PASSES; p++)
+	{
+		for(uint32_t i=0; i<BENCH_SIGNAL_FRAMES; i++)
+		{
+			const SIG_MESSAGE *_m = sigLookup( _msgs, 64, _frames[i].type, _frames[i].ID );
+			sigDecode( _m, _frames[i].DATA, &_out[6 * i] );
+		}
+		_sink += _out[p % ( BENCH_SIGNAL_FRAMES * 6 )];
+	}
+	*_lookup_ns = ( nowNs() - _t0 ) / ( (double)BENCH_SIGNAL_PASSES * BENCH_SIGNAL_FRAMES );
+	(void)_sink;
+}
+
+static double modelUs(const SIM_SPI_STATS *_s, uint32_t _clock)
+{
+	return (double)_s->bytes * 8.0 * 1e6 / (double)_clock + (double)_s->windows * BENCH_CS_OVERHEAD_NS / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t _csv = ( argc > 1 && strcmp( argv[1], "--csv" ) == 0 );
+	BENCH_RESULT _results[BENCH_NUM_CASES];
+
+	for(uint32_t i=0; i<BENCH_NUM_CASES; i++)
+		benchRun( &_cases[i], &_results[i] );
+
+	if( _csv )
+	{
+		printf("case,dlc,cs_windows,spi_bytes,host_ns");
+		for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+			printf(",us_at_%luhz,fps_at_%luhz", (unsigned long)_spi_clocks[k], (unsigned long)_spi_clocks[k]);
+		printf("\n");
+
+		for(uint32_t i=0; i<BENCH_NUM_CASES; i++)
+		{
+			printf("%s,%u,%lu,%lu,%.1f", _cases[i].name, _cases[i].dlc,
+				(unsigned long)_results[i].spi.windows, (unsigned long)_results[i].spi.bytes, _results[i].host_ns);
+			for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+			{
+				double _us = modelUs( &_results[i].spi, _spi_clocks[k] );
+				printf(",%.2f,%.0f", _us, 1e6 / _us);
+			}
+			printf("\n");
+		}
+		return 0;
+	}
+
+	printf("%-24s %3s %4s %5s %8s", "case", "dlc", "cs", "bytes", "host_ns");
+	for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+		printf("  %5luMHz us/fps", (unsigned long)(_spi_clocks[k] / 1000000));
+	printf("\n");
+
+	for(uint32_t i=0; i<BENCH_NUM_CASES; i++)
+	{
+		printf("%-24s %3u %4lu %5lu %8.1f", _cases[i].name, _cases[i].dlc,
+			(unsigned long)_results[i].spi.windows, (unsigned long)_results[i].spi.bytes, _results[i].host_ns);
+		for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+		{
+			double _us = modelUs( &_results[i].spi, _spi_clocks[k] );
+			printf("  %6.1f/%7.0f", _us, 1e6 / _us);
+		}
+		printf("\n");
+	}
+
+	// std frames of DLC 8 take 111 bit times, of DLC 0 47 bit times
+	printf("\nmonitor on a saturated 1 Mbit/s bus, %u frames : captured/overruns\n", BENCH_MONITOR_FRAMES);
+	printf("%-24s %3s", "case", "dlc");
+	for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+		printf("  %12luMHz", (unsigned long)(_spi_clocks[k] / 1000000));
+	printf("\n");
+	for(uint8_t _dlc=0; _dlc<=8; _dlc+=8)
+	{
+		printf("%-24s %3u", "monService_std", _dlc);
+		for(uint32_t k=0; k<BENCH_NUM_CLOCKS; k++)
+		{
+			MON_STATS _m;
+			benchMonitor( _spi_clocks[k], _dlc, _dlc ? 111 : 47, &_m );
+			printf("  %7lu/%6lu", (unsigned long)_m.frames, (unsigned long)_m.overruns);
+		}
+		printf("\n");
+	}
+	simSetSpiClock( 8000000 );
+
+	double _batch_ns, _lookup_ns;
+	benchSignals( &_batch_ns, &_lookup_ns );
+	printf("\nsignal decoding, 6 signals per frame : host ns/frame\n");
+	printf("%-24s %8.1f\n", "sigDecodeBatch", _batch_ns);
+	printf("%-24s %8.1f\n", "sigLookup+sigDecode", _lookup_ns);
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file mcp2515_bench_pal.c
+ * @brief Benchmark of the CPU cost of the driver frame paths with a PAL that costs nothing but its register
+ * accesses (bench/mcp2515_bench_spi.h). Built twice : with the PAL called across translation units, as with
+ * mcp2515_driver_pal.c, and with MCP_PAL_INLINE_HEADER, where the core inlines it. The difference is the call
+ * overhead of the PAL.
+ *
+ * The cost is given in time stamp counter cycles on x86 hosts, in nanoseconds elsewhere.
+ *
+ * Usage : mcp2515_bench_pal
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../mcp2515_driver.h"
+
+/**
+ * @brief Number of iterations of every case.
+*/
+#define BENCH_ITERATIONS 2000000
+
+static unsigned char _data[8] = { 0X11, 0X22, 0X33, 0X44, 0X55, 0X66, 0X77, 0X88 };
+static volatile uint32_t _sink;
+
+
+
+/* CASES ********************************************************************************************************************/
+
+static void runTransmitSID(void)
+{
+	canTransmit_wSID( 0, 0X123, 8, _data );
+}
+
+static void runTransmitEID(void)
+{
+	canTransmit_wEID( 0, 0X18FEF100, 8, _data );
+}
+
+static void runGetFrame(void)
+{
+	CAN_FRAME _f = canGetFrame_wID(0);
+	_sink = _f.ID;
+}
+
+static void runServiceRX(void)
+{
+	_sink = canServiceRX( 0, 0 );
+}
+
+typedef struct BENCH_CASE
+{
+	const char *name;
+	void (*run)(void);
+}BENCH_CASE;
+
+static const BENCH_CASE _cases[] =
+{
+	{ "canTransmit_wSID dlc 8", runTransmitSID },
+	{ "canTransmit_wEID dlc 8", runTransmitEID },
+	{ "canGetFrame_wID",        runGetFrame },
+	{ "canServiceRX (empty)",   runServiceRX },
+};
+#define BENCH_NUM_CASES ( sizeof(_cases) / sizeof(_cases[0]) )
+/*************************************************************************************************************************/
+
+
+
+static uint64_t benchCount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec _ts;
+	clock_gettime( CLOCK_MONOTONIC, &_ts );
+	return (uint64_t)_ts.tv_sec * 1000000000ULL + (uint64_t)_ts.tv_nsec;
+#endif
+}
+
+int main(void)
+{
+#ifdef MCP_PAL_INLINE_HEADER
+	const char *_mode = "inline";
+#else
+	const char *_mode = "out of line";
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	const char *_unit = "cycles";
+#else
+	const char *_unit = "ns";
+#endif
+
+	printf("PAL %s, %s per call\n", _mode, _unit);
+	for(uint32_t i=0; i<BENCH_NUM_CASES; i++)
+	{
+		_cases[i].run();
+
+		uint64_t _t0 = benchCount();
+		for(uint32_t n=0; n<BENCH_ITERATIONS; n++)
+			_cases[i].run();
+		uint64_t _t1 = benchCount();
+
+		printf("%-24s %8.1f\n", _cases[i].name, (double)( _t1 - _t0 ) / BENCH_ITERATIONS);
+	}
+
+	return 0;
+}
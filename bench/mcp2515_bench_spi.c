@@ -0,0 +1,15 @@
+/**
+ * @file mcp2515_bench_spi.c
+ * @brief Registers of the benchmark PAL, and its functions when they are not inlined.
+*/
+
+#include <stdint.h>
+
+volatile uint8_t bench_spdr;
+volatile uint8_t bench_cs;
+volatile uint32_t bench_tcnt;
+
+#ifndef MCP_PAL_INLINE_HEADER
+#define BENCH_SPI_FN
+#include "mcp2515_bench_spi.h"
+#endif
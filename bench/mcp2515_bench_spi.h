@@ -0,0 +1,55 @@
+/**
+ * @file mcp2515_bench_spi.h
+ * @brief PAL of the cycles per frame benchmark on memory mapped registers, like the SPI data register of a small
+ * MCU whose transfer completes at once. Used as MCP_PAL_INLINE_HEADER, the functions are static inline; compiled by
+ * mcp2515_bench_spi.c, they are ordinary functions called across translation units.
+*/
+#ifndef MCP2515_BENCH_SPI
+#define MCP2515_BENCH_SPI
+
+#include <stdint.h>
+
+#ifndef BENCH_SPI_FN
+#define BENCH_SPI_FN static inline
+#endif
+
+extern volatile uint8_t bench_spdr;
+extern volatile uint8_t bench_cs;
+extern volatile uint32_t bench_tcnt;
+
+BENCH_SPI_FN void pal_spi_init(void *data, uint8_t data_direction, uint8_t idle_level, uint8_t shift_edge)
+{
+	(void)data;
+	(void)data_direction;
+	(void)idle_level;
+	(void)shift_edge;
+}
+
+BENCH_SPI_FN void pal_select_slave(void)
+{
+	bench_cs = 0;
+}
+
+BENCH_SPI_FN void pal_deselect_slave(void)
+{
+	bench_cs = 1;
+}
+
+BENCH_SPI_FN void pal_spi_send(uint8_t byt)
+{
+	bench_spdr = byt;
+}
+
+// the chip answers 0 : transmit buffers free, standard frames received
+BENCH_SPI_FN uint8_t pal_spi_read(void)
+{
+	bench_spdr = 0X00;
+	return bench_spdr;
+}
+
+BENCH_SPI_FN uint32_t pal_get_time_us(void)
+{
+	return bench_tcnt;
+}
+
+#endif
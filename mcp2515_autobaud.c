@@ -0,0 +1,172 @@
+/**
+ * @file mcp2515_autobaud.c
+ * @brief Detection of the data rate of a bus in listen only mode.
+*/
+
+#include "mcp2515_autobaud.h"
+
+/* candidates tried when none are given, the most common rates first; the 20 MHz tables start at 40 kbps */
+static const uint16_t baud_default[] =
+{
+	500, 250, 125, 1000, 200, 100, 80, 50, 40,
+#if		MCP_CHIP_FREQ!=20000000
+	20, 10, 5
+#endif
+};
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to listen at one candidate for at most _window_us.
+ *
+ * @return
+ * 1 : IF BAUD_MIN_FRAMES FRAMES WERE RECEIVED WITHOUT ERROR
+ * 0 : IF MERRF WAS FLAGGED OR THE WINDOW EXPIRED
+*/
+static uint8_t baudListen(BAUD_RESULT *_res, const unsigned char *_cnf, uint8_t _inte, uint32_t _window_us)
+{
+	const uint8_t _rxif = (1<<RX0IF) | (1<<RX1IF);
+	uint8_t _frames = 0;
+
+	// CNF3, CNF2, CNF1, CANINTE as it was and CANINTF cleared, in one burst
+	canRequestMode(mcp_configuration_mode);
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( CNF3 );
+	pal_spi_send( _cnf[2] );
+	pal_spi_send( _cnf[1] );
+	pal_spi_send( _cnf[0] );
+	pal_spi_send( _inte );
+	pal_spi_send( 0X00 );
+	pal_deselect_slave();
+	canRequestMode(mcp_listen_only_mode);
+	_res->tried++;
+
+	uint32_t _start = pal_get_time_us();
+	do
+	{
+		uint8_t _intf = canReadRegister( CANINTF );
+		_res->polls++;
+
+		if( _intf & (1<<MERRF) )
+		{
+			_res->rejected++;
+			return 0;
+		}
+
+		if( _intf & _rxif )
+		{
+			_frames += ( _intf & (1<<RX0IF) ) ? 1 : 0;
+			_frames += ( _intf & (1<<RX1IF) ) ? 1 : 0;
+			// the frames that confirm the rate stay in the receive buffers
+			if( _frames >= BAUD_MIN_FRAMES )
+				return 1;
+			canClearInterruptFlags( _intf & _rxif );
+		}
+
+		pal_delay_us(BAUD_POLL_US);
+	}while( pal_get_time_us() - _start < _window_us );
+
+	return 0;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function detects the data rate of the bus. The candidates are listened to in turn, in listen only
+ * mode and with the masks and filters off, for at most BAUD_WINDOW_US each; the list is gone through again while
+ * the budget lasts. A candidate is taken after BAUD_MIN_FRAMES frames received without error and dropped at the
+ * first MERRF. A candidate that canGetBitTiming() cannot program at MCP_CHIP_FREQ is skipped.
+ *
+ * On success the chip stays in listen only mode at the detected rate, with the frames that confirmed it in its
+ * receive buffers : canRequestMode(mcp_normal_mode) joins the bus. Otherwise the chip gets back the bit timing and
+ * the mode it had. The interrupt flags are cleared either way, RXBnCTRL and CANINTE are kept.
+ *
+ * @param
+ * 1. _res : receives the result.
+ * 2. _rates : candidate data rates in Kbps, as for canBegin(); NULL for every supported rate, most common first.
+ * 3. _n : number of candidates in _rates.
+ * 4. _budget_us : bound of the detection time. Each candidate is given what is left of it at most, so the
+ * detection ends within the budget plus the set up of one candidate.
+ *
+ * @return
+ * 1. SUCCESS : _res->rate holds the data rate
+ * 2. FAILED : no candidate received a frame within the budget, or none can be programmed
+ */
+uint8_t baudDetect(BAUD_RESULT *_res, const uint16_t *_rates, uint8_t _n, uint32_t _budget_us)
+{
+	uint8_t _saved[4];
+	uint32_t _start = pal_get_time_us();
+
+	if( !_rates )
+	{
+		_rates = baud_default;
+		_n = sizeof(baud_default) / sizeof(baud_default[0]);
+	}
+
+	_res->rate = 0;
+	_res->tried = 0;
+	_res->rejected = 0;
+	_res->polls = 0;
+
+	canStateLock();
+	MCP_CAN_MODE _mode = canGetMode();
+
+	// CNF3, CNF2, CNF1, CANINTE
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( CNF3 );
+	for(uint8_t i=0; i<4; i++)
+		_saved[i] = pal_spi_read();
+	pal_deselect_slave();
+
+	// the filters must not hide a valid frame
+	uint8_t _rxb0ctrl = canReadRegister( RXB0CTRL );
+	uint8_t _rxb1ctrl = canReadRegister( RXB1CTRL );
+	canWriteRegister( RXB0CTRL, _rxb0ctrl | (3<<RXM0) );
+	canWriteRegister( RXB1CTRL, _rxb1ctrl | (3<<RXM0) );
+
+	while( _n && !_res->rate )
+	{
+		uint8_t _listened = 0;
+
+		for(uint8_t i=0; i<_n; i++)
+		{
+			uint32_t _elapsed = pal_get_time_us() - _start;
+			if( _elapsed >= _budget_us )
+				break;
+
+			unsigned char _cnf[3];
+			if( !canGetBitTiming( _rates[i], _cnf ) )
+				continue;
+
+			_listened++;
+			uint32_t _left = _budget_us - _elapsed;
+			if( baudListen( _res, _cnf, _saved[3], _left < BAUD_WINDOW_US ? _left : BAUD_WINDOW_US ) )
+			{
+				_res->rate = _rates[i];
+				for(uint8_t c=0; c<3; c++)
+					_res->cnf[c] = _cnf[c];
+				break;
+			}
+		}
+
+		if( !_listened || pal_get_time_us() - _start >= _budget_us )
+			break;
+	}
+
+	canWriteRegister( RXB0CTRL, _rxb0ctrl );
+	canWriteRegister( RXB1CTRL, _rxb1ctrl );
+
+	if( !_res->rate )
+	{
+		canRequestMode(mcp_configuration_mode);
+		canSetBitTiming( _saved[2], _saved[1], _saved[0] );
+		canRequestMode(_mode);
+	}
+
+	canStateUnlock();
+	_res->elapsed_us = pal_get_time_us() - _start;
+	return _res->rate ? 1 : 0;
+}
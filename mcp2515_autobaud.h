@@ -0,0 +1,51 @@
+/**
+ * @file mcp2515_autobaud.h
+ * @brief Detection of the data rate of a bus. baudDetect() listens to the bus in listen only mode at every candidate
+ * bit timing in turn : the chip neither acknowledges nor sends error frames in this mode, so a wrong guess does not
+ * disturb the other nodes. A candidate is taken as soon as a frame is received without error, and dropped as soon as
+ * the chip flags MERRF. Each candidate is watched with one READ of CANINTF per poll, which gives both the receive
+ * flags and MERRF in 3 bytes.
+ *
+ * The bus must carry traffic for a rate to be found; a silent bus costs the whole budget.
+*/
+#ifndef MCP2515_AUTOBAUD
+#define MCP2515_AUTOBAUD
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Longest time baudDetect() listens at one candidate, in microseconds. It should cover the period of the
+ * least frequent frame expected on the bus.
+*/
+#ifndef BAUD_WINDOW_US
+#define BAUD_WINDOW_US 100000
+#endif
+
+/**
+ * @brief Wait between two polls of CANINTF, in microseconds. The flags stay set until they are cleared, so a longer
+ * wait only costs detection latency, not frames.
+*/
+#ifndef BAUD_POLL_US
+#define BAUD_POLL_US 100
+#endif
+
+/**
+ * @brief Frames that must be received without error before a candidate is taken.
+*/
+#ifndef BAUD_MIN_FRAMES
+#define BAUD_MIN_FRAMES 1
+#endif
+
+typedef struct BAUD_RESULT
+{
+	uint16_t rate;				/* detected data rate in Kbps, 0 when none was found */
+	unsigned char cnf[3];		/* CNF1, CNF2, CNF3 of the detected rate */
+	uint8_t tried;				/* candidates listened to, passes included */
+	uint8_t rejected;			/* candidates dropped on MERRF */
+	uint32_t polls;				/* reads of CANINTF */
+	uint32_t elapsed_us;
+}BAUD_RESULT;
+
+uint8_t baudDetect(BAUD_RESULT *, const uint16_t *, uint8_t, uint32_t);
+
+#endif
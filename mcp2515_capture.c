@@ -0,0 +1,229 @@
+/**
+ * @file mcp2515_capture.c
+ * @brief Append only binary capture of received frames. See mcp2515_capture.h for the file layout.
+*/
+
+#include "mcp2515_capture.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to hand the active buffer over to capService() if the other one is free.
+*/
+static uint8_t capSwap(CAP_WRITER *_w)
+{
+	if( _w->pending )
+		return 0;
+
+	_w->pending = _w->fill;
+	_w->active ^= 1;
+	_w->fill = 0;
+	return 1;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function writes the file header of a capture.
+ *
+ * @param
+ * 1. _out : destination, CAP_HEADER_SIZE bytes.
+ *
+ * @return
+ * NOTHING
+ */
+void capHeader(uint8_t _out[CAP_HEADER_SIZE])
+{
+	static const char _magic[8] = CAP_MAGIC;
+
+	for(uint8_t i=0; i<8; i++)
+		_out[i] = _magic[i];
+	_out[8] = CAP_VERSION & 0XFF;
+	_out[9] = CAP_VERSION >> 8;
+	_out[10] = CAP_RECORD_SIZE & 0XFF;
+	_out[11] = CAP_RECORD_SIZE >> 8;
+	_out[12] = 0;
+	_out[13] = 0;
+	_out[14] = 0;
+	_out[15] = 0;
+}
+
+/**
+ * @brief This function initializes a double buffered writer.
+ *
+ * @param
+ * 1. _w : the writer.
+ * 2. _buf0, _buf1 : two buffers of _records * CAP_RECORD_SIZE bytes each.
+ * 3. _records : capacity of each buffer in records.
+ * 4. _sink : called with every full buffer.
+ * 5. _ctx : passed as it is to the sink.
+ *
+ * @return
+ * NOTHING
+ */
+void capBegin(CAP_WRITER *_w, uint8_t *_buf0, uint8_t *_buf1, uint32_t _records, CAP_SINK _sink, void *_ctx)
+{
+	_w->buf[0] = _buf0;
+	_w->buf[1] = _buf1;
+	_w->records = _records;
+	_w->fill = 0;
+	_w->active = 0;
+	_w->pending = 0;
+	_w->sink = _sink;
+	_w->ctx = _ctx;
+	_w->last_ts = 0;
+	_w->ts_high = 0;
+	_w->written = 0;
+	_w->dropped = 0;
+}
+
+/**
+ * @brief This function encodes a frame into a record.
+ *
+ * @param
+ * 1. _rec : destination, CAP_RECORD_SIZE bytes.
+ * 2. _frame : the frame.
+ * 3. _ts : time stamp in microseconds.
+ *
+ * @return
+ * NOTHING
+ */
+void capEncode(uint8_t _rec[CAP_RECORD_SIZE], const CAN_FRAME *_frame, uint64_t _ts)
+{
+	for(uint8_t i=0; i<8; i++)
+		_rec[i] = _ts >> (8 * i);
+	for(uint8_t i=0; i<4; i++)
+		_rec[8 + i] = _frame->ID >> (8 * i);
+	_rec[12] = ( _frame->type == can_extended ? CAP_FLAG_EXTENDED : 0 ) | ( _frame->isRemote ? CAP_FLAG_REMOTE : 0 );
+	_rec[13] = _frame->DLC;
+	_rec[14] = 0;
+	_rec[15] = 0;
+	for(uint8_t i=0; i<8; i++)
+		_rec[16 + i] = i < _frame->DLC ? _frame->DATA[i] : 0;
+}
+
+/**
+ * @brief This function decodes a record into a frame.
+ *
+ * @param
+ * 1. _rec : the record, CAP_RECORD_SIZE bytes.
+ * 2. _frame : the decoded frame.
+ * 3. _ts : the decoded time stamp, may be NULL.
+ *
+ * @return
+ * NOTHING
+ */
+void capDecode(const uint8_t _rec[CAP_RECORD_SIZE], CAN_FRAME *_frame, uint64_t *_ts)
+{
+	if( _ts )
+	{
+		*_ts = 0;
+		for(uint8_t i=0; i<8; i++)
+			*_ts |= (uint64_t)_rec[i] << (8 * i);
+	}
+
+	_frame->ID = (uint32_t)_rec[8] | ( (uint32_t)_rec[9] << 8 ) | ( (uint32_t)_rec[10] << 16 ) | ( (uint32_t)_rec[11] << 24 );
+	_frame->type = ( _rec[12] & CAP_FLAG_EXTENDED ) ? can_extended : can_standard;
+	_frame->isRemote = ( _rec[12] & CAP_FLAG_REMOTE ) ? 1 : 0;
+	_frame->DLC = _rec[13] > 8 ? 8 : _rec[13];
+	for(uint8_t i=0; i<8; i++)
+		_frame->DATA[i] = _rec[16 + i];
+}
+
+/**
+ * @brief This function appends a frame to the capture. It never blocks and never calls the sink, so it can be
+ * called from the receive path or an interrupt handler.
+ *
+ * @param
+ * 1. _w : the writer.
+ * 2. _frame : the frame.
+ * 3. _ts : the 32 bit time stamp from pal_get_time_us(), extended to 64 bits by the writer.
+ *
+ * @return
+ * 1 : IF THE FRAME WAS STORED
+ * 0 : IF IT WAS DROPPED BECAUSE BOTH BUFFERS ARE FULL
+ */
+uint8_t capWrite(CAP_WRITER *_w, const CAN_FRAME *_frame, uint32_t _ts)
+{
+	if( _w->fill == _w->records && !capSwap(_w) )
+	{
+		_w->dropped++;
+		return 0;
+	}
+
+	if( _ts < _w->last_ts )
+		_w->ts_high++;
+	_w->last_ts = _ts;
+
+	capEncode( &_w->buf[_w->active][ _w->fill * CAP_RECORD_SIZE ], _frame, ( (uint64_t)_w->ts_high << 32 ) | _ts );
+	_w->fill++;
+
+	if( _w->fill == _w->records )
+		capSwap(_w);
+
+	return 1;
+}
+
+/**
+ * @brief Receive hook for canServiceRX(), the context is the CAP_WRITER. The frame is stamped with pal_get_time_us().
+ *
+ * @param
+ * 1. _frame : the received frame.
+ * 2. _ctx : the writer.
+ *
+ * @return
+ * NOTHING
+ */
+void capRXHook(const CAN_FRAME *_frame, void *_ctx)
+{
+	capWrite( (CAP_WRITER *)_ctx, _frame, pal_get_time_us() );
+}
+
+/**
+ * @brief This function hands a full buffer, if any, over to the sink. Call it from the main loop or a low
+ * priority task.
+ *
+ * @param
+ * 1. _w : the writer.
+ *
+ * @return
+ * 1 : IF A BUFFER WAS WRITTEN
+ * 0 : OTHERWISE
+ */
+uint8_t capService(CAP_WRITER *_w)
+{
+	uint32_t _n = _w->pending;
+
+	if( !_n )
+		return 0;
+
+	if( _w->sink )
+		_w->sink( _w->buf[_w->active ^ 1], _n * CAP_RECORD_SIZE, _w->ctx );
+	_w->written += _n;
+	_w->pending = 0;
+	return 1;
+}
+
+/**
+ * @brief This function writes every stored record, including the partly filled active buffer. The receive path
+ * must not write to the capture while this function runs.
+ *
+ * @param
+ * 1. _w : the writer.
+ *
+ * @return
+ * NOTHING
+ */
+void capFlush(CAP_WRITER *_w)
+{
+	capService(_w);
+
+	if( _w->fill )
+	{
+		if( _w->sink )
+			_w->sink( _w->buf[_w->active], _w->fill * CAP_RECORD_SIZE, _w->ctx );
+		_w->written += _w->fill;
+		_w->fill = 0;
+	}
+}
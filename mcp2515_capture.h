@@ -0,0 +1,78 @@
+/**
+ * @file mcp2515_capture.h
+ * @brief Append only binary capture of received frames, written through a double buffered writer.
+ *
+ * File layout (little endian) :
+ * 		header, CAP_HEADER_SIZE bytes : magic "MCPCAP1" with its terminating zero, uint16_t version,
+ * 				uint16_t record size, uint32_t reserved.
+ * 		records, CAP_RECORD_SIZE bytes each :
+ * 				uint64_t time stamp in microseconds
+ * 				uint32_t ID (11 or 29 bits)
+ * 				uint8_t  flags, CAP_FLAG_*
+ * 				uint8_t  DLC
+ * 				uint8_t  reserved[2]
+ * 				uint8_t  DATA[8]
+ *
+ * As records have a fixed size, record i of a capture is at CAP_HEADER_SIZE + i * CAP_RECORD_SIZE.
+*/
+#ifndef MCP2515_CAPTURE
+#define MCP2515_CAPTURE
+
+#include "mcp2515_driver.h"
+
+#define CAP_MAGIC "MCPCAP1"
+
+#define CAP_VERSION 1
+
+#define CAP_HEADER_SIZE 16
+
+#define CAP_RECORD_SIZE 24
+
+/**
+ * @brief Bits of the flags byte of a record.
+*/
+#define CAP_FLAG_EXTENDED 0X01
+#define CAP_FLAG_REMOTE 0X02
+
+/**
+ * @brief Sink called with a full buffer of records. It is called from capService() and capFlush() only,
+ * never from the receive path.
+*/
+typedef void (*CAP_SINK)(const uint8_t *, uint32_t, void *);
+
+/**
+ * @brief Double buffered writer. Frames are appended to the active buffer; a full buffer is handed over to
+ * capService() while the other one keeps receiving. Storage is supplied by the caller.
+*/
+typedef struct CAP_WRITER
+{
+	uint8_t *buf[2];
+	uint32_t records;			/* capacity of each buffer in records */
+	uint32_t fill;				/* records in the active buffer */
+	uint8_t active;				/* index of the buffer being filled */
+	volatile uint32_t pending;	/* records waiting in the other buffer, 0 when it is free */
+	CAP_SINK sink;
+	void *ctx;
+	uint32_t last_ts;			/* to extend the 32 bit PAL time stamps to 64 bits */
+	uint32_t ts_high;
+	uint32_t written;			/* records handed to the sink */
+	uint32_t dropped;			/* records lost because both buffers were full */
+}CAP_WRITER;
+
+void capHeader(uint8_t [CAP_HEADER_SIZE]);
+
+void capBegin(CAP_WRITER *, uint8_t *, uint8_t *, uint32_t, CAP_SINK, void *);
+
+void capEncode(uint8_t [CAP_RECORD_SIZE], const CAN_FRAME *, uint64_t);
+
+void capDecode(const uint8_t [CAP_RECORD_SIZE], CAN_FRAME *, uint64_t *);
+
+uint8_t capWrite(CAP_WRITER *, const CAN_FRAME *, uint32_t);
+
+void capRXHook(const CAN_FRAME *, void *);
+
+uint8_t capService(CAP_WRITER *);
+
+void capFlush(CAP_WRITER *);
+
+#endif
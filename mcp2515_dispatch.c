@@ -0,0 +1,362 @@
+/**
+ * @file mcp2515_dispatch.c
+ * @brief Dispatch of received frames to subscribed handlers by CAN ID in constant time.
+*/
+
+#include "mcp2515_dispatch.h"
+
+#define DISPATCH_KEY_USED 0X80000000UL
+#define DISPATCH_KEY_DELETED 0XFFFFFFFFUL
+
+typedef struct DISPATCH_SUB
+{
+	CAN_RX_HOOK hook;
+	void *ctx;
+	uint32_t id;
+	uint32_t mask;
+	uint8_t ext;
+	uint8_t bits;		/* number of mask bits set, the specificity */
+}DISPATCH_SUB;
+
+/* handle 0 means no subscription */
+static DISPATCH_SUB _subs[DISPATCH_MAX_SUBS + 1];
+
+static uint8_t _std[2048];
+
+static uint32_t _ext_key[DISPATCH_EXT_SLOTS];
+static uint8_t _ext_sub[DISPATCH_EXT_SLOTS];
+static uint32_t _ext_used;
+
+static CAN_RX_HOOK _default_hook;
+static void *_default_ctx;
+
+
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to count the bits set in a word.
+*/
+static uint8_t dispatchBits(uint32_t _w)
+{
+	uint8_t _n = 0;
+	while( _w )
+	{
+		_w &= _w - 1;
+		_n++;
+	}
+	return _n;
+}
+
+/**
+ * @brief Utility function to check whether subscription _a should route an ID currently routed to _b.
+*/
+static uint8_t dispatchBetter(uint8_t _a, uint8_t _b)
+{
+	return _b == 0 || _subs[_a].bits > _subs[_b].bits;
+}
+
+/**
+ * @brief Utility function to get the first probe position of an extended ID key.
+*/
+static uint32_t dispatchHash(uint32_t _key)
+{
+	return ( _key * 2654435761UL ) & ( DISPATCH_EXT_SLOTS - 1 );
+}
+
+/**
+ * @brief Utility function to find the hash table entry of an extended ID.
+ *
+ * @return
+ * THE POSITION OF THE ENTRY, DISPATCH_EXT_SLOTS IF THE ID HAS NO ENTRY.
+*/
+static uint32_t dispatchFind(uint32_t _id)
+{
+	uint32_t _key = _id | DISPATCH_KEY_USED;
+	uint32_t _pos = dispatchHash( _key );
+
+	for(uint32_t i=0; i<DISPATCH_EXT_SLOTS; i++)
+	{
+		if( _ext_key[_pos] == _key )
+			return _pos;
+		if( _ext_key[_pos] == 0 )
+			break;
+		_pos = ( _pos + 1 ) & ( DISPATCH_EXT_SLOTS - 1 );
+	}
+
+	return DISPATCH_EXT_SLOTS;
+}
+
+/**
+ * @brief Utility function to route an extended ID to a subscription unless a more specific one already has it.
+*/
+static void dispatchRouteExt(uint32_t _id, uint8_t _h)
+{
+	uint32_t _pos = dispatchFind( _id );
+
+	if( _pos != DISPATCH_EXT_SLOTS )
+	{
+		if( dispatchBetter( _h, _ext_sub[_pos] ) )
+			_ext_sub[_pos] = _h;
+		return;
+	}
+
+	// first free or deleted entry of the probe sequence
+	_pos = dispatchHash( _id | DISPATCH_KEY_USED );
+	while( _ext_key[_pos] != 0 && _ext_key[_pos] != DISPATCH_KEY_DELETED )
+		_pos = ( _pos + 1 ) & ( DISPATCH_EXT_SLOTS - 1 );
+
+	if( _ext_key[_pos] == 0 )
+		_ext_used++;
+	_ext_key[_pos] = _id | DISPATCH_KEY_USED;
+	_ext_sub[_pos] = _h;
+}
+
+/**
+ * @brief Utility function to find the most specific remaining subscription of an ID.
+*/
+static uint8_t dispatchBest(uint32_t _id, uint8_t _ext)
+{
+	uint8_t _best = 0;
+
+	for(uint8_t h=1; h<=DISPATCH_MAX_SUBS; h++)
+	{
+		if( !_subs[h].hook || _subs[h].ext != _ext )
+			continue;
+		if( ( _id ^ _subs[h].id ) & _subs[h].mask )
+			continue;
+		if( dispatchBetter( h, _best ) )
+			_best = h;
+	}
+
+	return _best;
+}
+
+/**
+ * @brief Utility function to take a free subscription handle.
+*/
+static uint8_t dispatchAlloc(uint32_t _id, uint32_t _mask, uint8_t _ext, CAN_RX_HOOK _hook, void *_ctx)
+{
+	if( !_hook )
+		return 0;
+
+	for(uint8_t h=1; h<=DISPATCH_MAX_SUBS; h++)
+	{
+		if( _subs[h].hook )
+			continue;
+		_subs[h].hook = _hook;
+		_subs[h].ctx = _ctx;
+		_subs[h].id = _id & _mask;
+		_subs[h].mask = _mask;
+		_subs[h].ext = _ext;
+		_subs[h].bits = dispatchBits( _mask );
+		return h;
+	}
+
+	return 0;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function removes every subscription and the default handler.
+ *
+ * @param
+ * NOTHING
+ *
+ * @return
+ * NOTHING
+ */
+void canDispatchBegin(void)
+{
+	for(uint8_t h=0; h<=DISPATCH_MAX_SUBS; h++)
+		_subs[h].hook = 0;
+	for(uint16_t i=0; i<2048; i++)
+		_std[i] = 0;
+	for(uint32_t i=0; i<DISPATCH_EXT_SLOTS; i++)
+		_ext_key[i] = 0;
+	_ext_used = 0;
+	_default_hook = 0;
+	_default_ctx = 0;
+}
+
+/**
+ * @brief This function subscribes a handler to the standard IDs matching an ID and mask. Every matching ID is
+ * resolved into the direct table here, so the cost of dispatching does not depend on the mask.
+ *
+ * @param
+ * 1. _id : the 11 bit identifier.
+ * 2. _mask : bits of the identifier that must match, 0X7FF for an exact ID, 0 for every standard ID.
+ * 3. _hook : the handler.
+ * 4. _ctx : passed as it is to the handler.
+ *
+ * @return
+ * THE SUBSCRIPTION HANDLE, 0 IF ALL DISPATCH_MAX_SUBS HANDLES ARE IN USE.
+ */
+uint8_t canSubscribe_wSID(uint16_t _id, uint16_t _mask, CAN_RX_HOOK _hook, void *_ctx)
+{
+	_mask &= 0X7FF;
+
+	uint8_t _h = dispatchAlloc( _id, _mask, 0, _hook, _ctx );
+	if( !_h )
+		return 0;
+
+	// every value of the free bits
+	uint16_t _free = ~_mask & 0X7FF;
+	uint16_t _sub = 0;
+	do
+	{
+		uint16_t _v = ( _id & _mask ) | _sub;
+		if( dispatchBetter( _h, _std[_v] ) )
+			_std[_v] = _h;
+		_sub = ( _sub - _free ) & _free;
+	}
+	while( _sub );
+
+	return _h;
+}
+
+/**
+ * @brief This function subscribes a handler to the extended IDs matching an ID and mask. Every matching ID
+ * takes an entry of the hash table, so the mask may leave at most log2(DISPATCH_MAX_EXPANSION) bits free.
+ *
+ * @param
+ * 1. _id : the 29 bit identifier.
+ * 2. _mask : bits of the identifier that must match, 0X1FFFFFFF for an exact ID.
+ * 3. _hook : the handler.
+ * 4. _ctx : passed as it is to the handler.
+ *
+ * @return
+ * THE SUBSCRIPTION HANDLE, 0 IF THE MASK IS TOO WIDE, THE HASH TABLE TOO FULL OR ALL HANDLES ARE IN USE.
+ */
+uint8_t canSubscribe_wEID(uint32_t _id, uint32_t _mask, CAN_RX_HOOK _hook, void *_ctx)
+{
+	_mask &= 0X1FFFFFFF;
+
+	uint32_t _free = ~_mask & 0X1FFFFFFF;
+	uint8_t _free_bits = dispatchBits( _free );
+	if( _free_bits > 31 || ( 1UL << _free_bits ) > DISPATCH_MAX_EXPANSION )
+		return 0;
+
+	// keep at least one empty entry so that probes terminate
+	if( _ext_used + ( 1UL << _free_bits ) >= DISPATCH_EXT_SLOTS )
+		return 0;
+
+	uint8_t _h = dispatchAlloc( _id, _mask, 1, _hook, _ctx );
+	if( !_h )
+		return 0;
+
+	uint32_t _sub = 0;
+	do
+	{
+		dispatchRouteExt( ( _id & _mask ) | _sub, _h );
+		_sub = ( _sub - _free ) & _free;
+	}
+	while( _sub );
+
+	return _h;
+}
+
+/**
+ * @brief This function removes a subscription. The IDs it routed go to the next most specific subscription.
+ *
+ * @param
+ * 1. _h : the subscription handle.
+ *
+ * @return
+ * NOTHING
+ */
+void canUnsubscribe(uint8_t _h)
+{
+	if( _h == 0 || _h > DISPATCH_MAX_SUBS || !_subs[_h].hook )
+		return;
+
+	_subs[_h].hook = 0;
+
+	if( !_subs[_h].ext )
+	{
+		for(uint16_t v=0; v<2048; v++)
+			if( _std[v] == _h )
+				_std[v] = dispatchBest( v, 0 );
+		return;
+	}
+
+	for(uint32_t i=0; i<DISPATCH_EXT_SLOTS; i++)
+	{
+		if( _ext_key[i] == 0 || _ext_key[i] == DISPATCH_KEY_DELETED || _ext_sub[i] != _h )
+			continue;
+
+		uint8_t _best = dispatchBest( _ext_key[i] & 0X1FFFFFFF, 1 );
+		if( _best )
+			_ext_sub[i] = _best;
+		else
+			_ext_key[i] = DISPATCH_KEY_DELETED;
+	}
+}
+
+/**
+ * @brief This function sets the handler of the frames no subscription matches.
+ *
+ * @param
+ * 1. _hook : the handler, NULL to drop such frames.
+ * 2. _ctx : passed as it is to the handler.
+ *
+ * @return
+ * NOTHING
+ */
+void canSetDefaultHandler(CAN_RX_HOOK _hook, void *_ctx)
+{
+	_default_hook = _hook;
+	_default_ctx = _ctx;
+}
+
+/**
+ * @brief This function routes a frame to its handler with one table lookup.
+ *
+ * @param
+ * 1. _frame : the received frame.
+ *
+ * @return
+ * 1 : IF A SUBSCRIPTION HANDLED THE FRAME
+ * 0 : IF IT WENT TO THE DEFAULT HANDLER OR WAS DROPPED
+ */
+uint8_t canDispatch(const CAN_FRAME *_frame)
+{
+	uint8_t _h = 0;
+
+	if( _frame->type == can_extended )
+	{
+		uint32_t _pos = dispatchFind( _frame->ID & 0X1FFFFFFF );
+		if( _pos != DISPATCH_EXT_SLOTS )
+			_h = _ext_sub[_pos];
+	}
+	else
+		_h = _std[ _frame->ID & 0X7FF ];
+
+	if( _h )
+	{
+		_subs[_h].hook( _frame, _subs[_h].ctx );
+		return 1;
+	}
+
+	if( _default_hook )
+		_default_hook( _frame, _default_ctx );
+	return 0;
+}
+
+/**
+ * @brief Receive hook for canServiceRX() that dispatches every received frame. The context is not used.
+ *
+ * @param
+ * 1. _frame : the received frame.
+ * 2. _ctx : unused.
+ *
+ * @return
+ * NOTHING
+ */
+void canDispatchRXHook(const CAN_FRAME *_frame, void *_ctx)
+{
+	(void)_ctx;
+	canDispatch( _frame );
+}
@@ -0,0 +1,51 @@
+/**
+ * @file mcp2515_dispatch.h
+ * @brief Dispatch of received frames to subscribed handlers by CAN ID in constant time.
+ *
+ * Wildcard masks are resolved when subscribing : a subscription is expanded into every ID it matches, so a frame
+ * is routed with a single table lookup whatever the number of subscriptions. Standard IDs use a direct indexed
+ * table of 2048 entries, extended IDs an open addressing hash table. When subscriptions overlap, an ID is routed
+ * to the most specific one (most mask bits set); on a tie the earlier subscription keeps it.
+*/
+#ifndef MCP2515_DISPATCH
+#define MCP2515_DISPATCH
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Maximum number of subscriptions, at most 255.
+*/
+#ifndef DISPATCH_MAX_SUBS
+#define DISPATCH_MAX_SUBS 32
+#endif
+
+/**
+ * @brief Number of entries of the extended ID hash table, a power of two. Every extended ID matched by a
+ * subscription takes one entry.
+*/
+#ifndef DISPATCH_EXT_SLOTS
+#define DISPATCH_EXT_SLOTS 256
+#endif
+
+/**
+ * @brief Largest number of extended IDs a single wildcard subscription may expand into.
+*/
+#ifndef DISPATCH_MAX_EXPANSION
+#define DISPATCH_MAX_EXPANSION 64
+#endif
+
+void canDispatchBegin(void);
+
+uint8_t canSubscribe_wSID(uint16_t, uint16_t, CAN_RX_HOOK, void *);
+
+uint8_t canSubscribe_wEID(uint32_t, uint32_t, CAN_RX_HOOK, void *);
+
+void canUnsubscribe(uint8_t);
+
+void canSetDefaultHandler(CAN_RX_HOOK, void *);
+
+uint8_t canDispatch(const CAN_FRAME *);
+
+void canDispatchRXHook(const CAN_FRAME *, void *);
+
+#endif
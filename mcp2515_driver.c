@@ -6,7 +6,13 @@
 
 #include "mcp2515_driver.h"
 
-static CAN_FRAME _frame={ can_standard, 0, 0, 0, {0,0,0,0,0,0,0,0} };
+/* nesting of canEnterISR() in the calling context, the transactions made from the interrupt handler of the chip do
+ not lock; other threads keep locking meanwhile */
+MCP_THREAD_LOCAL volatile uint8_t mcp_isr_depth;
+
+/* reader of the receive buffers used by canServiceRX(), canReadFrameRX() when none */
+static CAN_RX_READER _rx_reader;
+static void *_rx_reader_ctx;
 
 
 
@@ -69,23 +75,6 @@ static uint8_t TXBnSIDH(uint8_t _buff)
 	return 0;
 }
 
-/**
- * @brief Utility function to get the address of RXBnSIDH register.
-*/
-static uint8_t RXBnSIDH(uint8_t _buff)
-{
-	switch(_buff)
-	{
-		case 0:
-			return RXB0SIDH;
-
-		case 1:
-			return RXB1SIDH;
-	}
-
-	return 0;
-}
-
 /**
  * @brief Utility function to get the address of TXBnDLC register.
 */
@@ -106,23 +95,6 @@ static uint8_t TXBnDLC(uint8_t _buff)
 	return 0;
 }
 
-/**
- * @brief Utility function to get the address of RXBnDLC register.
-*/
-static uint8_t RXBnDLC(uint8_t _buff)
-{
-	switch(_buff)
-	{
-		case 0:
-			return RXB0DLC;
-
-		case 1:
-			return RXB1DLC;
-	}
-
-	return 0;
-}
-
 /**
  * @brief Utility function to get the address of RXMnSIDH register.
 */
@@ -167,6 +139,18 @@ static uint8_t RXFnSIDH(uint8_t _buff)
 	}
 	return 0;
 }
+
+/**
+ * @brief Utility function to clock a buffer out to the chip in one chip select window. The frame is built in the
+ * buffer first, so with an inline PAL the loop compiles to straight-line SPI accesses.
+*/
+static void canSpiWrite(const uint8_t *_buf, uint8_t _n)
+{
+	pal_select_slave();
+	for(uint8_t i=0; i<_n; i++)
+		pal_spi_send( _buf[i] );
+	pal_deselect_slave();
+}
 /*************************************************************************************************************************/
 
 
@@ -244,161 +228,334 @@ void canSetBitTiming(unsigned char _cnf1, unsigned char _cnf2, unsigned char _cn
 }
 
 /**
- * @brief This function makes appropriate on chip initializations for the passed CAN data rate.
+ * @brief This function gets the CNF1, CNF2 and CNF3 values of a data rate for the clock of the chip (MCP_CHIP_FREQ),
+ * without writing them.
  *
  * @param
- * 1. data_rate : contains the CAN bus data rate in kbps.
+ * 1. data_rate : the CAN bus data rate in kbps.
+ * 2. _cnf : receives CNF1, CNF2 and CNF3, in that order.
  *
  * @return
- * 		NOTHING.
+ * 1. SUCCESS
+ * 2. FAILED : the data rate is not supported at MCP_CHIP_FREQ, _cnf receives the values of 125 kbps
  */
-void canBegin(void* data, uint16_t data_rate)
+uint8_t canGetBitTiming(uint16_t data_rate, unsigned char *_cnf)
 {
-
-#ifdef AUTO_SPI_INITIALIZATION
-	// initialize the SPI port for interacting with can.
-	pal_spi_init( data, MSB_FIRST, IDLE_LOW, LEADING_EDGE);
+#if		MCP_CHIP_FREQ==20000000
+	// the 20 MHz tables start at 40 kbps
+	if( data_rate < 40 )
+		data_rate = 0;
 #endif
 
-	pal_delay_us(5);
-
-	canRequestMode(mcp_configuration_mode);
-	//setting the bit time for CAN bus
 	switch(data_rate)
 	{
 		case 5:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_5kBPS_CNF1, MCP_8MHz_5kBPS_CNF2, MCP_8MHz_5kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_5kBPS_CNF1; _cnf[1] = MCP_8MHz_5kBPS_CNF2; _cnf[2] = MCP_8MHz_5kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_5kBPS_CNF1, MCP_16MHz_5kBPS_CNF2, MCP_16MHz_5kBPS_CNF3);
-#elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_40kBPS_CNF1, MCP_20MHz_40kBPS_CNF2, MCP_20MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_5kBPS_CNF1; _cnf[1] = MCP_16MHz_5kBPS_CNF2; _cnf[2] = MCP_16MHz_5kBPS_CNF3;
 #endif
 		break;
 
 
 		case 10:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_10kBPS_CNF1, MCP_8MHz_10kBPS_CNF2, MCP_8MHz_10kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_10kBPS_CNF1; _cnf[1] = MCP_8MHz_10kBPS_CNF2; _cnf[2] = MCP_8MHz_10kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_10kBPS_CNF1, MCP_16MHz_10kBPS_CNF2, MCP_16MHz_10kBPS_CNF3);
-#elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_40kBPS_CNF1, MCP_20MHz_40kBPS_CNF2, MCP_20MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_10kBPS_CNF1; _cnf[1] = MCP_16MHz_10kBPS_CNF2; _cnf[2] = MCP_16MHz_10kBPS_CNF3;
 #endif
 		break;
 
 		case 20:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_20kBPS_CNF1, MCP_8MHz_20kBPS_CNF2, MCP_8MHz_20kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_20kBPS_CNF1; _cnf[1] = MCP_8MHz_20kBPS_CNF2; _cnf[2] = MCP_8MHz_20kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_20kBPS_CNF1, MCP_16MHz_20kBPS_CNF2, MCP_16MHz_20kBPS_CNF3);
-#elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_40kBPS_CNF1, MCP_20MHz_40kBPS_CNF2, MCP_20MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_20kBPS_CNF1; _cnf[1] = MCP_16MHz_20kBPS_CNF2; _cnf[2] = MCP_16MHz_20kBPS_CNF3;
 #endif
 		break;
 
 		case 40:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_40kBPS_CNF1, MCP_8MHz_40kBPS_CNF2, MCP_8MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_40kBPS_CNF1; _cnf[1] = MCP_8MHz_40kBPS_CNF2; _cnf[2] = MCP_8MHz_40kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_40kBPS_CNF1, MCP_16MHz_40kBPS_CNF2, MCP_16MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_40kBPS_CNF1; _cnf[1] = MCP_16MHz_40kBPS_CNF2; _cnf[2] = MCP_16MHz_40kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_40kBPS_CNF1, MCP_20MHz_40kBPS_CNF2, MCP_20MHz_40kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_40kBPS_CNF1; _cnf[1] = MCP_20MHz_40kBPS_CNF2; _cnf[2] = MCP_20MHz_40kBPS_CNF3;
 #endif
 		break;
 
 		case 50:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_50kBPS_CNF1, MCP_8MHz_50kBPS_CNF2, MCP_8MHz_50kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_50kBPS_CNF1; _cnf[1] = MCP_8MHz_50kBPS_CNF2; _cnf[2] = MCP_8MHz_50kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_50kBPS_CNF1, MCP_16MHz_50kBPS_CNF2, MCP_16MHz_50kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_50kBPS_CNF1; _cnf[1] = MCP_16MHz_50kBPS_CNF2; _cnf[2] = MCP_16MHz_50kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_50kBPS_CNF1, MCP_20MHz_50kBPS_CNF2, MCP_20MHz_50kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_50kBPS_CNF1; _cnf[1] = MCP_20MHz_50kBPS_CNF2; _cnf[2] = MCP_20MHz_50kBPS_CNF3;
 #endif
 		break;
 
 		case 80:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_80kBPS_CNF1, MCP_8MHz_80kBPS_CNF2, MCP_8MHz_80kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_80kBPS_CNF1; _cnf[1] = MCP_8MHz_80kBPS_CNF2; _cnf[2] = MCP_8MHz_80kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_80kBPS_CNF1, MCP_16MHz_80kBPS_CNF2, MCP_16MHz_80kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_80kBPS_CNF1; _cnf[1] = MCP_16MHz_80kBPS_CNF2; _cnf[2] = MCP_16MHz_80kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_80kBPS_CNF1, MCP_20MHz_80kBPS_CNF2, MCP_20MHz_80kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_80kBPS_CNF1; _cnf[1] = MCP_20MHz_80kBPS_CNF2; _cnf[2] = MCP_20MHz_80kBPS_CNF3;
 #endif
 		break;
 
 		case 100:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_100kBPS_CNF1, MCP_8MHz_100kBPS_CNF2, MCP_8MHz_100kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_100kBPS_CNF1; _cnf[1] = MCP_8MHz_100kBPS_CNF2; _cnf[2] = MCP_8MHz_100kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_100kBPS_CNF1, MCP_16MHz_100kBPS_CNF2, MCP_16MHz_100kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_100kBPS_CNF1; _cnf[1] = MCP_16MHz_100kBPS_CNF2; _cnf[2] = MCP_16MHz_100kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_100kBPS_CNF1, MCP_20MHz_100kBPS_CNF2, MCP_20MHz_100kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_100kBPS_CNF1; _cnf[1] = MCP_20MHz_100kBPS_CNF2; _cnf[2] = MCP_20MHz_100kBPS_CNF3;
 #endif
 		break;
 
 		case 125:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_125kBPS_CNF1, MCP_8MHz_125kBPS_CNF2, MCP_8MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_125kBPS_CNF1; _cnf[1] = MCP_8MHz_125kBPS_CNF2; _cnf[2] = MCP_8MHz_125kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_125kBPS_CNF1, MCP_16MHz_125kBPS_CNF2, MCP_16MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_125kBPS_CNF1; _cnf[1] = MCP_16MHz_125kBPS_CNF2; _cnf[2] = MCP_16MHz_125kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_125kBPS_CNF1, MCP_20MHz_125kBPS_CNF2, MCP_20MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_125kBPS_CNF1; _cnf[1] = MCP_20MHz_125kBPS_CNF2; _cnf[2] = MCP_20MHz_125kBPS_CNF3;
 #endif
 		break;
 
 		case 200:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_200kBPS_CNF1, MCP_8MHz_200kBPS_CNF2, MCP_8MHz_200kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_200kBPS_CNF1; _cnf[1] = MCP_8MHz_200kBPS_CNF2; _cnf[2] = MCP_8MHz_200kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_200kBPS_CNF1, MCP_16MHz_200kBPS_CNF2, MCP_16MHz_200kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_200kBPS_CNF1; _cnf[1] = MCP_16MHz_200kBPS_CNF2; _cnf[2] = MCP_16MHz_200kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_200kBPS_CNF1, MCP_20MHz_200kBPS_CNF2, MCP_20MHz_200kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_200kBPS_CNF1; _cnf[1] = MCP_20MHz_200kBPS_CNF2; _cnf[2] = MCP_20MHz_200kBPS_CNF3;
 #endif
 		break;
 
 		case 250:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_250kBPS_CNF1, MCP_8MHz_250kBPS_CNF2, MCP_8MHz_250kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_250kBPS_CNF1; _cnf[1] = MCP_8MHz_250kBPS_CNF2; _cnf[2] = MCP_8MHz_250kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_250kBPS_CNF1, MCP_16MHz_250kBPS_CNF2, MCP_16MHz_250kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_250kBPS_CNF1; _cnf[1] = MCP_16MHz_250kBPS_CNF2; _cnf[2] = MCP_16MHz_250kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_250kBPS_CNF1, MCP_20MHz_250kBPS_CNF2, MCP_20MHz_250kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_250kBPS_CNF1; _cnf[1] = MCP_20MHz_250kBPS_CNF2; _cnf[2] = MCP_20MHz_250kBPS_CNF3;
 #endif
 		break;
 
 		case 500:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_500kBPS_CNF1, MCP_8MHz_500kBPS_CNF2, MCP_8MHz_500kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_500kBPS_CNF1; _cnf[1] = MCP_8MHz_500kBPS_CNF2; _cnf[2] = MCP_8MHz_500kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_500kBPS_CNF1, MCP_16MHz_500kBPS_CNF2, MCP_16MHz_500kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_500kBPS_CNF1; _cnf[1] = MCP_16MHz_500kBPS_CNF2; _cnf[2] = MCP_16MHz_500kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_500kBPS_CNF1, MCP_20MHz_500kBPS_CNF2, MCP_20MHz_500kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_500kBPS_CNF1; _cnf[1] = MCP_20MHz_500kBPS_CNF2; _cnf[2] = MCP_20MHz_500kBPS_CNF3;
 #endif
 		break;
 
 		case 1000:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_1000kBPS_CNF1, MCP_8MHz_1000kBPS_CNF2, MCP_8MHz_1000kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_1000kBPS_CNF1; _cnf[1] = MCP_8MHz_1000kBPS_CNF2; _cnf[2] = MCP_8MHz_1000kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_1000kBPS_CNF1, MCP_16MHz_1000kBPS_CNF2, MCP_16MHz_1000kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_1000kBPS_CNF1; _cnf[1] = MCP_16MHz_1000kBPS_CNF2; _cnf[2] = MCP_16MHz_1000kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_1000kBPS_CNF1, MCP_20MHz_1000kBPS_CNF2, MCP_20MHz_1000kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_1000kBPS_CNF1; _cnf[1] = MCP_20MHz_1000kBPS_CNF2; _cnf[2] = MCP_20MHz_1000kBPS_CNF3;
 #endif
 		break;
 
 		default:
 #if		MCP_CHIP_FREQ==8000000
-			canSetBitTiming(MCP_8MHz_125kBPS_CNF1, MCP_8MHz_125kBPS_CNF2, MCP_8MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_8MHz_125kBPS_CNF1; _cnf[1] = MCP_8MHz_125kBPS_CNF2; _cnf[2] = MCP_8MHz_125kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==16000000
-			canSetBitTiming(MCP_16MHz_125kBPS_CNF1, MCP_16MHz_125kBPS_CNF2, MCP_16MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_16MHz_125kBPS_CNF1; _cnf[1] = MCP_16MHz_125kBPS_CNF2; _cnf[2] = MCP_16MHz_125kBPS_CNF3;
 #elif	MCP_CHIP_FREQ==20000000
-			canSetBitTiming(MCP_20MHz_125kBPS_CNF1, MCP_20MHz_125kBPS_CNF2, MCP_20MHz_125kBPS_CNF3);
+			_cnf[0] = MCP_20MHz_125kBPS_CNF1; _cnf[1] = MCP_20MHz_125kBPS_CNF2; _cnf[2] = MCP_20MHz_125kBPS_CNF3;
 #endif
-		break;
+		return 0;
 	}
 
+	return 1;
+}
+
+/**
+ * @brief This function makes appropriate on chip initializations for the passed CAN data rate.
+ *
+ * @param
+ * 1. data_rate : contains the CAN bus data rate in kbps.
+ *
+ * @return
+ * 		NOTHING.
+ */
+void canBegin(void* data, uint16_t data_rate)
+{
+
+#ifdef AUTO_SPI_INITIALIZATION
+	// initialize the SPI port for interacting with can.
+	pal_spi_init( data, MSB_FIRST, IDLE_LOW, LEADING_EDGE);
+#endif
+
+	pal_delay_us(5);
+
+	canStateLock();
+	canRequestMode(mcp_configuration_mode);
+	//setting the bit time for CAN bus
+	unsigned char _cnf[3];
+	canGetBitTiming(data_rate, _cnf);
+	canSetBitTiming(_cnf[0], _cnf[1], _cnf[2]);
+
 	canRequestMode(mcp_normal_mode);
+	canStateUnlock();
+}
+
+/**
+ * @brief This function initializes the chip from a complete configuration with as few transactions as possible :
+ * RESET, one wait for the oscillator, three sequential WRITE bursts for the filters, BFPCTRL, TXRTSCTRL, masks, CNF
+ * registers and CANINTE, one WRITE for each RXBnCTRL, one READ burst that verifies everything, then one write of
+ * CANCTRL that enters the requested mode. The chip is left in configuration mode when the verification fails, and
+ * the wait for the requested mode is bounded by MCP_MODE_TIMEOUT_US.
+ *
+ * @param
+ * 1. _cfg : the configuration.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : a register did not read back as written, e.g. no chip answering on the SPI port, or the chip did
+ * not enter the requested mode within MCP_MODE_TIMEOUT_US. Also when the data rate is not supported at
+ * MCP_CHIP_FREQ, before the chip is touched.
+ */
+uint8_t canInit(const MCP_CONFIG *_cfg)
+{
+	uint8_t _img[0X2C];
+	unsigned char _cnf[3];
+
+	if( _cfg->data_rate )
+	{
+		if( !canGetBitTiming( _cfg->data_rate, _cnf ) )
+			return 0;
+	}
+	else
+	{
+		_cnf[0] = _cfg->cnf[0];
+		_cnf[1] = _cfg->cnf[1];
+		_cnf[2] = _cfg->cnf[2];
+	}
+
+#ifdef AUTO_SPI_INITIALIZATION
+	pal_spi_init( _cfg->spi_data, MSB_FIRST, IDLE_LOW, LEADING_EDGE);
+#endif
+
+	canStateLock();
+
+	// after RESET the chip is in configuration mode once the oscillator start-up timer has expired
+	canChipReset();
+	pal_delay_us(MCP_RESET_DELAY_US);
+
+	// image of 0X00 - 0X2B : RXF0 to RXF2, BFPCTRL, TXRTSCTRL, -, RXF3 to RXF5, -, RXM0, RXM1, CNF3 to CNF1, CANINTE
+	for(uint8_t i=0; i<6; i++)
+	{
+		uint8_t *_f = &_img[ ( i < 3 ? 0X00 : 0X10 ) + 4 * ( i % 3 ) ];
+		uint32_t _id = _cfg->filter[i];
+		_f[0] = _id >> 21;
+		_f[1] = ( _id >> 13 & 0XE0 ) | ( _id >> 16 & 3 ) | ( ( _cfg->filter_ext & (1<<i) ) ? (1<<EXIDE) : 0 );
+		_f[2] = _id >> 8;
+		_f[3] = _id;
+	}
+	for(uint8_t i=0; i<2; i++)
+	{
+		uint8_t *_m = &_img[ RXM0SIDH + 4 * i ];
+		_m[0] = _cfg->mask[i] >> 21;
+		_m[1] = ( _cfg->mask[i] >> 13 & 0XE0 ) | ( _cfg->mask[i] >> 16 & 3 );
+		_m[2] = _cfg->mask[i] >> 8;
+		_m[3] = _cfg->mask[i];
+	}
+	_img[BFPCTRL] = _cfg->bfpctrl;
+	_img[TXRTSCTRL] = _cfg->txrtsctrl;
+	_img[CNF3] = _cnf[2];
+	_img[CNF2] = _cnf[1];
+	_img[CNF1] = _cnf[0];
+	_img[CANINTE] = _cfg->caninte;
+
+	static const uint8_t _bursts[3][2] = { { 0X00, 0X0E }, { 0X10, 0X1C }, { 0X20, 0X2C } };
+	for(uint8_t b=0; b<3; b++)
+	{
+		pal_select_slave();
+		pal_spi_send( MCP_WRITE );
+		pal_spi_send( _bursts[b][0] );
+		for(uint8_t a=_bursts[b][0]; a<_bursts[b][1]; a++)
+			pal_spi_send( _img[a] );
+		pal_deselect_slave();
+	}
+
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( RXB0CTRL );
+	pal_spi_send( _cfg->rxb0ctrl );
+	pal_deselect_slave();
+
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( RXB1CTRL );
+	pal_spi_send( _cfg->rxb1ctrl );
+	pal_deselect_slave();
+
+	// one READ from 0X00 to RXB1CTRL, only the implemented writable bits are compared
+	uint8_t _ok = 1;
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( 0X00 );
+	for(uint8_t a=0X00; a<=RXB1CTRL; a++)
+	{
+		uint8_t _val = pal_spi_read();
+		uint8_t _mask;
+
+		if( a < 0X2C )
+		{
+			// CANSTAT, CANCTRL and the error counters are not part of the configuration
+			if( a == 0X0E || a == 0X0F || ( a >= 0X1C && a <= 0X1F ) )
+				continue;
+			_mask = 0XFF;
+			if( a < 0X28 && ( a & 0X0F ) < 0X0C && ( a & 0X03 ) == 1 )
+				_mask = 0XEB;	/* SIDL of a filter or mask, CNF2 at 0X29 is compared in full */
+			else if( a == BFPCTRL )
+				_mask = 0X3F;
+			else if( a == TXRTSCTRL )
+				_mask = 0X07;
+			else if( a == CNF3 )
+				_mask = 0XC7;
+			_ok &= ( ( _val ^ _img[a] ) & _mask ) == 0;
+		}
+		else if( a == RXB0CTRL )
+			_ok &= ( ( _val ^ _cfg->rxb0ctrl ) & 0X64 ) == 0;
+		else if( a == RXB1CTRL )
+			_ok &= ( ( _val ^ _cfg->rxb1ctrl ) & 0X60 ) == 0;
+	}
+	pal_deselect_slave();
+
+	if( !_ok )
+	{
+		canStateUnlock();
+		return 0;
+	}
+
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( CANCTRL );
+	pal_spi_send( ( _cfg->mode << 5 ) | ( _cfg->canctrl & 0X0F ) );
+	pal_deselect_slave();
+
+	uint32_t _start = pal_get_time_us();
+	while( canGetMode() != _cfg->mode )
+	{
+		if( pal_get_time_us() - _start >= MCP_MODE_TIMEOUT_US )
+		{
+			canStateUnlock();
+			return 0;
+		}
+	}
+
+	canStateUnlock();
+	return 1;
 }
 
 /**
@@ -483,6 +640,86 @@ uint8_t canIsFreeTX(uint8_t _buff)
 		return 1;
 }
 
+/**
+ * @brief This function reads the quick status of the chip with the READ STATUS instruction : the receive flags,
+ * the TXREQ bits and the transmit flags of all buffers in one byte.
+ *
+ * @param
+ * NOTHING
+ *
+ * @return
+ * THE STATUS BYTE, SEE THE MCP_STAT_* BIT POSITIONS.
+ */
+uint8_t canReadStatus(void)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_READ_STATUS );
+	uint8_t _status = pal_spi_read();
+	pal_deselect_slave();
+	return _status;
+}
+
+/**
+ * @brief This function reads one register of the chip.
+ *
+ * @param
+ * 1. _addr : the register address.
+ *
+ * @return
+ * THE REGISTER VALUE.
+ */
+uint8_t canReadRegister(uint8_t _addr)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( _addr );
+	uint8_t _val = pal_spi_read();
+	pal_deselect_slave();
+	return _val;
+}
+
+/**
+ * @brief This function writes one register of the chip.
+ *
+ * @param
+ * 1. _addr : the register address.
+ * 2. _val : the value written.
+ *
+ * @return
+ * NOTHING
+ */
+void canWriteRegister(uint8_t _addr, uint8_t _val)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( _addr );
+	pal_spi_send( _val );
+	pal_deselect_slave();
+}
+
+/**
+ * @brief This function changes the bits of a register selected by a mask with the BIT MODIFY instruction, the other
+ * bits keep their value. Only the registers the datasheet lists as bit modifiable accept it, the others take _val as
+ * a plain write.
+ *
+ * @param
+ * 1. _addr : the register address.
+ * 2. _mask : the bits to change.
+ * 3. _val : the new value of these bits.
+ *
+ * @return
+ * NOTHING
+ */
+void canBitModify(uint8_t _addr, uint8_t _mask, uint8_t _val)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( _addr );
+	pal_spi_send( _mask );
+	pal_spi_send( _val );
+	pal_deselect_slave();
+}
+
 /**
  * @brief This function sets the priority for a transmit buffer.
  *
@@ -641,16 +878,15 @@ uint8_t canTransmit(uint8_t _buff, uint8_t _num_bytes, unsigned char _data[8])
 {
 	if( canIsFreeTX(_buff) )
 	{
-		pal_select_slave();
-		pal_spi_send(MCP_WRITE);
-		pal_spi_send(TXBnDLC(_buff));
-		pal_spi_send(_num_bytes);
-		// sending the data bytes;
-		for(uint8_t i=0; i< _num_bytes; i++)
-		{
-			pal_spi_send( _data[i] );
-		}
-		pal_deselect_slave();
+		uint8_t _buf[11];
+		uint8_t _n = _num_bytes > 8 ? 8 : _num_bytes;
+
+		_buf[0] = MCP_WRITE;
+		_buf[1] = TXBnDLC(_buff);
+		_buf[2] = _num_bytes;
+		for(uint8_t i=0; i<_n; i++)
+			_buf[3 + i] = _data[i];
+		canSpiWrite( _buf, 3 + _n );
 
 		canRequestTransmission_wRTS(_buff);
 
@@ -681,23 +917,19 @@ uint8_t canTransmit_wSID(uint8_t _buff, uint16_t _sid, uint8_t _num_bytes, unsig
 {
 	if( canIsFreeTX(_buff) )
 	{
-		pal_select_slave();
-
-		pal_spi_send( MCP_WRITE );
-		pal_spi_send( TXBnSIDH(_buff) );
-
-		pal_spi_send( (_sid>>3) );
-		pal_spi_send( (_sid<<5) );
-		pal_spi_send( 0X00 );
-		pal_spi_send( 0X00 );
-
-		pal_spi_send(_num_bytes);
-		// sending the data bytes;
-		for(uint8_t i=0; i< _num_bytes; i++)
-		{
-			pal_spi_send( _data[i] );
-		}
-		pal_deselect_slave();
+		uint8_t _buf[15];
+		uint8_t _n = _num_bytes > 8 ? 8 : _num_bytes;
+
+		_buf[0] = MCP_WRITE;
+		_buf[1] = TXBnSIDH(_buff);
+		_buf[2] = _sid >> 3;
+		_buf[3] = _sid << 5;
+		_buf[4] = 0X00;
+		_buf[5] = 0X00;
+		_buf[6] = _num_bytes;
+		for(uint8_t i=0; i<_n; i++)
+			_buf[7 + i] = _data[i];
+		canSpiWrite( _buf, 7 + _n );
 
 		canRequestTransmission_wRTS(_buff);
 
@@ -729,24 +961,20 @@ uint8_t canTransmit_wEID(uint8_t _buff, uint32_t _eid, uint8_t _num_bytes, unsig
 {
 	if( canIsFreeTX(_buff) )
 	{
-		pal_select_slave();
-
-		pal_spi_send( MCP_WRITE );
-		pal_spi_send( TXBnSIDH(_buff) );
-
-		pal_spi_send( (_eid >> 21) );
-		//enabling the extended ID format in transmit buffer 0
-		pal_spi_send(  (_eid >> 13 & 0XE0) | (_eid>>16 & 3) | (1<<EXIDE) );
-		pal_spi_send( (_eid >> 8) );
-		pal_spi_send( _eid );
-
-		pal_spi_send(_num_bytes);
-		// sending the data bytes;
-		for(uint8_t i=0; i< _num_bytes; i++)
-		{
-			pal_spi_send( _data[i] );
-		}
-		pal_deselect_slave();
+		uint8_t _buf[15];
+		uint8_t _n = _num_bytes > 8 ? 8 : _num_bytes;
+
+		_buf[0] = MCP_WRITE;
+		_buf[1] = TXBnSIDH(_buff);
+		_buf[2] = _eid >> 21;
+		//enabling the extended ID format in the transmit buffer
+		_buf[3] = ( _eid >> 13 & 0XE0 ) | ( _eid >> 16 & 3 ) | (1<<EXIDE);
+		_buf[4] = _eid >> 8;
+		_buf[5] = _eid;
+		_buf[6] = _num_bytes;
+		for(uint8_t i=0; i<_n; i++)
+			_buf[7 + i] = _data[i];
+		canSpiWrite( _buf, 7 + _n );
 
 		canRequestTransmission_wRTS(_buff);
 
@@ -888,6 +1116,66 @@ void canClearMessageError(void)
 	pal_deselect_slave();
 }
 
+/**
+ * @brief This function reads the control register of a transmit buffer : ABTF, MLOA, TXERR, TXREQ and TXP bits.
+ *
+ * @param
+ * 1. _buff : the transmit buffer number.
+ *
+ * @return
+ * THE TXBnCTRL REGISTER.
+ */
+uint8_t canGetControlTX(uint8_t _buff)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( TXBnCTRL(_buff) );
+	uint8_t _ctrl = pal_spi_read();
+	pal_deselect_slave();
+
+	return _ctrl;
+}
+
+/**
+ * @brief This function clears interrupt flags of CANINTF in a single BIT MODIFY transaction. Flags outside the
+ * mask are left untouched, so flags raised meanwhile are not lost.
+ *
+ * @param
+ * 1. _mask : the flags to clear, e.g. (1<<TX0IF) | (1<<TX2IF).
+ *
+ * @return
+ * NOTHING
+ */
+void canClearInterruptFlags(uint8_t _mask)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( CANINTF );
+	pal_spi_send( _mask );
+	pal_spi_send( 0X00 );
+	pal_deselect_slave();
+}
+
+/**
+ * @brief This function enables or disables one shot mode (OSM). In one shot mode a frame that loses arbitration or
+ * meets a bus error is not retransmitted by the chip : TXREQ clears with MLOA or TXERR set in TXBnCTRL.
+ *
+ * @param
+ * 1. _enable : 1 to enable one shot mode, 0 to disable it.
+ *
+ * @return
+ * NOTHING
+ */
+void canSetOneShotTX(uint8_t _enable)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( CANCTRL );
+	pal_spi_send( (1<<OSM) );
+	pal_spi_send( _enable ? (1<<OSM) : 0 );
+	pal_deselect_slave();
+}
+
 /**
  * @brief This function aborts the message of any of the three transmit buffers.
  * The abort is achieved by clearing the TXREQ bit. This method does not set the abort flag.
@@ -910,6 +1198,52 @@ void canAbortTX(uint8_t _buff)
 	pal_deselect_slave();
 }
 
+/**
+ * @brief This function aborts the messages of the three transmit buffers at once with the ABAT bit of CANCTRL.
+ * A frame already on the bus ends first : the function waits for every TXREQ to clear (at most
+ * MCP_ABORT_TIMEOUT_US), reads the ABTF flags and clears ABAT so that transmissions can be requested again.
+ *
+ * @param
+ * NONE
+ *
+ * @return
+ * THE BUFFERS WHOSE MESSAGE WAS ABORTED, BIT n FOR BUFFER n.
+ */
+uint8_t canAbortAll(void)
+{
+	uint8_t _aborted = 0;
+
+	canStateLock();
+
+	// ABTF stays set until the next request of the buffer : only the buffers pending now are reported
+	uint8_t _pending = canReadStatus();
+
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( CANCTRL );
+	pal_spi_send( (1<<ABAT) );
+	pal_spi_send( (1<<ABAT) );
+	pal_deselect_slave();
+
+	uint32_t _start = pal_get_time_us();
+	while( ( canReadStatus() & ( (1<<MCP_STAT_TX0REQ) | (1<<MCP_STAT_TX1REQ) | (1<<MCP_STAT_TX2REQ) ) )
+		&& pal_get_time_us() - _start < MCP_ABORT_TIMEOUT_US );
+
+	for(uint8_t b=0; b<3; b++)
+		if( ( _pending & ( 1 << ( MCP_STAT_TX0REQ + 2 * b ) ) ) && ( canGetControlTX(b) & (1<<ABTF) ) )
+			_aborted |= 1 << b;
+
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( CANCTRL );
+	pal_spi_send( (1<<ABAT) );
+	pal_spi_send( 0X00 );
+	pal_deselect_slave();
+
+	canStateUnlock();
+	return _aborted;
+}
+
 
 
 /*
@@ -955,6 +1289,26 @@ void canDisableFilterRX(uint8_t _buff)
 	pal_deselect_slave();
 }
 
+/**
+ * @brief This function enables or disables the rollover of receive buffer 0 into receive buffer 1. With rollover a
+ * frame accepted by buffer 0 while it is full goes to buffer 1 instead of being lost.
+ *
+ * @param
+ * 1. _enable : 1 to enable rollover, 0 to disable it.
+ *
+ * @return
+ * NOTHING
+ */
+void canSetRolloverRX(uint8_t _enable)
+{
+	pal_select_slave();
+	pal_spi_send( MCP_BIT_MODIFY );
+	pal_spi_send( RXB0CTRL );
+	pal_spi_send( (1<<BUKT) );
+	pal_spi_send( _enable ? (1<<BUKT) : 0 );
+	pal_deselect_slave();
+}
+
 /**
  * @brief This function makes available one the two receive buffer for available CAN data.
  * The  function clears the RXnIF flags for this purpose.
@@ -1044,6 +1398,7 @@ uint8_t canIsFilledRX(uint8_t _buff)
  */
 void canSetMaskRX(uint8_t _num, uint32_t _mask)
 {
+	canStateLock();
 	canRequestMode(mcp_configuration_mode);
 
 	pal_select_slave();
@@ -1058,6 +1413,7 @@ void canSetMaskRX(uint8_t _num, uint32_t _mask)
 	pal_deselect_slave();
 
 	canRequestMode(mcp_normal_mode);
+	canStateUnlock();
 }
 
 /**
@@ -1078,6 +1434,7 @@ void canSetMaskRX(uint8_t _num, uint32_t _mask)
  */
 void canSetFilterRX(uint8_t _num, CAN_FRAME_TYPE _frame, uint32_t _filter)
 {
+	canStateLock();
 	canRequestMode(mcp_configuration_mode);
 
 	pal_select_slave();
@@ -1089,6 +1446,8 @@ void canSetFilterRX(uint8_t _num, CAN_FRAME_TYPE _frame, uint32_t _filter)
 	{
 		pal_spi_send( (_filter >> 13 & 0XE0) | (_filter>>16 & 3) );
 		pal_deselect_slave();
+		canRequestMode(mcp_normal_mode);
+		canStateUnlock();
 		return;
 	}
 	/*!!!!!!########*/
@@ -1100,11 +1459,13 @@ void canSetFilterRX(uint8_t _num, CAN_FRAME_TYPE _frame, uint32_t _filter)
 	pal_deselect_slave();
 
 	canRequestMode(mcp_normal_mode);
+	canStateUnlock();
 
 }
 
 /**
- * @brief This function gets the complete CAN data frame from one of the two receive buffers.
+ * @brief This function gets the complete CAN data frame from one of the two receive buffers, in a single READ RX
+ * BUFFER transaction.
  *
  * @param
  * 1. _buff : the receive buffer number.
@@ -1115,78 +1476,268 @@ void canSetFilterRX(uint8_t _num, CAN_FRAME_TYPE _frame, uint32_t _filter)
  */
 CAN_FRAME canGetFrame_wID(uint8_t _buff)
 {
-	uint8_t _ctrl;
+	uint8_t _r[13];
+	// a frame of the caller, not a shared one : threads may read both buffers at once
+	CAN_FRAME _frame={ can_standard, 0, 0, 0, {0,0,0,0,0,0,0,0} };
+
+	// SIDH to D7 in one READ RX BUFFER window, a fixed number of bytes so the loop is straight-line
 	pal_select_slave();
-	pal_spi_send( MCP_READ );
-	pal_spi_send( RXBnCTRL(_buff) );
-	_ctrl=pal_spi_read();
+	pal_spi_send( _buff ? MCP_READ_RX1_ID : MCP_READ_RX0_ID );
+	for(uint8_t i=0; i<13; i++)
+		_r[i] = pal_spi_read();
 	pal_deselect_slave();
 
-	if( _ctrl & (1<<RXRTR) )
-		_frame.isRemote=1;
-	else
-		_frame.isRemote=0;
+	canDecodeRaw( _r, &_frame );
+	return _frame;
+}
+
+/**
+ * @brief This function reads the complete CAN frame from one of the two receive buffers in a single SPI transaction
+ * using the READ RX BUFFER instruction. Only DLC data bytes are clocked and the RXnIF flag is cleared by the chip
+ * when the transaction ends, so there is no need to call enableRX() afterwards.
+ *
+ * @param
+ * 1. _buff : the receive buffer number.
+ * 2. _out : the frame read from the buffer.
+ *
+ * @return
+ * NOTHING
+ */
+void canReadFrameRX(uint8_t _buff, CAN_FRAME *_out)
+{
+	uint8_t _sidh, _sidl, _eid8, _eid0, _dlc;
 
-	uint32_t _id=0;
-	uint32_t ch;
 	pal_select_slave();
-	switch(_buff)
+	pal_spi_send( _buff ? MCP_READ_RX1_ID : MCP_READ_RX0_ID );
+	_sidh = pal_spi_read();
+	_sidl = pal_spi_read();
+	_eid8 = pal_spi_read();
+	_eid0 = pal_spi_read();
+	_dlc = pal_spi_read();
+
+	_out->ID = ( (uint32_t)_sidh << 3 ) | ( _sidl >> 5 );
+	if( _sidl & (1<<IDE) )
 	{
-	case 0:
-	pal_spi_send( MCP_READ_RX0_ID );
-	break;
-
-	case 1:
-	pal_spi_send( MCP_READ_RX1_ID );
-	break;
+		_out->type = can_extended;
+		_out->ID = ( _out->ID << 18 ) | ( (uint32_t)( _sidl & 0X03 ) << 16 ) | ( (uint32_t)_eid8 << 8 ) | _eid0;
+		_out->isRemote = ( _dlc & (1<<RTR) ) ? 1 : 0;
+	}
+	else
+	{
+		_out->type = can_standard;
+		_out->isRemote = ( _sidl & (1<<SRR) ) ? 1 : 0;
 	}
 
-	// reading the SIDH register
-	ch=(uint32_t)pal_spi_read();
-	_id |= (ch<<3);
-	// reading the SIDL register
-	ch=(uint32_t)pal_spi_read();
-	_id |= ( ( ch>>5 ) & (0X07) );
+	_out->DLC = _dlc & 0X0F;
+	if( _out->DLC > 8 )
+		_out->DLC = 8;
 
-	// if the id is extended
-	if( ch & (1<<IDE) )
+	// a remote frame carries no data bytes
+	if( !_out->isRemote )
 	{
-		_frame.type = can_extended;
-		_id = _id << 18;
-		_id |= ( (ch & 0X03) << 16 );
-		//reading RXB0EID8
-		ch=(uint32_t)pal_spi_read();
-		_id |= (ch<<8);
-		//reading the RXB0ID0
-		ch=(uint32_t)pal_spi_read();
-		_id |= (ch);
+		for(uint8_t i=0; i<_out->DLC; i++)
+			_out->DATA[i] = pal_spi_read();
 	}
 	else
+		_out->DLC = 0;
+
+	pal_deselect_slave();
+}
+
+/**
+ * @brief This function services both receive buffers : one RX STATUS transaction finds the filled buffers and each
+ * of them is read with canReadFrameRX(), which also releases the buffer, or with the reader set by canSetReaderRX().
+ *
+ * @param
+ * 1. _hook : called for every frame read, may be NULL.
+ * 2. _ctx : passed as it is to the hook.
+ *
+ * @return
+ * THE NUMBER OF FRAMES READ (0, 1 OR 2).
+ */
+uint8_t canServiceRX(CAN_RX_HOOK _hook, void *_ctx)
+{
+	CAN_FRAME _f;
+	uint8_t _n = 0;
+
+	pal_select_slave();
+	pal_spi_send( MCP_RX_STATUS );
+	uint8_t _status = pal_spi_read();
+	pal_deselect_slave();
+
+	for(uint8_t _buff=0; _buff<2; _buff++)
 	{
-		_frame.type = can_standard;
-		// flushing the extended ID bytes in case the frame is standard
-		pal_spi_read();
-		pal_spi_read();
+		if( !( _status & ( 0X40 << _buff ) ) )
+			continue;
+
+		if( _rx_reader )
+			_rx_reader( _buff, &_f, _rx_reader_ctx );
+		else
+			canReadFrameRX( _buff, &_f );
+		if( _hook )
+			_hook( &_f, _ctx );
+		_n++;
 	}
 
-	_frame.ID=_id;
+	return _n;
+}
+
+/**
+ * @brief This function sets the reader canServiceRX() uses for the filled receive buffers, e.g. the one of
+ * xferAttachRX() that reads them as xfer_rx_drain windows of the SPI transaction scheduler. Set it before the
+ * threads start.
+ *
+ * @param
+ * 1. _reader : reads one buffer into a frame and releases it, NULL for canReadFrameRX().
+ * 2. _ctx : passed as it is to the reader.
+ *
+ * @return
+ * NOTHING
+ */
+void canSetReaderRX(CAN_RX_READER _reader, void *_ctx)
+{
+	_rx_reader = _reader;
+	_rx_reader_ctx = _ctx;
+}
+
+/**
+ * @brief This function reads one of the two receive buffers as raw register bytes (SIDH, SIDL, EID8, EID0, DLC,
+ * D0 to D7) in a single READ RX BUFFER transaction, which also releases the buffer. The bytes are made ready for
+ * canLoadRawTX() : the remote flag of standard frames is moved from SRR to the RTR bit of DLC and the reserved bits
+ * are cleared, nothing else is decoded.
+ *
+ * @param
+ * 1. _buff : the receive buffer number.
+ * 2. _raw : the 13 register bytes, data bytes past the DLC are not read.
+ *
+ * @return
+ * THE NUMBER OF DATA BYTES READ.
+ */
+uint8_t canReadRawRX(uint8_t _buff, uint8_t _raw[13])
+{
+	uint8_t _n = 0;
+
+	pal_select_slave();
+	pal_spi_send( _buff ? MCP_READ_RX1_ID : MCP_READ_RX0_ID );
+	for(uint8_t i=0; i<5; i++)
+		_raw[i] = pal_spi_read();
 
-	if(_frame.isRemote)
+	uint8_t _remote = ( _raw[1] & (1<<IDE) ) ? ( _raw[4] & (1<<RTR) ) : ( _raw[1] & (1<<SRR) );
+
+	if( !_remote )
 	{
-		_frame.DLC=0;
-		pal_deselect_slave();
-		return _frame;
+		_n = _raw[4] & 0X0F;
+		if( _n > 8 )
+			_n = 8;
+		for(uint8_t i=0; i<_n; i++)
+			_raw[5 + i] = pal_spi_read();
 	}
+	pal_deselect_slave();
 
-	// reading the data length code from CAN frame
-	_frame.DLC=pal_spi_read();
-	// reading the data bytes
-	for(uint8_t i=0; i<8; i++)
+	_raw[1] &= ~(1<<SRR);
+	_raw[4] = ( _raw[4] & 0X0F ) | ( _remote ? (1<<RTR) : 0 );
+
+	return _n;
+}
+
+/**
+ * @brief This function decodes raw register bytes (SIDH, SIDL, EID8, EID0, DLC, D0 to D7) into a frame : as read
+ * from a receive buffer, as left by canReadRawRX(), or as held in a transmit buffer. A standard frame is remote when
+ * SRR or the RTR bit of DLC is set, an extended frame when the RTR bit is set. The DLC is limited to 8; a remote
+ * frame gets a DLC of 0, and the data bytes past the DLC are cleared.
+ *
+ * @param
+ * 1. _raw : the register bytes.
+ * 2. _out : the decoded frame.
+ *
+ * @return
+ * NOTHING
+ */
+void canDecodeRaw(const uint8_t _raw[13], CAN_FRAME *_out)
+{
+	_out->ID = ( (uint32_t)_raw[0] << 3 ) | ( _raw[1] >> 5 );
+	if( _raw[1] & (1<<IDE) )
 	{
-		_frame.DATA[i]=pal_spi_read();
+		_out->type = can_extended;
+		_out->ID = ( _out->ID << 18 ) | ( (uint32_t)( _raw[1] & 0X03 ) << 16 ) | ( (uint32_t)_raw[2] << 8 ) | _raw[3];
+		_out->isRemote = ( _raw[4] & (1<<RTR) ) ? 1 : 0;
 	}
+	else
+	{
+		_out->type = can_standard;
+		_out->isRemote = ( _raw[1] & (1<<SRR) ) || ( _raw[4] & (1<<RTR) ) ? 1 : 0;
+	}
+
+	_out->DLC = _raw[4] & 0X0F;
+	if( _out->DLC > 8 )
+		_out->DLC = 8;
+	if( _out->isRemote )
+		_out->DLC = 0;
 
+	for(uint8_t i=0; i<8; i++)
+		_out->DATA[i] = i < _out->DLC ? _raw[5 + i] : 0;
+}
+
+/**
+ * @brief This function loads raw register bytes (SIDH, SIDL, EID8, EID0, DLC, D0 to D7) into a transmit buffer
+ * with the LOAD TX BUFFER instruction and requests the transmission. The buffer is not checked : the caller must
+ * know it is free, e.g. from canReadStatus().
+ *
+ * @param
+ * 1. _buff : the transmit buffer number.
+ * 2. _raw : the register bytes, as produced by canReadRawRX().
+ *
+ * @return
+ * NOTHING
+ */
+void canLoadRawTX(uint8_t _buff, const uint8_t _raw[13])
+{
+	uint8_t _n = ( _raw[4] & (1<<RTR) ) ? 0 : ( _raw[4] & 0X0F );
+
+	if( _n > 8 )
+		_n = 8;
+
+	pal_select_slave();
+	pal_spi_send( MCP_LOAD_TX0_ID + 2 * ( _buff % 3 ) );
+	for(uint8_t i=0; i<5 + _n; i++)
+		pal_spi_send( _raw[i] );
 	pal_deselect_slave();
 
-	return _frame;
+	canRequestTransmission_wRTS(_buff);
+}
+
+/**
+ * @brief This function tells the driver that the interrupt handler of the chip is running. Until canLeaveISR() the
+ * transactions do not take pal_lock(), which may block : with MCP_PAL_LOCKING pal_lock() masks the interrupt of the
+ * chip, so the handler never runs during a transaction of a thread. The handler may call the APIs that make single
+ * transactions and never wait : canReadStatus(), canClearInterruptFlags(), canIsFilledRX(), canReadFrameRX(),
+ * canReadRawRX(), canServiceRX(), monService(), rxpInterrupt(). Does nothing without MCP_PAL_LOCKING.
+ *
+ * Only the calling context stops locking : the depth is thread local (see MCP_THREAD_LOCAL), so on a host where the
+ * handler is a signal handler or a thread of its own, the other threads go on taking pal_lock().
+ *
+ * @param
+ * NONE
+ *
+ * @return
+ * NOTHING
+ */
+void canEnterISR(void)
+{
+	mcp_isr_depth++;
+}
+
+/**
+ * @brief This function ends the part of the interrupt handler started with canEnterISR().
+ *
+ * @param
+ * NONE
+ *
+ * @return
+ * NOTHING
+ */
+void canLeaveISR(void)
+{
+	if( mcp_isr_depth )
+		mcp_isr_depth--;
 }
@@ -303,18 +303,18 @@
 
 #define RXM0SIDL 0X21
 
-#define RXM0EID8 0X23
+#define RXM0EID8 0X22
 
-#define RXM0EID0 0X24
+#define RXM0EID0 0X23
 
 
-#define RXM1SIDH 0X25
+#define RXM1SIDH 0X24
 
-#define RXM1SIDL 0X26
+#define RXM1SIDL 0X25
 
-#define RXM1EID8 0X27
+#define RXM1EID8 0X26
 
-#define RXM1EID0 0X28
+#define RXM1EID0 0X27
 
 /**
  * BITS
@@ -374,6 +374,24 @@
 #define RX1IF 1
 #define RX0IF 0
 
+/**
+ * @brief CNF3
+*/
+#define SOF 7
+#define WAKFIL 6
+
+/**
+ * @brief EFLG
+*/
+#define RX1OVR 7
+#define RX0OVR 6
+#define TXBO 5
+#define TXEP 4
+#define RXEP 3
+#define TXWAR 2
+#define RXWAR 1
+#define EWARN 0
+
 /**
  * @brief CANINTE
 */
@@ -399,9 +417,22 @@
 #define FILHIT11 1
 #define FILHIT10 0
 
+/**
+ * @brief READ STATUS instruction response
+*/
+#define MCP_STAT_RX0IF 0
+#define MCP_STAT_RX1IF 1
+#define MCP_STAT_TX0REQ 2
+#define MCP_STAT_TX0IF 3
+#define MCP_STAT_TX1REQ 4
+#define MCP_STAT_TX1IF 5
+#define MCP_STAT_TX2REQ 6
+#define MCP_STAT_TX2IF 7
+
 /**
  * @brief RXBnSIDL
 */
+#define SRR 4
 #define IDE 3
 
 /**
@@ -561,6 +592,38 @@ typedef struct CAN_FRAME
 	unsigned char DATA[8];
 }CAN_FRAME;
 
+/**
+ * @brief Complete configuration of the chip for canInit(). Masks and filters use the 29 bit layout of
+ * canSetMaskRX() and canSetFilterRX(), the standard ID in bits 28 to 18.
+*/
+typedef struct MCP_CONFIG
+{
+	void *spi_data;				/* passed to pal_spi_init() with AUTO_SPI_INITIALIZATION */
+	uint16_t data_rate;			/* Kbps, as for canBegin(); 0 to use cnf */
+	uint8_t cnf[3];				/* CNF1, CNF2, CNF3 when data_rate is 0 */
+	uint8_t caninte;
+	uint8_t bfpctrl;
+	uint8_t txrtsctrl;
+	uint32_t mask[2];
+	uint32_t filter[6];
+	uint8_t filter_ext;			/* bit n : filter n matches extended frames */
+	uint8_t rxb0ctrl;			/* RXM bits and BUKT */
+	uint8_t rxb1ctrl;			/* RXM bits */
+	uint8_t canctrl;			/* OSM, CLKEN and CLKPRE bits */
+	MCP_CAN_MODE mode;			/* mode entered at the end */
+}MCP_CONFIG;
+
+/**
+ * @brief Receive hook called by canServiceRX() for every frame read from the chip.
+*/
+typedef void (*CAN_RX_HOOK)(const CAN_FRAME *, void *);
+
+/**
+ * @brief Reads one receive buffer for canServiceRX() in place of canReadFrameRX(), and releases it. Set with
+ * canSetReaderRX(), e.g. by xferAttachRX() to read through the SPI transaction scheduler.
+*/
+typedef void (*CAN_RX_READER)(uint8_t, CAN_FRAME *, void *);
+
 
 
 /**
@@ -574,6 +637,116 @@ typedef struct CAN_FRAME
 */
 #define MCP_CHIP_FREQ 8000000
 
+/**
+ * @brief The following macro defines the wait of canInit() after the RESET instruction, in microseconds. The
+ * oscillator start-up timer holds the chip for 128 oscillator periods, 16 us at 8 MHz.
+*/
+#ifndef MCP_RESET_DELAY_US
+#define MCP_RESET_DELAY_US 20
+#endif
+
+/**
+ * @brief The following macro bounds the wait of canAbortAll() for the frame on the bus to end, in microseconds. A
+ * frame of 8 bytes with stuff bits takes about 30 ms at 5 Kbps.
+*/
+#ifndef MCP_ABORT_TIMEOUT_US
+#define MCP_ABORT_TIMEOUT_US 50000
+#endif
+
+/**
+ * @brief The following macro bounds the wait of canInit() for the chip to enter the requested mode, in
+ * microseconds. Leaving configuration mode waits for 11 recessive bits, entering it for the frame on the bus to end.
+*/
+#ifndef MCP_MODE_TIMEOUT_US
+#define MCP_MODE_TIMEOUT_US 50000
+#endif
+
+/**
+ * @brief The following macro makes the core APIs reach the platform through the operations table of the current
+ * device (see mcp2515_pal_ops.h) instead of the pal_* functions. Uncomment it, or define it from the build, to drive
+ * several backends from one binary.
+*/
+// #define MCP_PAL_DYNAMIC
+
+#if defined(MCP_PAL_DYNAMIC) && !defined(MCP_PAL_IMPLEMENTATION)
+#include "mcp2515_pal_ops.h"
+#endif
+
+/**
+ * @brief The following macro routes every SPI access of the core APIs through the transaction recorder in
+ * mcp2515_trace.c. Uncomment it, or define it from the build, to capture the SPI traffic of a node.
+*/
+// #define MCP_SPI_TRACE
+
+/**
+ * @brief Files that implement the platform abstraction layer define MCP_PAL_IMPLEMENTATION before including
+ * this header so that their own definitions are not redirected.
+*/
+#if defined(MCP_SPI_TRACE) && !defined(MCP_PAL_IMPLEMENTATION)
+#include "mcp2515_trace.h"
+#undef pal_select_slave
+#undef pal_deselect_slave
+#undef pal_spi_send
+#undef pal_spi_read
+#define pal_select_slave() traceSelectSlave()
+#define pal_deselect_slave() traceDeselectSlave()
+#define pal_spi_send(byt) traceSpiSend(byt)
+#define pal_spi_read() traceSpiRead()
+#endif
+
+/**
+ * @brief The following macro makes the core APIs and the library modules safe to call from several threads. Every
+ * SPI transaction takes pal_lock() around its chip select window, and the sequences that change the state of the
+ * chip take pal_state_lock() as well. Locks are taken per transaction, so a thread draining the receive buffers
+ * waits for one transaction at most, never for a whole configuration sequence. Between canEnterISR() and
+ * canLeaveISR() the transactions do not lock : pal_lock() masks the interrupt of the chip, so no transaction of a
+ * thread is in progress while its handler runs. Define it from the build rather than here, so that
+ * mcp2515_driver_pal_defs.h sees it and makes the device binding of MCP_PAL_DYNAMIC thread local.
+*/
+// #define MCP_PAL_LOCKING
+
+extern MCP_THREAD_LOCAL volatile uint8_t mcp_isr_depth;
+
+#if defined(MCP_PAL_LOCKING) && !defined(MCP_PAL_IMPLEMENTATION)
+// these take the pal_select_slave() and pal_deselect_slave() defined above : plain PAL, operations table or trace
+static inline void canLockSelect(void)
+{
+	if( !mcp_isr_depth )
+		pal_lock();
+	pal_select_slave();
+}
+
+static inline void canLockDeselect(void)
+{
+	pal_deselect_slave();
+	if( !mcp_isr_depth )
+		pal_unlock();
+}
+
+static inline void canStateLock(void)
+{
+	pal_state_lock();
+}
+
+static inline void canStateUnlock(void)
+{
+	pal_state_unlock();
+}
+
+#undef pal_select_slave
+#undef pal_deselect_slave
+#define pal_select_slave() canLockSelect()
+#define pal_deselect_slave() canLockDeselect()
+#else
+static inline void canStateLock(void)
+{
+}
+
+static inline void canStateUnlock(void)
+{
+}
+#endif
+
 
 
 /**
@@ -586,8 +759,12 @@ void canRequestMode(MCP_CAN_MODE);
 
 void canSetBitTiming(unsigned char, unsigned char, unsigned char);
 
+uint8_t canGetBitTiming(uint16_t, unsigned char *);
+
 void canBegin(void*, uint16_t);
 
+uint8_t canInit(const MCP_CONFIG *);
+
 uint8_t canGetTEC(void);
 
 uint8_t canGetREC(void);
@@ -596,6 +773,14 @@ void canChipReset(void);
 
 uint8_t canIsFreeTX(uint8_t);
 
+uint8_t canReadStatus(void);
+
+uint8_t canReadRegister(uint8_t);
+
+void canWriteRegister(uint8_t, uint8_t);
+
+void canBitModify(uint8_t, uint8_t, uint8_t);
+
 uint8_t canSetPriorityTX(uint8_t, uint8_t);
 
 uint8_t canSetSID_TX(uint8_t, uint16_t);
@@ -604,7 +789,7 @@ uint8_t canSetEID_TX(uint8_t, uint32_t);
 
 void canSetTXREQ(uint8_t);
 
-void canRequestTransmission_wiRTS(uint8_t);
+void canRequestTransmission_wRTS(uint8_t);
 
 uint8_t canTransmit(uint8_t, uint8_t, unsigned char [8]);
 
@@ -612,21 +797,31 @@ uint8_t canTransmit_wSID(uint8_t, uint16_t, uint8_t, unsigned char[8]);
 
 uint8_t canTransmit_wEID(uint8_t, uint32_t, uint8_t, unsigned char[8]);
 
-uint8_t canRemoteTransmit_wSID(uint8_t, uint16_t);
+uint8_t canTransmitRemote_wSID(uint8_t, uint16_t);
 
-uint8_t canRemoteTransmit_wEID(uint8_t, uint32_t);
+uint8_t canTransmitRemote_wEID(uint8_t, uint32_t);
 
 MCP_CAN_TX_ERROR canGetErrorTX(uint8_t);
 
 void canClearMessageError(void);
 
+uint8_t canGetControlTX(uint8_t);
+
+void canClearInterruptFlags(uint8_t);
+
+void canSetOneShotTX(uint8_t);
+
 void canAbortTX(uint8_t);
 
+uint8_t canAbortAll(void);
+
 void canEnableFilterRX(uint8_t);
 
 void canDisableFilterRX(uint8_t);
 
-void canEnableRX(uint8_t);
+void canSetRolloverRX(uint8_t);
+
+void enableRX(uint8_t);
 
 uint8_t canIsFilledRX(uint8_t);
 
@@ -636,4 +831,20 @@ void canSetFilterRX(uint8_t, CAN_FRAME_TYPE, uint32_t);
 
 CAN_FRAME canGetFrame_wID(uint8_t);
 
+void canReadFrameRX(uint8_t, CAN_FRAME *);
+
+uint8_t canServiceRX(CAN_RX_HOOK, void *);
+
+void canSetReaderRX(CAN_RX_READER, void *);
+
+uint8_t canReadRawRX(uint8_t, uint8_t [13]);
+
+void canDecodeRaw(const uint8_t [13], CAN_FRAME *);
+
+void canLoadRawTX(uint8_t, const uint8_t [13]);
+
+void canEnterISR(void);
+
+void canLeaveISR(void);
+
 #endif
@@ -6,6 +6,9 @@
 
 #include "mcp2515_driver_pal.h"
 
+// with MCP_PAL_INLINE_HEADER the PAL APIs come from that header
+#ifndef MCP_PAL_INLINE_HEADER
+
 /**
  * @brief This PAL API will be called by core APIs to initialize the SPI port.
  * 
@@ -74,4 +77,77 @@ void pal_spi_send(uint8_t byt)
 uint8_t pal_spi_read(void)
 {
     /* !...Platform Specific Code here...! */
-}
\ No newline at end of file
+}
+
+/**
+ * @brief This PAL API will be called by core APIs to get a free running time stamp in microseconds.
+ * The counter is allowed to wrap around.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return 
+ * uint32_t : the current time in microseconds.
+*/
+uint32_t pal_get_time_us(void)
+{
+    /* !...Platform Specific Code here...! */
+}
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, before every SPI transaction.
+ * It takes the lock of the SPI port of the chip and masks the interrupt of the chip if a handler talks to it.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_lock(void)
+{
+    /* !...Platform Specific Code here...! */
+}
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, after every SPI transaction.
+ * It undoes pal_lock().
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_unlock(void)
+{
+    /* !...Platform Specific Code here...! */
+}
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, around sequences of
+ * transactions that change the state of the chip. It takes the recursive state lock of the chip.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_state_lock(void)
+{
+    /* !...Platform Specific Code here...! */
+}
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, at the end of a sequence
+ * started with pal_state_lock().
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_state_unlock(void)
+{
+    /* !...Platform Specific Code here...! */
+}
+
+#endif
@@ -17,7 +17,7 @@
  * @return
  * NOTHING
 */
-inline void pal_delay_ms(uint32_t _int)
+static inline void pal_delay_ms(uint32_t _int)
 {
     /* !...Platform Specific Code here...! */
 }
@@ -31,12 +31,22 @@ inline void pal_delay_ms(uint32_t _int)
  * @return
  * NOTHING
 */
-inline void pal_delay_us(uint32_t _int)
+static inline void pal_delay_us(uint32_t _int)
 {
     /* !...Platform Specific Code here...! */
 }
 
 
+/**
+ * @brief The following macro names a header that supplies the SPI and time stamp PAL APIs below as static inline
+ * functions or macros, e.g. on the SPI data register of an AVR or a Cortex-M0. The core then inlines them into its
+ * frame loops instead of calling into mcp2515_driver_pal.c, which is left out of the build. Define it from the build,
+ * e.g. -DMCP_PAL_INLINE_HEADER='"board_pal.h"'.
+*/
+#ifdef MCP_PAL_INLINE_HEADER
+#include MCP_PAL_INLINE_HEADER
+#else
+
 /**
  * @brief This PAL API will be called by core APIs to initialize the SPI port.
  * 
@@ -92,5 +102,66 @@ void pal_spi_send(uint8_t byt);
 */
 uint8_t pal_spi_read(void);
 
+/**
+ * @brief This PAL API will be called by core APIs to get a free running time stamp in microseconds.
+ * The counter is allowed to wrap around.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return 
+ * uint32_t : the current time in microseconds.
+*/
+uint32_t pal_get_time_us(void);
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, before every SPI transaction
+ * (chip select window), so that the transactions of different threads do not interleave. It takes the lock of the
+ * SPI port of the chip, e.g. a mutex; when an interrupt handler also talks to the chip it masks that interrupt too.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_lock(void);
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, after every SPI transaction. It
+ * undoes pal_lock().
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_unlock(void);
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, around sequences of transactions
+ * that change the state of the chip (mode switches, configuration, abort). It takes the state lock of the chip,
+ * which must be a recursive lock distinct from the one of pal_lock() : the sequences nest, and the transactions of
+ * other threads go on between the ones of a sequence.
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_state_lock(void);
+
+/**
+ * @brief This PAL API will be called by core APIs when MCP_PAL_LOCKING is defined, at the end of a sequence started
+ * with pal_state_lock().
+ * 
+ * @param 
+ * NONE
+ * 
+ * @return NOTHING
+*/
+void pal_state_unlock(void);
+
+#endif
+
 
 #endif
\ No newline at end of file
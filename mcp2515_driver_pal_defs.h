@@ -11,6 +11,7 @@
  * 
  * Define any custom types below (if required).
 */
+#include <stdint.h>
 
 #define MSB_FIRST 1
 #define LSB_FIRST 0
@@ -21,6 +22,26 @@
 #define LEADING_EDGE 1
 #define TRAILING_EDGE 0
 
+/**
+ * @brief Storage class of the state the driver keeps for the calling thread : the table chosen with palUse() under
+ * MCP_PAL_DYNAMIC and the canEnterISR() depth of MCP_PAL_LOCKING. With MCP_PAL_LOCKING defined from the build it is
+ * thread local, so a palUse() in one thread never redirects the transactions of another, and a handler between
+ * canEnterISR() and canLeaveISR() only stops the locking of its own context; otherwise one copy serves the whole
+ * program. Define it from the
+ * build for a compiler or an RTOS that spells thread local storage differently.
+*/
+#ifndef MCP_THREAD_LOCAL
+#if !defined(MCP_PAL_LOCKING)
+#define MCP_THREAD_LOCAL
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define MCP_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define MCP_THREAD_LOCAL __thread
+#else
+#define MCP_THREAD_LOCAL
+#endif
+#endif
+
 /**
  * If the platform does not support types - 1. uint8_t, uint16_t, uin32_t then uncomment and stuitably modify the following lines.
  * 
@@ -0,0 +1,302 @@
+/**
+ * @file mcp2515_gateway.c
+ * @brief Gateway between several MCP2515 chips with raw register forwarding.
+*/
+
+#include "mcp2515_gateway.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to point the driver at the chip of a bus, only when it changes.
+*/
+static void gwSelect(CAN_GATEWAY *_gw, uint8_t _b)
+{
+	if( _gw->selected == _b )
+		return;
+	_gw->bus[_b].select( _gw->bus[_b].ctx );
+	_gw->selected = _b;
+}
+
+/**
+ * @brief Utility function to check whether the raw ID bytes of a frame match a route.
+*/
+static uint8_t gwMatch(const GW_ROUTE *_r, const uint8_t _raw[13])
+{
+	uint32_t _id = ( (uint32_t)_raw[0] << 3 ) | ( _raw[1] >> 5 );
+
+	if( _raw[1] & (1<<IDE) )
+	{
+		if( _r->type != can_extended )
+			return 0;
+		_id = ( _id << 18 ) | ( (uint32_t)( _raw[1] & 0X03 ) << 16 ) | ( (uint32_t)_raw[2] << 8 ) | _raw[3];
+	}
+	else if( _r->type == can_extended )
+		return 0;
+
+	return ( ( _id ^ _r->id ) & _r->mask ) == 0;
+}
+
+/**
+ * @brief Utility function to write a new ID into the raw bytes of a frame.
+*/
+static void gwSetID(uint8_t _raw[13], CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	if( _type == can_extended )
+	{
+		_raw[0] = _id >> 21;
+		_raw[1] = ( ( _id >> 13 ) & 0XE0 ) | (1<<EXIDE) | ( ( _id >> 16 ) & 0X03 );
+		_raw[2] = _id >> 8;
+		_raw[3] = _id;
+	}
+	else
+	{
+		_raw[0] = _id >> 3;
+		_raw[1] = ( _id << 5 ) & 0XE0;
+		_raw[2] = 0;
+		_raw[3] = 0;
+	}
+}
+
+/**
+ * @brief Utility function to load a frame into the transmit buffer of a bus and account for it on its route.
+*/
+static void gwLoad(CAN_GATEWAY *_gw, uint8_t _b, const uint8_t _raw[13], uint8_t _route, uint32_t _ts)
+{
+	GW_BUS *_bus = &_gw->bus[_b];
+	GW_ROUTE *_r = &_gw->routes[_route];
+
+	gwSelect( _gw, _b );
+	canLoadRawTX( _bus->tx_buff, _raw );
+	_bus->status |= 1 << ( MCP_STAT_TX0REQ + 2 * _bus->tx_buff );
+
+	uint32_t _latency = pal_get_time_us() - _ts;
+	_r->forwarded++;
+	_r->latency_sum_us += _latency;
+	if( _latency > _r->latency_max_us )
+		_r->latency_max_us = _latency;
+}
+
+/**
+ * @brief Utility function to check whether the transmit buffer of a bus is free in this pass.
+*/
+static uint8_t gwFreeTX(const GW_BUS *_bus)
+{
+	return !( _bus->status & ( 1 << ( MCP_STAT_TX0REQ + 2 * _bus->tx_buff ) ) );
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a gateway.
+ *
+ * @param
+ * 1. _gw : the gateway.
+ * 2. _routes : the routing table, scanned in order : the first matching route forwards the frame.
+ * 3. _count : number of routes, at most 255.
+ *
+ * @return
+ * NOTHING
+ */
+void gwBegin(CAN_GATEWAY *_gw, GW_ROUTE *_routes, uint8_t _count)
+{
+	_gw->buses = 0;
+	_gw->selected = 0XFF;
+	_gw->routes = _routes;
+	_gw->route_count = _count;
+	gwClearStats( _gw );
+}
+
+/**
+ * @brief This function adds a bus and enables receive buffer rollover on its chip. The chip must already be
+ * initialized and in normal mode.
+ *
+ * @param
+ * 1. _gw : the gateway.
+ * 2. _select : points the platform abstraction layer at the chip of the bus.
+ * 3. _ctx : passed as it is to the select hook.
+ * 4. _tx_buff : transmit buffer used for forwarded frames.
+ *
+ * @return
+ * THE BUS NUMBER, 0XFF IF GW_MAX_BUSES BUSES ARE ALREADY ADDED.
+ */
+uint8_t gwAddBus(CAN_GATEWAY *_gw, GW_SELECT _select, void *_ctx, uint8_t _tx_buff)
+{
+	if( _gw->buses >= GW_MAX_BUSES )
+		return 0XFF;
+
+	GW_BUS *_bus = &_gw->bus[_gw->buses];
+	_bus->select = _select;
+	_bus->ctx = _ctx;
+	_bus->tx_buff = _tx_buff % 3;
+	_bus->head = 0;
+	_bus->tail = 0;
+	_bus->received = 0;
+	_bus->unrouted = 0;
+
+	// a frame arriving while buffer 0 waits for the gateway must not be lost
+	gwSelect( _gw, _gw->buses );
+	canSetRolloverRX(1);
+
+	return _gw->buses++;
+}
+
+/**
+ * @brief This function fills a route that forwards frames unchanged.
+ *
+ * @param
+ * 1. _r : the route.
+ * 2. _src : source bus.
+ * 3. _type : can_standard or can_extended.
+ * 4. _id : the identifier.
+ * 5. _mask : bits of the identifier that must match, 0 to forward every ID of the type.
+ * 6. _dst : destination buses, bit n for bus n.
+ *
+ * @return
+ * NOTHING
+ */
+void gwRoute(GW_ROUTE *_r, uint8_t _src, CAN_FRAME_TYPE _type, uint32_t _id, uint32_t _mask, uint8_t _dst)
+{
+	_r->src = _src;
+	_r->type = _type == can_extended ? can_extended : can_standard;
+	_r->id = _id;
+	_r->mask = _mask;
+	_r->dst = _dst;
+	_r->rewrite = 0;
+	_r->forwarded = 0;
+	_r->dropped = 0;
+	_r->latency_max_us = 0;
+	_r->latency_sum_us = 0;
+}
+
+/**
+ * @brief This function makes a route replace the ID of the frames it forwards.
+ *
+ * @param
+ * 1. _r : the route.
+ * 2. _type : can_standard or can_extended.
+ * 3. _id : the new identifier.
+ *
+ * @return
+ * NOTHING
+ */
+void gwRewrite(GW_ROUTE *_r, CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	_r->rewrite = 1;
+	_r->new_type = _type == can_extended ? can_extended : can_standard;
+	_r->new_id = _id;
+}
+
+/**
+ * @brief This function clears the statistics of every route and bus.
+ *
+ * @param
+ * 1. _gw : the gateway.
+ *
+ * @return
+ * NOTHING
+ */
+void gwClearStats(CAN_GATEWAY *_gw)
+{
+	for(uint8_t i=0; i<_gw->route_count; i++)
+	{
+		_gw->routes[i].forwarded = 0;
+		_gw->routes[i].dropped = 0;
+		_gw->routes[i].latency_max_us = 0;
+		_gw->routes[i].latency_sum_us = 0;
+	}
+	for(uint8_t b=0; b<_gw->buses; b++)
+	{
+		_gw->bus[b].received = 0;
+		_gw->bus[b].unrouted = 0;
+	}
+}
+
+/**
+ * @brief This function runs one forwarding pass : one READ STATUS per bus, then the queued frames go to the
+ * transmit buffers that are free, then every received frame is read raw and forwarded. A frame goes straight to
+ * the transmit buffer when it is free and nothing is queued before it. Call it in a loop or on the chips'
+ * interrupts; the forwarding latency is one pass at most when the destination is idle.
+ *
+ * @param
+ * 1. _gw : the gateway.
+ *
+ * @return
+ * NOTHING
+ */
+void gwService(CAN_GATEWAY *_gw)
+{
+	for(uint8_t b=0; b<_gw->buses; b++)
+	{
+		gwSelect( _gw, b );
+		_gw->bus[b].status = canReadStatus();
+	}
+
+	// queued frames first, they are older
+	for(uint8_t b=0; b<_gw->buses; b++)
+	{
+		GW_BUS *_bus = &_gw->bus[b];
+		if( _bus->head != _bus->tail && gwFreeTX( _bus ) )
+		{
+			GW_QUEUED *_q = &_bus->queue[_bus->tail];
+			gwLoad( _gw, b, _q->raw, _q->route, _q->ts );
+			_bus->tail = ( _bus->tail + 1 ) & ( GW_QUEUE_LEN - 1 );
+		}
+	}
+
+	for(uint8_t b=0; b<_gw->buses; b++)
+	{
+		for(uint8_t _rx=0; _rx<2; _rx++)
+		{
+			if( !( _gw->bus[b].status & ( 1 << ( MCP_STAT_RX0IF + _rx ) ) ) )
+				continue;
+
+			uint8_t _raw[13];
+			gwSelect( _gw, b );
+			canReadRawRX( _rx, _raw );
+			uint32_t _ts = pal_get_time_us();
+			_gw->bus[b].received++;
+
+			uint8_t _route = 0;
+			while( _route < _gw->route_count && ( _gw->routes[_route].src != b || !gwMatch( &_gw->routes[_route], _raw ) ) )
+				_route++;
+			if( _route == _gw->route_count )
+			{
+				_gw->bus[b].unrouted++;
+				continue;
+			}
+
+			GW_ROUTE *_r = &_gw->routes[_route];
+			if( _r->rewrite )
+				gwSetID( _raw, _r->new_type, _r->new_id );
+
+			for(uint8_t d=0; d<_gw->buses; d++)
+			{
+				if( !( _r->dst & (1<<d) ) )
+					continue;
+
+				GW_BUS *_dst = &_gw->bus[d];
+				if( _dst->head == _dst->tail && gwFreeTX( _dst ) )
+				{
+					gwLoad( _gw, d, _raw, _route, _ts );
+					continue;
+				}
+
+				uint8_t _next = ( _dst->head + 1 ) & ( GW_QUEUE_LEN - 1 );
+				if( _next == _dst->tail )
+				{
+					_r->dropped++;
+					continue;
+				}
+
+				GW_QUEUED *_q = &_dst->queue[_dst->head];
+				for(uint8_t i=0; i<13; i++)
+					_q->raw[i] = _raw[i];
+				_q->route = _route;
+				_q->ts = _ts;
+				_dst->head = _next;
+			}
+		}
+	}
+}
@@ -0,0 +1,92 @@
+/**
+ * @file mcp2515_gateway.h
+ * @brief Gateway between several MCP2515 chips. Frames are routed by source bus and ID/mask and forwarded as raw
+ * register bytes from the receive buffer of one chip to a transmit buffer of the others, without decoding; only a
+ * route with an ID rewrite touches the four ID bytes.
+ *
+ * The driver talks to one chip at a time : every bus is given a select hook that points the platform abstraction
+ * layer at its chip (e.g. the chip select pin used by pal_select_slave()). Each bus transmits through one buffer
+ * so that frames keep their order, with a small software queue behind it; a frame that finds the queue full is
+ * dropped and counted on its route.
+*/
+#ifndef MCP2515_GATEWAY
+#define MCP2515_GATEWAY
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Maximum number of buses of a gateway.
+*/
+#ifndef GW_MAX_BUSES
+#define GW_MAX_BUSES 3
+#endif
+
+/**
+ * @brief Number of frames waiting for the transmit buffer of a bus, a power of two.
+*/
+#ifndef GW_QUEUE_LEN
+#define GW_QUEUE_LEN 16
+#endif
+
+typedef void (*GW_SELECT)(void *);
+
+typedef struct GW_ROUTE
+{
+	uint8_t src;				/* source bus */
+	CAN_FRAME_TYPE type;		/* can_standard or can_extended */
+	uint32_t id;
+	uint32_t mask;				/* bits of the ID that must match */
+	uint8_t dst;				/* destination buses, bit n for bus n */
+	uint8_t rewrite;			/* 1 to replace the ID */
+	CAN_FRAME_TYPE new_type;
+	uint32_t new_id;
+
+	/* statistics, per destination */
+	uint32_t forwarded;
+	uint32_t dropped;
+	uint32_t latency_max_us;	/* from reading the receive buffer to loading the transmit buffer */
+	uint64_t latency_sum_us;
+}GW_ROUTE;
+
+typedef struct GW_QUEUED
+{
+	uint8_t raw[13];
+	uint8_t route;
+	uint32_t ts;
+}GW_QUEUED;
+
+typedef struct GW_BUS
+{
+	GW_SELECT select;
+	void *ctx;
+	uint8_t tx_buff;
+	uint8_t status;				/* READ STATUS of the current gwService() pass */
+	GW_QUEUED queue[GW_QUEUE_LEN];
+	uint8_t head;
+	uint8_t tail;
+	uint32_t received;
+	uint32_t unrouted;			/* frames matching no route */
+}GW_BUS;
+
+typedef struct CAN_GATEWAY
+{
+	GW_BUS bus[GW_MAX_BUSES];
+	uint8_t buses;
+	uint8_t selected;
+	GW_ROUTE *routes;
+	uint8_t route_count;
+}CAN_GATEWAY;
+
+void gwBegin(CAN_GATEWAY *, GW_ROUTE *, uint8_t);
+
+uint8_t gwAddBus(CAN_GATEWAY *, GW_SELECT, void *, uint8_t);
+
+void gwRoute(GW_ROUTE *, uint8_t, CAN_FRAME_TYPE, uint32_t, uint32_t, uint8_t);
+
+void gwRewrite(GW_ROUTE *, CAN_FRAME_TYPE, uint32_t);
+
+void gwClearStats(CAN_GATEWAY *);
+
+void gwService(CAN_GATEWAY *);
+
+#endif
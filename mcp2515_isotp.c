@@ -0,0 +1,525 @@
+/**
+ * @file mcp2515_isotp.c
+ * @brief ISO 15765-2 (ISO-TP) transport on top of the driver.
+*/
+
+#include "mcp2515_isotp.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to convert an STmin byte to microseconds. Reserved values mean the longest time.
+*/
+static uint32_t isotpStMinUs(uint8_t _st)
+{
+	if( _st <= 0X7F )
+		return (uint32_t)_st * 1000;
+	if( _st >= 0XF1 && _st <= 0XF9 )
+		return (uint32_t)( _st - 0XF0 ) * 100;
+	return 127000;
+}
+
+/**
+ * @brief Utility function to give the number of data bytes of a received frame : a DLC of 9 to 15 still means 8.
+*/
+static uint8_t isotpDLC(const CAN_FRAME *_frame)
+{
+	return _frame->DLC > 8 ? 8 : _frame->DLC;
+}
+
+/**
+ * @brief Utility function to transmit a frame of the link, padded as configured.
+ *
+ * @return
+ * 1 : IF THE FRAME WAS HANDED TO THE CHIP
+ * 0 : IF THE TRANSMIT BUFFER IS BUSY
+*/
+static uint8_t isotpTransmit(ISOTP_LINK *_l, unsigned char _data[8], uint8_t _len)
+{
+#if ISOTP_PADDING
+	for(uint8_t i=_len; i<8; i++)
+		_data[i] = ISOTP_PAD_BYTE;
+	_len = 8;
+#endif
+
+	if( _l->type == can_extended )
+		return canTransmit_wEID( _l->buff, _l->tx_id, _len, _data );
+	return canTransmit_wSID( _l->buff, (uint16_t)_l->tx_id, _len, _data );
+}
+
+/**
+ * @brief Utility function to send the pending flow control frame of the receive side.
+*/
+static uint8_t isotpSendFC(ISOTP_LINK *_l)
+{
+	unsigned char _data[8];
+
+	_data[0] = _l->fc_pending;
+	_data[1] = _l->block_size;
+	_data[2] = _l->st_min;
+
+	if( !isotpTransmit( _l, _data, 3 ) )
+		return 0;
+	_l->fc_pending = 0;
+	return 1;
+}
+
+/**
+ * @brief Utility function to end the transmission of the link and report it.
+*/
+static void isotpTxEnd(ISOTP_LINK *_l, ISOTP_RESULT _result)
+{
+	_l->tx_state = isotp_idle;
+	if( _l->tx_done )
+		_l->tx_done( _l, _result, _l->tx_pos, _l->tx_ctx );
+}
+
+/**
+ * @brief Utility function to end the reception of the link and report it.
+*/
+static void isotpRxEnd(ISOTP_LINK *_l, ISOTP_RESULT _result)
+{
+	_l->rx_state = isotp_idle;
+	if( _l->rx_done )
+		_l->rx_done( _l, _result, _l->rx_pos, _l->rx_ctx );
+}
+
+/**
+ * @brief Utility function to send the single frame or first frame of a message.
+*/
+static uint8_t isotpSendFirst(ISOTP_LINK *_l)
+{
+	unsigned char _data[8];
+	uint8_t _n = 0;
+	uint8_t _pci;
+
+	if( _l->tx_len <= 7 )
+	{
+		_data[0] = ISOTP_SINGLE_FRAME | _l->tx_len;
+		_pci = 1;
+	}
+	else if( _l->tx_len <= 0XFFF )
+	{
+		_data[0] = ISOTP_FIRST_FRAME | ( _l->tx_len >> 8 );
+		_data[1] = _l->tx_len;
+		_pci = 2;
+	}
+	else
+	{
+		// escape sequence : 32 bit length
+		_data[0] = ISOTP_FIRST_FRAME;
+		_data[1] = 0;
+		_data[2] = _l->tx_len >> 24;
+		_data[3] = _l->tx_len >> 16;
+		_data[4] = _l->tx_len >> 8;
+		_data[5] = _l->tx_len;
+		_pci = 6;
+	}
+
+	while( _pci + _n < 8 && _n < _l->tx_len )
+	{
+		_data[_pci + _n] = _l->tx_data[_n];
+		_n++;
+	}
+
+	if( !isotpTransmit( _l, _data, _pci + _n ) )
+		return 0;
+
+	_l->tx_pos = _n;
+	_l->tx_sn = 1;
+	return 1;
+}
+
+/**
+ * @brief Utility function to send the next consecutive frame of a message.
+*/
+static uint8_t isotpSendConsecutive(ISOTP_LINK *_l)
+{
+	unsigned char _data[8];
+	uint8_t _n = 0;
+
+	_data[0] = ISOTP_CONSECUTIVE_FRAME | _l->tx_sn;
+	while( _n < 7 && _l->tx_pos + _n < _l->tx_len )
+	{
+		_data[1 + _n] = _l->tx_data[_l->tx_pos + _n];
+		_n++;
+	}
+
+	if( !isotpTransmit( _l, _data, 1 + _n ) )
+		return 0;
+
+	_l->tx_pos += _n;
+	_l->tx_sn = ( _l->tx_sn + 1 ) & 0X0F;
+	return 1;
+}
+
+/**
+ * @brief Utility function to handle a flow control frame received by the transmit side.
+*/
+static void isotpOnFlowControl(ISOTP_LINK *_l, const CAN_FRAME *_frame)
+{
+	if( _l->tx_state != isotp_tx_wait_fc || isotpDLC( _frame ) < 3 )
+		return;
+
+	switch( _frame->DATA[0] & 0X0F )
+	{
+		case ISOTP_FC_CTS:
+			_l->tx_block = _frame->DATA[1];
+			_l->tx_count = 0;
+			_l->tx_wait = 0;
+			_l->tx_st_us = isotpStMinUs( _frame->DATA[2] );
+			// the first frame of a block does not wait for STmin
+			_l->tx_time = pal_get_time_us() - _l->tx_st_us;
+			_l->tx_state = isotp_tx_consecutive;
+			break;
+
+		case ISOTP_FC_WAIT:
+			if( ++_l->tx_wait > ISOTP_MAX_WAIT )
+				isotpTxEnd( _l, isotp_timeout );
+			else
+				_l->tx_time = pal_get_time_us();
+			break;
+
+		case ISOTP_FC_OVERFLOW:
+			isotpTxEnd( _l, isotp_overflow );
+			break;
+
+		default:
+			isotpTxEnd( _l, isotp_unexpected );
+			break;
+	}
+}
+
+/**
+ * @brief Utility function to handle a single frame or first frame received by the receive side.
+*/
+static void isotpOnFirst(ISOTP_LINK *_l, const CAN_FRAME *_frame)
+{
+	uint32_t _len;
+	uint8_t _pci;
+
+	if( ( _frame->DATA[0] & 0XF0 ) == ISOTP_SINGLE_FRAME )
+	{
+		_len = _frame->DATA[0] & 0X0F;
+		_pci = 1;
+		if( _len == 0 || _pci + _len > isotpDLC( _frame ) )
+			return;
+	}
+	else
+	{
+		if( isotpDLC( _frame ) < 8 )
+			return;
+		_len = ( (uint32_t)( _frame->DATA[0] & 0X0F ) << 8 ) | _frame->DATA[1];
+		_pci = 2;
+		if( _len == 0 )
+		{
+			_len = ( (uint32_t)_frame->DATA[2] << 24 ) | ( (uint32_t)_frame->DATA[3] << 16 ) | ( (uint32_t)_frame->DATA[4] << 8 ) | _frame->DATA[5];
+			_pci = 6;
+		}
+		if( _len <= 7 )
+			return;
+	}
+
+	// a new message aborts the one in progress
+	if( _l->rx_state == isotp_rx_consecutive )
+		isotpRxEnd( _l, isotp_unexpected );
+
+	_l->rx_len = _len;
+	_l->rx_pos = 0;
+
+	if( _len > _l->rx_size )
+	{
+		if( _pci != 1 )
+		{
+			_l->fc_pending = ISOTP_FLOW_CONTROL | ISOTP_FC_OVERFLOW;
+			isotpSendFC( _l );
+		}
+		isotpRxEnd( _l, isotp_overflow );
+		return;
+	}
+
+	while( _l->rx_pos < _len && _pci + _l->rx_pos < 8 )
+	{
+		_l->rx_buf[_l->rx_pos] = _frame->DATA[_pci + _l->rx_pos];
+		_l->rx_pos++;
+	}
+
+	if( _l->rx_pos == _len )
+	{
+		isotpRxEnd( _l, isotp_ok );
+		return;
+	}
+
+	_l->rx_state = isotp_rx_consecutive;
+	_l->rx_sn = 1;
+	_l->rx_count = 0;
+	_l->rx_time = pal_get_time_us();
+	_l->fc_pending = ISOTP_FLOW_CONTROL | ISOTP_FC_CTS;
+	isotpSendFC( _l );
+}
+
+/**
+ * @brief Utility function to handle a consecutive frame received by the receive side.
+*/
+static void isotpOnConsecutive(ISOTP_LINK *_l, const CAN_FRAME *_frame)
+{
+	if( _l->rx_state != isotp_rx_consecutive )
+		return;
+
+	if( ( _frame->DATA[0] & 0X0F ) != _l->rx_sn )
+	{
+		isotpRxEnd( _l, isotp_wrong_sn );
+		return;
+	}
+
+	uint8_t _n = isotpDLC( _frame ) - 1;
+	if( _n > _l->rx_len - _l->rx_pos )
+		_n = _l->rx_len - _l->rx_pos;
+	for(uint8_t i=0; i<_n; i++)
+		_l->rx_buf[_l->rx_pos + i] = _frame->DATA[1 + i];
+	_l->rx_pos += _n;
+
+	if( _l->rx_pos == _l->rx_len )
+	{
+		isotpRxEnd( _l, isotp_ok );
+		return;
+	}
+
+	_l->rx_sn = ( _l->rx_sn + 1 ) & 0X0F;
+	_l->rx_time = pal_get_time_us();
+
+	if( _l->block_size && ++_l->rx_count == _l->block_size )
+	{
+		_l->rx_count = 0;
+		_l->fc_pending = ISOTP_FLOW_CONTROL | ISOTP_FC_CTS;
+		isotpSendFC( _l );
+	}
+}
+
+/**
+ * @brief Utility function to send the frames and run the timers of one link.
+*/
+static void isotpServiceLink(ISOTP_LINK *_l, uint8_t *_free, uint32_t _now)
+{
+	uint8_t _bit = 1 << _l->buff;
+
+	// flow control first : the peer is waiting for it
+	if( _l->fc_pending && ( *_free & _bit ) )
+	{
+		*_free &= ~_bit;
+		isotpSendFC( _l );
+	}
+
+	if( _l->rx_state == isotp_rx_consecutive && _now - _l->rx_time > ISOTP_TIMEOUT_US )
+		isotpRxEnd( _l, isotp_timeout );
+
+	switch( _l->tx_state )
+	{
+		case isotp_tx_first:
+			if( !( *_free & _bit ) )
+				break;
+			*_free &= ~_bit;
+			if( !isotpSendFirst( _l ) )
+				break;
+			if( _l->tx_pos == _l->tx_len )
+				isotpTxEnd( _l, isotp_ok );
+			else
+			{
+				_l->tx_state = isotp_tx_wait_fc;
+				_l->tx_wait = 0;
+				_l->tx_time = _now;
+			}
+			break;
+
+		case isotp_tx_wait_fc:
+			if( _now - _l->tx_time > ISOTP_TIMEOUT_US )
+				isotpTxEnd( _l, isotp_timeout );
+			break;
+
+		case isotp_tx_consecutive:
+			if( !( *_free & _bit ) || _now - _l->tx_time < _l->tx_st_us )
+				break;
+			*_free &= ~_bit;
+			if( !isotpSendConsecutive( _l ) )
+				break;
+			_l->tx_time = _now;
+			if( _l->tx_pos == _l->tx_len )
+				isotpTxEnd( _l, isotp_ok );
+			else if( _l->tx_block && ++_l->tx_count == _l->tx_block )
+				_l->tx_state = isotp_tx_wait_fc;
+			break;
+	}
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a link. Flow control defaults to no block limit and no separation time.
+ *
+ * @param
+ * 1. _l : the link.
+ * 2. _type : can_standard or can_extended.
+ * 3. _tx_id : ID of the frames sent on the link.
+ * 4. _rx_id : ID of the frames received on the link.
+ * 5. _buff : transmit buffer of the link.
+ *
+ * @return
+ * NOTHING
+ */
+void isotpBegin(ISOTP_LINK *_l, CAN_FRAME_TYPE _type, uint32_t _tx_id, uint32_t _rx_id, uint8_t _buff)
+{
+	_l->type = _type == can_extended ? can_extended : can_standard;
+	_l->tx_id = _tx_id;
+	_l->rx_id = _rx_id;
+	_l->buff = _buff % 3;
+	_l->block_size = 0;
+	_l->st_min = 0;
+
+	_l->tx_state = isotp_idle;
+	_l->tx_done = 0;
+	_l->tx_ctx = 0;
+
+	_l->rx_state = isotp_idle;
+	_l->rx_buf = 0;
+	_l->rx_size = 0;
+	_l->fc_pending = 0;
+	_l->rx_done = 0;
+	_l->rx_ctx = 0;
+}
+
+/**
+ * @brief This function sets the flow control parameters the link asks its peer for when receiving.
+ *
+ * @param
+ * 1. _l : the link.
+ * 2. _block_size : consecutive frames between two flow control frames, 0 for no limit.
+ * 3. _st_min : minimum separation time between consecutive frames, 0X00 to 0X7F milliseconds or 0XF1 to 0XF9
+ *    for 100 to 900 microseconds.
+ *
+ * @return
+ * NOTHING
+ */
+void isotpSetFlowControl(ISOTP_LINK *_l, uint8_t _block_size, uint8_t _st_min)
+{
+	_l->block_size = _block_size;
+	_l->st_min = _st_min;
+}
+
+/**
+ * @brief This function sets the buffer that received messages are reassembled into.
+ *
+ * @param
+ * 1. _l : the link.
+ * 2. _buf : the buffer, it holds the message from the callback until the next first or single frame.
+ * 3. _size : size of the buffer, longer messages are refused with an overflow flow control frame.
+ * 4. _done : called when a message is complete or its reception fails, may be NULL.
+ * 5. _ctx : passed as it is to the callback.
+ *
+ * @return
+ * NOTHING
+ */
+void isotpSetReceiveBuffer(ISOTP_LINK *_l, unsigned char *_buf, uint32_t _size, ISOTP_CALLBACK _done, void *_ctx)
+{
+	_l->rx_buf = _buf;
+	_l->rx_size = _buf ? _size : 0;
+	_l->rx_done = _done;
+	_l->rx_ctx = _ctx;
+}
+
+/**
+ * @brief This function starts sending a message. The data is not copied and must stay valid until the callback.
+ *
+ * @param
+ * 1. _l : the link.
+ * 2. _data : the message.
+ * 3. _len : length of the message, 1 to 0XFFFFFFFF bytes.
+ * 4. _done : called when the message is sent or its transmission fails, may be NULL.
+ * 5. _ctx : passed as it is to the callback.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : a message is already being sent on the link or the length is 0
+ */
+uint8_t isotpSend(ISOTP_LINK *_l, const unsigned char *_data, uint32_t _len, ISOTP_CALLBACK _done, void *_ctx)
+{
+	if( _l->tx_state != isotp_idle || _len == 0 )
+		return 0;
+
+	_l->tx_data = _data;
+	_l->tx_len = _len;
+	_l->tx_pos = 0;
+	_l->tx_done = _done;
+	_l->tx_ctx = _ctx;
+	_l->tx_state = isotp_tx_first;
+	return 1;
+}
+
+/**
+ * @brief Receive hook for canServiceRX() or a dispatch subscription, the context is the ISOTP_LINK. Frames with
+ * another ID are ignored.
+ *
+ * @param
+ * 1. _frame : the received frame.
+ * 2. _ctx : the link.
+ *
+ * @return
+ * NOTHING
+ */
+void isotpRXHook(const CAN_FRAME *_frame, void *_ctx)
+{
+	ISOTP_LINK *_l = (ISOTP_LINK *)_ctx;
+
+	if( _frame->isRemote || _frame->DLC == 0 || _frame->ID != _l->rx_id )
+		return;
+	if( ( _frame->type == can_extended ) != ( _l->type == can_extended ) )
+		return;
+
+	switch( _frame->DATA[0] & 0XF0 )
+	{
+		case ISOTP_SINGLE_FRAME:
+		case ISOTP_FIRST_FRAME:
+			isotpOnFirst( _l, _frame );
+			break;
+		case ISOTP_CONSECUTIVE_FRAME:
+			isotpOnConsecutive( _l, _frame );
+			break;
+		case ISOTP_FLOW_CONTROL:
+			isotpOnFlowControl( _l, _frame );
+			break;
+	}
+}
+
+/**
+ * @brief This function sends the frames that are due and runs the timeouts of a set of links, with one
+ * READ STATUS transaction for all of them. Each link sends at most one frame per call, so call it at least as
+ * often as frames can leave the bus to keep transfers bus bound.
+ *
+ * @param
+ * 1. _links : array of links.
+ * 2. _n : number of links.
+ *
+ * @return
+ * NOTHING
+ */
+void isotpService(ISOTP_LINK *_links, uint8_t _n)
+{
+	uint8_t _status = 0XFF;
+	uint8_t _free = 0;
+	uint32_t _now = pal_get_time_us();
+
+	// read the buffers only when a link has something to send
+	for(uint8_t i=0; i<_n; i++)
+		if( _links[i].fc_pending || _links[i].tx_state == isotp_tx_first || _links[i].tx_state == isotp_tx_consecutive )
+		{
+			_status = canReadStatus();
+			break;
+		}
+
+	for(uint8_t _buff=0; _buff<3; _buff++)
+		if( !( _status & ( 1 << ( MCP_STAT_TX0REQ + 2 * _buff ) ) ) )
+			_free |= (1<<_buff);
+
+	for(uint8_t i=0; i<_n; i++)
+		isotpServiceLink( &_links[i], &_free, _now );
+}
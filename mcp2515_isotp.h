@@ -0,0 +1,123 @@
+/**
+ * @file mcp2515_isotp.h
+ * @brief ISO 15765-2 (ISO-TP) transport on top of the driver : segmentation into first and consecutive frames,
+ * reassembly into caller supplied buffers and flow control, for any number of concurrent links.
+ *
+ * A link is a pair of CAN IDs, one to transmit and one to receive, that carries one message in each direction
+ * at a time. Received frames are passed to isotpRXHook() (directly from canServiceRX() or through
+ * canSubscribe_wSID() / canSubscribe_wEID() with the link as context) and copied straight into the receive
+ * buffer of the link. isotpService() sends the frames and runs the timers; call it and the receive path from the
+ * same context.
+ *
+ * Each link transmits through a single buffer : the chip sends buffers of equal priority highest number first, so
+ * consecutive frames spread over several buffers could reach the bus out of order.
+*/
+#ifndef MCP2515_ISOTP
+#define MCP2515_ISOTP
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Timeout in microseconds for a flow control frame (N_Bs) and for a consecutive frame (N_Cr).
+*/
+#ifndef ISOTP_TIMEOUT_US
+#define ISOTP_TIMEOUT_US 1000000UL
+#endif
+
+/**
+ * @brief Number of flow control WAIT frames accepted in a row before the transmission is abandoned (N_WFTmax).
+*/
+#ifndef ISOTP_MAX_WAIT
+#define ISOTP_MAX_WAIT 10
+#endif
+
+/**
+ * @brief Set to 1 to pad every frame to 8 bytes with ISOTP_PAD_BYTE, to 0 to send the shortest DLC.
+*/
+#ifndef ISOTP_PADDING
+#define ISOTP_PADDING 1
+#endif
+
+#ifndef ISOTP_PAD_BYTE
+#define ISOTP_PAD_BYTE 0XCC
+#endif
+
+/**
+ * @brief Protocol control information, high nibble of the first data byte.
+*/
+#define ISOTP_SINGLE_FRAME 0X00
+#define ISOTP_FIRST_FRAME 0X10
+#define ISOTP_CONSECUTIVE_FRAME 0X20
+#define ISOTP_FLOW_CONTROL 0X30
+
+/**
+ * @brief Flow status of a flow control frame.
+*/
+#define ISOTP_FC_CTS 0
+#define ISOTP_FC_WAIT 1
+#define ISOTP_FC_OVERFLOW 2
+
+/**
+ * @brief Outcome of a transfer, passed to the completion callbacks.
+*/
+typedef enum ISOTP_RESULT{ isotp_ok=0, isotp_timeout=1, isotp_wrong_sn=2, isotp_overflow=3, isotp_unexpected=4 }ISOTP_RESULT;
+
+typedef enum ISOTP_STATE{ isotp_idle=0, isotp_tx_first=1, isotp_tx_wait_fc=2, isotp_tx_consecutive=3, isotp_rx_consecutive=4 }ISOTP_STATE;
+
+struct ISOTP_LINK;
+
+/**
+ * @brief Completion callback : the link, the outcome and the number of bytes sent or received.
+*/
+typedef void (*ISOTP_CALLBACK)(struct ISOTP_LINK *, ISOTP_RESULT, uint32_t, void *);
+
+typedef struct ISOTP_LINK
+{
+	CAN_FRAME_TYPE type;		/* can_standard or can_extended, for both IDs */
+	uint32_t tx_id;
+	uint32_t rx_id;
+	uint8_t buff;				/* transmit buffer of the link */
+	uint8_t block_size;			/* BS of our flow control frames, 0 for no limit */
+	uint8_t st_min;				/* STmin of our flow control frames, ISO 15765-2 encoding */
+
+	/* transmit side */
+	uint8_t tx_state;
+	const unsigned char *tx_data;
+	uint32_t tx_len;
+	uint32_t tx_pos;
+	uint8_t tx_sn;
+	uint8_t tx_block;			/* BS of the last flow control frame received */
+	uint8_t tx_count;			/* consecutive frames sent in the current block */
+	uint8_t tx_wait;			/* WAIT frames received in a row */
+	uint32_t tx_st_us;			/* STmin of the last flow control frame received */
+	uint32_t tx_time;			/* when the last frame was sent */
+	ISOTP_CALLBACK tx_done;
+	void *tx_ctx;
+
+	/* receive side */
+	uint8_t rx_state;
+	unsigned char *rx_buf;
+	uint32_t rx_size;
+	uint32_t rx_len;
+	uint32_t rx_pos;
+	uint8_t rx_sn;
+	uint8_t rx_count;			/* consecutive frames received in the current block */
+	uint8_t fc_pending;			/* first byte of a flow control frame waiting for the transmit buffer, 0 when none */
+	uint32_t rx_time;			/* when the last frame was received */
+	ISOTP_CALLBACK rx_done;
+	void *rx_ctx;
+}ISOTP_LINK;
+
+void isotpBegin(ISOTP_LINK *, CAN_FRAME_TYPE, uint32_t, uint32_t, uint8_t);
+
+void isotpSetFlowControl(ISOTP_LINK *, uint8_t, uint8_t);
+
+void isotpSetReceiveBuffer(ISOTP_LINK *, unsigned char *, uint32_t, ISOTP_CALLBACK, void *);
+
+uint8_t isotpSend(ISOTP_LINK *, const unsigned char *, uint32_t, ISOTP_CALLBACK, void *);
+
+void isotpRXHook(const CAN_FRAME *, void *);
+
+void isotpService(ISOTP_LINK *, uint8_t);
+
+#endif
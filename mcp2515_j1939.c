@@ -0,0 +1,841 @@
+/**
+ * @file mcp2515_j1939.c
+ * @brief SAE J1939 on top of the driver.
+*/
+
+#include "mcp2515_j1939.h"
+
+/* states of a receive session */
+#define J1939_RX_IDLE 0
+#define J1939_RX_BAM 1
+#define J1939_RX_RTS 2
+
+/* states of the transmit side */
+#define J1939_TX_IDLE 0
+#define J1939_TX_SINGLE 1
+#define J1939_TX_CM 2
+#define J1939_TX_BAM_DT 3
+#define J1939_TX_WAIT_CTS 4
+#define J1939_TX_DT 5
+#define J1939_TX_WAIT_EOMA 6
+#define J1939_TX_HOLD 7
+
+/* abort reasons */
+#define J1939_ABORT_BUSY 1
+#define J1939_ABORT_RESOURCES 2
+#define J1939_ABORT_TIMEOUT 3
+
+/* number of hardware acceptance filters */
+#define J1939_HW_FILTERS 6
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to transmit a frame from the node.
+*/
+static uint8_t j1939Transmit(J1939_NODE *_n, uint8_t _priority, uint32_t _pgn, uint8_t _da, uint8_t _sa, unsigned char _data[8], uint8_t _len)
+{
+	return canTransmit_wEID( _n->buff, j1939EncodeID( _priority, _pgn, _da, _sa ), _len, _data );
+}
+
+/**
+ * @brief Utility function to transmit a TP.CM frame.
+*/
+static uint8_t j1939SendCM(J1939_NODE *_n, uint8_t _da, uint8_t _ctrl, uint8_t _b1, uint8_t _b2, uint8_t _b3, uint8_t _b4, uint32_t _pgn)
+{
+	unsigned char _data[8] = { _ctrl, _b1, _b2, _b3, _b4, _pgn, _pgn >> 8, _pgn >> 16 };
+
+	return j1939Transmit( _n, 7, J1939_PGN_TP_CM, _da, _n->address, _data, 8 );
+}
+
+/**
+ * @brief Utility function to transmit the address claim of the node, or a cannot claim when it has no address.
+*/
+static uint8_t j1939SendClaim(J1939_NODE *_n)
+{
+	unsigned char _data[8];
+
+	for(uint8_t i=0; i<8; i++)
+		_data[i] = _n->name[i];
+
+	if( !j1939Transmit( _n, 6, J1939_PGN_ADDRESS_CLAIMED, J1939_GLOBAL_ADDRESS, _n->address, _data, 8 ) )
+		return 0;
+	_n->claim_pending = 0;
+	return 1;
+}
+
+/**
+ * @brief Utility function to transmit the pending TP.CM frame of a receive session.
+*/
+static uint8_t j1939SendCtrl(J1939_NODE *_n, J1939_RX_SESSION *_s)
+{
+	uint8_t _ok = 0;
+
+	switch( _s->ctrl_pending )
+	{
+		case J1939_TP_CTS:
+			_ok = j1939SendCM( _n, _s->peer, J1939_TP_CTS, _s->window - _s->next + 1, _s->next, 0XFF, 0XFF, _s->pgn );
+			break;
+		case J1939_TP_EOMA:
+			_ok = j1939SendCM( _n, _s->peer, J1939_TP_EOMA, _s->len, _s->len >> 8, _s->packets, 0XFF, _s->pgn );
+			break;
+		case J1939_TP_ABORT:
+			_ok = j1939SendCM( _n, _s->peer, J1939_TP_ABORT, _s->reason, 0XFF, 0XFF, 0XFF, _s->pgn );
+			break;
+	}
+
+	if( _ok )
+		_s->ctrl_pending = 0;
+	return _ok;
+}
+
+/**
+ * @brief Utility function to transmit a TP.DT packet of the message being sent.
+*/
+static uint8_t j1939SendDT(J1939_NODE *_n)
+{
+	unsigned char _data[8];
+	uint16_t _pos = (uint16_t)( _n->tx_next - 1 ) * 7;
+
+	_data[0] = _n->tx_next;
+	for(uint8_t i=0; i<7; i++)
+		_data[1 + i] = _pos + i < _n->tx_len ? _n->tx_data[_pos + i] : 0XFF;
+
+	if( !j1939Transmit( _n, 7, J1939_PGN_TP_DT, _n->tx_da, _n->address, _data, 8 ) )
+		return 0;
+	_n->tx_next++;
+	return 1;
+}
+
+/**
+ * @brief Utility function to end the transmission of the node and report it.
+*/
+static void j1939TxEnd(J1939_NODE *_n, uint8_t _ok)
+{
+	_n->tx_state = J1939_TX_IDLE;
+	if( _n->tx_done )
+		_n->tx_done( _n, _ok, _n->tx_ctx );
+}
+
+/**
+ * @brief Utility function to hand a message to the handler of its PGN.
+*/
+static void j1939Deliver(J1939_NODE *_n, const J1939_MSG *_msg)
+{
+	for(uint8_t i=0; i<_n->sub_count; i++)
+		if( _n->subs[i].pgn == _msg->pgn )
+		{
+			_n->subs[i].handler( _n, _msg, _n->subs[i].ctx );
+			return;
+		}
+
+	if( _n->default_handler )
+		_n->default_handler( _n, _msg, _n->default_ctx );
+}
+
+/**
+ * @brief Utility function to compare two NAMEs, the lower value has the higher priority.
+ *
+ * @return
+ * 1 : IF _a WINS OVER _b
+ * 0 : OTHERWISE
+*/
+static uint8_t j1939NameWins(const unsigned char _a[8], const unsigned char _b[8])
+{
+	for(int8_t i=7; i>=0; i--)
+		if( _a[i] != _b[i] )
+			return _a[i] < _b[i];
+	return 0;
+}
+
+/**
+ * @brief Utility function to handle an address claim of another node.
+*/
+static void j1939OnClaim(J1939_NODE *_n, const J1939_MSG *_msg)
+{
+	if( _msg->len < 8 || _n->address == J1939_NULL_ADDRESS || _msg->sa != _n->address )
+		return;
+
+	if( j1939NameWins( _n->name, _msg->data ) )
+	{
+		// we keep the address, tell the other node again
+		_n->claim_pending = 1;
+		j1939SendClaim( _n );
+		return;
+	}
+
+	// arbitrary address capable nodes move on through the dynamic range 128 to 247
+	if( ( _n->name[7] & 0X80 ) && _n->claim_tries < 120 )
+	{
+		_n->claim_tries++;
+		_n->address = _n->address >= 128 && _n->address < 247 ? _n->address + 1 : 128;
+		_n->claim_state = j1939_claiming;
+	}
+	else
+	{
+		_n->address = J1939_NULL_ADDRESS;
+		_n->claim_state = j1939_cannot_claim;
+	}
+
+	_n->claim_time = pal_get_time_us();
+	_n->claim_pending = 1;
+	j1939SendClaim( _n );
+
+	// the filters take 8 trips through configuration mode : left to j1939Service(), out of the receive path
+	if( _n->filters )
+		_n->filters_pending = 1;
+}
+
+/**
+ * @brief Utility function to find the receive session of a sender, or a free one.
+*/
+static J1939_RX_SESSION *j1939Session(J1939_NODE *_n, uint8_t _peer, uint8_t _da, uint8_t _alloc)
+{
+	J1939_RX_SESSION *_free = 0;
+
+	for(uint8_t i=0; i<J1939_MAX_RX_SESSIONS; i++)
+	{
+		J1939_RX_SESSION *_s = &_n->rx[i];
+		if( _s->state != J1939_RX_IDLE && _s->peer == _peer && _s->da == _da )
+			return _s;
+		if( !_free && _s->state == J1939_RX_IDLE && !_s->ctrl_pending && _s->buf )
+			_free = _s;
+	}
+
+	return _alloc ? _free : 0;
+}
+
+/**
+ * @brief Utility function to handle a TP.CM frame.
+*/
+static void j1939OnCM(J1939_NODE *_n, const J1939_MSG *_msg)
+{
+	if( _msg->len < 8 )
+		return;
+
+	const unsigned char *_d = _msg->data;
+	uint32_t _pgn = _d[5] | ( (uint32_t)_d[6] << 8 ) | ( (uint32_t)_d[7] << 16 );
+	uint16_t _len = _d[1] | ( (uint16_t)_d[2] << 8 );
+	J1939_RX_SESSION *_s;
+
+	switch( _d[0] )
+	{
+		case J1939_TP_BAM:
+		case J1939_TP_RTS:
+			if( ( _d[0] == J1939_TP_BAM ) != ( _msg->da == J1939_GLOBAL_ADDRESS ) )
+				return;
+
+			// a new announcement from the same sender replaces the message in progress
+			_s = j1939Session( _n, _msg->sa, _msg->da, 1 );
+			if( _s && _s->state != J1939_RX_IDLE )
+				_n->tp_errors++;
+
+			if( !_s || _len > _s->size || _len <= 8 || _len > J1939_MAX_LEN || _d[3] != ( _len + 6 ) / 7 )
+			{
+				if( _s )
+					_s->state = J1939_RX_IDLE;
+				if( _d[0] == J1939_TP_RTS )
+					j1939SendCM( _n, _msg->sa, J1939_TP_ABORT, J1939_ABORT_RESOURCES, 0XFF, 0XFF, 0XFF, _pgn );
+				return;
+			}
+
+			_s->peer = _msg->sa;
+			_s->da = _msg->da;
+			_s->priority = _msg->priority;
+			_s->pgn = _pgn;
+			_s->len = _len;
+			_s->packets = _d[3];
+			_s->next = 1;
+			_s->time = pal_get_time_us();
+
+			if( _d[0] == J1939_TP_BAM )
+			{
+				_s->state = J1939_RX_BAM;
+				return;
+			}
+
+			_s->state = J1939_RX_RTS;
+			_s->cts = _d[4] < J1939_CTS_PACKETS ? _d[4] : J1939_CTS_PACKETS;
+			if( _s->cts == 0 )
+				_s->cts = 1;
+			_s->window = _s->packets < _s->cts ? _s->packets : _s->cts;
+			_s->ctrl_pending = J1939_TP_CTS;
+			j1939SendCtrl( _n, _s );
+			return;
+
+		case J1939_TP_CTS:
+			if( ( _n->tx_state != J1939_TX_WAIT_CTS && _n->tx_state != J1939_TX_DT && _n->tx_state != J1939_TX_HOLD )
+				|| _msg->sa != _n->tx_da || _pgn != _n->tx_pgn )
+				return;
+			_n->tx_time = pal_get_time_us();
+			if( _d[1] == 0 )
+			{
+				// the receiver asks to hold the connection, the next CTS comes within T4
+				_n->tx_state = J1939_TX_HOLD;
+				return;
+			}
+			if( _d[2] == 0 || _d[2] > _n->tx_packets )
+				return;
+			_n->tx_next = _d[2];
+			_n->tx_window = _d[2] + _d[1] - 1 > _n->tx_packets ? _n->tx_packets : _d[2] + _d[1] - 1;
+			_n->tx_state = J1939_TX_DT;
+			return;
+
+		case J1939_TP_EOMA:
+			if( _n->tx_state == J1939_TX_WAIT_EOMA && _msg->sa == _n->tx_da && _pgn == _n->tx_pgn )
+				j1939TxEnd( _n, 1 );
+			return;
+
+		case J1939_TP_ABORT:
+			if( _n->tx_state >= J1939_TX_WAIT_CTS && _msg->sa == _n->tx_da && _pgn == _n->tx_pgn )
+				j1939TxEnd( _n, 0 );
+			_s = j1939Session( _n, _msg->sa, _msg->da, 0 );
+			if( _s && _s->state == J1939_RX_RTS )
+			{
+				_s->state = J1939_RX_IDLE;
+				_n->tp_errors++;
+			}
+			return;
+	}
+}
+
+/**
+ * @brief Utility function to handle a TP.DT frame, the data goes straight into the session buffer.
+*/
+static void j1939OnDT(J1939_NODE *_n, const J1939_MSG *_msg)
+{
+	J1939_RX_SESSION *_s = j1939Session( _n, _msg->sa, _msg->da, 0 );
+
+	if( !_s || _msg->len < 8 )
+		return;
+
+	if( _msg->data[0] != _s->next )
+	{
+		_s->state = J1939_RX_IDLE;
+		_n->tp_errors++;
+		if( _s->da != J1939_GLOBAL_ADDRESS )
+		{
+			_s->reason = J1939_ABORT_TIMEOUT;
+			_s->ctrl_pending = J1939_TP_ABORT;
+			j1939SendCtrl( _n, _s );
+		}
+		return;
+	}
+
+	uint16_t _pos = (uint16_t)( _s->next - 1 ) * 7;
+	for(uint8_t i=0; i<7 && _pos + i < _s->len; i++)
+		_s->buf[_pos + i] = _msg->data[1 + i];
+
+	_s->next++;
+	_s->time = pal_get_time_us();
+
+	if( _s->next > _s->packets )
+	{
+		J1939_MSG _full;
+
+		_s->state = J1939_RX_IDLE;
+		if( _s->da != J1939_GLOBAL_ADDRESS )
+		{
+			_s->ctrl_pending = J1939_TP_EOMA;
+			j1939SendCtrl( _n, _s );
+		}
+
+		_full.pgn = _s->pgn;
+		_full.priority = _s->priority;
+		_full.sa = _s->peer;
+		_full.da = _s->da;
+		_full.len = _s->len;
+		_full.data = _s->buf;
+		j1939Deliver( _n, &_full );
+		return;
+	}
+
+	if( _s->state == J1939_RX_RTS && _s->next > _s->window )
+	{
+		_s->window = _s->next + _s->cts - 1 > _s->packets ? _s->packets : _s->next + _s->cts - 1;
+		_s->ctrl_pending = J1939_TP_CTS;
+		j1939SendCtrl( _n, _s );
+	}
+}
+
+/**
+ * @brief Utility function to add the acceptance keys (ID bits 8 to 25) of a PGN.
+*/
+static uint8_t j1939AddKeys(uint32_t *_keys, uint8_t _count, uint32_t _pgn, uint8_t _address)
+{
+	_pgn &= 0X3FFFF;
+
+	if( ( ( _pgn >> 8 ) & 0XFF ) >= 240 )
+	{
+		_keys[_count++] = _pgn << 8;
+		return _count;
+	}
+
+	// PDU1 : addressed to the node or to everyone
+	_keys[_count++] = ( ( _pgn & 0X3FF00 ) | J1939_GLOBAL_ADDRESS ) << 8;
+	if( _address < J1939_NULL_ADDRESS )
+		_keys[_count++] = ( ( _pgn & 0X3FF00 ) | _address ) << 8;
+	return _count;
+}
+
+/**
+ * @brief Utility function to count (and optionally collect) the distinct values of the keys under a mask.
+*/
+static uint8_t j1939Distinct(const uint32_t *_keys, uint8_t _count, uint32_t _mask, uint32_t *_out)
+{
+	uint32_t _vals[2 * ( J1939_MAX_SUBS + 4 )];
+	uint8_t _n = 0;
+
+	for(uint8_t i=0; i<_count; i++)
+	{
+		uint32_t _v = _keys[i] & _mask;
+		uint8_t j = 0;
+		while( j < _n && _vals[j] != _v )
+			j++;
+		if( j == _n )
+			_vals[_n++] = _v;
+	}
+
+	if( _out )
+		for(uint8_t i=0; i<_n; i++)
+			_out[i] = _vals[i];
+	return _n;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function builds a 29 bit ID.
+ *
+ * @param
+ * 1. _priority : 0 (highest) to 7.
+ * 2. _pgn : the parameter group number.
+ * 3. _da : destination address, used by PDU1 PGNs (PF below 240) only.
+ * 4. _sa : source address.
+ *
+ * @return
+ * THE EXTENDED ID.
+ */
+uint32_t j1939EncodeID(uint8_t _priority, uint32_t _pgn, uint8_t _da, uint8_t _sa)
+{
+	uint32_t _id = ( (uint32_t)( _priority & 0X07 ) << 26 ) | ( ( _pgn & 0X3FFFF ) << 8 ) | _sa;
+
+	if( ( ( _pgn >> 8 ) & 0XFF ) < 240 )
+		_id = ( _id & ~0XFF00UL ) | ( (uint32_t)_da << 8 );
+	return _id;
+}
+
+/**
+ * @brief This function splits a 29 bit ID into priority, PGN and addresses.
+ *
+ * @param
+ * 1. _id : the extended ID.
+ * 2. _msg : receives pgn, priority, sa and da.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939DecodeID(uint32_t _id, J1939_MSG *_msg)
+{
+	_msg->priority = ( _id >> 26 ) & 0X07;
+	_msg->sa = _id;
+
+	if( ( ( _id >> 16 ) & 0XFF ) < 240 )
+	{
+		_msg->pgn = ( _id >> 8 ) & 0X3FF00;
+		_msg->da = _id >> 8;
+	}
+	else
+	{
+		_msg->pgn = ( _id >> 8 ) & 0X3FFFF;
+		_msg->da = J1939_GLOBAL_ADDRESS;
+	}
+}
+
+/**
+ * @brief This function initializes a node. It has no address until j1939Claim() is called.
+ *
+ * @param
+ * 1. _n : the node.
+ * 2. _name : the 64 bit NAME, least significant byte first. Bit 63 (arbitrary address capable) lets the node
+ *    move to another address when it loses a claim.
+ * 3. _preferred : the address to claim.
+ * 4. _buff : transmit buffer of the node.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939Begin(J1939_NODE *_n, const unsigned char _name[8], uint8_t _preferred, uint8_t _buff)
+{
+	for(uint8_t i=0; i<8; i++)
+		_n->name[i] = _name[i];
+	_n->address = J1939_NULL_ADDRESS;
+	_n->preferred = _preferred;
+	_n->buff = _buff % 3;
+	_n->claim_state = j1939_unclaimed;
+	_n->claim_pending = 0;
+	_n->claim_tries = 0;
+	_n->filters = 0;
+	_n->filters_pending = 0;
+	_n->sub_count = 0;
+	_n->default_handler = 0;
+	_n->default_ctx = 0;
+	_n->tp_errors = 0;
+	_n->tx_state = J1939_TX_IDLE;
+
+	for(uint8_t i=0; i<J1939_MAX_RX_SESSIONS; i++)
+	{
+		_n->rx[i].state = J1939_RX_IDLE;
+		_n->rx[i].ctrl_pending = 0;
+		_n->rx[i].buf = 0;
+		_n->rx[i].size = 0;
+	}
+}
+
+/**
+ * @brief This function gives the receive sessions their buffers. Without buffers multi packet messages are refused.
+ *
+ * @param
+ * 1. _n : the node.
+ * 2. _pool : J1939_MAX_RX_SESSIONS * _size bytes.
+ * 3. _size : buffer size of each session, up to J1939_MAX_LEN.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939SetReceiveBuffers(J1939_NODE *_n, unsigned char *_pool, uint16_t _size)
+{
+	for(uint8_t i=0; i<J1939_MAX_RX_SESSIONS; i++)
+	{
+		_n->rx[i].buf = _pool ? _pool + (uint32_t)i * _size : 0;
+		_n->rx[i].size = _pool ? _size : 0;
+	}
+}
+
+/**
+ * @brief This function subscribes a handler to a PGN. Single frame and multi packet messages of the PGN
+ * addressed to the node or to everyone reach the handler.
+ *
+ * @param
+ * 1. _n : the node.
+ * 2. _pgn : the parameter group number, with PS 0 for PDU1 PGNs.
+ * 3. _handler : the handler.
+ * 4. _ctx : passed as it is to the handler.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : J1939_MAX_SUBS subscriptions already
+ */
+uint8_t j1939Subscribe(J1939_NODE *_n, uint32_t _pgn, J1939_HANDLER _handler, void *_ctx)
+{
+	if( _n->sub_count >= J1939_MAX_SUBS || !_handler )
+		return 0;
+
+	_n->subs[_n->sub_count].pgn = _pgn & 0X3FFFF;
+	_n->subs[_n->sub_count].handler = _handler;
+	_n->subs[_n->sub_count].ctx = _ctx;
+	_n->sub_count++;
+	return 1;
+}
+
+/**
+ * @brief This function sets the handler of the messages with no subscription. With a default handler
+ * j1939ApplyFilters() accepts every frame.
+ *
+ * @param
+ * 1. _n : the node.
+ * 2. _handler : the handler, NULL to drop such messages.
+ * 3. _ctx : passed as it is to the handler.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939SetDefaultHandler(J1939_NODE *_n, J1939_HANDLER _handler, void *_ctx)
+{
+	_n->default_handler = _handler;
+	_n->default_ctx = _ctx;
+}
+
+/**
+ * @brief This function programs both masks and the six filters so that only the subscribed PGNs, address claim,
+ * request and transport frames reach the receive buffers. Priority and source address are not filtered; PDU1
+ * PGNs are accepted for the node's address and the global address. When the PGNs do not fit six filters, mask bits
+ * are given up one at a time, each time the one that merges the most PGNs, so a few unwanted PGNs may pass and
+ * are dropped in software. The filters follow later address changes of the node : j1939Claim() and a lost claim
+ * only mark them pending, the next j1939Service() programs them.
+ *
+ * @param
+ * 1. _n : the node.
+ *
+ * @return
+ * NOTHING
+ *
+ * @note
+ * The chip goes through configuration mode and is left in normal mode, frames arriving meanwhile are lost.
+ */
+void j1939ApplyFilters(J1939_NODE *_n)
+{
+	uint32_t _keys[2 * ( J1939_MAX_SUBS + 4 )];
+	uint32_t _vals[2 * ( J1939_MAX_SUBS + 4 )];
+	uint8_t _count = 0;
+	uint32_t _mask = 0X03FFFF00;
+
+	_n->filters = 1;
+	_n->filters_pending = 0;
+
+	if( _n->default_handler )
+	{
+		canDisableFilterRX(0);
+		canDisableFilterRX(1);
+		return;
+	}
+
+	_count = j1939AddKeys( _keys, _count, J1939_PGN_ADDRESS_CLAIMED, _n->address );
+	_count = j1939AddKeys( _keys, _count, J1939_PGN_REQUEST, _n->address );
+	_count = j1939AddKeys( _keys, _count, J1939_PGN_TP_CM, _n->address );
+	_count = j1939AddKeys( _keys, _count, J1939_PGN_TP_DT, _n->address );
+	for(uint8_t i=0; i<_n->sub_count; i++)
+		_count = j1939AddKeys( _keys, _count, _n->subs[i].pgn, _n->address );
+
+	while( j1939Distinct( _keys, _count, _mask, 0 ) > J1939_HW_FILTERS )
+	{
+		uint32_t _best = 0;
+		uint8_t _best_n = 0XFF;
+
+		for(uint8_t b=8; b<26; b++)
+		{
+			uint32_t _bit = 1UL << b;
+			if( !( _mask & _bit ) )
+				continue;
+			uint8_t _d = j1939Distinct( _keys, _count, _mask & ~_bit, 0 );
+			if( _d < _best_n )
+			{
+				_best_n = _d;
+				_best = _bit;
+			}
+		}
+		_mask &= ~_best;
+	}
+
+	uint8_t _n_vals = j1939Distinct( _keys, _count, _mask, _vals );
+
+	canSetMaskRX(0, _mask);
+	canSetMaskRX(1, _mask);
+	for(uint8_t i=0; i<J1939_HW_FILTERS; i++)
+		canSetFilterRX( i, can_extended, _vals[ i < _n_vals ? i : _n_vals - 1 ] );
+	canEnableFilterRX(0);
+	canEnableFilterRX(1);
+}
+
+/**
+ * @brief This function claims the preferred address. The node may send once the claim stood J1939_CLAIM_US.
+ *
+ * @param
+ * 1. _n : the node.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939Claim(J1939_NODE *_n)
+{
+	_n->address = _n->preferred;
+	_n->claim_state = j1939_claiming;
+	_n->claim_tries = 0;
+	_n->claim_time = pal_get_time_us();
+	_n->claim_pending = 1;
+	j1939SendClaim( _n );
+
+	if( _n->filters )
+		_n->filters_pending = 1;
+}
+
+/**
+ * @brief This function starts sending a message : a single frame up to 8 bytes, a BAM transfer to the global
+ * address or an RTS/CTS transfer to a node above. The data is not copied and must stay valid until the callback.
+ *
+ * @param
+ * 1. _n : the node.
+ * 2. _priority : 0 (highest) to 7.
+ * 3. _pgn : the parameter group number.
+ * 4. _da : destination address, J1939_GLOBAL_ADDRESS for everyone.
+ * 5. _data : the message.
+ * 6. _len : 0 to J1939_MAX_LEN bytes.
+ * 7. _done : called when the transfer ends, may be NULL.
+ * 8. _ctx : passed as it is to the callback.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : no address claimed yet, a message is already being sent or the length is too large
+ */
+uint8_t j1939Send(J1939_NODE *_n, uint8_t _priority, uint32_t _pgn, uint8_t _da, const unsigned char *_data, uint16_t _len, J1939_DONE _done, void *_ctx)
+{
+	if( _n->claim_state != j1939_claimed || _n->tx_state != J1939_TX_IDLE || _len > J1939_MAX_LEN )
+		return 0;
+
+	_n->tx_priority = _priority;
+	_n->tx_pgn = _pgn & 0X3FFFF;
+	_n->tx_da = _da;
+	_n->tx_data = _data;
+	_n->tx_len = _len;
+	_n->tx_packets = ( _len + 6 ) / 7;
+	_n->tx_done = _done;
+	_n->tx_ctx = _ctx;
+	_n->tx_state = _len <= 8 ? J1939_TX_SINGLE : J1939_TX_CM;
+	return 1;
+}
+
+/**
+ * @brief Receive hook for canServiceRX() or a dispatch subscription, the context is the J1939_NODE.
+ *
+ * @param
+ * 1. _frame : the received frame.
+ * 2. _ctx : the node.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939RXHook(const CAN_FRAME *_frame, void *_ctx)
+{
+	J1939_NODE *_n = (J1939_NODE *)_ctx;
+	J1939_MSG _msg;
+
+	if( _frame->type != can_extended || _frame->isRemote )
+		return;
+
+	j1939DecodeID( _frame->ID, &_msg );
+	if( _msg.da != J1939_GLOBAL_ADDRESS && ( _msg.da != _n->address || _n->address == J1939_NULL_ADDRESS ) )
+		return;
+	_msg.len = _frame->DLC;
+	_msg.data = _frame->DATA;
+
+	switch( _msg.pgn )
+	{
+		case J1939_PGN_TP_CM:
+			j1939OnCM( _n, &_msg );
+			return;
+
+		case J1939_PGN_TP_DT:
+			j1939OnDT( _n, &_msg );
+			return;
+
+		case J1939_PGN_ADDRESS_CLAIMED:
+			j1939OnClaim( _n, &_msg );
+			break;
+
+		case J1939_PGN_REQUEST:
+			if( _msg.len >= 3 && _msg.data[0] == ( J1939_PGN_ADDRESS_CLAIMED & 0XFF ) && _msg.data[1] == ( J1939_PGN_ADDRESS_CLAIMED >> 8 )
+				&& _msg.data[2] == 0 && _n->claim_state != j1939_unclaimed )
+			{
+				_n->claim_pending = 1;
+				j1939SendClaim( _n );
+			}
+			break;
+	}
+
+	j1939Deliver( _n, &_msg );
+}
+
+/**
+ * @brief This function sends the pending frames of the node, at most one per call, and runs the address claim
+ * and transport timers. After an address change it programs the filters again. Call it at least every few
+ * milliseconds.
+ *
+ * @param
+ * 1. _n : the node.
+ *
+ * @return
+ * NOTHING
+ */
+void j1939Service(J1939_NODE *_n)
+{
+	uint32_t _now = pal_get_time_us();
+	uint8_t _free = 1;
+
+	if( _n->claim_state == j1939_claiming && _now - _n->claim_time >= J1939_CLAIM_US )
+		_n->claim_state = j1939_claimed;
+
+	if( _n->filters_pending )
+		j1939ApplyFilters( _n );
+
+	if( _n->claim_pending )
+		_free = !j1939SendClaim( _n );
+
+	for(uint8_t i=0; i<J1939_MAX_RX_SESSIONS; i++)
+	{
+		J1939_RX_SESSION *_s = &_n->rx[i];
+
+		if( ( _s->state == J1939_RX_BAM && _now - _s->time > J1939_T1_US ) || ( _s->state == J1939_RX_RTS && _now - _s->time > J1939_T2_US ) )
+		{
+			if( _s->state == J1939_RX_RTS )
+			{
+				_s->reason = J1939_ABORT_TIMEOUT;
+				_s->ctrl_pending = J1939_TP_ABORT;
+			}
+			_s->state = J1939_RX_IDLE;
+			_n->tp_errors++;
+		}
+
+		if( _free && _s->ctrl_pending )
+			_free = !j1939SendCtrl( _n, _s );
+	}
+
+	if( !_free || _n->claim_state != j1939_claimed )
+		return;
+
+	switch( _n->tx_state )
+	{
+		case J1939_TX_SINGLE:
+		{
+			unsigned char _data[8];
+			for(uint8_t i=0; i<_n->tx_len; i++)
+				_data[i] = _n->tx_data[i];
+			if( j1939Transmit( _n, _n->tx_priority, _n->tx_pgn, _n->tx_da, _n->address, _data, _n->tx_len ) )
+				j1939TxEnd( _n, 1 );
+			break;
+		}
+
+		case J1939_TX_CM:
+			if( _n->tx_da == J1939_GLOBAL_ADDRESS )
+			{
+				if( !j1939SendCM( _n, J1939_GLOBAL_ADDRESS, J1939_TP_BAM, _n->tx_len, _n->tx_len >> 8, _n->tx_packets, 0XFF, _n->tx_pgn ) )
+					break;
+				_n->tx_state = J1939_TX_BAM_DT;
+			}
+			else
+			{
+				if( !j1939SendCM( _n, _n->tx_da, J1939_TP_RTS, _n->tx_len, _n->tx_len >> 8, _n->tx_packets, 0XFF, _n->tx_pgn ) )
+					break;
+				_n->tx_state = J1939_TX_WAIT_CTS;
+			}
+			_n->tx_next = 1;
+			_n->tx_time = _now;
+			break;
+
+		case J1939_TX_BAM_DT:
+			if( _now - _n->tx_time < J1939_BAM_INTERVAL_US || !j1939SendDT( _n ) )
+				break;
+			_n->tx_time = _now;
+			if( _n->tx_next > _n->tx_packets )
+				j1939TxEnd( _n, 1 );
+			break;
+
+		case J1939_TX_WAIT_CTS:
+		case J1939_TX_WAIT_EOMA:
+		case J1939_TX_HOLD:
+			if( _now - _n->tx_time > ( _n->tx_state == J1939_TX_HOLD ? J1939_T4_US : J1939_T3_US ) )
+			{
+				j1939SendCM( _n, _n->tx_da, J1939_TP_ABORT, J1939_ABORT_TIMEOUT, 0XFF, 0XFF, 0XFF, _n->tx_pgn );
+				j1939TxEnd( _n, 0 );
+			}
+			break;
+
+		case J1939_TX_DT:
+			if( !j1939SendDT( _n ) )
+				break;
+			_n->tx_time = _now;
+			if( _n->tx_next > _n->tx_window )
+				_n->tx_state = _n->tx_next > _n->tx_packets ? J1939_TX_WAIT_EOMA : J1939_TX_WAIT_CTS;
+			break;
+	}
+}
@@ -0,0 +1,205 @@
+/**
+ * @file mcp2515_j1939.h
+ * @brief SAE J1939 on top of the driver : 29 bit ID encoding, BAM and RTS/CTS multi packet transport (J1939-21),
+ * address claim (J1939-81), and acceptance masks and filters computed from the subscribed PGNs.
+ *
+ * A node is one J1939 controller application with its NAME and source address. Received frames are passed to
+ * j1939RXHook() with the node as context; j1939Service() sends the pending frames and runs the timers. Call both
+ * from the same context. Multi packet messages are reassembled straight into caller supplied buffers and handed
+ * to the handlers without another copy; single frame messages are handed over in the received CAN_FRAME.
+*/
+#ifndef MCP2515_J1939
+#define MCP2515_J1939
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Maximum number of PGN subscriptions of a node.
+*/
+#ifndef J1939_MAX_SUBS
+#define J1939_MAX_SUBS 16
+#endif
+
+/**
+ * @brief Number of multi packet messages a node may receive at the same time.
+*/
+#ifndef J1939_MAX_RX_SESSIONS
+#define J1939_MAX_RX_SESSIONS 2
+#endif
+
+/**
+ * @brief Number of packets requested by each CTS frame.
+*/
+#ifndef J1939_CTS_PACKETS
+#define J1939_CTS_PACKETS 16
+#endif
+
+/**
+ * @brief Interval between the data packets of a BAM transfer, 50 to 200 ms.
+*/
+#ifndef J1939_BAM_INTERVAL_US
+#define J1939_BAM_INTERVAL_US 50000UL
+#endif
+
+/**
+ * @brief Transport timeouts of J1939-21 : T1 between data packets, T2 after a CTS, T3 for a CTS or end of
+ * message acknowledgment, T4 for the next CTS after a CTS that holds the connection.
+*/
+#ifndef J1939_T1_US
+#define J1939_T1_US 750000UL
+#endif
+
+#ifndef J1939_T2_US
+#define J1939_T2_US 1250000UL
+#endif
+
+#ifndef J1939_T3_US
+#define J1939_T3_US 1250000UL
+#endif
+
+#ifndef J1939_T4_US
+#define J1939_T4_US 1050000UL
+#endif
+
+/**
+ * @brief Time an address claim must stand unchallenged before the address is used.
+*/
+#define J1939_CLAIM_US 250000UL
+
+/**
+ * @brief Largest message carried by the transport protocol.
+*/
+#define J1939_MAX_LEN 1785
+
+/**
+ * @brief Special addresses and PGNs.
+*/
+#define J1939_NULL_ADDRESS 0XFE
+#define J1939_GLOBAL_ADDRESS 0XFF
+
+#define J1939_PGN_REQUEST 0XEA00UL
+#define J1939_PGN_ADDRESS_CLAIMED 0XEE00UL
+#define J1939_PGN_TP_CM 0XEC00UL
+#define J1939_PGN_TP_DT 0XEB00UL
+
+/**
+ * @brief Control bytes of TP.CM.
+*/
+#define J1939_TP_RTS 16
+#define J1939_TP_CTS 17
+#define J1939_TP_EOMA 19
+#define J1939_TP_BAM 32
+#define J1939_TP_ABORT 255
+
+/**
+ * @brief Address claim state of a node.
+*/
+typedef enum J1939_CLAIM_STATE{ j1939_unclaimed=0, j1939_claiming=1, j1939_claimed=2, j1939_cannot_claim=3 }J1939_CLAIM_STATE;
+
+/**
+ * @brief A received message. For PDU2 PGNs the destination is J1939_GLOBAL_ADDRESS.
+*/
+typedef struct J1939_MSG
+{
+	uint32_t pgn;
+	uint8_t priority;
+	uint8_t sa;
+	uint8_t da;
+	uint16_t len;
+	const unsigned char *data;
+}J1939_MSG;
+
+struct J1939_NODE;
+
+typedef void (*J1939_HANDLER)(struct J1939_NODE *, const J1939_MSG *, void *);
+
+/**
+ * @brief Completion of a transmission : the node, 1 when sent (and acknowledged for RTS/CTS) or 0 when aborted.
+*/
+typedef void (*J1939_DONE)(struct J1939_NODE *, uint8_t, void *);
+
+typedef struct J1939_SUB
+{
+	uint32_t pgn;
+	J1939_HANDLER handler;
+	void *ctx;
+}J1939_SUB;
+
+typedef struct J1939_RX_SESSION
+{
+	uint8_t state;
+	uint8_t peer;			/* source address of the sender */
+	uint8_t da;				/* J1939_GLOBAL_ADDRESS for BAM */
+	uint8_t priority;
+	uint32_t pgn;
+	uint16_t len;
+	uint8_t packets;		/* total number of data packets */
+	uint8_t next;			/* next sequence number expected */
+	uint8_t window;			/* last sequence number of the current CTS */
+	uint8_t cts;			/* packets per CTS */
+	uint8_t reason;			/* abort reason when ctrl_pending is J1939_TP_ABORT */
+	uint8_t ctrl_pending;	/* TP.CM control byte waiting for the transmit buffer, 0 when none */
+	uint32_t time;
+	unsigned char *buf;
+	uint16_t size;
+}J1939_RX_SESSION;
+
+typedef struct J1939_NODE
+{
+	unsigned char name[8];		/* NAME in bus order, least significant byte first */
+	uint8_t address;			/* current source address, J1939_NULL_ADDRESS when none */
+	uint8_t preferred;
+	uint8_t buff;				/* transmit buffer of the node */
+	uint8_t claim_state;
+	uint8_t claim_pending;
+	uint8_t claim_tries;		/* addresses tried by an arbitrary address capable node */
+	uint8_t filters;			/* 1 once j1939ApplyFilters() was called, the filters follow the address */
+	uint8_t filters_pending;	/* the address changed, j1939Service() programs the filters again */
+	uint32_t claim_time;
+
+	J1939_SUB subs[J1939_MAX_SUBS];
+	uint8_t sub_count;
+	J1939_HANDLER default_handler;
+	void *default_ctx;
+
+	J1939_RX_SESSION rx[J1939_MAX_RX_SESSIONS];
+	uint32_t tp_errors;			/* multi packet messages received incompletely */
+
+	/* transmit side, one message at a time */
+	uint8_t tx_state;
+	uint8_t tx_priority;
+	uint8_t tx_da;
+	uint32_t tx_pgn;
+	const unsigned char *tx_data;
+	uint16_t tx_len;
+	uint8_t tx_packets;
+	uint8_t tx_next;			/* next sequence number to send */
+	uint8_t tx_window;			/* last sequence number the peer asked for */
+	uint32_t tx_time;
+	J1939_DONE tx_done;
+	void *tx_ctx;
+}J1939_NODE;
+
+uint32_t j1939EncodeID(uint8_t, uint32_t, uint8_t, uint8_t);
+
+void j1939DecodeID(uint32_t, J1939_MSG *);
+
+void j1939Begin(J1939_NODE *, const unsigned char [8], uint8_t, uint8_t);
+
+void j1939SetReceiveBuffers(J1939_NODE *, unsigned char *, uint16_t);
+
+uint8_t j1939Subscribe(J1939_NODE *, uint32_t, J1939_HANDLER, void *);
+
+void j1939SetDefaultHandler(J1939_NODE *, J1939_HANDLER, void *);
+
+void j1939ApplyFilters(J1939_NODE *);
+
+void j1939Claim(J1939_NODE *);
+
+uint8_t j1939Send(J1939_NODE *, uint8_t, uint32_t, uint8_t, const unsigned char *, uint16_t, J1939_DONE, void *);
+
+void j1939RXHook(const CAN_FRAME *, void *);
+
+void j1939Service(J1939_NODE *);
+
+#endif
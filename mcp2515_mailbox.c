@@ -0,0 +1,210 @@
+/**
+ * @file mcp2515_mailbox.c
+ * @brief Latest value cache of received frames, keyed by CAN ID.
+*/
+
+#include "mcp2515_mailbox.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to build the hash table key of an ID.
+*/
+static uint32_t mbKey(CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	return ( _id & 0X1FFFFFFF ) | MB_KEY_USED | ( _type == can_extended ? MB_KEY_EXT : 0 );
+}
+
+/**
+ * @brief Utility function to get the first probe position of a key (multiplicative hashing).
+*/
+static uint32_t mbHash(const CAN_MAILBOX *_mb, uint32_t _key)
+{
+	return ( _key * 2654435761UL ) & ( _mb->hash_size - 1 );
+}
+
+/**
+ * @brief Utility function to find the slot of an ID, or NULL.
+*/
+static MB_SLOT *mbFind(const CAN_MAILBOX *_mb, CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	if( _type != can_extended && _mb->std )
+		return &_mb->std[ _id & ( MB_STD_SLOTS - 1 ) ];
+
+	if( !_mb->hash )
+		return 0;
+
+	uint32_t _key = mbKey( _type, _id );
+	uint32_t _pos = mbHash( _mb, _key );
+
+	for(uint32_t i=0; i<_mb->hash_size; i++)
+	{
+		uint32_t _k = _mb->hash[_pos].key;
+		if( _k == _key )
+			return &_mb->hash[_pos];
+		if( _k == 0 )
+			return 0;
+		_pos = ( _pos + 1 ) & ( _mb->hash_size - 1 );
+	}
+
+	return 0;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a mailbox table. The storage is supplied by the caller.
+ *
+ * @param
+ * 1. _mb : the mailbox table.
+ * 2. _std : MB_STD_SLOTS slots for standard IDs, or NULL to keep standard IDs in the hash table.
+ * 3. _hash : slots of the hash table, or NULL.
+ * 4. _hash_size : number of hash table slots, rounded down to a power of two.
+ *
+ * @return
+ * NOTHING
+ */
+void mbBegin(CAN_MAILBOX *_mb, MB_SLOT *_std, MB_SLOT *_hash, uint32_t _hash_size)
+{
+	uint32_t _size = 1;
+	while( _size * 2 <= _hash_size && _size * 2 != 0 )
+		_size *= 2;
+
+	_mb->std = _std;
+	_mb->hash = _hash_size ? _hash : 0;
+	_mb->hash_size = _mb->hash ? _size : 0;
+	_mb->hash_used = 0;
+	_mb->dropped = 0;
+
+	if( _std )
+		for(uint32_t i=0; i<MB_STD_SLOTS; i++)
+		{
+			_std[i].seq = 0;
+			_std[i].key = 0;
+		}
+
+	for(uint32_t i=0; i<_mb->hash_size; i++)
+	{
+		_hash[i].seq = 0;
+		_hash[i].key = 0;
+	}
+}
+
+/**
+ * @brief This function stores a frame in the slot of its ID. Only one context may call it.
+ *
+ * @param
+ * 1. _mb : the mailbox table.
+ * 2. _frame : the received frame.
+ * 3. _ts : time stamp of the frame.
+ *
+ * @return
+ * 1 : IF THE FRAME WAS STORED
+ * 0 : IF THE ID IS NEW AND THE HASH TABLE IS FULL (OR ABSENT)
+ */
+uint8_t mbUpdate(CAN_MAILBOX *_mb, const CAN_FRAME *_frame, uint32_t _ts)
+{
+	MB_SLOT *_slot = mbFind( _mb, _frame->type, _frame->ID );
+
+	if( !_slot )
+	{
+		// new ID : claim the first empty slot of its probe sequence, keep one slot free to end the probes
+		if( !_mb->hash || _mb->hash_used + 1 >= _mb->hash_size )
+		{
+			_mb->dropped++;
+			return 0;
+		}
+
+		uint32_t _key = mbKey( _frame->type, _frame->ID );
+		uint32_t _pos = mbHash( _mb, _key );
+		while( _mb->hash[_pos].key )
+			_pos = ( _pos + 1 ) & ( _mb->hash_size - 1 );
+
+		_slot = &_mb->hash[_pos];
+		_slot->key = _key;
+		_mb->hash_used++;
+	}
+
+	uint32_t _seq = _slot->seq;
+
+	_slot->seq = _seq + 1;
+	MB_BARRIER();
+
+	_slot->ts = _ts;
+	_slot->dlc = _frame->DLC;
+	_slot->remote = _frame->isRemote;
+	for(uint8_t i=0; i<8; i++)
+		_slot->data[i] = _frame->DATA[i];
+
+	MB_BARRIER();
+	_slot->seq = _seq + 2;
+
+	return 1;
+}
+
+/**
+ * @brief Receive hook for canServiceRX(), the context is the CAN_MAILBOX. The frame is stamped with pal_get_time_us().
+ *
+ * @param
+ * 1. _frame : the received frame.
+ * 2. _ctx : the mailbox table.
+ *
+ * @return
+ * NOTHING
+ */
+void mbRXHook(const CAN_FRAME *_frame, void *_ctx)
+{
+	mbUpdate( (CAN_MAILBOX *)_ctx, _frame, pal_get_time_us() );
+}
+
+/**
+ * @brief This function reads the latest frame of an ID. The copy is consistent even if the receive path
+ * overwrites the slot meanwhile.
+ *
+ * @param
+ * 1. _mb : the mailbox table.
+ * 2. _type : can_standard or can_extended.
+ * 3. _id : the identifier.
+ * 4. _out : the latest frame.
+ * 5. _ts : time stamp of the latest frame, may be NULL.
+ *
+ * @return
+ * THE NUMBER OF FRAMES RECEIVED FOR THE ID SO FAR (0 WHEN NONE, _out IS THEN UNCHANGED). Comparing it with the
+ * value of a previous call tells whether there is a new frame and how many were collapsed.
+ */
+uint32_t mbRead(const CAN_MAILBOX *_mb, CAN_FRAME_TYPE _type, uint32_t _id, CAN_FRAME *_out, uint32_t *_ts)
+{
+	MB_SLOT *_slot = mbFind( _mb, _type, _id );
+	uint32_t _seq;
+
+	if( !_slot )
+		return 0;
+
+	// an odd count is a write in progress : wait for it, then copy again if another write came in meanwhile
+	for(;;)
+	{
+		_seq = _slot->seq;
+		if( _seq == 0 )
+			return 0;
+		if( _seq & 1 )
+			continue;
+		MB_BARRIER();
+
+		_out->DLC = _slot->dlc;
+		_out->isRemote = _slot->remote;
+		for(uint8_t i=0; i<8; i++)
+			_out->DATA[i] = _slot->data[i];
+		if( _ts )
+			*_ts = _slot->ts;
+
+		MB_BARRIER();
+		if( _slot->seq == _seq )
+			break;
+	}
+
+	_out->type = _type == can_extended ? can_extended : can_standard;
+	_out->ID = _id;
+
+	return _seq / 2;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file mcp2515_mailbox.h
+ * @brief Latest value cache of received frames, keyed by CAN ID. Every received frame overwrites the slot of its
+ * ID in place, so a burst never takes more memory than one slot per ID.
+ *
+ * Standard IDs are looked up in a direct indexed table of 2048 slots (optional), extended IDs (and standard IDs
+ * when there is no direct table) in an open addressing hash table with linear probing. Slots are never freed.
+ *
+ * Each slot is protected by a sequence lock : the writer makes the sequence odd while it updates the slot and
+ * even again afterwards, readers retry when the sequence was odd or changed while they copied the slot. There is
+ * one writer, the receive path; readers never block it.
+*/
+#ifndef MCP2515_MAILBOX
+#define MCP2515_MAILBOX
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Number of slots of the direct indexed table for standard IDs.
+*/
+#define MB_STD_SLOTS 2048
+
+/**
+ * @brief Memory barrier used by the sequence lock. On a single core with the writer in an interrupt a compiler
+ * barrier would do; the default also orders the accesses between cores.
+*/
+#ifndef MB_BARRIER
+#if defined(__GNUC__)
+#define MB_BARRIER() __sync_synchronize()
+#else
+#define MB_BARRIER()
+#endif
+#endif
+
+typedef struct MB_SLOT
+{
+	volatile uint32_t seq;		/* even when stable, 0 when never written */
+	volatile uint32_t key;		/* hash table only : ID | MB_KEY_USED, extended flag in MB_KEY_EXT */
+	uint32_t ts;				/* pal_get_time_us() when the frame was stored */
+	uint8_t dlc;
+	uint8_t remote;
+	unsigned char data[8];
+}MB_SLOT;
+
+#define MB_KEY_USED 0X80000000UL
+#define MB_KEY_EXT 0X40000000UL
+
+typedef struct CAN_MAILBOX
+{
+	MB_SLOT *std;			/* MB_STD_SLOTS slots or NULL */
+	MB_SLOT *hash;			/* hash_size slots or NULL */
+	uint32_t hash_size;		/* power of two */
+	uint32_t hash_used;
+	uint32_t dropped;		/* frames of new IDs that found the hash table full */
+}CAN_MAILBOX;
+
+void mbBegin(CAN_MAILBOX *, MB_SLOT *, MB_SLOT *, uint32_t);
+
+uint8_t mbUpdate(CAN_MAILBOX *, const CAN_FRAME *, uint32_t);
+
+void mbRXHook(const CAN_FRAME *, void *);
+
+uint32_t mbRead(const CAN_MAILBOX *, CAN_FRAME_TYPE, uint32_t, CAN_FRAME *, uint32_t *);
+
+#endif
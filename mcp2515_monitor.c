@@ -0,0 +1,159 @@
+/**
+ * @file mcp2515_monitor.c
+ * @brief Passive bus monitor in listen only mode.
+*/
+
+#include "mcp2515_monitor.h"
+
+/**
+ * @brief This function starts the monitor : listen only mode, every frame accepted by receive buffer 0 with rollover
+ * into buffer 1, interrupts on received frames, errors and error frames. The chip neither acknowledges nor sends
+ * anything in listen only mode, so the monitor is invisible to the bus.
+ *
+ * @param
+ * 1. _mon : the monitor.
+ * 2. _ring : storage for the frames.
+ * 3. _size : capacity of the ring in frames, at least 2.
+ *
+ * @return
+ * NOTHING
+ */
+void monBegin(CAN_MONITOR *_mon, MON_FRAME *_ring, uint16_t _size)
+{
+	_mon->ring = _ring;
+	_mon->size = _size;
+	_mon->head = 0;
+	_mon->tail = 0;
+	_mon->stats.frames = 0;
+	_mon->stats.interrupts = 0;
+	_mon->stats.both_full = 0;
+	_mon->stats.overruns = 0;
+	_mon->stats.error_frames = 0;
+	_mon->stats.dropped = 0;
+
+	canStateLock();
+	_mon->mode = canGetMode();
+	_mon->caninte = canReadRegister( CANINTE );
+	_mon->rxb0ctrl = canReadRegister( RXB0CTRL );
+	_mon->rxb1ctrl = canReadRegister( RXB1CTRL );
+
+	canWriteRegister( RXB0CTRL, (3<<RXM0) | (1<<BUKT) );
+	canWriteRegister( RXB1CTRL, (3<<RXM0) );
+	canWriteRegister( CANINTE, (1<<RX0IE) | (1<<RX1IE) | (1<<ERRIE) | (1<<MERRE) );
+	canBitModify( EFLG, (1<<RX0OVR) | (1<<RX1OVR), 0X00 );
+	canClearInterruptFlags( (1<<RX0IF) | (1<<RX1IF) | (1<<ERRIF) | (1<<MERRF) );
+	canRequestMode(mcp_listen_only_mode);
+	canStateUnlock();
+}
+
+/**
+ * @brief This function services the interrupt of the chip : one READ of CANINTF, then one READ RX BUFFER for each
+ * full buffer, buffer 0 first as it holds the older frame under rollover. EFLG is read and cleared only when ERRIF is
+ * set. Call it from the interrupt handler, or whenever the INT line is low.
+ *
+ * @param
+ * 1. _mon : the monitor.
+ *
+ * @return
+ * THE NUMBER OF FRAMES READ (0, 1 OR 2).
+ */
+uint8_t monService(CAN_MONITOR *_mon)
+{
+	uint8_t _n = 0;
+	uint8_t _intf = canReadRegister( CANINTF );
+
+	if( !( _intf & ( (1<<RX0IF) | (1<<RX1IF) | (1<<ERRIF) | (1<<MERRF) ) ) )
+		return 0;
+
+	uint32_t _ts = pal_get_time_us();
+	_mon->stats.interrupts++;
+
+	if( ( _intf & (1<<RX0IF) ) && ( _intf & (1<<RX1IF) ) )
+		_mon->stats.both_full++;
+
+	for(uint8_t _buff=0; _buff<2; _buff++)
+	{
+		if( !( _intf & ( _buff ? (1<<RX1IF) : (1<<RX0IF) ) ) )
+			continue;
+
+		uint16_t _next = ( _mon->head + 1 ) % _mon->size;
+		MON_FRAME *_f = &_mon->ring[_mon->head];
+		uint8_t _raw[13];
+
+		// the buffer is read and released even when the ring is full
+		canReadRawRX( _buff, _next == _mon->tail ? _raw : _f->raw );
+		_n++;
+
+		if( _next == _mon->tail )
+		{
+			_mon->stats.dropped++;
+			continue;
+		}
+		_f->ts = _ts;
+		_mon->head = _next;
+		_mon->stats.frames++;
+	}
+
+	if( _intf & (1<<ERRIF) )
+	{
+		uint8_t _eflg = canReadRegister( EFLG );
+		_mon->stats.overruns += ( ( _eflg & (1<<RX0OVR) ) ? 1 : 0 ) + ( ( _eflg & (1<<RX1OVR) ) ? 1 : 0 );
+		canBitModify( EFLG, (1<<RX0OVR) | (1<<RX1OVR), 0X00 );
+	}
+
+	if( _intf & (1<<MERRF) )
+		_mon->stats.error_frames++;
+
+	if( _intf & ( (1<<ERRIF) | (1<<MERRF) ) )
+		canClearInterruptFlags( _intf & ( (1<<ERRIF) | (1<<MERRF) ) );
+
+	return _n;
+}
+
+/**
+ * @brief This function takes the oldest frame out of the ring and decodes it.
+ *
+ * @param
+ * 1. _mon : the monitor.
+ * 2. _out : receives the frame.
+ * 3. _ts : receives the time stamp, NULL if not needed.
+ *
+ * @return
+ * 1 : IF A FRAME WAS TAKEN
+ * 0 : IF THE RING IS EMPTY
+ */
+uint8_t monRead(CAN_MONITOR *_mon, CAN_FRAME *_out, uint32_t *_ts)
+{
+	if( _mon->tail == _mon->head )
+		return 0;
+
+	const MON_FRAME *_f = &_mon->ring[_mon->tail];
+
+	canDecodeRaw( _f->raw, _out );
+
+	if( _ts )
+		*_ts = _f->ts;
+
+	_mon->tail = ( _mon->tail + 1 ) % _mon->size;
+	return 1;
+}
+
+/**
+ * @brief This function stops the monitor and puts back the mode, CANINTE and RXBnCTRL the chip had before
+ * monBegin(). The frames still in the ring can be read afterwards.
+ *
+ * @param
+ * 1. _mon : the monitor.
+ *
+ * @return
+ * NOTHING
+ */
+void monEnd(CAN_MONITOR *_mon)
+{
+	canStateLock();
+	canWriteRegister( CANINTE, _mon->caninte );
+	canWriteRegister( RXB0CTRL, _mon->rxb0ctrl );
+	canWriteRegister( RXB1CTRL, _mon->rxb1ctrl );
+	canRequestMode( (MCP_CAN_MODE)_mon->mode );
+	canStateUnlock();
+}
@@ -0,0 +1,61 @@
+/**
+ * @file mcp2515_monitor.h
+ * @brief Passive bus monitor. monBegin() puts the chip in listen only mode with the masks and filters off and
+ * rollover on, and enables the receive, error and message error interrupts. monService(), called from the interrupt
+ * of the chip, reads CANINTF once and each full receive buffer with one READ RX BUFFER (which releases it), and
+ * stores the raw frames with a time stamp into a ring. The frames are decoded later, outside the interrupt, by
+ * monRead().
+ *
+ * A frame costs two SPI transactions, 1.5 when both buffers are full at the interrupt : 3 bytes of CANINTF and
+ * 6 to 14 bytes of buffer. EFLG is only read when the chip flags an error.
+*/
+#ifndef MCP2515_MONITOR
+#define MCP2515_MONITOR
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief A frame as read from a receive buffer, in the layout of canReadRawRX().
+*/
+typedef struct MON_FRAME
+{
+	uint32_t ts;				/* pal_get_time_us() at the interrupt */
+	uint8_t raw[13];			/* SIDH, SIDL, EID8, EID0, DLC, D0 to D7 */
+}MON_FRAME;
+
+typedef struct MON_STATS
+{
+	uint32_t frames;			/* frames stored in the ring */
+	uint32_t interrupts;		/* calls of monService() that found a frame or an error */
+	uint32_t both_full;			/* interrupts that found both receive buffers full, the chip is near overrun */
+	uint32_t overruns;			/* frames lost by the chip, RX0OVR and RX1OVR */
+	uint32_t error_frames;		/* MERRF, the chip saw an error frame on the bus */
+	uint32_t dropped;			/* frames lost because the ring was full */
+}MON_STATS;
+
+/**
+ * @brief Monitor context. The ring is supplied by the caller; monService() only moves head and monRead() only
+ * moves tail, so one interrupt and one reader need no lock.
+*/
+typedef struct CAN_MONITOR
+{
+	MON_FRAME *ring;
+	uint16_t size;				/* capacity of the ring in frames */
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	MON_STATS stats;
+	uint8_t mode;				/* mode, CANINTE and RXBnCTRL before monBegin(), put back by monEnd() */
+	uint8_t caninte;
+	uint8_t rxb0ctrl;
+	uint8_t rxb1ctrl;
+}CAN_MONITOR;
+
+void monBegin(CAN_MONITOR *, MON_FRAME *, uint16_t);
+
+uint8_t monService(CAN_MONITOR *);
+
+uint8_t monRead(CAN_MONITOR *, CAN_FRAME *, uint32_t *);
+
+void monEnd(CAN_MONITOR *);
+
+#endif
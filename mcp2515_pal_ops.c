@@ -0,0 +1,48 @@
+/**
+ * @file mcp2515_pal_ops.c
+ * @brief Current device of the platform abstraction layer operations table.
+*/
+
+#include "mcp2515_pal_ops.h"
+
+#ifndef MCP_PAL_STATIC
+
+/* table of the device the core APIs talk to, one per thread with MCP_PAL_LOCKING */
+MCP_THREAD_LOCAL const MCP_PAL_OPS *mcp_pal;
+
+/**
+ * @brief This function points the core APIs at a device. Every core API call that follows goes through its table,
+ * until the next palUse(). With MCP_PAL_LOCKING only the calls of the calling thread are redirected, a thread that
+ * never called palUse() has no device.
+ *
+ * @param
+ * 1. _ops : the table of the device.
+ *
+ * @return
+ * THE TABLE OF THE DEVICE USED BEFORE, NULL IF NONE.
+ */
+const MCP_PAL_OPS *palUse(const MCP_PAL_OPS *_ops)
+{
+	const MCP_PAL_OPS *_prev = mcp_pal;
+	mcp_pal = _ops;
+	return _prev;
+}
+
+#else
+
+/**
+ * @brief This function does nothing when the table is bound at compile time with MCP_PAL_STATIC.
+ *
+ * @param
+ * 1. _ops : ignored.
+ *
+ * @return
+ * THE STATIC TABLE.
+ */
+const MCP_PAL_OPS *palUse(const MCP_PAL_OPS *_ops)
+{
+	(void)_ops;
+	return MCP_PAL_CURRENT;
+}
+
+#endif
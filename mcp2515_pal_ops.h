@@ -0,0 +1,95 @@
+/**
+ * @file mcp2515_pal_ops.h
+ * @brief Platform abstraction layer as an operations table. When MCP_PAL_DYNAMIC is defined the core APIs reach the
+ * platform through the table of the current device instead of the pal_* functions of a single backend, so one
+ * binary can drive chips behind different SPI ports, or a real chip and the simulated one, and swap backends at run
+ * time with palUse(). The binding is per thread when MCP_PAL_LOCKING is defined (see MCP_THREAD_LOCAL) : each
+ * thread picks its device once and its transactions go to that device whatever the other threads pick.
+ *
+ * For tiny MCUs the table can be bound at compile time : with MCP_PAL_STATIC defined to the name of a constant
+ * table, the calls go straight through that table and, when MCP_PAL_STATIC_HEADER names a header that defines it
+ * with static inline functions, the compiler inlines them like the pal_* functions.
+*/
+#ifndef MCP2515_PAL_OPS
+#define MCP2515_PAL_OPS
+
+#include "mcp2515_driver_pal.h"
+
+/**
+ * @brief Operations of one device. select, deselect, send, read and time_us are required; the others may be NULL.
+ * Every operation gets ctx, e.g. the SPI port and chip select pin of the device.
+*/
+typedef struct MCP_PAL_OPS
+{
+	void (*init)(void *, void *, uint8_t, uint8_t, uint8_t);	/* as pal_spi_init() */
+	void (*select)(void *);
+	void (*deselect)(void *);
+	void (*send)(void *, uint8_t);
+	uint8_t (*read)(void *);
+	void (*delay_us)(void *, uint32_t);
+	uint32_t (*time_us)(void *);
+	void (*irq_disable)(void *);		/* masks the interrupt of the chip */
+	void (*irq_enable)(void *);
+	void (*lock)(void *);				/* takes the SPI port of the device, for callers shared between threads */
+	void (*unlock)(void *);
+	void (*state_lock)(void *);			/* recursive lock of the state of the device, see pal_state_lock() */
+	void (*state_unlock)(void *);
+	void *ctx;
+}MCP_PAL_OPS;
+
+#if defined(MCP_PAL_STATIC_HEADER)
+#include MCP_PAL_STATIC_HEADER
+#elif defined(MCP_PAL_STATIC)
+extern const MCP_PAL_OPS MCP_PAL_STATIC;
+#endif
+
+#ifdef MCP_PAL_STATIC
+#define MCP_PAL_CURRENT (&MCP_PAL_STATIC)
+#else
+extern MCP_THREAD_LOCAL const MCP_PAL_OPS *mcp_pal;
+#define MCP_PAL_CURRENT mcp_pal
+#endif
+
+const MCP_PAL_OPS *palUse(const MCP_PAL_OPS *);
+
+/**
+ * @brief Files that implement the platform abstraction layer define MCP_PAL_IMPLEMENTATION and only get the table
+ * type, their own pal_* definitions are not redirected.
+*/
+#ifndef MCP_PAL_IMPLEMENTATION
+#undef pal_spi_init
+#undef pal_select_slave
+#undef pal_deselect_slave
+#undef pal_spi_send
+#undef pal_spi_read
+#undef pal_delay_us
+#undef pal_delay_ms
+#undef pal_get_time_us
+#undef pal_lock
+#undef pal_unlock
+#undef pal_state_lock
+#undef pal_state_unlock
+#define pal_spi_init(data, dir, idle, edge) \
+	( MCP_PAL_CURRENT->init ? MCP_PAL_CURRENT->init( MCP_PAL_CURRENT->ctx, data, dir, idle, edge ) : (void)0 )
+#define pal_select_slave() MCP_PAL_CURRENT->select( MCP_PAL_CURRENT->ctx )
+#define pal_deselect_slave() MCP_PAL_CURRENT->deselect( MCP_PAL_CURRENT->ctx )
+#define pal_spi_send(byt) MCP_PAL_CURRENT->send( MCP_PAL_CURRENT->ctx, byt )
+#define pal_spi_read() MCP_PAL_CURRENT->read( MCP_PAL_CURRENT->ctx )
+#define pal_delay_us(us) \
+	( MCP_PAL_CURRENT->delay_us ? MCP_PAL_CURRENT->delay_us( MCP_PAL_CURRENT->ctx, us ) : (void)0 )
+#define pal_delay_ms(ms) pal_delay_us( (uint32_t)(ms) * 1000 )
+#define pal_get_time_us() MCP_PAL_CURRENT->time_us( MCP_PAL_CURRENT->ctx )
+// the port is taken before the interrupt of the chip is masked, and given back after it is unmasked
+#define pal_lock() \
+	( MCP_PAL_CURRENT->lock ? MCP_PAL_CURRENT->lock( MCP_PAL_CURRENT->ctx ) : (void)0, \
+	MCP_PAL_CURRENT->irq_disable ? MCP_PAL_CURRENT->irq_disable( MCP_PAL_CURRENT->ctx ) : (void)0 )
+#define pal_unlock() \
+	( MCP_PAL_CURRENT->irq_enable ? MCP_PAL_CURRENT->irq_enable( MCP_PAL_CURRENT->ctx ) : (void)0, \
+	MCP_PAL_CURRENT->unlock ? MCP_PAL_CURRENT->unlock( MCP_PAL_CURRENT->ctx ) : (void)0 )
+#define pal_state_lock() \
+	( MCP_PAL_CURRENT->state_lock ? MCP_PAL_CURRENT->state_lock( MCP_PAL_CURRENT->ctx ) : (void)0 )
+#define pal_state_unlock() \
+	( MCP_PAL_CURRENT->state_unlock ? MCP_PAL_CURRENT->state_unlock( MCP_PAL_CURRENT->ctx ) : (void)0 )
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/**
+ * @file mcp2515_power.c
+ * @brief Sleep and wake-up of the chip with a cached configuration image.
+*/
+
+#include "mcp2515_power.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to write CANCTRL as cached, which requests the mode the chip had before sleeping, and
+ * to wait for the mode at most MCP_MODE_TIMEOUT_US.
+ *
+ * @return
+ * 1 : IF THE CHIP ENTERED THE MODE
+ * 0 : IF IT DID NOT IN TIME
+*/
+static uint8_t pwrEnterMode(const PWR_CTX *_ctx)
+{
+	canWriteRegister( CANCTRL, _ctx->canctrl & ~(1<<ABAT) );
+
+	uint32_t _start = pal_get_time_us();
+	while( canGetMode() != (MCP_CAN_MODE)( _ctx->canctrl >> 5 ) )
+	{
+		if( pal_get_time_us() - _start >= MCP_MODE_TIMEOUT_US )
+			return 0;
+	}
+	return 1;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a power management context.
+ *
+ * @param
+ * 1. _ctx : the context.
+ *
+ * @return
+ * NOTHING
+ */
+void pwrBegin(PWR_CTX *_ctx)
+{
+	_ctx->asleep = 0;
+	_ctx->aborted = 0;
+	_ctx->wakeups = 0;
+	_ctx->wake_us = 0;
+}
+
+/**
+ * @brief This function puts the chip to sleep. The pending frames get PWR_QUIESCE_US to leave and are aborted
+ * afterwards; the configuration registers are cached with one READ burst; WAKIE is enabled so that bus activity
+ * (or pwrWake()) wakes the chip up. The wake-up filter of CNF3 can only be changed in configuration mode, which
+ * costs two mode switches when it differs from the current setting.
+ *
+ * @param
+ * 1. _ctx : the context.
+ * 2. _wake_filter : 1 to enable the low pass filter on the wake-up input (WAKFIL), 0 to disable it.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : the chip is already asleep
+ */
+uint8_t pwrSleep(PWR_CTX *_ctx, uint8_t _wake_filter)
+{
+	const uint8_t _txreq = (1<<MCP_STAT_TX0REQ) | (1<<MCP_STAT_TX1REQ) | (1<<MCP_STAT_TX2REQ);
+
+	if( _ctx->asleep )
+		return 0;
+
+	canStateLock();
+
+	uint32_t _start = pal_get_time_us();
+	while( ( canReadStatus() & _txreq ) && pal_get_time_us() - _start < PWR_QUIESCE_US );
+	_ctx->aborted = ( canReadStatus() & _txreq ) ? canAbortAll() : 0;
+
+	// CANCTRL is mirrored at 0X0F, the image holds the mode to go back to
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( 0X00 );
+	for(uint8_t a=0; a<0X2C; a++)
+		_ctx->image[a] = pal_spi_read();
+	pal_deselect_slave();
+	_ctx->canctrl = _ctx->image[0X0F];
+
+	_ctx->rxb0ctrl = canReadRegister( RXB0CTRL );
+	_ctx->rxb1ctrl = canReadRegister( RXB1CTRL );
+
+	if( ( ( _ctx->image[CNF3] >> WAKFIL ) & 1 ) != ( _wake_filter ? 1 : 0 ) )
+	{
+		canRequestMode(mcp_configuration_mode);
+		canBitModify( CNF3, (1<<WAKFIL), _wake_filter ? (1<<WAKFIL) : 0 );
+		_ctx->image[CNF3] ^= (1<<WAKFIL);
+	}
+
+	canClearInterruptFlags( (1<<WAKIF) );
+	canBitModify( CANINTE, (1<<WAKIE), (1<<WAKIE) );
+
+	canRequestMode(mcp_sleep_mode);
+	_ctx->asleep = 1;
+	_ctx->sleep_us = pal_get_time_us();
+
+	canStateUnlock();
+	return 1;
+}
+
+/**
+ * @brief This function handles the wake-up of the chip. One READ burst of CNF3 to CANINTF tells whether WAKIF is
+ * set and whether the chip still holds its configuration. On WAKIF the flag is cleared, WAKIE is put back as it
+ * was and the mode the chip had before sleeping is requested (the chip wakes up in listen only mode, and the
+ * frame that woke it is lost). A chip that lost its configuration is restored with pwrRestore(). Either way the
+ * chip counts as awake afterwards, even when it did not enter the mode : call pwrRestore() to try again.
+ *
+ * @param
+ * 1. _ctx : the context.
+ *
+ * @return
+ * 1. pwr_woke : the chip woke up and is back in its previous mode
+ * 2. pwr_asleep : it is still asleep, or was not put to sleep by pwrSleep()
+ * 3. pwr_failed : it woke up but did not enter its previous mode within MCP_MODE_TIMEOUT_US
+ */
+PWR_RESULT pwrService(PWR_CTX *_ctx)
+{
+	uint8_t _r[5];
+
+	if( !_ctx->asleep )
+		return pwr_asleep;
+
+	pal_select_slave();
+	pal_spi_send( MCP_READ );
+	pal_spi_send( CNF3 );
+	for(uint8_t i=0; i<5; i++)
+		_r[i] = pal_spi_read();
+	pal_deselect_slave();
+
+	uint32_t _t0 = pal_get_time_us();
+
+	// CNF3, CNF2, CNF1 no longer as cached : the chip was reset
+	uint8_t _entered;
+	if( _r[0] != _ctx->image[CNF3] || _r[1] != _ctx->image[CNF2] || _r[2] != _ctx->image[CNF1] )
+	{
+		_entered = pwrRestore( _ctx );
+	}
+	else
+	{
+		if( !( _r[4] & (1<<WAKIF) ) )
+			return pwr_asleep;
+
+		canStateLock();
+		canClearInterruptFlags( (1<<WAKIF) );
+		canBitModify( CANINTE, (1<<WAKIE), _ctx->image[CANINTE] );
+		_entered = pwrEnterMode( _ctx );
+		_ctx->asleep = 0;
+		canStateUnlock();
+	}
+
+	if( !_entered )
+		return pwr_failed;
+
+	_ctx->wakeups++;
+	_ctx->wake_us = pal_get_time_us() - _t0;
+	return pwr_woke;
+}
+
+/**
+ * @brief This function wakes the chip up from the host : setting WAKIF while WAKIE is enabled wakes it like bus
+ * activity does, then pwrService() brings it back to its previous mode.
+ *
+ * @param
+ * 1. _ctx : the context.
+ *
+ * @return
+ * THE RESULT OF pwrService().
+ */
+PWR_RESULT pwrWake(PWR_CTX *_ctx)
+{
+	if( !_ctx->asleep )
+		return pwr_asleep;
+
+	canBitModify( CANINTF, (1<<WAKIF), (1<<WAKIF) );
+	return pwrService( _ctx );
+}
+
+/**
+ * @brief This function writes the cached configuration back into a chip that lost it, e.g. after its supply was
+ * cut during sleep : RESET, one WRITE burst of the registers 0X00 to 0X2B, one write of each RXBnCTRL, then the
+ * previous mode. The CANCTRL mirrors inside the burst keep the chip in configuration mode.
+ *
+ * @param
+ * 1. _ctx : the context, filled by pwrSleep().
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : the chip did not enter the previous mode within MCP_MODE_TIMEOUT_US
+ */
+uint8_t pwrRestore(PWR_CTX *_ctx)
+{
+	uint8_t _config = ( _ctx->canctrl & 0X1F & ~(1<<ABAT) ) | ( mcp_configuration_mode << 5 );
+
+	canStateLock();
+	canChipReset();
+	pal_delay_us(MCP_RESET_DELAY_US);
+
+	pal_select_slave();
+	pal_spi_send( MCP_WRITE );
+	pal_spi_send( 0X00 );
+	for(uint8_t a=0; a<0X2C; a++)
+		pal_spi_send( ( a & 0X0F ) == 0X0F ? _config : _ctx->image[a] );
+	pal_deselect_slave();
+
+	canWriteRegister( RXB0CTRL, _ctx->rxb0ctrl );
+	canWriteRegister( RXB1CTRL, _ctx->rxb1ctrl );
+
+	uint8_t _entered = pwrEnterMode( _ctx );
+	_ctx->asleep = 0;
+	canStateUnlock();
+	return _entered;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file mcp2515_power.h
+ * @brief Sleep and wake-up of the chip. pwrSleep() lets the pending frames leave, caches the configuration
+ * registers, enables the wake-up interrupt (and optionally the wake-up filter) and puts the chip to sleep.
+ * pwrService(), called on the chip's interrupt or periodically, handles WAKIF : the chip wakes up in listen only
+ * mode, so the mode it had before sleeping is requested back at once.
+ *
+ * The chip keeps its registers while it sleeps. When its supply was cut, or it was reset, the configuration is
+ * written back from the cache with pwrRestore() in a single WRITE burst.
+ *
+ * The wait for the previous mode is bounded by MCP_MODE_TIMEOUT_US; a chip that does not enter it is reported,
+ * not waited for.
+*/
+#ifndef MCP2515_POWER
+#define MCP2515_POWER
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Longest wait of pwrSleep() for the pending frames to leave before they are aborted, in microseconds.
+*/
+#ifndef PWR_QUIESCE_US
+#define PWR_QUIESCE_US 10000
+#endif
+
+/**
+ * @brief Results of pwrService() and pwrWake().
+*/
+typedef enum PWR_RESULT{ pwr_asleep=0, pwr_woke=1, pwr_failed=2 }PWR_RESULT;
+
+typedef struct PWR_CTX
+{
+	uint8_t image[0X2C];		/* registers 0X00 - 0X2B : filters, BFPCTRL, TXRTSCTRL, masks, CNF, CANINTE */
+	uint8_t rxb0ctrl;
+	uint8_t rxb1ctrl;
+	uint8_t canctrl;			/* CANCTRL before sleeping, with the mode to go back to */
+	uint8_t asleep;
+	uint8_t aborted;			/* transmit buffers aborted by the last pwrSleep(), bit n for buffer n */
+	uint32_t sleep_us;			/* pal_get_time_us() when the chip went to sleep */
+	uint32_t wake_us;			/* time from WAKIF seen to the previous mode entered, last wake-up */
+	uint32_t wakeups;
+}PWR_CTX;
+
+void pwrBegin(PWR_CTX *);
+
+uint8_t pwrSleep(PWR_CTX *, uint8_t);
+
+PWR_RESULT pwrService(PWR_CTX *);
+
+PWR_RESULT pwrWake(PWR_CTX *);
+
+uint8_t pwrRestore(PWR_CTX *);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file mcp2515_rxpoll.c
+ * @brief Hybrid interrupt and polling receive.
+*/
+
+#include "mcp2515_rxpoll.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to turn the receive interrupts on or off, the other interrupts are left as they are.
+*/
+static void rxpEnable(uint8_t _on)
+{
+	canBitModify( CANINTE, (1<<RX0IE) | (1<<RX1IE), _on ? ( (1<<RX0IE) | (1<<RX1IE) ) : 0 );
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes the hybrid receive with the RXP_* defaults and turns the receive interrupts on.
+ *
+ * @param
+ * 1. _rxp : the context.
+ * 2. _hook : called for every frame read, may be NULL.
+ * 3. _ctx : passed as it is to the hook.
+ *
+ * @return
+ * NOTHING
+ */
+void rxpBegin(CAN_RXPOLL *_rxp, CAN_RX_HOOK _hook, void *_ctx)
+{
+	_rxp->hook = _hook;
+	_rxp->ctx = _ctx;
+	_rxp->threshold = RXP_THRESHOLD;
+	_rxp->window_us = RXP_WINDOW_US;
+	_rxp->budget = RXP_BUDGET;
+	_rxp->idle_polls = RXP_IDLE_POLLS;
+	_rxp->mode = rxp_interrupt;
+	_rxp->window_start = pal_get_time_us();
+	_rxp->window_frames = 0;
+	_rxp->idle = 0;
+
+	_rxp->stats.frames = 0;
+	_rxp->stats.interrupts = 0;
+	_rxp->stats.polls = 0;
+	_rxp->stats.budget_spent = 0;
+	_rxp->stats.to_polling = 0;
+	_rxp->stats.to_interrupt = 0;
+
+	rxpEnable(1);
+}
+
+/**
+ * @brief This function is called from the interrupt of the chip. In interrupt mode it reads the full buffers with
+ * canServiceRX() and counts the frames of the current window; reaching the threshold turns the receive interrupts
+ * off and hands the receive over to rxpPoll(). In polling mode it does nothing, the interrupt came from another
+ * source.
+ *
+ * @param
+ * 1. _rxp : the context.
+ *
+ * @return
+ * THE NUMBER OF FRAMES READ (0, 1 OR 2).
+ */
+uint8_t rxpInterrupt(CAN_RXPOLL *_rxp)
+{
+	if( _rxp->mode != rxp_interrupt )
+		return 0;
+
+	uint8_t _n = canServiceRX( _rxp->hook, _rxp->ctx );
+	_rxp->stats.interrupts++;
+	_rxp->stats.frames += _n;
+
+	uint32_t _now = pal_get_time_us();
+	if( _now - _rxp->window_start >= _rxp->window_us )
+	{
+		_rxp->window_start = _now;
+		_rxp->window_frames = 0;
+	}
+	_rxp->window_frames += _n;
+
+	if( _rxp->window_frames >= _rxp->threshold )
+	{
+		rxpEnable(0);
+		_rxp->idle = 0;
+		_rxp->mode = rxp_polling;
+		_rxp->stats.to_polling++;
+	}
+
+	return _n;
+}
+
+/**
+ * @brief This function is called from the main loop. In polling mode it reads frames with canServiceRX() until
+ * both buffers are empty or the budget is spent. After idle_polls calls in a row that found nothing, the receive
+ * interrupts are turned back on. In interrupt mode it does nothing.
+ *
+ * @param
+ * 1. _rxp : the context.
+ *
+ * @return
+ * THE NUMBER OF FRAMES READ.
+ */
+uint16_t rxpPoll(CAN_RXPOLL *_rxp)
+{
+	uint16_t _n = 0;
+
+	if( _rxp->mode != rxp_polling )
+		return 0;
+
+	_rxp->stats.polls++;
+
+	while( _n < _rxp->budget )
+	{
+		uint8_t _got = canServiceRX( _rxp->hook, _rxp->ctx );
+		if( !_got )
+			break;
+		_n += _got;
+	}
+	_rxp->stats.frames += _n;
+
+	if( _n >= _rxp->budget )
+		_rxp->stats.budget_spent++;
+
+	if( _n )
+		_rxp->idle = 0;
+	else if( ++_rxp->idle >= _rxp->idle_polls )
+	{
+		_rxp->window_start = pal_get_time_us();
+		_rxp->window_frames = 0;
+		_rxp->mode = rxp_interrupt;
+		_rxp->stats.to_interrupt++;
+		rxpEnable(1);
+	}
+
+	return _n;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file mcp2515_rxpoll.h
+ * @brief Hybrid interrupt and polling receive. At low rates every frame is read from the interrupt of the chip by
+ * rxpInterrupt(). When the frames of one window reach a threshold the receive interrupts are turned off in CANINTE
+ * and the frames are read by rxpPoll() from the main loop instead, at most a budget of frames per call. After a
+ * number of polls in a row that find both buffers empty the receive interrupts are turned back on.
+ *
+ * A frame that arrives while the receive interrupts are off keeps its RXnIF set, so the INT line goes low as soon as
+ * they are turned back on : no frame waits for the next one.
+*/
+#ifndef MCP2515_RXPOLL
+#define MCP2515_RXPOLL
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Default frames read from the interrupt within RXP_WINDOW_US that switch to polling.
+*/
+#ifndef RXP_THRESHOLD
+#define RXP_THRESHOLD 8
+#endif
+
+/**
+ * @brief Default window over which the interrupt load is counted, in microseconds.
+*/
+#ifndef RXP_WINDOW_US
+#define RXP_WINDOW_US 1000
+#endif
+
+/**
+ * @brief Default largest number of frames read by one rxpPoll().
+*/
+#ifndef RXP_BUDGET
+#define RXP_BUDGET 16
+#endif
+
+/**
+ * @brief Default polls in a row finding both buffers empty that switch back to interrupts.
+*/
+#ifndef RXP_IDLE_POLLS
+#define RXP_IDLE_POLLS 4
+#endif
+
+typedef enum RXP_MODE{ rxp_interrupt=0, rxp_polling=1 }RXP_MODE;
+
+typedef struct RXP_STATS
+{
+	uint32_t frames;
+	uint32_t interrupts;		/* calls of rxpInterrupt() in interrupt mode */
+	uint32_t polls;				/* calls of rxpPoll() in polling mode */
+	uint32_t budget_spent;		/* polls that stopped on the budget with frames left */
+	uint32_t to_polling;		/* switches from interrupts to polling */
+	uint32_t to_interrupt;		/* switches from polling to interrupts */
+}RXP_STATS;
+
+typedef struct CAN_RXPOLL
+{
+	CAN_RX_HOOK hook;
+	void *ctx;
+	uint16_t threshold;			/* tuning, set to the RXP_* defaults by rxpBegin() and free to change */
+	uint32_t window_us;
+	uint16_t budget;
+	uint8_t idle_polls;
+	volatile RXP_MODE mode;
+	uint32_t window_start;
+	uint16_t window_frames;
+	uint8_t idle;				/* empty polls in a row */
+	RXP_STATS stats;
+}CAN_RXPOLL;
+
+void rxpBegin(CAN_RXPOLL *, CAN_RX_HOOK, void *);
+
+uint8_t rxpInterrupt(CAN_RXPOLL *);
+
+uint16_t rxpPoll(CAN_RXPOLL *);
+
+#endif
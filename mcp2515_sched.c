@@ -0,0 +1,315 @@
+/**
+ * @file mcp2515_sched.c
+ * @brief Cyclic transmit scheduler built on a two level hierarchical timer wheel.
+*/
+
+#include "mcp2515_sched.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to push a message on a wheel slot.
+*/
+static void schedLink(SCHED_MSG **_head, SCHED_MSG *_m)
+{
+	_m->next = *_head;
+	if( *_head )
+		(*_head)->pprev = &_m->next;
+	*_head = _m;
+	_m->pprev = _head;
+}
+
+/**
+ * @brief Utility function to unlink a message from its wheel slot.
+*/
+static void schedUnlink(SCHED_MSG *_m)
+{
+	if( !_m->pprev )
+		return;
+	*_m->pprev = _m->next;
+	if( _m->next )
+		_m->next->pprev = _m->pprev;
+	_m->next = 0;
+	_m->pprev = 0;
+}
+
+/**
+ * @brief Utility function to append a message to the list of released messages waiting for a buffer.
+*/
+static void schedLateAppend(CAN_SCHEDULER *_s, SCHED_MSG *_m)
+{
+	_m->late_next = 0;
+	_m->late_pprev = _s->late_tail;
+	*_s->late_tail = _m;
+	_s->late_tail = &_m->late_next;
+}
+
+/**
+ * @brief Utility function to remove a message from the list of released messages.
+*/
+static void schedLateRemove(CAN_SCHEDULER *_s, SCHED_MSG *_m)
+{
+	if( !_m->late_pprev )
+		return;
+	*_m->late_pprev = _m->late_next;
+	if( _m->late_next )
+		_m->late_next->late_pprev = _m->late_pprev;
+	else
+		_s->late_tail = _m->late_pprev;
+	_m->late_next = 0;
+	_m->late_pprev = 0;
+}
+
+/**
+ * @brief Utility function to put a message on the wheel slot of its expiry tick.
+*/
+static void schedInsert(CAN_SCHEDULER *_s, SCHED_MSG *_m)
+{
+	uint32_t _delta = _m->expires - _s->now;
+
+	if( _delta < SCHED_WHEEL0_SIZE )
+		schedLink( &_s->wheel0[ _m->expires & ( SCHED_WHEEL0_SIZE - 1 ) ], _m );
+	else
+		schedLink( &_s->wheel1[ ( _m->expires >> SCHED_WHEEL0_BITS ) & ( SCHED_WHEEL1_SIZE - 1 ) ], _m );
+}
+
+/**
+ * @brief Utility function to transmit a message on a free buffer.
+ *
+ * @return
+ * 1 : IF THE MESSAGE WAS HANDED TO THE CHIP
+ * 0 : IF NONE OF THE FREE BUFFERS ACCEPTED IT
+*/
+static uint8_t schedSend(SCHED_MSG *_m, uint8_t *_free)
+{
+	uint8_t _sel = _m->data_sel;
+
+	for(uint8_t _buff=0; _buff<3; _buff++)
+	{
+		if( !( *_free & (1<<_buff) ) )
+			continue;
+		*_free &= ~(1<<_buff);
+
+		uint8_t _ok;
+		if( _m->type == can_extended )
+			_ok = canTransmit_wEID( _buff, _m->id, _m->dlc[_sel], _m->data[_sel] );
+		else
+			_ok = canTransmit_wSID( _buff, _m->id, _m->dlc[_sel], _m->data[_sel] );
+
+		if( _ok )
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Utility function to update the statistics of a message that has just been sent.
+*/
+static void schedSent(CAN_SCHEDULER *_s, SCHED_MSG *_m)
+{
+	uint32_t _t = pal_get_time_us();
+	uint32_t _lateness = _s->now - _m->due;
+
+	if( _lateness )
+	{
+		_m->late++;
+		if( _lateness > _m->max_lateness )
+			_m->max_lateness = _lateness > 0XFFFF ? 0XFFFF : _lateness;
+	}
+
+	if( _m->sent )
+	{
+		uint32_t _interval = _t - _m->last_sent_us;
+		uint32_t _nominal = (uint32_t)_m->period * _s->tick_us;
+		uint32_t _jitter = _interval > _nominal ? _interval - _nominal : _nominal - _interval;
+		if( _jitter > _m->max_jitter_us )
+			_m->max_jitter_us = _jitter;
+	}
+
+	_m->last_sent_us = _t;
+	_m->sent++;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a scheduler.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _tx_mask : transmit buffers the scheduler may use, bit n for buffer n.
+ * 3. _tick_us : length of a tick in microseconds, used for the jitter statistics only.
+ *
+ * @return
+ * NOTHING
+ */
+void schedBegin(CAN_SCHEDULER *_s, uint8_t _tx_mask, uint32_t _tick_us)
+{
+	for(uint32_t i=0; i<SCHED_WHEEL0_SIZE; i++)
+		_s->wheel0[i] = 0;
+	for(uint32_t i=0; i<SCHED_WHEEL1_SIZE; i++)
+		_s->wheel1[i] = 0;
+	_s->late = 0;
+	_s->late_tail = &_s->late;
+	_s->now = 0;
+	_s->tick_us = _tick_us;
+	_s->tx_mask = _tx_mask & 0X07;
+}
+
+/**
+ * @brief This function registers a cyclic message.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _m : storage for the message.
+ * 3. _type : can_standard or can_extended.
+ * 4. _id : the 11 or 29 bit identifier.
+ * 5. _dlc : number of data bytes.
+ * 6. _data : the initial payload.
+ * 7. _period : period in ticks, 1 to SCHED_MAX_PERIOD.
+ * 8. _phase : offset of the releases in ticks, used to spread messages of the same period over the ticks.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : period out of range
+ */
+uint8_t schedAdd(CAN_SCHEDULER *_s, SCHED_MSG *_m, CAN_FRAME_TYPE _type, uint32_t _id, uint8_t _dlc, const unsigned char *_data, uint16_t _period, uint16_t _phase)
+{
+	if( _period == 0 || _period > SCHED_MAX_PERIOD )
+		return 0;
+
+	_m->next = 0;
+	_m->pprev = 0;
+	_m->late_next = 0;
+	_m->late_pprev = 0;
+	_m->type = _type;
+	_m->id = _id;
+	_m->period = _period;
+	_m->data_sel = 0;
+	_m->sent = 0;
+	_m->misses = 0;
+	_m->late = 0;
+	_m->max_lateness = 0;
+	_m->last_sent_us = 0;
+	_m->max_jitter_us = 0;
+	schedUpdate( _m, _dlc, _data );
+
+	// first tick after now that is in phase
+	uint32_t _base = _s->now + 1;
+	_m->expires = _base + ( ( _phase % _period ) + _period - ( _base % _period ) ) % _period;
+
+	schedInsert( _s, _m );
+	return 1;
+}
+
+/**
+ * @brief This function unregisters a cyclic message. A pending release is discarded.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _m : the message.
+ *
+ * @return
+ * NOTHING
+ */
+void schedRemove(CAN_SCHEDULER *_s, SCHED_MSG *_m)
+{
+	schedUnlink( _m );
+	schedLateRemove( _s, _m );
+}
+
+/**
+ * @brief This function replaces the payload of a registered message. The new payload is written to the copy that
+ * the scheduler is not using and then published by a single byte write, so it may be called while the scheduler
+ * runs in an interrupt, as long as there is one writer per message.
+ *
+ * @param
+ * 1. _m : the message.
+ * 2. _dlc : number of data bytes.
+ * 3. _data : the payload.
+ *
+ * @return
+ * NOTHING
+ */
+void schedUpdate(SCHED_MSG *_m, uint8_t _dlc, const unsigned char *_data)
+{
+	uint8_t _sel = _m->data_sel ^ 1;
+
+	if( _dlc > 8 )
+		_dlc = 8;
+	for(uint8_t i=0; i<_dlc; i++)
+		_m->data[_sel][i] = _data[i];
+	_m->dlc[_sel] = _dlc;
+	_m->data_sel = _sel;
+}
+
+/**
+ * @brief This function advances the scheduler by one tick and transmits the messages that are due. Call it from
+ * the tick interrupt or a periodic task. The work done is proportional to the number of due messages, plus one
+ * READ STATUS transaction when there is something to send.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ *
+ * @return
+ * NOTHING
+ */
+void schedTick(CAN_SCHEDULER *_s)
+{
+	SCHED_MSG *_m;
+
+	_s->now++;
+
+	// at the start of a level 0 revolution, spread the matching level 1 slot over level 0
+	if( ( _s->now & ( SCHED_WHEEL0_SIZE - 1 ) ) == 0 )
+	{
+		SCHED_MSG **_slot = &_s->wheel1[ ( _s->now >> SCHED_WHEEL0_BITS ) & ( SCHED_WHEEL1_SIZE - 1 ) ];
+		while( ( _m = *_slot ) != 0 )
+		{
+			schedUnlink( _m );
+			schedInsert( _s, _m );
+		}
+	}
+
+	// release the due messages and put them back on the wheel for their next period
+	SCHED_MSG **_slot = &_s->wheel0[ _s->now & ( SCHED_WHEEL0_SIZE - 1 ) ];
+	SCHED_MSG *_due = *_slot;
+	*_slot = 0;
+	if( _due )
+		_due->pprev = &_due;
+
+	while( ( _m = _due ) != 0 )
+	{
+		schedUnlink( _m );
+
+		_m->expires += _m->period;
+		schedInsert( _s, _m );
+
+		if( _m->late_pprev )
+			// the previous release is still waiting for a buffer, it is replaced by this one
+			_m->misses++;
+		else
+			schedLateAppend( _s, _m );
+		_m->due = _s->now;
+	}
+
+	if( !_s->late )
+		return;
+
+	// transmit released messages in release order while there are free buffers
+	uint8_t _status = canReadStatus();
+	uint8_t _free = 0;
+	for(uint8_t _buff=0; _buff<3; _buff++)
+		if( ( _s->tx_mask & (1<<_buff) ) && !( _status & ( 1 << ( MCP_STAT_TX0REQ + 2 * _buff ) ) ) )
+			_free |= (1<<_buff);
+
+	while( _free && ( _m = _s->late ) != 0 )
+	{
+		if( !schedSend( _m, &_free ) )
+			break;
+		schedLateRemove( _s, _m );
+		schedSent( _s, _m );
+	}
+}
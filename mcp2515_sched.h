@@ -0,0 +1,87 @@
+/**
+ * @file mcp2515_sched.h
+ * @brief Cyclic transmit scheduler. Messages are registered with a period and a phase offset in ticks and kept
+ * in a two level hierarchical timer wheel, so that a tick only touches the messages that are due.
+ *
+ * A message with period P and phase F is due at every tick t with t % P == F % P. Due messages are handed to
+ * canTransmit_wSID() / canTransmit_wEID() on a free transmit buffer; a message that finds no free buffer is
+ * retried on the following ticks until it is sent or its next period starts, which counts as a deadline miss.
+*/
+#ifndef MCP2515_SCHED
+#define MCP2515_SCHED
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Size of the wheels : level 0 has 2^SCHED_WHEEL0_BITS slots of one tick, level 1 has
+ * 2^SCHED_WHEEL1_BITS slots of 2^SCHED_WHEEL0_BITS ticks.
+*/
+#ifndef SCHED_WHEEL0_BITS
+#define SCHED_WHEEL0_BITS 8
+#endif
+
+#ifndef SCHED_WHEEL1_BITS
+#define SCHED_WHEEL1_BITS 6
+#endif
+
+#define SCHED_WHEEL0_SIZE ( 1UL << SCHED_WHEEL0_BITS )
+#define SCHED_WHEEL1_SIZE ( 1UL << SCHED_WHEEL1_BITS )
+
+/**
+ * @brief Longest period that the wheels can hold, in ticks.
+*/
+#define SCHED_MAX_PERIOD ( ( SCHED_WHEEL1_SIZE - 1 ) * SCHED_WHEEL0_SIZE )
+
+/**
+ * @brief A cyclic message. The storage is supplied by the application and must stay valid while registered.
+*/
+typedef struct SCHED_MSG
+{
+	/* wheel and retry list links, owned by the scheduler */
+	struct SCHED_MSG *next;
+	struct SCHED_MSG **pprev;
+	struct SCHED_MSG *late_next;
+	struct SCHED_MSG **late_pprev;
+
+	CAN_FRAME_TYPE type;
+	uint32_t id;
+	uint16_t period;
+	uint32_t expires;			/* tick of the next release */
+	uint32_t due;				/* release tick of the instance waiting for a buffer */
+
+	/* two copies of the payload, schedUpdate() writes the inactive one and flips 'data_sel' */
+	uint8_t dlc[2];
+	unsigned char data[2][8];
+	volatile uint8_t data_sel;
+
+	/* statistics */
+	uint32_t sent;
+	uint32_t misses;			/* instances replaced by the next release before they could be sent */
+	uint32_t late;				/* instances sent on a later tick than their release */
+	uint16_t max_lateness;		/* ticks */
+	uint32_t last_sent_us;
+	uint32_t max_jitter_us;		/* largest deviation of the interval between two transmissions from the period */
+}SCHED_MSG;
+
+typedef struct CAN_SCHEDULER
+{
+	SCHED_MSG *wheel0[SCHED_WHEEL0_SIZE];
+	SCHED_MSG *wheel1[SCHED_WHEEL1_SIZE];
+	SCHED_MSG *late;			/* messages released but not yet sent, in release order */
+	SCHED_MSG **late_tail;
+	uint32_t now;				/* current tick */
+	uint32_t tick_us;			/* length of a tick, for the jitter statistics */
+	uint8_t tx_mask;			/* transmit buffers the scheduler may use, bit n for buffer n */
+}CAN_SCHEDULER;
+
+void schedBegin(CAN_SCHEDULER *, uint8_t, uint32_t);
+
+uint8_t schedAdd(CAN_SCHEDULER *, SCHED_MSG *, CAN_FRAME_TYPE, uint32_t, uint8_t, const unsigned char *, uint16_t, uint16_t);
+
+void schedRemove(CAN_SCHEDULER *, SCHED_MSG *);
+
+void schedUpdate(SCHED_MSG *, uint8_t, const unsigned char *);
+
+void schedTick(CAN_SCHEDULER *);
+
+#endif
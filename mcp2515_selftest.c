@@ -0,0 +1,184 @@
+/**
+ * @file mcp2515_selftest.c
+ * @brief Loopback self-test of the chip and of the SPI link.
+*/
+
+#include "mcp2515_selftest.h"
+
+/* frames sent and not come back yet, by sequence number */
+typedef struct TEST_FLIGHT
+{
+	uint32_t seq[TEST_INFLIGHT];
+	uint8_t used[TEST_INFLIGHT];
+	uint8_t count;
+	TEST_RESULT *res;
+}TEST_FLIGHT;
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to build the frame of a sequence number : standard and extended IDs alternate, the DLC
+ * runs from 2 to 8, the sequence number is in the first two data bytes and the other bytes are derived from it.
+*/
+static void testFrame(uint32_t _seq, CAN_FRAME *_f)
+{
+	_f->type = ( _seq & 1 ) ? can_extended : can_standard;
+	_f->isRemote = 0;
+	_f->ID = ( _seq & 1 ) ? ( ( _seq * 0X9E3779B1UL ) & 0X1FFFFFFF ) : ( ( _seq * 0X25 ) & 0X7FF );
+	_f->DLC = 2 + _seq % 7;
+	_f->DATA[0] = _seq;
+	_f->DATA[1] = _seq >> 8;
+	for(uint8_t i=2; i<8; i++)
+		_f->DATA[i] = ( _seq >> ( i & 1 ? 16 : 0 ) ) ^ ( i * 0X5B );
+}
+
+/**
+ * @brief Utility function given to canServiceRX() : matches a frame that came back against the frames in flight.
+*/
+static void testCheck(const CAN_FRAME *_f, void *_ctx)
+{
+	TEST_FLIGHT *_fl = (TEST_FLIGHT *)_ctx;
+	uint16_t _tag = _f->DATA[0] | ( (uint16_t)_f->DATA[1] << 8 );
+
+	for(uint8_t i=0; i<TEST_INFLIGHT; i++)
+	{
+		if( !_fl->used[i] || (uint16_t)_fl->seq[i] != _tag )
+			continue;
+
+		CAN_FRAME _exp;
+		testFrame( _fl->seq[i], &_exp );
+		_fl->used[i] = 0;
+		_fl->count--;
+
+		uint8_t _ok = _f->type == _exp.type && _f->ID == _exp.ID && _f->DLC == _exp.DLC && !_f->isRemote;
+		for(uint8_t b=0; _ok && b<_exp.DLC; b++)
+			_ok = _f->DATA[b] == _exp.DATA[b];
+
+		if( _ok )
+			_fl->res->received++;
+		else
+			_fl->res->corrupt++;
+		return;
+	}
+
+	// nothing in flight carries this sequence number : it takes no slot, so it is not one of the frames sent
+	_fl->res->unexpected++;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function runs the loopback self-test : _frames frames are sent through the three transmit buffers in
+ * turn with TEST_INFLIGHT of them in flight, read back with canServiceRX() and compared with what was sent. The masks
+ * and filters are off and rollover is on during the test; the mode and RXBnCTRL are put back afterwards.
+ *
+ * The frame rate is the one of the whole driver path on this platform : SPI clock, PAL overhead and bus time in
+ * loopback. With MCP_SPI_TRACE defined, spi_bytes and bytes_per_frame tell the SPI cost per frame; without it they
+ * are 0.
+ *
+ * Every frame sent ends in received, corrupt or lost, so the three add up to _frames. A frame that matches none of
+ * the frames in flight is counted in unexpected and fails the test.
+ *
+ * @param
+ * 1. _res : receives the result.
+ * 2. _frames : number of frames to send.
+ * 3. _timeout_us : bound of the test duration.
+ *
+ * @return
+ * 1 : IF EVERY FRAME CAME BACK UNALTERED WITHIN THE TIME
+ * 0 : OTHERWISE, _res TELLS WHAT WENT WRONG
+ */
+uint8_t testLoopback(TEST_RESULT *_res, uint32_t _frames, uint32_t _timeout_us)
+{
+	TEST_FLIGHT _fl;
+	CAN_FRAME _f;
+
+	_res->sent = 0;
+	_res->received = 0;
+	_res->corrupt = 0;
+	_res->lost = 0;
+	_res->unexpected = 0;
+	_res->spi_bytes = 0;
+	_res->spi_windows = 0;
+	_fl.count = 0;
+	_fl.res = _res;
+	for(uint8_t i=0; i<TEST_INFLIGHT; i++)
+		_fl.used[i] = 0;
+
+	canStateLock();
+	MCP_CAN_MODE _mode = canGetMode();
+	uint8_t _rxb0ctrl = canReadRegister( RXB0CTRL );
+	uint8_t _rxb1ctrl = canReadRegister( RXB1CTRL );
+
+	canRequestMode(mcp_loopback_mode);
+	canWriteRegister( RXB0CTRL, (3<<RXM0) | (1<<BUKT) );
+	canWriteRegister( RXB1CTRL, (3<<RXM0) );
+	canClearInterruptFlags( (1<<RX0IF) | (1<<RX1IF) | (1<<TX0IF) | (1<<TX1IF) | (1<<TX2IF) );
+
+#ifdef MCP_SPI_TRACE
+	TRACE_STATS _t0, _t1;
+	traceGetStats( &_t0 );
+#endif
+
+	uint32_t _start = pal_get_time_us();
+	uint32_t _last = _start;
+
+	while( _res->received + _res->corrupt + _res->lost < _frames )
+	{
+		uint32_t _now = pal_get_time_us();
+		if( _now - _start >= _timeout_us )
+			break;
+
+		// with at most TEST_INFLIGHT frames out, the buffer used three frames ago has already sent its frame
+		while( _res->sent < _frames && _fl.count < TEST_INFLIGHT )
+		{
+			uint8_t _slot = 0;
+			while( _fl.used[_slot] )
+				_slot++;
+
+			testFrame( _res->sent, &_f );
+			uint8_t _buff = _res->sent % 3;
+			uint8_t _ok = ( _f.type == can_extended )
+				? canTransmit_wEID( _buff, _f.ID, _f.DLC, _f.DATA )
+				: canTransmit_wSID( _buff, _f.ID, _f.DLC, _f.DATA );
+			if( !_ok )
+				break;
+
+			_fl.seq[_slot] = _res->sent++;
+			_fl.used[_slot] = 1;
+			_fl.count++;
+		}
+
+		if( canServiceRX( testCheck, &_fl ) )
+			_last = pal_get_time_us();
+		else if( _fl.count && _now - _last >= TEST_FRAME_TIMEOUT_US )
+		{
+			_res->lost += _fl.count;
+			_fl.count = 0;
+			for(uint8_t i=0; i<TEST_INFLIGHT; i++)
+				_fl.used[i] = 0;
+			_last = _now;
+		}
+	}
+
+	_res->elapsed_us = pal_get_time_us() - _start;
+
+#ifdef MCP_SPI_TRACE
+	traceGetStats( &_t1 );
+	_res->spi_bytes = _t1.bytes - _t0.bytes;
+	_res->spi_windows = _t1.windows - _t0.windows;
+#endif
+
+	_res->lost += _frames - ( _res->received + _res->corrupt + _res->lost );
+	_res->frames_per_s = _res->elapsed_us ? (uint32_t)( (uint64_t)_res->received * 1000000 / _res->elapsed_us ) : 0;
+	_res->bytes_per_frame = _res->received ? _res->spi_bytes / _res->received : 0;
+	_res->passed = ( _res->received == _frames && !_res->unexpected );
+
+	canWriteRegister( RXB0CTRL, _rxb0ctrl );
+	canWriteRegister( RXB1CTRL, _rxb1ctrl );
+	canRequestMode(_mode);
+	canStateUnlock();
+
+	return _res->passed;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file mcp2515_selftest.h
+ * @brief Loopback self-test of the chip and of the SPI link. testLoopback() puts the chip in loopback mode and
+ * streams frames through the core transmit and receive APIs (canTransmit_wSID(), canTransmit_wEID(),
+ * canServiceRX()) as fast as the link allows, checks that every frame comes back unaltered, and measures the frame
+ * rate. With MCP_SPI_TRACE defined the SPI traffic is measured as well, from the counters of the recorder; these count
+ * every transaction, recorded or paused, so the figures hold while the recording is paused. Without it the SPI
+ * figures of the result stay 0.
+ *
+ * The test takes over the chip : it should run when the application has no frame pending, e.g. at boot.
+*/
+#ifndef MCP2515_SELFTEST
+#define MCP2515_SELFTEST
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Frames in flight at once. Two receive buffers (with rollover) take the frames that come back, so more
+ * frames in flight could overflow them while the host is busy.
+*/
+#define TEST_INFLIGHT 2
+
+/**
+ * @brief Time after which the frames in flight are counted as lost when none of them came back, in microseconds.
+*/
+#ifndef TEST_FRAME_TIMEOUT_US
+#define TEST_FRAME_TIMEOUT_US 10000
+#endif
+
+typedef struct TEST_RESULT
+{
+	uint32_t sent;
+	uint32_t received;			/* frames that came back unaltered */
+	uint32_t corrupt;			/* frames that came back with another ID, DLC or payload */
+	uint32_t lost;				/* frames that did not come back within TEST_FRAME_TIMEOUT_US, or not sent in time */
+	uint32_t unexpected;		/* frames received that match no frame in flight : late, duplicated or from the bus */
+	uint32_t elapsed_us;
+	uint32_t frames_per_s;		/* received frames per second */
+	uint32_t spi_bytes;			/* bytes clocked during the test, 0 without MCP_SPI_TRACE */
+	uint32_t spi_windows;		/* chip select windows during the test, 0 without MCP_SPI_TRACE */
+	uint16_t bytes_per_frame;	/* spi_bytes per received frame, transmit and receive included, 0 without MCP_SPI_TRACE */
+	uint8_t passed;				/* every frame sent came back unaltered and nothing else was received */
+}TEST_RESULT;
+
+uint8_t testLoopback(TEST_RESULT *, uint32_t, uint32_t);
+
+#endif
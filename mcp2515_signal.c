@@ -0,0 +1,219 @@
+/**
+ * @file mcp2515_signal.c
+ * @brief Decoding of DBC style signals through precompiled extraction plans.
+*/
+
+#include "mcp2515_signal.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to build the sort key of a message, extended IDs after standard ones.
+*/
+static uint32_t sigKey(CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	return ( _id & 0X1FFFFFFF ) | ( _type == can_extended ? 0X80000000UL : 0 );
+}
+
+/**
+ * @brief Utility function to decode the signals of one frame from its data.
+*/
+static void sigDecodeData(const SIG_PLAN *_plan, uint8_t _count, const unsigned char *_d, SIG_VALUE *_out)
+{
+	uint64_t _le = (uint64_t)_d[0] | ( (uint64_t)_d[1] << 8 ) | ( (uint64_t)_d[2] << 16 ) | ( (uint64_t)_d[3] << 24 )
+		| ( (uint64_t)_d[4] << 32 ) | ( (uint64_t)_d[5] << 40 ) | ( (uint64_t)_d[6] << 48 ) | ( (uint64_t)_d[7] << 56 );
+	uint64_t _be = (uint64_t)_d[7] | ( (uint64_t)_d[6] << 8 ) | ( (uint64_t)_d[5] << 16 ) | ( (uint64_t)_d[4] << 24 )
+		| ( (uint64_t)_d[3] << 32 ) | ( (uint64_t)_d[2] << 40 ) | ( (uint64_t)_d[1] << 48 ) | ( (uint64_t)_d[0] << 56 );
+
+	for(uint8_t i=0; i<_count; i++)
+	{
+		const SIG_PLAN *_p = &_plan[i];
+		uint64_t _raw = ( ( _p->big_endian ? _be : _le ) >> _p->shift ) & _p->mask;
+
+		if( _p->is_signed )
+			_out[i] = (SIG_VALUE)( (int64_t)( _raw << _p->sign_shift ) >> _p->sign_shift ) * _p->scale + _p->offset;
+		else
+			_out[i] = (SIG_VALUE)_raw * _p->scale + _p->offset;
+	}
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function compiles signal definitions into extraction plans.
+ *
+ * @param
+ * 1. _defs : the signal definitions.
+ * 2. _count : number of signals.
+ * 3. _plan : receives one plan per signal, in the same order.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : a signal has a length of 0 or does not fit in the 8 data bytes
+ */
+uint8_t sigCompile(const SIG_DEF *_defs, uint8_t _count, SIG_PLAN *_plan)
+{
+	for(uint8_t i=0; i<_count; i++)
+	{
+		const SIG_DEF *_s = &_defs[i];
+		int16_t _lsb;
+
+		if( _s->length == 0 || _s->length > 64 || _s->start_bit > 63 )
+			return 0;
+
+		if( _s->byte_order == SIG_BIG_ENDIAN )
+		{
+			// position of the most significant bit in the big endian word, the signal extends towards bit 0
+			int16_t _msb = ( 7 - ( _s->start_bit >> 3 ) ) * 8 + ( _s->start_bit & 0X07 );
+			_lsb = _msb - ( _s->length - 1 );
+			_plan[i].big_endian = 1;
+		}
+		else
+		{
+			_lsb = _s->start_bit;
+			if( _lsb + _s->length > 64 )
+				return 0;
+			_plan[i].big_endian = 0;
+		}
+
+		if( _lsb < 0 )
+			return 0;
+
+		_plan[i].shift = _lsb;
+		_plan[i].mask = _s->length == 64 ? ~(uint64_t)0 : ( (uint64_t)1 << _s->length ) - 1;
+		_plan[i].is_signed = _s->is_signed ? 1 : 0;
+		_plan[i].sign_shift = _s->is_signed ? 64 - _s->length : 0;
+		_plan[i].scale = _s->scale;
+		_plan[i].offset = _s->offset;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief This function fills a message description.
+ *
+ * @param
+ * 1. _msg : the message.
+ * 2. _type : can_standard or can_extended.
+ * 3. _id : the identifier.
+ * 4. _plan : the compiled plans of its signals.
+ * 5. _count : number of signals.
+ *
+ * @return
+ * NOTHING
+ */
+void sigMessage(SIG_MESSAGE *_msg, CAN_FRAME_TYPE _type, uint32_t _id, const SIG_PLAN *_plan, uint8_t _count)
+{
+	_msg->type = _type == can_extended ? can_extended : can_standard;
+	_msg->id = _id;
+	_msg->plan = _plan;
+	_msg->count = _count;
+}
+
+/**
+ * @brief This function sorts a message table by ID for sigLookup(). Call it once after loading the table.
+ *
+ * @param
+ * 1. _msgs : the messages.
+ * 2. _count : number of messages.
+ *
+ * @return
+ * NOTHING
+ */
+void sigSort(SIG_MESSAGE *_msgs, uint16_t _count)
+{
+	// insertion sort : tables are small and loaded once
+	for(uint16_t i=1; i<_count; i++)
+	{
+		SIG_MESSAGE _m = _msgs[i];
+		uint32_t _key = sigKey( _m.type, _m.id );
+		uint16_t j = i;
+
+		while( j > 0 && sigKey( _msgs[j - 1].type, _msgs[j - 1].id ) > _key )
+		{
+			_msgs[j] = _msgs[j - 1];
+			j--;
+		}
+		_msgs[j] = _m;
+	}
+}
+
+/**
+ * @brief This function finds the description of a message by binary search.
+ *
+ * @param
+ * 1. _msgs : the messages, sorted by sigSort().
+ * 2. _count : number of messages.
+ * 3. _type : can_standard or can_extended.
+ * 4. _id : the identifier.
+ *
+ * @return
+ * THE MESSAGE, NULL WHEN THE ID IS NOT DESCRIBED.
+ */
+const SIG_MESSAGE *sigLookup(const SIG_MESSAGE *_msgs, uint16_t _count, CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	uint32_t _key = sigKey( _type, _id );
+	uint16_t _lo = 0;
+	uint16_t _hi = _count;
+
+	while( _lo < _hi )
+	{
+		uint16_t _mid = _lo + ( _hi - _lo ) / 2;
+		uint32_t _k = sigKey( _msgs[_mid].type, _msgs[_mid].id );
+
+		if( _k == _key )
+			return &_msgs[_mid];
+		if( _k < _key )
+			_lo = _mid + 1;
+		else
+			_hi = _mid;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief This function decodes every signal of a frame in one pass.
+ *
+ * @param
+ * 1. _msg : the message description.
+ * 2. _data : the 8 data bytes of the frame (bytes past the DLC are decoded as they are).
+ * 3. _out : receives one physical value per signal, in definition order.
+ *
+ * @return
+ * THE NUMBER OF SIGNALS DECODED.
+ */
+uint8_t sigDecode(const SIG_MESSAGE *_msg, const unsigned char *_data, SIG_VALUE *_out)
+{
+	sigDecodeData( _msg->plan, _msg->count, _data, _out );
+	return _msg->count;
+}
+
+/**
+ * @brief This function decodes an array of frames of the same message. The frames are read in place through a
+ * stride, so the data may come from a CAN_FRAME array (DATA member, sizeof(CAN_FRAME)) or straight from the
+ * records of a memory mapped capture (data offset, record size).
+ *
+ * @param
+ * 1. _msg : the message description.
+ * 2. _data : data bytes of the first frame.
+ * 3. _stride : distance in bytes between the data of two frames.
+ * 4. _frames : number of frames.
+ * 5. _out : receives _frames * _msg->count values, frame after frame.
+ *
+ * @return
+ * THE NUMBER OF VALUES WRITTEN.
+ */
+uint32_t sigDecodeBatch(const SIG_MESSAGE *_msg, const unsigned char *_data, uint32_t _stride, uint32_t _frames, SIG_VALUE *_out)
+{
+	for(uint32_t i=0; i<_frames; i++)
+	{
+		sigDecodeData( _msg->plan, _msg->count, _data, _out );
+		_data += _stride;
+		_out += _msg->count;
+	}
+
+	return _frames * _msg->count;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file mcp2515_signal.h
+ * @brief Decoding of DBC style signals from frame data through extraction plans compiled once at load time.
+ *
+ * A signal is described as in a DBC file : start bit, length, byte order, signedness, scale and offset. For the
+ * little endian (Intel) byte order the start bit is the least significant bit of the signal, for the big endian
+ * (Motorola) byte order it is the most significant bit, both numbered byte * 8 + bit. sigCompile() turns every
+ * definition into a shift and a mask on the 64 bit word of the frame data, so decoding a frame loads the data
+ * once and then costs a shift, a mask and a multiply add per signal.
+*/
+#ifndef MCP2515_SIGNAL
+#define MCP2515_SIGNAL
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Type of the physical values, double for full precision of signals above 24 bits.
+*/
+#ifndef SIG_VALUE_TYPE
+#define SIG_VALUE_TYPE float
+#endif
+
+typedef SIG_VALUE_TYPE SIG_VALUE;
+
+/**
+ * @brief Byte order of a signal.
+*/
+#define SIG_LITTLE_ENDIAN 0
+#define SIG_BIG_ENDIAN 1
+
+typedef struct SIG_DEF
+{
+	uint8_t start_bit;
+	uint8_t length;			/* 1 to 64 bits */
+	uint8_t byte_order;		/* SIG_LITTLE_ENDIAN or SIG_BIG_ENDIAN */
+	uint8_t is_signed;
+	SIG_VALUE scale;
+	SIG_VALUE offset;
+}SIG_DEF;
+
+/**
+ * @brief Extraction plan of a signal, filled by sigCompile().
+*/
+typedef struct SIG_PLAN
+{
+	uint64_t mask;
+	uint8_t shift;
+	uint8_t big_endian;
+	uint8_t is_signed;
+	uint8_t sign_shift;		/* 64 - length for signed signals, 0 for unsigned ones */
+	SIG_VALUE scale;
+	SIG_VALUE offset;
+}SIG_PLAN;
+
+typedef struct SIG_MESSAGE
+{
+	CAN_FRAME_TYPE type;
+	uint32_t id;
+	const SIG_PLAN *plan;
+	uint8_t count;			/* number of signals */
+}SIG_MESSAGE;
+
+uint8_t sigCompile(const SIG_DEF *, uint8_t, SIG_PLAN *);
+
+void sigMessage(SIG_MESSAGE *, CAN_FRAME_TYPE, uint32_t, const SIG_PLAN *, uint8_t);
+
+void sigSort(SIG_MESSAGE *, uint16_t);
+
+const SIG_MESSAGE *sigLookup(const SIG_MESSAGE *, uint16_t, CAN_FRAME_TYPE, uint32_t);
+
+uint8_t sigDecode(const SIG_MESSAGE *, const unsigned char *, SIG_VALUE *);
+
+uint32_t sigDecodeBatch(const SIG_MESSAGE *, const unsigned char *, uint32_t, uint32_t, SIG_VALUE *);
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file mcp2515_snapshot.c
+ * @brief Snapshot of the register map of the chip in sequential READ bursts, with decoders.
+*/
+
+#include "mcp2515_snapshot.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to decode an identifier from SIDH, SIDL, EID8, EID0 in the 29 bit layout of
+ * canSetMaskRX() and canSetFilterRX(), the standard ID in bits 28 to 18.
+*/
+static uint32_t snapID29(const uint8_t *_r)
+{
+	return ( (uint32_t)_r[0] << 21 ) | ( (uint32_t)( _r[1] & 0XE0 ) << 13 ) | ( (uint32_t)( _r[1] & 0X03 ) << 16 )
+		| ( (uint32_t)_r[2] << 8 ) | _r[3];
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function reads rows of the register map. Every run of consecutive rows is read with one
+ * sequential READ; SNAP_ALL reads the 128 registers in a single transaction. READ has no side effect, the
+ * receive flags are not cleared.
+ *
+ * @param
+ * 1. _snap : receives the registers.
+ * 2. _rows : rows to read, SNAP_ALL, SNAP_DIAG or an OR of SNAP_RXF0_2 ... SNAP_RXB1.
+ *
+ * @return
+ * THE NUMBER OF READ TRANSACTIONS.
+ */
+uint8_t canSnapshot(MCP_SNAPSHOT *_snap, uint8_t _rows)
+{
+	uint8_t _bursts = 0;
+	uint8_t _row = 0;
+
+	_snap->rows = _rows;
+	_snap->ts = pal_get_time_us();
+
+	while( _row < 8 )
+	{
+		if( !( _rows & (1<<_row) ) )
+		{
+			_row++;
+			continue;
+		}
+
+		uint8_t _end = _row;
+		while( _end < 8 && ( _rows & (1<<_end) ) )
+			_end++;
+
+		pal_select_slave();
+		pal_spi_send( MCP_READ );
+		pal_spi_send( _row << 4 );
+		for(uint8_t a=_row<<4; a<(_end<<4); a++)
+			_snap->regs[a] = pal_spi_read();
+		pal_deselect_slave();
+
+		_bursts++;
+		_row = _end;
+	}
+
+	return _bursts;
+}
+
+/**
+ * @brief This function decodes the mode of operation from CANSTAT, mirrored in every row.
+ *
+ * @param
+ * 1. _snap : the snapshot, at least one row read.
+ *
+ * @return
+ * THE MODE, mcp_configuration_mode IF NO ROW WAS READ.
+ */
+MCP_CAN_MODE snapGetMode(const MCP_SNAPSHOT *_snap)
+{
+	for(uint8_t _row=0; _row<8; _row++)
+		if( _snap->rows & (1<<_row) )
+			return (MCP_CAN_MODE)( _snap->regs[ ( _row << 4 ) | 0X0E ] >> 5 );
+
+	return mcp_configuration_mode;
+}
+
+/**
+ * @brief This function decodes the error state from TEC, REC, EFLG and CANINTF.
+ *
+ * @param
+ * 1. _snap : the snapshot, rows SNAP_RXF3_5 and SNAP_CONTROL read.
+ * 2. _out : receives the error state.
+ *
+ * @return
+ * NOTHING
+ */
+void snapGetErrors(const MCP_SNAPSHOT *_snap, SNAP_ERRORS *_out)
+{
+	uint8_t _eflg = _snap->regs[EFLG];
+
+	if( _eflg & (1<<TXBO) )
+		_out->state = mcp_bus_off;
+	else if( _eflg & ( (1<<TXEP) | (1<<RXEP) ) )
+		_out->state = mcp_error_passive;
+	else
+		_out->state = mcp_error_active;
+
+	_out->tec = _snap->regs[TEC];
+	_out->rec = _snap->regs[REC];
+	_out->tx_warning = ( _eflg & (1<<TXWAR) ) ? 1 : 0;
+	_out->rx_warning = ( _eflg & (1<<RXWAR) ) ? 1 : 0;
+	_out->rx0_overflow = ( _eflg & (1<<RX0OVR) ) ? 1 : 0;
+	_out->rx1_overflow = ( _eflg & (1<<RX1OVR) ) ? 1 : 0;
+	_out->message_error = ( _snap->regs[CANINTF] & (1<<MERRF) ) ? 1 : 0;
+}
+
+/**
+ * @brief This function decodes the state and the content of a transmit buffer.
+ *
+ * @param
+ * 1. _snap : the snapshot, rows SNAP_CONTROL and SNAP_TXBn read.
+ * 2. _buff : the transmit buffer number.
+ * 3. _out : receives the state.
+ *
+ * @return
+ * NOTHING
+ */
+void snapGetTX(const MCP_SNAPSHOT *_snap, uint8_t _buff, SNAP_TX *_out)
+{
+	const uint8_t *_r = &_snap->regs[ TXB0CTRL + 0X10 * ( _buff % 3 ) ];
+
+	_out->pending = ( _r[0] & (1<<TXREQ) ) ? 1 : 0;
+	_out->complete = ( _snap->regs[CANINTF] & ( 1 << ( TX0IF + _buff % 3 ) ) ) ? 1 : 0;
+	_out->aborted = ( _r[0] & (1<<ABTF) ) ? 1 : 0;
+	_out->lost_arbitration = ( _r[0] & (1<<MLOA) ) ? 1 : 0;
+	_out->error = ( _r[0] & (1<<TXERR) ) ? 1 : 0;
+	_out->priority = _r[0] & 0X03;
+	canDecodeRaw( _r + 1, &_out->frame );
+}
+
+/**
+ * @brief This function decodes the state and the content of a receive buffer.
+ *
+ * @param
+ * 1. _snap : the snapshot, rows SNAP_CONTROL and SNAP_RXBn read.
+ * 2. _buff : the receive buffer number.
+ * 3. _out : receives the state.
+ *
+ * @return
+ * NOTHING
+ */
+void snapGetRX(const MCP_SNAPSHOT *_snap, uint8_t _buff, SNAP_RX *_out)
+{
+	const uint8_t *_r = &_snap->regs[ _buff ? RXB1CTRL : RXB0CTRL ];
+
+	_out->full = ( _snap->regs[CANINTF] & ( _buff ? (1<<RX1IF) : (1<<RX0IF) ) ) ? 1 : 0;
+	_out->filter = _buff ? ( _r[0] & 0X07 ) : ( _r[0] & 0X01 );
+	_out->mode = ( _r[0] >> RXM0 ) & 0X03;
+	_out->rollover = _buff ? 0 : ( ( _r[0] & (1<<BUKT) ) ? 1 : 0 );
+	canDecodeRaw( _r + 1, &_out->frame );
+}
+
+/**
+ * @brief This function decodes a mask in the layout of canSetMaskRX().
+ *
+ * @param
+ * 1. _snap : the snapshot, row SNAP_CONTROL read.
+ * 2. _num : the mask number.
+ *
+ * @return
+ * THE 29 BIT MASK, THE STANDARD ID BITS IN BITS 28 TO 18.
+ */
+uint32_t snapGetMask(const MCP_SNAPSHOT *_snap, uint8_t _num)
+{
+	return snapID29( &_snap->regs[ _num ? RXM1SIDH : RXM0SIDH ] );
+}
+
+/**
+ * @brief This function decodes a filter in the layout of canSetFilterRX().
+ *
+ * @param
+ * 1. _snap : the snapshot, row SNAP_RXF0_2 or SNAP_RXF3_5 read.
+ * 2. _num : the filter number.
+ * 3. _type : receives can_standard or can_extended, NULL if not needed.
+ *
+ * @return
+ * THE 29 BIT FILTER, THE STANDARD ID BITS IN BITS 28 TO 18.
+ */
+uint32_t snapGetFilter(const MCP_SNAPSHOT *_snap, uint8_t _num, CAN_FRAME_TYPE *_type)
+{
+	// RXF0 to RXF2 at 0X00, RXF3 to RXF5 at 0X10
+	const uint8_t *_r = &_snap->regs[ ( _num < 3 ? 0X00 : 0X10 ) + 4 * ( _num % 3 ) ];
+
+	if( _type )
+		*_type = ( _r[1] & (1<<EXIDE) ) ? can_extended : can_standard;
+	return snapID29( _r );
+}
+
+/**
+ * @brief This function lists the registers that differ between two snapshots, in the rows read by both.
+ *
+ * @param
+ * 1. _a : the first snapshot.
+ * 2. _b : the second snapshot.
+ * 3. _addrs : receives the addresses of the registers that differ, NULL to only count them.
+ * 4. _max : size of _addrs.
+ *
+ * @return
+ * THE NUMBER OF REGISTERS THAT DIFFER, MAY BE MORE THAN _max.
+ */
+uint8_t snapDiff(const MCP_SNAPSHOT *_a, const MCP_SNAPSHOT *_b, uint8_t *_addrs, uint8_t _max)
+{
+	uint8_t _rows = _a->rows & _b->rows;
+	uint8_t _count = 0;
+
+	for(uint8_t a=0; a<128; a++)
+	{
+		if( !( _rows & ( 1 << ( a >> 4 ) ) ) || _a->regs[a] == _b->regs[a] )
+			continue;
+		if( _addrs && _count < _max )
+			_addrs[_count] = a;
+		_count++;
+	}
+
+	return _count;
+}
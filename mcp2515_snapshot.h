@@ -0,0 +1,91 @@
+/**
+ * @file mcp2515_snapshot.h
+ * @brief Snapshot of the register map of the chip. The 128 registers are read in rows of 16 : every run of
+ * consecutive rows is one sequential READ, so the whole map costs a single transaction of 130 bytes and the view
+ * it gives is consistent within a row run. Decoders turn the raw registers into the mode, the error state, the
+ * state of the buffers and the masks and filters; snapDiff() lists the registers that changed between two
+ * snapshots.
+ *
+ * CANSTAT and CANCTRL are mirrored at the end of every row, so any row gives the mode.
+*/
+#ifndef MCP2515_SNAPSHOT
+#define MCP2515_SNAPSHOT
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Rows of the register map, for canSnapshot().
+*/
+#define SNAP_RXF0_2 0X01	/* 0X00 - 0X0F : RXF0 to RXF2, BFPCTRL, TXRTSCTRL */
+#define SNAP_RXF3_5 0X02	/* 0X10 - 0X1F : RXF3 to RXF5, TEC, REC */
+#define SNAP_CONTROL 0X04	/* 0X20 - 0X2F : RXM0, RXM1, CNF3 to CNF1, CANINTE, CANINTF, EFLG */
+#define SNAP_TXB0 0X08		/* 0X30 - 0X3F */
+#define SNAP_TXB1 0X10
+#define SNAP_TXB2 0X20
+#define SNAP_RXB0 0X40		/* 0X60 - 0X6F */
+#define SNAP_RXB1 0X80
+#define SNAP_ALL 0XFF
+
+/**
+ * @brief Rows needed by the diagnostic decoders (errors, interrupt flags, transmit buffers), read in one burst.
+*/
+#define SNAP_DIAG ( SNAP_RXF3_5 | SNAP_CONTROL | SNAP_TXB0 | SNAP_TXB1 | SNAP_TXB2 )
+
+typedef struct MCP_SNAPSHOT
+{
+	uint8_t regs[128];
+	uint8_t rows;				/* rows read, registers of the other rows are left as they were */
+	uint32_t ts;				/* pal_get_time_us() at the start of the read */
+}MCP_SNAPSHOT;
+
+typedef enum MCP_ERROR_STATE{ mcp_error_active=0, mcp_error_passive=1, mcp_bus_off=2 }MCP_ERROR_STATE;
+
+typedef struct SNAP_ERRORS
+{
+	MCP_ERROR_STATE state;
+	uint8_t tec;
+	uint8_t rec;
+	uint8_t tx_warning;			/* TEC >= 96 */
+	uint8_t rx_warning;			/* REC >= 96 */
+	uint8_t rx0_overflow;
+	uint8_t rx1_overflow;
+	uint8_t message_error;		/* MERRF */
+}SNAP_ERRORS;
+
+typedef struct SNAP_TX
+{
+	uint8_t pending;			/* TXREQ */
+	uint8_t complete;			/* TXnIF */
+	uint8_t aborted;			/* ABTF */
+	uint8_t lost_arbitration;	/* MLOA */
+	uint8_t error;				/* TXERR */
+	uint8_t priority;			/* TXP */
+	CAN_FRAME frame;			/* content of the buffer */
+}SNAP_TX;
+
+typedef struct SNAP_RX
+{
+	uint8_t full;				/* RXnIF */
+	uint8_t filter;				/* filter that accepted the frame */
+	uint8_t mode;				/* RXM bits */
+	uint8_t rollover;			/* BUKT, buffer 0 only */
+	CAN_FRAME frame;			/* content of the buffer */
+}SNAP_RX;
+
+uint8_t canSnapshot(MCP_SNAPSHOT *, uint8_t);
+
+MCP_CAN_MODE snapGetMode(const MCP_SNAPSHOT *);
+
+void snapGetErrors(const MCP_SNAPSHOT *, SNAP_ERRORS *);
+
+void snapGetTX(const MCP_SNAPSHOT *, uint8_t, SNAP_TX *);
+
+void snapGetRX(const MCP_SNAPSHOT *, uint8_t, SNAP_RX *);
+
+uint32_t snapGetMask(const MCP_SNAPSHOT *, uint8_t);
+
+uint32_t snapGetFilter(const MCP_SNAPSHOT *, uint8_t, CAN_FRAME_TYPE *);
+
+uint8_t snapDiff(const MCP_SNAPSHOT *, const MCP_SNAPSHOT *, uint8_t *, uint8_t);
+
+#endif
@@ -0,0 +1,306 @@
+/**
+ * @file mcp2515_trace.c
+ * @brief SPI transaction recorder. See mcp2515_trace.h for the record layout.
+*/
+
+#include "mcp2515_trace.h"
+
+static uint8_t *_ring;
+static uint32_t _cap;
+static uint32_t _head;
+static uint32_t _tail;
+static uint32_t _used;
+static uint8_t _enabled;
+
+static TRACE_STATS _stats;
+
+/* lock of the ring and the counters, see traceSetLock() */
+static void (*_lock)(void *);
+static void (*_unlock)(void *);
+static void *_lock_ctx;
+
+/* the window being recorded, one per thread : threads on different devices clock their windows at the same time */
+typedef struct TRACE_WINDOW
+{
+	uint32_t ts;
+	uint32_t clocked;
+	uint8_t bytes[TRACE_MAX_WINDOW];
+	uint8_t dir[(TRACE_MAX_WINDOW + 7) / 8];
+}TRACE_WINDOW;
+
+static MCP_THREAD_LOCAL TRACE_WINDOW _win;
+
+
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to take the lock of the ring and the counters.
+*/
+static void traceLock(void)
+{
+	if( _lock )
+		_lock( _lock_ctx );
+}
+
+/**
+ * @brief Utility function to release the lock of the ring and the counters.
+*/
+static void traceUnlock(void)
+{
+	if( _unlock )
+		_unlock( _lock_ctx );
+}
+
+/**
+ * @brief Utility function to read a byte of the ring at an offset from a position.
+*/
+static uint8_t traceAt(uint32_t _pos, uint32_t _off)
+{
+	return _ring[ (_pos + _off) % _cap ];
+}
+
+/**
+ * @brief Utility function to append a byte at the head of the ring.
+*/
+static void tracePut(uint8_t _b)
+{
+	_ring[_head] = _b;
+	_head = (_head + 1) % _cap;
+	_used++;
+}
+
+/**
+ * @brief Utility function to get the size of a record from its length byte.
+*/
+static uint32_t traceRecordSize(uint8_t _n)
+{
+	return 5 + ( (uint32_t)_n + 7 ) / 8 + _n;
+}
+
+/**
+ * @brief Utility function to store the window that has just been closed, under the lock.
+*/
+static void traceCommit(void)
+{
+	uint8_t _n = _win.clocked > TRACE_MAX_WINDOW ? TRACE_MAX_WINDOW : (uint8_t)_win.clocked;
+	uint32_t _size = traceRecordSize(_n);
+
+	if( _win.clocked > TRACE_MAX_WINDOW )
+		_stats.truncated++;
+
+	if( _size > _cap )
+	{
+		_stats.dropped++;
+		return;
+	}
+
+	// make room by overwriting the oldest records
+	while( _cap - _used < _size )
+	{
+		uint32_t _old = traceRecordSize( traceAt( _tail, 4 ) );
+		_tail = (_tail + _old) % _cap;
+		_used -= _old;
+		_stats.dropped++;
+	}
+
+	tracePut( _win.ts );
+	tracePut( _win.ts >> 8 );
+	tracePut( _win.ts >> 16 );
+	tracePut( _win.ts >> 24 );
+	tracePut( _n );
+	for(uint8_t i=0; i < (_n + 7) / 8; i++)
+		tracePut( _win.dir[i] );
+	for(uint8_t i=0; i < _n; i++)
+		tracePut( _win.bytes[i] );
+}
+
+/**
+ * @brief Utility function to record a byte of the window of the calling thread. The counters are updated when the
+ * window closes.
+*/
+static void traceByte(uint8_t _b, uint8_t _miso)
+{
+	if( _win.clocked < TRACE_MAX_WINDOW )
+	{
+		uint8_t _bit = 1 << (_win.clocked & 7);
+		_win.bytes[_win.clocked] = _b;
+		if( _miso )
+			_win.dir[_win.clocked >> 3] |= _bit;
+		else
+			_win.dir[_win.clocked >> 3] &= ~_bit;
+	}
+	_win.clocked++;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function attaches the ring buffer to the recorder and starts recording.
+ *
+ * @param
+ * 1. _buf : storage for the ring.
+ * 2. _size : size of the storage in bytes.
+ *
+ * @return
+ * NOTHING
+ */
+void traceBegin(uint8_t *_buf, uint32_t _size)
+{
+	traceLock();
+	_ring = _buf;
+	_cap = _size;
+	_head = 0;
+	_tail = 0;
+	_used = 0;
+	_stats.windows = 0;
+	_stats.bytes = 0;
+	_stats.dropped = 0;
+	_stats.truncated = 0;
+	_enabled = ( _buf && _size );
+	traceUnlock();
+}
+
+/**
+ * @brief This function pauses or resumes recording. The SPI traffic is passed through in both cases.
+ *
+ * @param
+ * 1. _enable : 1 to record, 0 to pause.
+ *
+ * @return
+ * NOTHING
+ */
+void traceEnable(uint8_t _enable)
+{
+	traceLock();
+	_enabled = _enable && _ring && _cap;
+	traceUnlock();
+}
+
+/**
+ * @brief This function sets the lock taken around the ring and the counters. It is needed when threads record
+ * windows of different devices at the same time (MCP_PAL_LOCKING with per device locks), e.g. a mutex. Set it before
+ * the threads start.
+ *
+ * @param
+ * 1. _lock_fn : takes the lock, NULL when a single thread records.
+ * 2. _unlock_fn : releases the lock.
+ * 3. _ctx : passed to both.
+ *
+ * @return
+ * NOTHING
+ */
+void traceSetLock(void (*_lock_fn)(void *), void (*_unlock_fn)(void *), void *_ctx)
+{
+	_lock = _lock_fn;
+	_unlock = _unlock_fn;
+	_lock_ctx = _ctx;
+}
+
+/**
+ * @brief This function copies the recorder counters.
+ *
+ * @param
+ * 1. _out : destination for the counters.
+ *
+ * @return
+ * NOTHING
+ */
+void traceGetStats(TRACE_STATS *_out)
+{
+	traceLock();
+	*_out = _stats;
+	traceUnlock();
+}
+
+/**
+ * @brief This function writes the recorded windows, oldest first, preceded by the TRACE_MAGIC header.
+ * Only whole records are written.
+ *
+ * @param
+ * 1. _out : destination buffer.
+ * 2. _size : size of the destination buffer in bytes.
+ *
+ * @return
+ * THE NUMBER OF BYTES WRITTEN, 0 IF THE HEADER DOES NOT FIT.
+ */
+uint32_t traceDump(uint8_t *_out, uint32_t _size)
+{
+	static const char _magic[TRACE_HEADER_SIZE] = TRACE_MAGIC;
+
+	if( _size < TRACE_HEADER_SIZE )
+		return 0;
+
+	for(uint8_t i=0; i<TRACE_HEADER_SIZE; i++)
+		_out[i] = _magic[i];
+
+	traceLock();
+	uint32_t _len = TRACE_HEADER_SIZE;
+	uint32_t _pos = _tail;
+	uint32_t _left = _used;
+
+	while( _left )
+	{
+		uint32_t _rec = traceRecordSize( traceAt( _pos, 4 ) );
+		if( _len + _rec > _size )
+			break;
+		for(uint32_t i=0; i<_rec; i++)
+			_out[_len++] = traceAt( _pos, i );
+		_pos = (_pos + _rec) % _cap;
+		_left -= _rec;
+	}
+	traceUnlock();
+
+	return _len;
+}
+
+
+
+/*
+ * 		!	 P L A T F O R M		A B S T R A C T I O N		L A Y E R		W R A P P E R S		!
+ */
+
+
+/**
+ * @brief This function opens a window in the recorder and selects the chip.
+ */
+void traceSelectSlave(void)
+{
+	_win.ts = pal_get_time_us();
+	_win.clocked = 0;
+	pal_select_slave();
+}
+
+/**
+ * @brief This function deselects the chip and stores the window.
+ */
+void traceDeselectSlave(void)
+{
+	pal_deselect_slave();
+	traceLock();
+	_stats.windows++;
+	_stats.bytes += _win.clocked;
+	if( _enabled )
+		traceCommit();
+	traceUnlock();
+}
+
+/**
+ * @brief This function sends a byte to the chip and records it.
+ */
+void traceSpiSend(uint8_t _b)
+{
+	pal_spi_send(_b);
+	traceByte( _b, 0 );
+}
+
+/**
+ * @brief This function reads a byte from the chip and records it.
+ */
+uint8_t traceSpiRead(void)
+{
+	uint8_t _b = pal_spi_read();
+	traceByte( _b, 1 );
+	return _b;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file mcp2515_trace.h
+ * @brief SPI transaction recorder. When MCP_SPI_TRACE is defined the core APIs reach the platform abstraction
+ * layer through this recorder, which stores every chip select window into a binary ring buffer.
+ *
+ * Record layout (little endian) :
+ * 		uint32_t time stamp in microseconds, taken when the window opens.
+ * 		uint8_t  number of bytes clocked in the window (n).
+ * 		uint8_t  direction bitmap, (n+7)/8 bytes. Bit i set when byte i was read from the chip (MISO),
+ * 				 clear when it was sent to the chip (MOSI).
+ * 		uint8_t  the n bytes.
+ *
+ * The opcode and the register address are the first bytes of a window and are not stored separately.
+*/
+#ifndef MCP2515_TRACE
+#define MCP2515_TRACE
+
+#include "mcp2515_driver_pal.h"
+
+// with MCP_PAL_DYNAMIC the recorder passes the traffic on to the table of the current device
+#ifdef MCP_PAL_DYNAMIC
+#include "mcp2515_pal_ops.h"
+#endif
+
+/**
+ * @brief Magic bytes at the start of a trace dump.
+*/
+#define TRACE_MAGIC "MCPTRC1"
+
+/**
+ * @brief Size of the file header written by traceDump() : the magic including its terminating zero.
+*/
+#define TRACE_HEADER_SIZE 8
+
+/**
+ * @brief Longest chip select window that is recorded in full. Longer windows are truncated in the record.
+*/
+#ifndef TRACE_MAX_WINDOW
+#define TRACE_MAX_WINDOW 136
+#endif
+
+/**
+ * @brief Recorder counters.
+*/
+typedef struct TRACE_STATS
+{
+	uint32_t windows;	/* windows recorded since traceBegin() */
+	uint32_t bytes;		/* bytes clocked since traceBegin() */
+	uint32_t dropped;	/* oldest records overwritten because the ring was full */
+	uint32_t truncated;	/* windows longer than TRACE_MAX_WINDOW */
+}TRACE_STATS;
+
+void traceBegin(uint8_t *, uint32_t);
+
+void traceEnable(uint8_t);
+
+void traceSetLock(void (*)(void *), void (*)(void *), void *);
+
+void traceGetStats(TRACE_STATS *);
+
+uint32_t traceDump(uint8_t *, uint32_t);
+
+void traceSelectSlave(void);
+
+void traceDeselectSlave(void);
+
+void traceSpiSend(uint8_t);
+
+uint8_t traceSpiRead(void);
+
+#endif
@@ -0,0 +1,656 @@
+/**
+ * @file mcp2515_txq.c
+ * @brief Transmit queue with completion reporting driven by the TXnIF flags.
+*/
+
+#include "mcp2515_txq.h"
+
+/**
+ * @brief Aborts requested by the queue itself, recorded in TXQ_ENTRY.action until the abort is seen.
+*/
+#define TXQ_ACT_NONE 0
+#define TXQ_ACT_CANCEL 1
+#define TXQ_ACT_DROP 2
+#define TXQ_ACT_BOOST 3
+#define TXQ_ACT_EXPIRE 4
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to encode a frame into the raw register bytes of a transmit buffer.
+*/
+static void txqEncode(uint8_t _raw[13], const CAN_FRAME *_frame)
+{
+	uint8_t _dlc = _frame->DLC > 8 ? 8 : _frame->DLC;
+
+	if( _frame->type == can_extended )
+	{
+		_raw[0] = _frame->ID >> 21;
+		_raw[1] = ( ( _frame->ID >> 13 ) & 0XE0 ) | (1<<EXIDE) | ( ( _frame->ID >> 16 ) & 0X03 );
+		_raw[2] = _frame->ID >> 8;
+		_raw[3] = _frame->ID;
+	}
+	else
+	{
+		_raw[0] = _frame->ID >> 3;
+		_raw[1] = ( _frame->ID << 5 ) & 0XE0;
+		_raw[2] = 0;
+		_raw[3] = 0;
+	}
+
+	_raw[4] = _dlc | ( _frame->isRemote ? (1<<RTR) : 0 );
+	for(uint8_t i=0; i<8; i++)
+		_raw[5 + i] = i < _dlc ? _frame->DATA[i] : 0;
+}
+
+/**
+ * @brief Utility function to find or create the statistics of an ID (multiplicative hashing, linear probing).
+*/
+static TXQ_STATS *txqIDStats(CAN_TXQ *_q, CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	if( !_q->ids )
+		return 0;
+
+	uint32_t _key = ( _id & 0X1FFFFFFF ) | TXQ_KEY_USED | ( _type == can_extended ? TXQ_KEY_EXT : 0 );
+	uint32_t _pos = ( _key * 2654435761UL ) & ( _q->ids_size - 1 );
+
+	for(uint16_t i=0; i<_q->ids_size; i++)
+	{
+		TXQ_ID_STATS *_s = &_q->ids[_pos];
+		if( _s->key == _key )
+			return &_s->stats;
+		if( _s->key == 0 )
+		{
+			_s->key = _key;
+			return &_s->stats;
+		}
+		_pos = ( _pos + 1 ) & ( _q->ids_size - 1 );
+	}
+
+	_q->ids_lost++;
+	return 0;
+}
+
+/**
+ * @brief Utility function to add the outcome of a frame to a set of statistics.
+*/
+static void txqAccount(TXQ_STATS *_s, const TXQ_RESULT *_r)
+{
+	if( _r->status == txq_sent )
+		_s->sent++;
+	else if( _r->status == txq_dropped )
+		_s->dropped++;
+	else if( _r->status == txq_expired )
+		_s->expired++;
+	else
+		_s->aborted++;
+
+	_s->arb_lost += _r->arb_lost;
+	_s->tx_errors += _r->tx_errors;
+	_s->retransmits += _r->retransmits;
+}
+
+/**
+ * @brief Utility function to free a slot and report its completion.
+*/
+static void txqComplete(CAN_TXQ *_q, uint8_t _s, TXQ_STATUS _status, uint32_t _now)
+{
+	TXQ_ENTRY *_e = &_q->slot[_s];
+	TXQ_RESULT _r;
+
+	_r.handle = _e->handle;
+	_r.status = _status;
+	_r.type = _e->type;
+	_r.id = _e->id;
+	_r.arb_lost = _e->arb_lost;
+	_r.tx_errors = _e->tx_errors;
+	_r.retransmits = _e->retransmits;
+	_r.queued_us = _e->loaded ? _e->load_us - _e->submit_us : _now - _e->submit_us;
+	_r.latency_us = _now - _e->submit_us;
+
+	if( _e->loaded )
+		txqAccount( &_q->buff_stats[_e->buff], &_r );
+	TXQ_STATS *_ids = txqIDStats( _q, _e->type, _e->id );
+	if( _ids )
+		txqAccount( _ids, &_r );
+
+	// the slot is free before the callback runs, so the callback may submit the next frame
+	_e->handle = 0;
+	_e->loaded = 0;
+
+	if( _e->done )
+	{
+		_e->done( &_r, _e->ctx );
+		return;
+	}
+
+	uint16_t _next = ( _q->res_head + 1 ) & ( TXQ_RESULTS - 1 );
+	if( _next == _q->res_tail )
+	{
+		_q->results_lost++;
+		return;
+	}
+	_q->results[_q->res_head] = _r;
+	_q->res_head = _next;
+}
+
+/**
+ * @brief Utility function to check whether the deadline of a frame has passed.
+*/
+static uint8_t txqExpired(const TXQ_ENTRY *_e, uint32_t _now)
+{
+	return _e->timed && (int32_t)( _now - _e->deadline_us ) >= 0;
+}
+
+/**
+ * @brief Utility function to apply the deadline and the policy to a loaded frame.
+ *
+ * @return
+ * TXQ_ACT_EXPIRE, TXQ_ACT_DROP, TXQ_ACT_BOOST OR TXQ_ACT_NONE
+*/
+static uint8_t txqDecide(const CAN_TXQ *_q, const TXQ_ENTRY *_e, uint32_t _now)
+{
+	const TXQ_POLICY *_p = _q->policy;
+
+	if( txqExpired( _e, _now ) )
+		return TXQ_ACT_EXPIRE;
+
+	if( !_p )
+		return TXQ_ACT_NONE;
+
+	if( ( _p->drop_after && _e->arb_lost >= _p->drop_after ) || ( _p->max_pending_us && _now - _e->load_us >= _p->max_pending_us ) )
+		return TXQ_ACT_DROP;
+
+	if( _p->boost_after && _e->prio < 3 && _e->arb_lost >= (uint16_t)_p->boost_after * ( _e->prio - _p->base_prio + 1 ) )
+		return TXQ_ACT_BOOST;
+
+	return TXQ_ACT_NONE;
+}
+
+/**
+ * @brief Utility function to request the transmission of a loaded frame again, one TXP step higher when boosted.
+*/
+static void txqRetransmit(CAN_TXQ *_q, uint8_t _b, TXQ_ENTRY *_e, uint8_t _boost)
+{
+	if( _boost )
+	{
+		_e->prio++;
+		canSetPriorityTX( _b, _e->prio );
+		_q->prio[_b] = _e->prio;
+	}
+
+	canRequestTransmission_wRTS(_b);
+	if( _e->retransmits < 0XFFFF )
+		_e->retransmits++;
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes a transmit queue and clears the TXnIF flags of its buffers. The buffers must
+ * be idle and not used by anything else.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _tx_mask : transmit buffers the queue may use, bit n for buffer n.
+ *
+ * @return
+ * NOTHING
+ */
+void txqBegin(CAN_TXQ *_q, uint8_t _tx_mask)
+{
+	for(uint8_t i=0; i<TXQ_SLOTS; i++)
+		_q->slot[i].handle = 0;
+	for(uint8_t b=0; b<3; b++)
+	{
+		_q->loaded[b] = 0XFF;
+		_q->prio[b] = 0XFF;
+	}
+
+	_q->head = 0XFF;
+	_q->tail = 0XFF;
+	_q->tx_mask = _tx_mask & 0X07;
+	_q->policy = 0;
+	_q->next_handle = 1;
+	_q->res_head = 0;
+	_q->res_tail = 0;
+	_q->results_lost = 0;
+	_q->ids = 0;
+	_q->ids_size = 0;
+	txqClearStats( _q );
+
+	canClearInterruptFlags( _q->tx_mask << TX0IF );
+}
+
+/**
+ * @brief This function queues a frame for transmission. Nothing is sent before the next txqService() pass.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _frame : the frame, copied.
+ * 3. _done : called from txqService() with the completion, NULL to report it through txqPoll().
+ * 4. _ctx : passed as it is to the callback.
+ *
+ * @return
+ * THE HANDLE OF THE FRAME, 0 IF THE QUEUE IS FULL.
+ */
+uint32_t txqSubmit(CAN_TXQ *_q, const CAN_FRAME *_frame, TXQ_DONE _done, void *_ctx)
+{
+	uint8_t _s = 0;
+
+	while( _s < TXQ_SLOTS && _q->slot[_s].handle )
+		_s++;
+	if( _s == TXQ_SLOTS )
+		return 0;
+
+	TXQ_ENTRY *_e = &_q->slot[_s];
+	txqEncode( _e->raw, _frame );
+	_e->type = _frame->type == can_extended ? can_extended : can_standard;
+	_e->id = _frame->ID;
+	_e->loaded = 0;
+	_e->next = 0XFF;
+	_e->action = TXQ_ACT_NONE;
+	_e->arb_lost = 0;
+	_e->tx_errors = 0;
+	_e->retransmits = 0;
+	_e->timed = 0;
+	_e->submit_us = pal_get_time_us();
+	_e->done = _done;
+	_e->ctx = _ctx;
+
+	_e->handle = _q->next_handle++;
+	if( !_q->next_handle )
+		_q->next_handle = 1;
+
+	if( _q->head == 0XFF )
+		_q->head = _s;
+	else
+		_q->slot[_q->tail].next = _s;
+	_q->tail = _s;
+
+	return _e->handle;
+}
+
+/**
+ * @brief This function queues a frame that must leave before a deadline. Past the deadline the frame is aborted
+ * if it is in a transmit buffer, or skipped if it is still queued, and reported as txq_expired.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _frame : the frame, copied.
+ * 3. _timeout_us : time from now to the deadline.
+ * 4. _done : called from txqService() with the completion, NULL to report it through txqPoll().
+ * 5. _ctx : passed as it is to the callback.
+ *
+ * @return
+ * THE HANDLE OF THE FRAME, 0 IF THE QUEUE IS FULL.
+ */
+uint32_t txqSubmit_wDeadline(CAN_TXQ *_q, const CAN_FRAME *_frame, uint32_t _timeout_us, TXQ_DONE _done, void *_ctx)
+{
+	uint32_t _handle = txqSubmit( _q, _frame, _done, _ctx );
+
+	if( _handle )
+	{
+		TXQ_ENTRY *_e = &_q->slot[_q->tail];
+		_e->timed = 1;
+		_e->deadline_us = _e->submit_us + _timeout_us;
+	}
+
+	return _handle;
+}
+
+/**
+ * @brief This function cancels a frame. A queued frame is reported aborted at once; a frame already in a transmit
+ * buffer has its transmission aborted and is reported by the next txqService() pass, as sent if it left before
+ * the abort.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _handle : the handle returned by txqSubmit().
+ *
+ * @return
+ * 1 : IF THE FRAME WAS STILL IN THE QUEUE
+ * 0 : IF IT HAS ALREADY COMPLETED
+ */
+uint8_t txqCancel(CAN_TXQ *_q, uint32_t _handle)
+{
+	if( !_handle )
+		return 0;
+
+	for(uint8_t b=0; b<3; b++)
+	{
+		if( _q->loaded[b] != 0XFF && _q->slot[_q->loaded[b]].handle == _handle )
+		{
+			_q->slot[_q->loaded[b]].action = TXQ_ACT_CANCEL;
+			canAbortTX(b);
+			return 1;
+		}
+	}
+
+	uint8_t _prev = 0XFF;
+	for(uint8_t _s=_q->head; _s!=0XFF; _s=_q->slot[_s].next)
+	{
+		if( _q->slot[_s].handle != _handle )
+		{
+			_prev = _s;
+			continue;
+		}
+
+		if( _prev == 0XFF )
+			_q->head = _q->slot[_s].next;
+		else
+			_q->slot[_prev].next = _q->slot[_s].next;
+		if( _q->tail == _s )
+			_q->tail = _prev;
+
+		txqComplete( _q, _s, txq_aborted, pal_get_time_us() );
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief This function aborts every frame of the queue at once, e.g. for an emergency stop : the queued frames
+ * are detached so nothing more is loaded, the transmit buffers are aborted together with canAbortAll(), and every
+ * frame is reported, loaded ones first. A loaded frame that left before the abort is reported as sent. The
+ * callbacks may submit new frames; they are sent normally.
+ *
+ * @param
+ * 1. _q : the queue.
+ *
+ * @return
+ * THE NUMBER OF FRAMES REPORTED ABORTED.
+ */
+uint8_t txqAbortAll(CAN_TXQ *_q)
+{
+	uint8_t _queued = _q->head;
+	uint8_t _count = 0;
+	uint8_t _clear = 0;
+
+	_q->head = 0XFF;
+	_q->tail = 0XFF;
+
+	canAbortAll();
+	uint8_t _status = canReadStatus();
+	uint32_t _now = pal_get_time_us();
+
+	for(uint8_t b=0; b<3; b++)
+	{
+		uint8_t _s = _q->loaded[b];
+		if( _s == 0XFF )
+			continue;
+
+		if( _status & ( 1 << ( MCP_STAT_TX0IF + 2 * b ) ) )
+		{
+			_clear |= 1 << ( TX0IF + b );
+			_q->loaded[b] = 0XFF;
+			txqComplete( _q, _s, txq_sent, _now );
+		}
+		else if( !( _status & ( 1 << ( MCP_STAT_TX0REQ + 2 * b ) ) ) )
+		{
+			_q->loaded[b] = 0XFF;
+			txqComplete( _q, _s, txq_aborted, _now );
+			_count++;
+		}
+	}
+
+	if( _clear )
+		canClearInterruptFlags( _clear );
+
+	while( _queued != 0XFF )
+	{
+		uint8_t _next = _q->slot[_queued].next;
+		txqComplete( _q, _queued, txq_aborted, _now );
+		_queued = _next;
+		_count++;
+	}
+
+	return _count;
+}
+
+/**
+ * @brief This function runs one pass of the queue : one READ STATUS for the three buffers, completions of the
+ * loaded frames, one BIT MODIFY clearing the TXnIF flags consumed, then the oldest queued frames go to the free
+ * buffers. A frame whose TXREQ cleared without TXnIF was aborted, by the queue (cancel, policy) or by someone
+ * else; in one shot mode it may also have failed its attempt, which MLOA or TXERR tells.
+ *
+ * @param
+ * 1. _q : the queue.
+ *
+ * @return
+ * NOTHING
+ */
+void txqService(CAN_TXQ *_q)
+{
+	uint8_t _status = canReadStatus();
+	uint32_t _now = pal_get_time_us();
+	uint8_t _one_shot = _q->policy && _q->policy->one_shot;
+	uint8_t _clear = 0;
+
+	for(uint8_t b=0; b<3; b++)
+	{
+		uint8_t _s = _q->loaded[b];
+		if( _s == 0XFF )
+			continue;
+		TXQ_ENTRY *_e = &_q->slot[_s];
+
+		if( _status & ( 1 << ( MCP_STAT_TX0IF + 2 * b ) ) )
+		{
+			_clear |= 1 << ( TX0IF + b );
+			_q->loaded[b] = 0XFF;
+			txqComplete( _q, _s, txq_sent, _now );
+			continue;
+		}
+
+		if( !( _status & ( 1 << ( MCP_STAT_TX0REQ + 2 * b ) ) ) )
+		{
+			uint8_t _ctrl = canGetControlTX(b);
+
+			if( _e->action == TXQ_ACT_BOOST )
+			{
+				_e->action = TXQ_ACT_NONE;
+				txqRetransmit( _q, b, _e, 1 );
+				continue;
+			}
+
+			if( _e->action == TXQ_ACT_NONE && _one_shot && ( _ctrl & ( (1<<MLOA) | (1<<TXERR) ) ) )
+			{
+				if( ( _ctrl & (1<<MLOA) ) && _e->arb_lost < 0XFFFF )
+					_e->arb_lost++;
+				if( ( _ctrl & (1<<TXERR) ) && _e->tx_errors < 0XFFFF )
+					_e->tx_errors++;
+
+				uint8_t _act = txqDecide( _q, _e, _now );
+				if( _act == TXQ_ACT_NONE || _act == TXQ_ACT_BOOST )
+				{
+					txqRetransmit( _q, b, _e, _act == TXQ_ACT_BOOST );
+					continue;
+				}
+				_e->action = _act;
+			}
+
+			_q->loaded[b] = 0XFF;
+			if( _e->action == TXQ_ACT_EXPIRE )
+				txqComplete( _q, _s, txq_expired, _now );
+			else if( _e->action == TXQ_ACT_DROP )
+				txqComplete( _q, _s, txq_dropped, _now );
+			else if( _e->action == TXQ_ACT_CANCEL )
+				txqComplete( _q, _s, txq_aborted, _now );
+			else
+				txqComplete( _q, _s, ( _ctrl & (1<<TXERR) ) ? txq_error : txq_aborted, _now );
+			continue;
+		}
+
+		if( _e->action != TXQ_ACT_NONE )
+			continue;
+
+#if TXQ_TRACK_ERRORS
+		if( !_one_shot )
+		{
+			uint8_t _ctrl = canGetControlTX(b);
+			if( ( _ctrl & (1<<MLOA) ) && _e->arb_lost < 0XFFFF )
+				_e->arb_lost++;
+			if( ( _ctrl & (1<<TXERR) ) && _e->tx_errors < 0XFFFF )
+				_e->tx_errors++;
+		}
+#endif
+
+		// raising TXP needs the request cleared first : the frame is aborted and requested again next pass
+		_e->action = txqDecide( _q, _e, _now );
+		if( _e->action != TXQ_ACT_NONE )
+			canAbortTX(b);
+	}
+
+	if( _clear )
+		canClearInterruptFlags( _clear );
+
+	for(uint8_t b=0; b<3 && _q->head!=0XFF; b++)
+	{
+		if( !( _q->tx_mask & (1<<b) ) || _q->loaded[b] != 0XFF || ( _status & ( 1 << ( MCP_STAT_TX0REQ + 2 * b ) ) ) )
+			continue;
+
+		// stale frames are dropped here and never reach the chip
+		uint8_t _s;
+		TXQ_ENTRY *_e;
+		do
+		{
+			_s = _q->head;
+			_e = &_q->slot[_s];
+			_q->head = _e->next;
+			if( _q->head == 0XFF )
+				_q->tail = 0XFF;
+			if( !txqExpired( _e, _now ) )
+				break;
+			txqComplete( _q, _s, txq_expired, _now );
+			_s = 0XFF;
+		}while( _q->head != 0XFF );
+
+		if( _s == 0XFF )
+			break;
+
+		if( _q->policy && _q->prio[b] != _q->policy->base_prio )
+		{
+			canSetPriorityTX( b, _q->policy->base_prio );
+			_q->prio[b] = _q->policy->base_prio;
+		}
+		_e->prio = _q->prio[b];
+
+		canLoadRawTX( b, _e->raw );
+		_e->loaded = 1;
+		_e->buff = b;
+		_e->load_us = pal_get_time_us();
+		_q->loaded[b] = _s;
+	}
+}
+
+/**
+ * @brief This function takes the oldest completion of the frames submitted without a callback.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _result : receives the completion.
+ *
+ * @return
+ * 1 : IF A COMPLETION WAS TAKEN
+ * 0 : IF THERE IS NONE
+ */
+uint8_t txqPoll(CAN_TXQ *_q, TXQ_RESULT *_result)
+{
+	if( _q->res_head == _q->res_tail )
+		return 0;
+
+	*_result = _q->results[_q->res_tail];
+	_q->res_tail = ( _q->res_tail + 1 ) & ( TXQ_RESULTS - 1 );
+	return 1;
+}
+
+/**
+ * @brief This function sets the retransmission policy of a queue and puts the chip in or out of one shot mode
+ * accordingly. The policy is kept by pointer.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _policy : the policy, NULL to leave the TXP bits alone and let the chip retransmit.
+ *
+ * @return
+ * NOTHING
+ */
+void txqSetPolicy(CAN_TXQ *_q, const TXQ_POLICY *_policy)
+{
+	_q->policy = _policy;
+	canSetOneShotTX( _policy && _policy->one_shot );
+}
+
+/**
+ * @brief This function gives a queue a table for statistics per ID. The table is cleared.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _table : the table, NULL to stop counting per ID.
+ * 3. _size : number of entries, a power of two.
+ *
+ * @return
+ * NOTHING
+ */
+void txqSetStatsTable(CAN_TXQ *_q, TXQ_ID_STATS *_table, uint16_t _size)
+{
+	_q->ids = _table;
+	_q->ids_size = _table ? _size : 0;
+	txqClearStats( _q );
+}
+
+/**
+ * @brief This function clears the statistics per buffer and per ID.
+ *
+ * @param
+ * 1. _q : the queue.
+ *
+ * @return
+ * NOTHING
+ */
+void txqClearStats(CAN_TXQ *_q)
+{
+	static const TXQ_STATS _zero;
+
+	for(uint8_t b=0; b<3; b++)
+		_q->buff_stats[b] = _zero;
+	for(uint16_t i=0; i<_q->ids_size; i++)
+	{
+		_q->ids[i].key = 0;
+		_q->ids[i].stats = _zero;
+	}
+	_q->ids_lost = 0;
+}
+
+/**
+ * @brief This function gets the statistics of an ID.
+ *
+ * @param
+ * 1. _q : the queue.
+ * 2. _type : can_standard or can_extended.
+ * 3. _id : the identifier.
+ *
+ * @return
+ * THE STATISTICS, NULL WHEN NO FRAME OF THE ID HAS COMPLETED.
+ */
+const TXQ_STATS *txqGetIDStats(const CAN_TXQ *_q, CAN_FRAME_TYPE _type, uint32_t _id)
+{
+	if( !_q->ids )
+		return 0;
+
+	uint32_t _key = ( _id & 0X1FFFFFFF ) | TXQ_KEY_USED | ( _type == can_extended ? TXQ_KEY_EXT : 0 );
+	uint32_t _pos = ( _key * 2654435761UL ) & ( _q->ids_size - 1 );
+
+	for(uint16_t i=0; i<_q->ids_size; i++)
+	{
+		if( _q->ids[_pos].key == _key )
+			return &_q->ids[_pos].stats;
+		if( _q->ids[_pos].key == 0 )
+			return 0;
+		_pos = ( _pos + 1 ) & ( _q->ids_size - 1 );
+	}
+
+	return 0;
+}
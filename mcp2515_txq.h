@@ -0,0 +1,160 @@
+/**
+ * @file mcp2515_txq.h
+ * @brief Transmit queue with completion reporting. Frames are submitted to a software queue and get a handle; the
+ * queue loads them into the free transmit buffers and reports each completion (sent, aborted or error) through a
+ * callback, or through a completion ring when the frame has no callback.
+ *
+ * Completions are detected from the TXnIF flags : txqService() reads them with one READ STATUS for the three
+ * buffers and clears the flags it consumed with one BIT MODIFY, so nothing spins on canIsFreeTX(). Call it in a
+ * loop or on the chip's interrupt with TXnIE enabled.
+ *
+ * Frames loaded into several buffers at once leave in buffer priority order (TXP, then the highest buffer number
+ * first), not in submission order. Give the queue a single buffer when the order matters.
+ *
+ * Arbitration losses, bus errors and retransmissions are counted per frame, per buffer and, with a statistics
+ * table, per ID. A policy can raise the TXP bits of a frame that keeps losing arbitration and drop a frame after
+ * a number of losses or a time in the transmit buffer. The chip retransmits by itself and only keeps sticky MLOA
+ * and TXERR flags, so the counts are the txqService() passes that saw them; in one shot mode the queue
+ * retransmits itself and every attempt is counted exactly.
+ *
+ * A frame may carry a deadline : past it, the frame is aborted if it is in a transmit buffer, skipped if it is
+ * still queued, and reported as expired, so a stale control frame never reaches the bus late.
+*/
+#ifndef MCP2515_TXQ
+#define MCP2515_TXQ
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Number of frames a queue holds, queued and loaded ones together, at most 255.
+*/
+#ifndef TXQ_SLOTS
+#define TXQ_SLOTS 16
+#endif
+
+/**
+ * @brief Number of completions the ring holds for frames submitted without a callback, a power of two.
+*/
+#ifndef TXQ_RESULTS
+#define TXQ_RESULTS 16
+#endif
+
+/**
+ * @brief Set to 1 to read the control register of the buffers still pending in each txqService() pass and count
+ * the passes in which the frame had lost arbitration or met a bus error. Costs one SPI read per pending buffer.
+*/
+#ifndef TXQ_TRACK_ERRORS
+#define TXQ_TRACK_ERRORS 1
+#endif
+
+typedef enum TXQ_STATUS{ txq_sent=0, txq_aborted=1, txq_error=2, txq_dropped=3, txq_expired=4 }TXQ_STATUS;
+
+typedef struct TXQ_POLICY
+{
+	uint8_t one_shot;			/* 1 to put the chip in one shot mode and retransmit from the queue */
+	uint8_t base_prio;			/* TXP given to every frame when it is loaded, 0 to 3 */
+	uint8_t boost_after;		/* losses that raise TXP by one step, again after as many more, 0 never */
+	uint16_t drop_after;		/* losses after which the frame is dropped, 0 never */
+	uint32_t max_pending_us;	/* time in the transmit buffer after which the frame is dropped, 0 never */
+}TXQ_POLICY;
+
+typedef struct TXQ_STATS
+{
+	uint32_t sent;
+	uint32_t aborted;			/* aborted and error completions */
+	uint32_t dropped;			/* dropped by the policy */
+	uint32_t expired;			/* dropped at their deadline, queued or loaded */
+	uint32_t arb_lost;
+	uint32_t tx_errors;
+	uint32_t retransmits;		/* transmissions requested again by the queue */
+}TXQ_STATS;
+
+typedef struct TXQ_ID_STATS
+{
+	uint32_t key;				/* ID | TXQ_KEY_USED, extended flag in TXQ_KEY_EXT */
+	TXQ_STATS stats;
+}TXQ_ID_STATS;
+
+#define TXQ_KEY_USED 0X80000000UL
+#define TXQ_KEY_EXT 0X40000000UL
+
+typedef struct TXQ_RESULT
+{
+	uint32_t handle;
+	TXQ_STATUS status;
+	CAN_FRAME_TYPE type;
+	uint32_t id;
+	uint16_t arb_lost;			/* arbitration losses */
+	uint16_t tx_errors;			/* bus errors */
+	uint16_t retransmits;
+	uint32_t queued_us;			/* from txqSubmit() to loading the transmit buffer */
+	uint32_t latency_us;		/* from txqSubmit() to the pass that saw the completion */
+}TXQ_RESULT;
+
+typedef void (*TXQ_DONE)(const TXQ_RESULT *, void *);
+
+typedef struct TXQ_ENTRY
+{
+	uint8_t raw[13];			/* SIDH, SIDL, EID8, EID0, DLC, D0 to D7 */
+	CAN_FRAME_TYPE type;
+	uint32_t id;
+	uint32_t handle;			/* 0 when the slot is free */
+	uint8_t loaded;				/* 1 while in a transmit buffer */
+	uint8_t buff;
+	uint8_t next;				/* next queued slot, 0XFF at the end */
+	uint8_t action;				/* abort requested by the queue, see txqService() */
+	uint8_t prio;				/* current TXP */
+	uint8_t timed;				/* 1 when deadline_us applies */
+	uint32_t deadline_us;
+	uint16_t arb_lost;
+	uint16_t tx_errors;
+	uint16_t retransmits;
+	uint32_t submit_us;
+	uint32_t load_us;
+	TXQ_DONE done;
+	void *ctx;
+}TXQ_ENTRY;
+
+typedef struct CAN_TXQ
+{
+	TXQ_ENTRY slot[TXQ_SLOTS];
+	uint8_t head;				/* oldest queued slot, 0XFF when none */
+	uint8_t tail;
+	uint8_t loaded[3];			/* slot in each transmit buffer, 0XFF when none */
+	uint8_t tx_mask;			/* transmit buffers used, bit n for buffer n */
+	uint8_t prio[3];			/* TXP last set on each buffer, 0XFF when unknown */
+	const TXQ_POLICY *policy;
+	uint32_t next_handle;
+	TXQ_RESULT results[TXQ_RESULTS];
+	uint16_t res_head;
+	uint16_t res_tail;
+	uint32_t results_lost;		/* completions dropped because the ring was full */
+	TXQ_STATS buff_stats[3];
+	TXQ_ID_STATS *ids;			/* NULL or ids_size entries */
+	uint16_t ids_size;			/* power of two */
+	uint32_t ids_lost;			/* completions of new IDs that found the table full */
+}CAN_TXQ;
+
+void txqBegin(CAN_TXQ *, uint8_t);
+
+uint32_t txqSubmit(CAN_TXQ *, const CAN_FRAME *, TXQ_DONE, void *);
+
+uint32_t txqSubmit_wDeadline(CAN_TXQ *, const CAN_FRAME *, uint32_t, TXQ_DONE, void *);
+
+uint8_t txqCancel(CAN_TXQ *, uint32_t);
+
+uint8_t txqAbortAll(CAN_TXQ *);
+
+void txqService(CAN_TXQ *);
+
+uint8_t txqPoll(CAN_TXQ *, TXQ_RESULT *);
+
+void txqSetPolicy(CAN_TXQ *, const TXQ_POLICY *);
+
+void txqSetStatsTable(CAN_TXQ *, TXQ_ID_STATS *, uint16_t);
+
+void txqClearStats(CAN_TXQ *);
+
+const TXQ_STATS *txqGetIDStats(const CAN_TXQ *, CAN_FRAME_TYPE, uint32_t);
+
+#endif
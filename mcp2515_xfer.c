@@ -0,0 +1,500 @@
+/**
+ * @file mcp2515_xfer.c
+ * @brief Priority scheduler of SPI transactions, one queue per class ordered by deadline.
+*/
+
+#include "mcp2515_xfer.h"
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to tell whether a window goes before another of the same class : timed windows by
+ * deadline, before the untimed ones, and in submission order otherwise.
+*/
+static uint8_t xferBefore(const CAN_XFER *_a, const CAN_XFER *_b)
+{
+	if( _a->timed != _b->timed )
+		return _a->timed;
+	return _a->timed && (int32_t)( _a->deadline_us - _b->deadline_us ) < 0;
+}
+
+/**
+ * @brief Utility function to clock one window out on the device it names. The binding of palUse() is per thread
+ * with MCP_PAL_LOCKING, so pointing the calling thread at the device for one window leaves the other threads alone;
+ * an interrupt handler that talks to a chip binds its own device on entry and puts the previous one back on exit.
+*/
+static void xferClock(CAN_XFER *_x)
+{
+#ifdef MCP_PAL_DYNAMIC
+	const MCP_PAL_OPS *_prev = _x->dev ? palUse( _x->dev ) : 0;
+#endif
+
+	pal_select_slave();
+	for(uint8_t i=0; i<_x->n_tx; i++)
+		pal_spi_send( _x->tx[i] );
+	for(uint8_t i=0; i<_x->n_rx; i++)
+		_x->rx[i] = pal_spi_read();
+	pal_deselect_slave();
+
+#ifdef MCP_PAL_DYNAMIC
+	if( _x->dev )
+		palUse( _prev );
+#endif
+}
+
+/**
+ * @brief Utility function to set the class and the sizes of a window being built. The window is marked as not
+ * queued, so a builder must not be used on a queued window.
+*/
+static void xferSetup(CAN_XFER *_x, XFER_CLASS _cls, uint8_t _n_tx, uint8_t _n_rx)
+{
+	_x->next = 0;
+	_x->queued = 0;
+	_x->cls = _cls;
+	_x->n_tx = _n_tx;
+	_x->n_rx = _n_rx;
+}
+
+/**
+ * @brief Utility function to leave a window that a builder refuses with no bytes to clock, so xferSubmit() refuses it
+ * as well when the result of the builder is not looked at.
+*/
+static uint8_t xferReject(CAN_XFER *_x, XFER_CLASS _cls)
+{
+	xferSetup( _x, _cls, 0, 0 );
+	return 0;
+}
+
+/**
+ * @brief Utility function to build the WRITE of the four ID registers of a mask or a filter, as canSetMaskRX()
+ * and canSetFilterRX() write them : SIDH and SIDL only for a standard filter.
+*/
+static void xferSetID(CAN_XFER *_x, uint8_t _addr, uint32_t _id, uint8_t _n, uint8_t _exide)
+{
+	xferSetup( _x, xfer_config, 2 + _n, 0 );
+	_x->tx[0] = MCP_WRITE;
+	_x->tx[1] = _addr;
+	_x->tx[2] = _id >> 21;
+	_x->tx[3] = ( _id >> 13 & 0XE0 ) | ( _id >> 16 & 3 ) | ( _exide ? (1<<EXIDE) : 0 );
+	_x->tx[4] = _id >> 8;
+	_x->tx[5] = _id;
+}
+
+/**
+ * @brief Utility function given to canSetReaderRX() : reads a receive buffer as an xfer_rx_drain window of the
+ * attached scheduler, which clocks it after the drains already queued and before every other class.
+*/
+static void xferReaderRX(uint8_t _buff, CAN_FRAME *_out, void *_ctx)
+{
+	CAN_XFER_SCHED *_s = (CAN_XFER_SCHED *)_ctx;
+	CAN_XFER _x;
+
+	if( !xferReadRX( &_x, _buff ) )
+		return;
+	_x.done = 0;
+	_x.ctx = 0;
+#ifdef MCP_PAL_DYNAMIC
+	// the device canServiceRX() was called for
+	_x.dev = MCP_PAL_CURRENT;
+#endif
+	xferSubmit( _s, &_x, 0 );
+	while( _x.queued )
+		xferRun( _s, 1 );
+
+	canDecodeRaw( _x.rx, _out );
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function initializes the scheduler with empty queues and cleared statistics.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ *
+ * @return
+ * NOTHING
+ */
+void xferBegin(CAN_XFER_SCHED *_s)
+{
+	for(uint8_t c=0; c<XFER_CLASSES; c++)
+	{
+		_s->head[c] = 0;
+		_s->stats[c] = (XFER_STATS){ 0, 0, 0, 0, 0, 0, 0, 0 };
+	}
+}
+
+/**
+ * @brief This function queues a window built with one of the xfer* builders, or filled in by hand. Nothing is
+ * clocked before the next xferRun().
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _x : the window; cls, tx, n_tx, n_rx, done and ctx set.
+ * 3. _budget_us : time from now within which the window should start, 0 for none. Orders the windows of a class.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : the window is already queued, or its class or sizes are out of range
+ */
+uint8_t xferSubmit(CAN_XFER_SCHED *_s, CAN_XFER *_x, uint32_t _budget_us)
+{
+	if( _x->queued || (uint8_t)_x->cls >= XFER_CLASSES || !_x->n_tx || _x->n_tx > XFER_MAX_TX
+		|| _x->n_rx > XFER_MAX_RX )
+		return 0;
+
+	_x->submit_us = pal_get_time_us();
+	_x->timed = _budget_us ? 1 : 0;
+	_x->deadline_us = _x->submit_us + _budget_us;
+
+	// after every window it does not go before : equal deadlines keep the submission order
+	CAN_XFER **_pp = &_s->head[_x->cls];
+	while( *_pp && !xferBefore( _x, *_pp ) )
+		_pp = &(*_pp)->next;
+	_x->next = *_pp;
+	*_pp = _x;
+	_x->queued = 1;
+
+	XFER_STATS *_st = &_s->stats[_x->cls];
+	_st->submitted++;
+	if( ++_st->depth > _st->max_depth )
+		_st->max_depth = _st->depth;
+
+	return 1;
+}
+
+/**
+ * @brief This function removes a window from its queue before it is clocked. Its callback is not called.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _x : the window.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : the window is not queued
+ */
+uint8_t xferCancel(CAN_XFER_SCHED *_s, CAN_XFER *_x)
+{
+	if( !_x->queued )
+		return 0;
+
+	for(CAN_XFER **_pp = &_s->head[_x->cls]; *_pp; _pp = &(*_pp)->next)
+	{
+		if( *_pp != _x )
+			continue;
+
+		*_pp = _x->next;
+		_x->next = 0;
+		_x->queued = 0;
+		_s->stats[_x->cls].depth--;
+		_s->stats[_x->cls].cancelled++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief This function clocks queued windows one at a time. Before each window the queues are looked at again from
+ * the most urgent class, so a window submitted by a callback goes ahead of the less urgent ones already queued.
+ * The queues are not locked : submit and run from one thread, never from an interrupt handler.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _max : most windows to clock, 0 to run until the queues are empty.
+ *
+ * @return
+ * THE NUMBER OF WINDOWS CLOCKED.
+ */
+uint16_t xferRun(CAN_XFER_SCHED *_s, uint16_t _max)
+{
+	uint16_t _runs = 0;
+
+	while( !_max || _runs < _max )
+	{
+		uint8_t c = 0;
+		while( c < XFER_CLASSES && !_s->head[c] )
+			c++;
+		if( c == XFER_CLASSES )
+			break;
+
+		CAN_XFER *_x = _s->head[c];
+		_s->head[c] = _x->next;
+		_x->next = 0;
+		_x->queued = 0;
+
+		XFER_STATS *_st = &_s->stats[c];
+		_st->depth--;
+
+		uint32_t _now = pal_get_time_us();
+		_x->wait_us = _now - _x->submit_us;
+		_st->wait_total_us += _x->wait_us;
+		if( _x->wait_us > _st->wait_max_us )
+			_st->wait_max_us = _x->wait_us;
+		if( _x->timed && (int32_t)( _now - _x->deadline_us ) > 0 )
+			_st->misses++;
+
+		xferClock( _x );
+		_st->completed++;
+		_runs++;
+
+		if( _x->done )
+			_x->done( _x, _x->ctx );
+	}
+
+	return _runs;
+}
+
+/**
+ * @brief This function copies the statistics of a class. The mean wait is wait_total_us / completed.
+ *
+ * @param
+ * 1. _s : the scheduler.
+ * 2. _cls : the class.
+ * 3. _out : receives the statistics.
+ *
+ * @return
+ * NOTHING
+ */
+void xferGetStats(const CAN_XFER_SCHED *_s, XFER_CLASS _cls, XFER_STATS *_out)
+{
+	*_out = _s->stats[ (uint8_t)_cls < XFER_CLASSES ? _cls : xfer_diag ];
+}
+
+/**
+ * @brief This function builds the READ RX BUFFER window of a receive buffer, class xfer_rx_drain. rx receives SIDH
+ * to D7 as for canReadRawRX(), and the chip releases the buffer at the end of the window.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _buff : the receive buffer number, 0 or 1.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : no such buffer, the window is left empty
+ */
+uint8_t xferReadRX(CAN_XFER *_x, uint8_t _buff)
+{
+	if( _buff > 1 )
+		return xferReject( _x, xfer_rx_drain );
+
+	xferSetup( _x, xfer_rx_drain, 1, 13 );
+	_x->tx[0] = _buff ? MCP_READ_RX1_ID : MCP_READ_RX0_ID;
+	return 1;
+}
+
+/**
+ * @brief This function builds the LOAD TX BUFFER window of a transmit buffer, class xfer_tx_load. Only DLC data
+ * bytes are clocked; the transmission is requested by a following xferRTS() window.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _buff : the transmit buffer number, 0 to 2.
+ * 3. _raw : SIDH, SIDL, EID8, EID0, DLC, D0 to D7, as for canLoadRawTX().
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : no such buffer, the window is left empty
+ */
+uint8_t xferLoadTX(CAN_XFER *_x, uint8_t _buff, const uint8_t _raw[13])
+{
+	if( _buff > 2 )
+		return xferReject( _x, xfer_tx_load );
+
+	uint8_t _dlc = _raw[4] & 0X0F;
+	uint8_t _n = 5 + ( ( _raw[4] & (1<<RTR) ) ? 0 : ( _dlc > 8 ? 8 : _dlc ) );
+
+	xferSetup( _x, xfer_tx_load, 1 + _n, 0 );
+	_x->tx[0] = MCP_LOAD_TX0_ID + 2 * _buff;
+	for(uint8_t i=0; i<_n; i++)
+		_x->tx[1 + i] = _raw[i];
+	return 1;
+}
+
+/**
+ * @brief This function builds the RTS window that requests the transmission of transmit buffers, class xfer_tx_load.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _mask : the transmit buffers, bit n for buffer n.
+ *
+ * @return
+ * NOTHING
+ */
+void xferRTS(CAN_XFER *_x, uint8_t _mask)
+{
+	xferSetup( _x, xfer_tx_load, 1, 0 );
+	// RTS carries the buffers in its three low bits, MCP_RTS_ALL when all of them are set
+	_x->tx[0] = ( MCP_RTS_ALL & ~0X07 ) | ( _mask & 0X07 );
+}
+
+/**
+ * @brief This function builds the READ STATUS window, class xfer_tx_complete. rx[0] receives the status as returned
+ * by canReadStatus().
+ *
+ * @param
+ * 1. _x : the window.
+ *
+ * @return
+ * NOTHING
+ */
+void xferReadStatus(CAN_XFER *_x)
+{
+	xferSetup( _x, xfer_tx_complete, 1, 1 );
+	_x->tx[0] = MCP_READ_STATUS;
+}
+
+/**
+ * @brief This function builds a sequential READ window.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _cls : the class.
+ * 3. _addr : the first register.
+ * 4. _n : the number of registers, at most XFER_MAX_RX.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : too many registers, the window is left empty
+ */
+uint8_t xferRead(CAN_XFER *_x, XFER_CLASS _cls, uint8_t _addr, uint8_t _n)
+{
+	if( _n > XFER_MAX_RX )
+		return xferReject( _x, _cls );
+
+	xferSetup( _x, _cls, 2, _n );
+	_x->tx[0] = MCP_READ;
+	_x->tx[1] = _addr;
+	return 1;
+}
+
+/**
+ * @brief This function builds a sequential WRITE window.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _cls : the class.
+ * 3. _addr : the first register.
+ * 4. _data : the values.
+ * 5. _n : the number of registers, at most XFER_MAX_TX - 2.
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : too many registers, the window is left empty
+ */
+uint8_t xferWrite(CAN_XFER *_x, XFER_CLASS _cls, uint8_t _addr, const uint8_t *_data, uint8_t _n)
+{
+	if( _n > XFER_MAX_TX - 2 )
+		return xferReject( _x, _cls );
+
+	xferSetup( _x, _cls, 2 + _n, 0 );
+	_x->tx[0] = MCP_WRITE;
+	_x->tx[1] = _addr;
+	for(uint8_t i=0; i<_n; i++)
+		_x->tx[2 + i] = _data[i];
+	return 1;
+}
+
+/**
+ * @brief This function builds a BIT MODIFY window.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _cls : the class.
+ * 3. _addr : the register, one of those that allow bit modify.
+ * 4. _mask : the bits to change.
+ * 5. _val : their new values.
+ *
+ * @return
+ * NOTHING
+ */
+void xferBitModify(CAN_XFER *_x, XFER_CLASS _cls, uint8_t _addr, uint8_t _mask, uint8_t _val)
+{
+	xferSetup( _x, _cls, 4, 0 );
+	_x->tx[0] = MCP_BIT_MODIFY;
+	_x->tx[1] = _addr;
+	_x->tx[2] = _mask;
+	_x->tx[3] = _val;
+}
+
+/**
+ * @brief This function builds the BIT MODIFY window of CANCTRL that requests a mode, class xfer_config. The chip
+ * enters the mode when it is ready, e.g. configuration mode once the frame on the bus has ended : read CANSTAT,
+ * or call canGetMode(), before windows that need the mode.
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _mode : the mode.
+ *
+ * @return
+ * NOTHING
+ */
+void xferRequestMode(CAN_XFER *_x, MCP_CAN_MODE _mode)
+{
+	xferBitModify( _x, xfer_config, CANCTRL, 0XE0, _mode << 5 );
+}
+
+/**
+ * @brief This function builds the WRITE window of a mask, class xfer_config, with the bytes canSetMaskRX() writes.
+ * The chip takes it in configuration mode only, see xferRequestMode().
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _num : the mask number, 0 or 1.
+ * 3. _mask : the mask, laid out as for canSetMaskRX().
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : no such mask, the window is left empty
+ */
+uint8_t xferSetMask(CAN_XFER *_x, uint8_t _num, uint32_t _mask)
+{
+	if( _num > 1 )
+		return xferReject( _x, xfer_config );
+
+	xferSetID( _x, _num ? RXM1SIDH : RXM0SIDH, _mask, 4, 0 );
+	return 1;
+}
+
+/**
+ * @brief This function builds the WRITE window of a filter, class xfer_config, with the bytes canSetFilterRX()
+ * writes. The chip takes it in configuration mode only, see xferRequestMode().
+ *
+ * @param
+ * 1. _x : the window.
+ * 2. _num : the filter number, 0 to 5.
+ * 3. _frame : can_standard or can_extended.
+ * 4. _filter : the filter, laid out as for canSetFilterRX().
+ *
+ * @return
+ * 1. SUCCESS
+ * 2. FAILED : no such filter, the window is left empty
+ */
+uint8_t xferSetFilter(CAN_XFER *_x, uint8_t _num, CAN_FRAME_TYPE _frame, uint32_t _filter)
+{
+	static const uint8_t _addr[6] = { RXF0SIDH, RXF1SIDH, RXF2SIDH, RXF3SIDH, RXF4SIDH, RXF5SIDH };
+
+	if( _num > 5 )
+		return xferReject( _x, xfer_config );
+
+	xferSetID( _x, _addr[_num], _filter, _frame == can_extended ? 4 : 2, _frame == can_extended );
+	return 1;
+}
+
+/**
+ * @brief This function makes canServiceRX() read the receive buffers through a scheduler : each filled buffer is
+ * an xfer_rx_drain window, clocked ahead of every other class queued. canServiceRX() then runs the scheduler, so it
+ * must be called from the thread that runs it and no longer from an interrupt handler.
+ *
+ * @param
+ * 1. _s : the scheduler, NULL to read the buffers directly again.
+ *
+ * @return
+ * NOTHING
+ */
+void xferAttachRX(CAN_XFER_SCHED *_s)
+{
+	canSetReaderRX( _s ? xferReaderRX : 0, _s );
+}
@@ -0,0 +1,124 @@
+/**
+ * @file mcp2515_xfer.h
+ * @brief Priority scheduler of SPI transactions, for chips sharing one SPI bus with each other and with other
+ * peripherals. Every chip select window is a descriptor with a class; xferRun() clocks the queued windows one at a
+ * time, the highest class first and, within a class, the earliest deadline first. A long sequence (reconfiguration
+ * of the filters, loading of a queue of frames) is submitted as several windows, so an urgent receive drain gets
+ * the bus after the window in progress instead of after the whole sequence.
+ *
+ * The descriptors are supplied by the application and must stay valid while queued. With MCP_PAL_DYNAMIC each one
+ * names the device it is meant for, and the queues mix the windows of every device on the bus.
+ *
+ * The queues have no lock : submit, cancel and run from one thread, never from an interrupt handler. A handler that
+ * should go ahead of the queued windows calls canServiceRX() after xferAttachRX(), from the thread that runs the
+ * scheduler.
+*/
+#ifndef MCP2515_XFER
+#define MCP2515_XFER
+
+#include "mcp2515_driver.h"
+
+/**
+ * @brief Longest window : bytes clocked out, then bytes clocked in. LOAD TX BUFFER with a whole frame takes 14.
+*/
+#ifndef XFER_MAX_TX
+#define XFER_MAX_TX 16
+#endif
+
+#ifndef XFER_MAX_RX
+#define XFER_MAX_RX 16
+#endif
+
+/**
+ * @brief Classes of windows, most urgent first.
+*/
+typedef enum XFER_CLASS
+{
+	xfer_rx_drain=0,			/* reads of the receive buffers, late ones overrun */
+	xfer_tx_complete=1,			/* status reads and flag clears after a transmission */
+	xfer_tx_load=2,				/* loading of transmit buffers and RTS */
+	xfer_config=3,				/* masks, filters, modes, bit timing */
+	xfer_diag=4					/* error counters, snapshots */
+}XFER_CLASS;
+
+#define XFER_CLASSES 5
+
+struct CAN_XFER;
+
+/**
+ * @brief Called by xferRun() once the window is clocked; rx holds the bytes read. The descriptor is no longer
+ * queued and may be submitted again from the callback.
+*/
+typedef void (*XFER_DONE)(struct CAN_XFER *, void *);
+
+typedef struct CAN_XFER
+{
+	struct CAN_XFER *next;		/* queue link, owned by the scheduler */
+	XFER_CLASS cls;
+#ifdef MCP_PAL_DYNAMIC
+	const MCP_PAL_OPS *dev;		/* device of the window, NULL for the current one */
+#endif
+	uint8_t tx[XFER_MAX_TX];
+	uint8_t n_tx;
+	uint8_t rx[XFER_MAX_RX];
+	uint8_t n_rx;
+	uint8_t queued;
+	uint8_t timed;				/* 1 when deadline_us applies */
+	uint32_t deadline_us;
+	uint32_t submit_us;
+	uint32_t wait_us;			/* from submission to the start of the window, last run */
+	XFER_DONE done;				/* may be NULL */
+	void *ctx;
+}CAN_XFER;
+
+typedef struct XFER_STATS
+{
+	uint32_t submitted;
+	uint32_t completed;
+	uint32_t cancelled;
+	uint32_t misses;			/* windows started after their deadline */
+	uint16_t depth;				/* windows queued now */
+	uint16_t max_depth;
+	uint64_t wait_total_us;		/* from submission to the start of the window, all completed windows */
+	uint32_t wait_max_us;
+}XFER_STATS;
+
+typedef struct CAN_XFER_SCHED
+{
+	CAN_XFER *head[XFER_CLASSES];	/* one queue per class, timed windows by deadline then untimed ones */
+	XFER_STATS stats[XFER_CLASSES];
+}CAN_XFER_SCHED;
+
+void xferBegin(CAN_XFER_SCHED *);
+
+uint8_t xferSubmit(CAN_XFER_SCHED *, CAN_XFER *, uint32_t);
+
+uint8_t xferCancel(CAN_XFER_SCHED *, CAN_XFER *);
+
+uint16_t xferRun(CAN_XFER_SCHED *, uint16_t);
+
+void xferGetStats(const CAN_XFER_SCHED *, XFER_CLASS, XFER_STATS *);
+
+uint8_t xferReadRX(CAN_XFER *, uint8_t);
+
+uint8_t xferLoadTX(CAN_XFER *, uint8_t, const uint8_t [13]);
+
+void xferRTS(CAN_XFER *, uint8_t);
+
+void xferReadStatus(CAN_XFER *);
+
+uint8_t xferRead(CAN_XFER *, XFER_CLASS, uint8_t, uint8_t);
+
+uint8_t xferWrite(CAN_XFER *, XFER_CLASS, uint8_t, const uint8_t *, uint8_t);
+
+void xferBitModify(CAN_XFER *, XFER_CLASS, uint8_t, uint8_t, uint8_t);
+
+void xferRequestMode(CAN_XFER *, MCP_CAN_MODE);
+
+uint8_t xferSetMask(CAN_XFER *, uint8_t, uint32_t);
+
+uint8_t xferSetFilter(CAN_XFER *, uint8_t, CAN_FRAME_TYPE, uint32_t);
+
+void xferAttachRX(CAN_XFER_SCHED *);
+
+#endif
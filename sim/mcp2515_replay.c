@@ -0,0 +1,166 @@
+/**
+ * @file mcp2515_replay.c
+ * @brief Platform abstraction layer that replays a trace dump written by traceDump().
+*/
+
+#define MCP_PAL_IMPLEMENTATION
+#include "mcp2515_replay.h"
+
+static const uint8_t *_dump;
+static uint32_t _len;
+static uint32_t _pos;
+
+static TRACE_RECORD _rec;
+static uint8_t _valid;
+static uint32_t _index;
+static uint32_t _now;
+
+static REPLAY_STATS _stats;
+
+/**
+ * @brief This function starts replaying a dump.
+ *
+ * @param
+ * 1. _buf : the dump, it must stay valid during the replay.
+ * 2. _size : length of the dump in bytes.
+ *
+ * @return
+ * 1 : IF THE DUMP HAS A VALID HEADER
+ * 0 : OTHERWISE
+ */
+uint8_t replayBegin(const uint8_t *_buf, uint32_t _size)
+{
+	_stats.windows = 0;
+	_stats.bytes = 0;
+	_stats.mismatches = 0;
+	_stats.overruns = 0;
+	_valid = 0;
+	_now = 0;
+
+	if( !traceCheckHeader( _buf, _size ) )
+	{
+		_dump = 0;
+		_len = 0;
+		return 0;
+	}
+
+	_dump = _buf;
+	_len = _size;
+	_pos = TRACE_HEADER_SIZE;
+	return 1;
+}
+
+/**
+ * @brief This function checks whether every window of the dump has been replayed.
+ *
+ * @param NONE
+ *
+ * @return
+ * 1 : IF THE DUMP IS EXHAUSTED
+ * 0 : OTHERWISE
+ */
+uint8_t replayDone(void)
+{
+	uint32_t _p = _pos;
+	TRACE_RECORD _r;
+	return !_dump || !traceNextRecord( _dump, _len, &_p, &_r );
+}
+
+/**
+ * @brief This function copies the replay counters.
+ *
+ * @param
+ * 1. _out : destination for the counters.
+ *
+ * @return NOTHING
+ */
+void replayGetStats(REPLAY_STATS *_out)
+{
+	*_out = _stats;
+}
+
+
+
+/*
+ * 		!	 P L A T F O R M		A B S T R A C T I O N		L A Y E R		!
+ */
+
+
+void pal_spi_init(void *data, uint8_t data_direction, uint8_t idle_level, uint8_t shift_edge)
+{
+	(void)data;
+	(void)data_direction;
+	(void)idle_level;
+	(void)shift_edge;
+}
+
+void pal_select_slave(void)
+{
+	_stats.windows++;
+	_index = 0;
+	_valid = _dump && traceNextRecord( _dump, _len, &_pos, &_rec );
+	if( _valid )
+		_now = _rec.ts;
+	else
+		_stats.overruns++;
+}
+
+void pal_deselect_slave(void)
+{
+	// a window that ends early leaves recorded bytes unconsumed
+	if( _valid && _index < _rec.n )
+		_stats.mismatches++;
+	_valid = 0;
+}
+
+void pal_spi_send(uint8_t byt)
+{
+	_stats.bytes++;
+
+	if( !_valid || _index >= _rec.n )
+	{
+		_stats.overruns++;
+		return;
+	}
+
+	if( TRACE_IS_MISO( &_rec, _index ) || _rec.bytes[_index] != byt )
+		_stats.mismatches++;
+	_index++;
+}
+
+uint8_t pal_spi_read(void)
+{
+	_stats.bytes++;
+
+	if( !_valid || _index >= _rec.n )
+	{
+		_stats.overruns++;
+		return 0XFF;
+	}
+
+	if( !TRACE_IS_MISO( &_rec, _index ) )
+		_stats.mismatches++;
+	return _rec.bytes[_index++];
+}
+
+uint32_t pal_get_time_us(void)
+{
+	return _now;
+}
+
+// a replay runs on one thread, the locks have nothing to do
+void pal_lock(void)
+{
+}
+
+void pal_unlock(void)
+{
+}
+
+void pal_state_lock(void)
+{
+}
+
+void pal_state_unlock(void)
+{
+}
@@ -0,0 +1,29 @@
+/**
+ * @file mcp2515_replay.h
+ * @brief Platform abstraction layer that replays a trace dump written by traceDump(). It is linked in place of
+ * mcp2515_driver_pal.c (or the simulator) and feeds the recorded MISO bytes back to the driver, window by window,
+ * while checking that the driver sends the recorded MOSI bytes.
+*/
+#ifndef MCP2515_REPLAY
+#define MCP2515_REPLAY
+
+#include "mcp2515_trace_reader.h"
+
+/**
+ * @brief Replay counters.
+*/
+typedef struct REPLAY_STATS
+{
+	uint32_t windows;		/* chip select windows opened by the driver */
+	uint32_t bytes;			/* bytes clocked by the driver */
+	uint32_t mismatches;	/* bytes that differ from the recording in value or direction */
+	uint32_t overruns;		/* bytes or windows the driver clocked beyond the recording */
+}REPLAY_STATS;
+
+uint8_t replayBegin(const uint8_t *, uint32_t);
+
+uint8_t replayDone(void);
+
+void replayGetStats(REPLAY_STATS *);
+
+#endif
@@ -0,0 +1,817 @@
+/**
+ * @file mcp2515_sim.c
+ * @brief Register level model of the MCP2515 chip, linked in place of mcp2515_driver_pal.c on a host.
+*/
+
+#include <string.h>
+
+#define MCP_PAL_IMPLEMENTATION
+#include "mcp2515_sim.h"
+
+uint8_t sim_regs[128];
+
+static SIM_SPI_STATS _stats;
+
+/* simulated time, advanced by the SPI traffic and by simAdvanceTime() */
+static uint64_t _time_ns;
+static uint32_t _spi_clock = 8000000;
+
+static void (*_tx_hook)(uint8_t, const uint8_t *, void *);
+static void *_tx_hook_ctx;
+
+/* bus contention : attempts of every loaded frame that lose arbitration, then meet a bus error */
+static uint8_t _losses;
+static uint8_t _errors;
+static uint8_t _attempts[3];
+
+/* bit timing of the other nodes on the bus, all 0 when every bit timing matches */
+static uint8_t _bus_cnf[3];
+
+/* frame put on the bus periodically as the simulated time passes, period 0 when there is none */
+static CAN_FRAME _traffic;
+static uint32_t _traffic_period_us;
+static uint64_t _traffic_next_ns;
+
+/* register with bits stuck at a level on READ, mask 0 when there is none */
+static uint8_t _stuck_addr;
+static uint8_t _stuck_mask;
+static uint8_t _stuck_val;
+
+/* state of the current chip select window */
+static uint8_t _selected;
+static uint8_t _instruction;
+static uint8_t _count;
+static uint8_t _addr;
+static uint8_t _mask;
+
+
+
+/* UTILITY FUNCTIONS ********************************************************************************************************/
+
+/**
+ * @brief Utility function to fold the mirrored CANSTAT/CANCTRL addresses and the 7 bit address space.
+*/
+static uint8_t simAddr(uint8_t _a)
+{
+	_a &= 0X7F;
+	if( (_a & 0X0F) == 0X0E )
+		return CANSTAT & 0X7F;
+	if( (_a & 0X0F) == 0X0F )
+		return CANCTRL & 0X7F;
+	return _a;
+}
+
+/**
+ * @brief Utility function to wake the chip up when it sleeps with WAKIE enabled. It wakes up in listen only mode.
+*/
+static void simWakeUp(void)
+{
+	if( ( sim_regs[CANSTAT & 0X7F] >> 5 ) != mcp_sleep_mode || !( sim_regs[CANINTE] & (1<<WAKIE) ) )
+		return;
+
+	sim_regs[CANINTF] |= (1<<WAKIF);
+	sim_regs[CANCTRL & 0X7F] = ( sim_regs[CANCTRL & 0X7F] & 0X1F ) | ( mcp_listen_only_mode << 5 );
+	sim_regs[CANSTAT & 0X7F] = ( sim_regs[CANSTAT & 0X7F] & 0X1F ) | ( mcp_listen_only_mode << 5 );
+}
+
+/**
+ * @brief Utility function to write a register with the side effects of the real chip.
+*/
+static void simWrite(uint8_t _a, uint8_t _val)
+{
+	_a = simAddr(_a);
+
+	// status and error counters are read only
+	if( _a == (CANSTAT & 0X7F) || _a == TEC || _a == REC )
+		return;
+
+	// ABTF, MLOA and TXERR are read only, cleared when TXREQ is set
+	if( _a == TXB0CTRL || _a == TXB1CTRL || _a == TXB2CTRL )
+	{
+		uint8_t _old = sim_regs[_a];
+		_val = ( _val & 0X0B ) | ( _old & 0X70 );
+		if( ( _val & (1<<TXREQ) ) && !( _old & (1<<TXREQ) ) )
+			_val &= ~0X70;
+	}
+	else if( _a > TXB0CTRL && _a < TXB2CTRL + 14 && ( _a & 0X0F ) <= 0X0D )
+		_attempts[ ( _a >> 4 ) - 3 ] = 0;
+
+	sim_regs[_a] = _val;
+
+	// the mode request takes effect immediately
+	if( _a == (CANCTRL & 0X7F) )
+		sim_regs[CANSTAT & 0X7F] = ( sim_regs[CANSTAT & 0X7F] & 0X1F ) | ( _val & 0XE0 );
+
+	// setting WAKIF from the host wakes a sleeping chip up
+	if( _a == CANINTF && ( _val & (1<<WAKIF) ) )
+		simWakeUp();
+}
+
+/**
+ * @brief Utility function to get the base address of the transmit buffer used by the LOAD TX BUFFER instruction.
+*/
+static uint8_t simLoadTxAddr(uint8_t _ins)
+{
+	uint8_t _base = TXB0SIDH + 0X10 * ( (_ins >> 1) & 0X03 );
+	return (_ins & 1) ? _base + 5 : _base;
+}
+
+/**
+ * @brief Utility function to read the filter or mask registers as a 32 bit word in register order.
+*/
+static uint32_t simWord(uint8_t _a)
+{
+	return ( (uint32_t)sim_regs[_a] << 24 ) | ( (uint32_t)sim_regs[_a+1] << 16 ) | ( (uint32_t)sim_regs[_a+2] << 8 ) | sim_regs[_a+3];
+}
+
+/**
+ * @brief Utility function to check a frame in register order against a mask/filter pair.
+*/
+static uint8_t simMatch(uint32_t _id, uint8_t _mask_addr, uint8_t _filter_addr)
+{
+	uint32_t _mask = simWord(_mask_addr);
+	uint32_t _filter = simWord(_filter_addr);
+	uint8_t _ext = (_id >> 16) & (1<<IDE);
+
+	// the filter applies either to standard or extended frames
+	if( ( (_filter >> 16) & (1<<EXIDE) ) != ( _ext ? (1<<EXIDE) : 0 ) )
+		return 0;
+
+	// SIDH, SIDL<7:5>, and for extended frames SIDL<1:0>, EID8, EID0
+	uint32_t _bits = _ext ? 0XFFE3FFFF : 0XFFE00000;
+	_mask &= _bits;
+
+	return ( (_id ^ _filter) & _mask ) == 0;
+}
+
+/**
+ * @brief Utility function to place a frame in register order into one of the receive buffers.
+*/
+static void simFillRX(uint8_t _buff, const uint8_t *_raw, uint8_t _remote, uint8_t _filhit)
+{
+	uint8_t _base = _buff ? RXB1CTRL : RXB0CTRL;
+	memcpy( &sim_regs[_base + 1], _raw, 13 );
+
+	uint8_t _ctrl = sim_regs[_base];
+	_ctrl &= _buff ? 0XF0 : 0XF4;
+	if( _remote )
+		_ctrl |= (1<<RXRTR);
+	_ctrl |= _filhit;
+	sim_regs[_base] = _ctrl;
+
+	sim_regs[CANINTF] |= _buff ? (1<<RX1IF) : (1<<RX0IF);
+}
+
+/**
+ * @brief Utility function to run the acceptance filters on a frame in register order and store it.
+ *
+ * @return
+ * 1 : IF THE FRAME WAS STORED
+ * 0 : IF THE FRAME WAS REJECTED OR LOST BY OVERFLOW
+*/
+static uint8_t simReceive(const uint8_t *_raw)
+{
+	uint32_t _id = ( (uint32_t)_raw[0] << 24 ) | ( (uint32_t)_raw[1] << 16 ) | ( (uint32_t)_raw[2] << 8 ) | _raw[3];
+	uint8_t _ext = _raw[1] & (1<<IDE);
+	uint8_t _remote = _ext ? ( _raw[4] & (1<<RTR) ) : ( _raw[1] & 0X10 );
+	uint8_t _rxm0 = ( sim_regs[RXB0CTRL] >> RXM0 ) & 0X03;
+	uint8_t _rxm1 = ( sim_regs[RXB1CTRL] >> RXM0 ) & 0X03;
+
+	int8_t _hit0 = -1;
+	int8_t _hit1 = -1;
+
+	if( _rxm0 == 3 )
+		_hit0 = 0;
+	else if( simMatch( _id, RXM0SIDH, RXF0SIDH ) )
+		_hit0 = 0;
+	else if( simMatch( _id, RXM0SIDH, RXF1SIDH ) )
+		_hit0 = 1;
+
+	if( _hit0 >= 0 )
+	{
+		if( !( sim_regs[CANINTF] & (1<<RX0IF) ) )
+		{
+			simFillRX( 0, _raw, _remote, _hit0 );
+			return 1;
+		}
+		if( sim_regs[RXB0CTRL] & (1<<BUKT) )
+		{
+			if( !( sim_regs[CANINTF] & (1<<RX1IF) ) )
+			{
+				simFillRX( 1, _raw, _remote, _hit0 );
+				return 1;
+			}
+			sim_regs[EFLG] |= (1<<RX1OVR);
+			sim_regs[CANINTF] |= (1<<ERRIF);
+			return 0;
+		}
+		sim_regs[EFLG] |= (1<<RX0OVR);
+		sim_regs[CANINTF] |= (1<<ERRIF);
+		return 0;
+	}
+
+	if( _rxm1 == 3 )
+		_hit1 = 2;
+	else
+	{
+		static const uint8_t _filters[4] = { RXF2SIDH, RXF3SIDH, RXF4SIDH, RXF5SIDH };
+		for(uint8_t i=0; i<4; i++)
+		{
+			if( simMatch( _id, RXM1SIDH, _filters[i] ) )
+			{
+				_hit1 = 2 + i;
+				break;
+			}
+		}
+	}
+
+	if( _hit1 < 0 )
+		return 0;
+
+	if( !( sim_regs[CANINTF] & (1<<RX1IF) ) )
+	{
+		simFillRX( 1, _raw, _remote, _hit1 );
+		return 1;
+	}
+	sim_regs[EFLG] |= (1<<RX1OVR);
+	sim_regs[CANINTF] |= (1<<ERRIF);
+	return 0;
+}
+
+/**
+ * @brief Utility function to update the warning, error passive and bus off flags of EFLG from TEC and REC. TEC
+ * saturates at 255 in the model, which stands for bus off.
+*/
+static void simErrorFlags(void)
+{
+	uint8_t _tec = sim_regs[TEC];
+	uint8_t _rec = sim_regs[REC];
+	uint8_t _eflg = sim_regs[EFLG] & ( (1<<RX1OVR) | (1<<RX0OVR) );
+
+	if( _tec >= 96 )
+		_eflg |= (1<<TXWAR) | (1<<EWARN);
+	if( _rec >= 96 )
+		_eflg |= (1<<RXWAR) | (1<<EWARN);
+	if( _tec >= 128 )
+		_eflg |= (1<<TXEP);
+	if( _rec >= 128 )
+		_eflg |= (1<<RXEP);
+	if( _tec == 255 )
+		_eflg |= (1<<TXBO);
+
+	sim_regs[EFLG] = _eflg;
+}
+
+/**
+ * @brief Utility function to check the bit timing of the chip against the one of the bus. A chip sampling at
+ * another rate sees error frames instead of the frame : MERRF is set and, outside listen only mode, REC counts
+ * the error.
+ *
+ * @return
+ * 1 : IF THE CHIP CAN RECEIVE THE FRAME
+ * 0 : IF THE BIT TIMING DIFFERS
+*/
+static uint8_t simBitTiming(void)
+{
+	if( !_bus_cnf[0] && !_bus_cnf[1] && !_bus_cnf[2] )
+		return 1;
+
+	// SOF and WAKFIL of CNF3 do not change the bit timing
+	if( sim_regs[CNF1] == _bus_cnf[0] && sim_regs[CNF2] == _bus_cnf[1] && ( ( sim_regs[CNF3] ^ _bus_cnf[2] ) & 0X07 ) == 0 )
+		return 1;
+
+	sim_regs[CANINTF] |= (1<<MERRF);
+	if( ( sim_regs[CANSTAT & 0X7F] >> 5 ) != mcp_listen_only_mode && sim_regs[REC] < 255 )
+	{
+		sim_regs[REC]++;
+		simErrorFlags();
+	}
+	return 0;
+}
+
+/**
+ * @brief Utility function to complete every transmission request that is pending in the transmit buffers.
+*/
+static void simTransmit(void)
+{
+	for(uint8_t _buff=0; _buff<3; _buff++)
+	{
+		uint8_t _ctrl = TXB0CTRL + 0X10 * _buff;
+		if( !( sim_regs[_ctrl] & (1<<TXREQ) ) )
+			continue;
+
+		// ABAT aborts every pending frame and holds new requests until it is cleared
+		if( sim_regs[CANCTRL & 0X7F] & (1<<ABAT) )
+		{
+			sim_regs[_ctrl] = ( sim_regs[_ctrl] & ~(1<<TXREQ) ) | (1<<ABTF);
+			continue;
+		}
+
+		uint8_t _mode = sim_regs[CANSTAT & 0X7F] >> 5;
+		if( _mode == mcp_configuration_mode || _mode == mcp_sleep_mode || _mode == mcp_listen_only_mode )
+			continue;
+
+		if( _attempts[_buff] < _losses + _errors )
+		{
+			if( _attempts[_buff]++ < _losses )
+				sim_regs[_ctrl] |= (1<<MLOA);
+			else
+			{
+				sim_regs[_ctrl] |= (1<<TXERR);
+				sim_regs[TEC] = sim_regs[TEC] > 247 ? 255 : sim_regs[TEC] + 8;
+				simErrorFlags();
+			}
+
+			// one shot mode gives up, otherwise the frame is retried in the next window
+			if( sim_regs[CANCTRL & 0X7F] & (1<<OSM) )
+				sim_regs[_ctrl] &= ~(1<<TXREQ);
+			continue;
+		}
+		_attempts[_buff] = 0;
+		if( sim_regs[TEC] )
+		{
+			sim_regs[TEC]--;
+			simErrorFlags();
+		}
+
+		uint8_t _raw[13];
+		memcpy( _raw, &sim_regs[_ctrl + 1], 13 );
+
+		if( _tx_hook )
+			_tx_hook( _buff, _raw, _tx_hook_ctx );
+
+		if( _mode == mcp_loopback_mode )
+		{
+			// the transmit buffer keeps the EXIDE bit at the position of the IDE bit, the SRR bit follows RTR
+			if( !( _raw[1] & (1<<IDE) ) && ( _raw[4] & (1<<RTR) ) )
+				_raw[1] |= 0X10;
+			simReceive( _raw );
+		}
+
+		sim_regs[_ctrl] &= ~( (1<<TXREQ) | (1<<MLOA) | (1<<TXERR) | (1<<ABTF) );
+		sim_regs[CANINTF] |= ( 1 << (TX0IF + _buff) );
+	}
+}
+
+/**
+ * @brief Utility function to put the periodic frames of simSetBusTraffic() that are due on the bus.
+*/
+static void simTraffic(void)
+{
+	while( _traffic_period_us && _time_ns >= _traffic_next_ns )
+	{
+		_traffic_next_ns += (uint64_t)_traffic_period_us * 1000;
+		simInjectFrame( &_traffic );
+	}
+}
+/*************************************************************************************************************************/
+
+
+
+/**
+ * @brief This function puts the simulated chip into its power on state and clears the SPI counters.
+ *
+ * @param NONE
+ *
+ * @return NOTHING
+*/
+void simReset(void)
+{
+	memset( sim_regs, 0, sizeof(sim_regs) );
+	sim_regs[CANCTRL & 0X7F] = 0X87;
+	sim_regs[CANSTAT & 0X7F] = 0X80;
+	_selected = 0;
+	for(uint8_t i=0; i<3; i++)
+		_attempts[i] = 0;
+	simClearStats();
+}
+
+/**
+ * @brief This function copies the SPI traffic counters.
+ *
+ * @param
+ * 1. _stats : destination for the counters.
+ *
+ * @return NOTHING
+*/
+void simGetStats(SIM_SPI_STATS *_out)
+{
+	*_out = _stats;
+}
+
+/**
+ * @brief This function clears the SPI traffic counters.
+ *
+ * @param NONE
+ *
+ * @return NOTHING
+*/
+void simClearStats(void)
+{
+	_stats.windows = 0;
+	_stats.bytes = 0;
+}
+
+/**
+ * @brief This function sets the SPI clock used to advance the simulated time. Every byte takes 8 clock
+ * periods and every chip select window adds SIM_CS_OVERHEAD_NS.
+ *
+ * @param
+ * 1. _hz : the SPI clock in Hz.
+ *
+ * @return NOTHING
+*/
+void simSetSpiClock(uint32_t _hz)
+{
+	if( _hz )
+		_spi_clock = _hz;
+}
+
+/**
+ * @brief This function advances the simulated time, e.g. to model the bus time of a frame.
+ *
+ * @param
+ * 1. _us : microseconds to add.
+ *
+ * @return NOTHING
+*/
+void simAdvanceTime(uint32_t _us)
+{
+	_time_ns += (uint64_t)_us * 1000;
+	simTraffic();
+}
+
+/**
+ * @brief This function puts a frame on the simulated bus. The frame passes through the acceptance filters of the
+ * chip when its bit timing matches the one set by simSetBusTiming().
+ *
+ * @param
+ * 1. _frame : the frame to receive.
+ *
+ * @return
+ * 1 : IF THE FRAME WAS STORED IN A RECEIVE BUFFER
+ * 0 : IF THE FRAME WAS REJECTED, LOST BY OVERFLOW, SAMPLED AT THE WRONG BIT TIMING (MERRF) OR ONLY WOKE THE CHIP UP
+*/
+uint8_t simInjectFrame(const CAN_FRAME *_frame)
+{
+	// a sleeping chip only wakes up, the frame is lost
+	if( ( sim_regs[CANSTAT & 0X7F] >> 5 ) == mcp_sleep_mode )
+	{
+		simWakeUp();
+		return 0;
+	}
+
+	if( !simBitTiming() )
+		return 0;
+
+	uint8_t _raw[13];
+	memset( _raw, 0, sizeof(_raw) );
+
+	if( _frame->type == can_extended )
+	{
+		_raw[0] = _frame->ID >> 21;
+		_raw[1] = ( (_frame->ID >> 13) & 0XE0 ) | ( (_frame->ID >> 16) & 0X03 ) | (1<<IDE);
+		_raw[2] = _frame->ID >> 8;
+		_raw[3] = _frame->ID;
+		_raw[4] = _frame->isRemote ? (1<<RTR) : 0;
+	}
+	else
+	{
+		_raw[0] = _frame->ID >> 3;
+		_raw[1] = ( _frame->ID << 5 ) | ( _frame->isRemote ? 0X10 : 0 );
+	}
+	_raw[4] |= _frame->DLC & 0X0F;
+	memcpy( &_raw[5], _frame->DATA, 8 );
+
+	return simReceive( _raw );
+}
+
+/**
+ * @brief This function models a congested bus : every frame loaded afterwards loses arbitration in its first
+ * _losses attempts and meets a bus error in the next _errors attempts before it is sent. One attempt is made per
+ * chip select window. In one shot mode every failed attempt clears TXREQ.
+ *
+ * @param
+ * 1. _losses : attempts lost to arbitration.
+ * 2. _errors : attempts destroyed by a bus error, each adds 8 to TEC.
+ *
+ * @return NOTHING
+*/
+void simSetContention(uint8_t _losses_n, uint8_t _errors_n)
+{
+	_losses = _losses_n;
+	_errors = _errors_n;
+	for(uint8_t i=0; i<3; i++)
+		_attempts[i] = 0;
+}
+
+/**
+ * @brief This function sets the bit timing of the other nodes on the simulated bus. A chip configured with other
+ * CNF1, CNF2 and PHSEG2 values does not receive the frames put on the bus, it flags MERRF instead.
+ *
+ * @param
+ * 1. _cnf1 : CNF1 of the bus, all 0 for a bus that matches every bit timing (the default).
+ * 2. _cnf2 : CNF2 of the bus.
+ * 3. _cnf3 : CNF3 of the bus.
+ *
+ * @return NOTHING
+*/
+void simSetBusTiming(uint8_t _cnf1, uint8_t _cnf2, uint8_t _cnf3)
+{
+	_bus_cnf[0] = _cnf1;
+	_bus_cnf[1] = _cnf2;
+	_bus_cnf[2] = _cnf3;
+}
+
+/**
+ * @brief This function puts a frame on the simulated bus every _period_us of simulated time, as seen by
+ * simInjectFrame(). The frames arrive between two chip select windows.
+ *
+ * @param
+ * 1. _frame : the frame, copied.
+ * 2. _period_us : period of the frame, 0 to stop the traffic.
+ *
+ * @return NOTHING
+*/
+void simSetBusTraffic(const CAN_FRAME *_frame, uint32_t _period_us)
+{
+	if( _frame )
+		_traffic = *_frame;
+	_traffic_period_us = _period_us;
+	_traffic_next_ns = _time_ns + (uint64_t)_period_us * 1000;
+}
+
+/**
+ * @brief This function installs a hook that sees every frame the simulated chip transmits.
+ *
+ * @param
+ * 1. _hook : called with the buffer number and the 13 buffer registers SIDH..D7.
+ * 2. _ctx : passed as it is to the hook.
+ *
+ * @return NOTHING
+*/
+void simSetTxHook(void (*_hook)(uint8_t, const uint8_t *, void *), void *_ctx)
+{
+	_tx_hook = _hook;
+	_tx_hook_ctx = _ctx;
+}
+
+/**
+ * @brief This function makes bits of a register read back at a fixed level with the READ instruction, as a
+ * faulty chip or a shorted MISO line would. The register itself keeps what is written; simReset() keeps the fault.
+ *
+ * @param
+ * 1. _addr : the register, CANSTAT and CANCTRL at any of their mirrors.
+ * 2. _mask : the stuck bits, 0 to remove the fault.
+ * 3. _val : the level of the stuck bits.
+ *
+ * @return NOTHING
+*/
+void simSetStuckBits(uint8_t _addr, uint8_t _mask, uint8_t _val)
+{
+	_stuck_addr = simAddr(_addr);
+	_stuck_mask = _mask;
+	_stuck_val = _val;
+}
+
+
+
+/*
+ * 		!	 P L A T F O R M		A B S T R A C T I O N		L A Y E R		!
+ */
+
+
+void pal_spi_init(void *data, uint8_t data_direction, uint8_t idle_level, uint8_t shift_edge)
+{
+	(void)data;
+	(void)data_direction;
+	(void)idle_level;
+	(void)shift_edge;
+}
+
+void pal_select_slave(void)
+{
+	_selected = 1;
+	_count = 0;
+	_stats.windows++;
+	_time_ns += SIM_CS_OVERHEAD_NS;
+}
+
+void pal_deselect_slave(void)
+{
+	if( !_selected )
+		return;
+	_selected = 0;
+
+	// the RX buffer read instruction clears the receive flag when the window closes
+	if( ( _instruction & 0XF9 ) == MCP_READ_RX0_ID && _count )
+		sim_regs[CANINTF] &= ~( (_instruction & 0X04) ? (1<<RX1IF) : (1<<RX0IF) );
+
+	if( _instruction == MCP_RESET && _count )
+	{
+		simReset();
+		return;
+	}
+
+	simTransmit();
+	simTraffic();
+}
+
+void pal_spi_send(uint8_t byt)
+{
+	_stats.bytes++;
+	_time_ns += 8000000000ULL / _spi_clock;
+
+	if( _count == 0 )
+	{
+		_instruction = byt;
+		_count = 1;
+
+		if( ( byt & 0XF8 ) == 0X80 )
+		{
+			// request to send
+			for(uint8_t i=0; i<3; i++)
+				if( ( byt & (1<<i) ) && !( sim_regs[TXB0CTRL + 0X10 * i] & (1<<TXREQ) ) )
+					sim_regs[TXB0CTRL + 0X10 * i] = ( sim_regs[TXB0CTRL + 0X10 * i] & ~0X70 ) | (1<<TXREQ);
+		}
+		else if( ( byt & 0XF9 ) == MCP_READ_RX0_ID )
+			_addr = ( (byt & 0X04) ? RXB1SIDH : RXB0SIDH ) + ( (byt & 0X02) ? 5 : 0 );
+		else if( ( byt & 0XF8 ) == MCP_LOAD_TX0_ID && ( byt & 0X07 ) <= 5 )
+		{
+			_addr = simLoadTxAddr( byt );
+			_attempts[ ( byt >> 1 ) & 0X03 ] = 0;
+		}
+		return;
+	}
+
+	switch( _instruction )
+	{
+	case MCP_READ:
+	case MCP_WRITE:
+		if( _count == 1 )
+			_addr = byt;
+		else if( _instruction == MCP_WRITE )
+			simWrite( _addr++, byt );
+		else
+			_addr++;
+		break;
+
+	case MCP_BIT_MODIFY:
+		if( _count == 1 )
+			_addr = byt;
+		else if( _count == 2 )
+			_mask = byt;
+		else if( _count == 3 )
+			simWrite( _addr, ( sim_regs[simAddr(_addr)] & ~_mask ) | ( byt & _mask ) );
+		break;
+
+	default:
+		if( ( _instruction & 0XF8 ) == MCP_LOAD_TX0_ID )
+			sim_regs[ (_addr++) & 0X7F ] = byt;
+		break;
+	}
+
+	if( _count < 0XFF )
+		_count++;
+}
+
+uint8_t pal_spi_read(void)
+{
+	_stats.bytes++;
+	_time_ns += 8000000000ULL / _spi_clock;
+
+	uint8_t _ret = 0XFF;
+
+	if( _count == 0 )
+		return _ret;
+
+	switch( _instruction )
+	{
+	case MCP_READ:
+		if( _count >= 2 )
+		{
+			uint8_t _a = simAddr(_addr++);
+			_ret = sim_regs[_a];
+			if( _a == _stuck_addr )
+				_ret = ( _ret & ~_stuck_mask ) | ( _stuck_val & _stuck_mask );
+		}
+		break;
+
+	case MCP_READ_STATUS:
+	{
+		uint8_t _f = sim_regs[CANINTF];
+		_ret = ( _f & 0X03 )
+			| ( ( sim_regs[TXB0CTRL] & (1<<TXREQ) ) ? 0X04 : 0 ) | ( ( _f & (1<<TX0IF) ) ? 0X08 : 0 )
+			| ( ( sim_regs[TXB1CTRL] & (1<<TXREQ) ) ? 0X10 : 0 ) | ( ( _f & (1<<TX1IF) ) ? 0X20 : 0 )
+			| ( ( sim_regs[TXB2CTRL] & (1<<TXREQ) ) ? 0X40 : 0 ) | ( ( _f & (1<<TX2IF) ) ? 0X80 : 0 );
+	}
+		break;
+
+	case MCP_RX_STATUS:
+	{
+		uint8_t _f = sim_regs[CANINTF] & 0X03;
+		_ret = _f << 6;
+		if( _f )
+		{
+			uint8_t _base = ( _f & 1 ) ? RXB0CTRL : RXB1CTRL;
+			uint8_t _sidl = sim_regs[_base + 2];
+			uint8_t _ext = ( _sidl & (1<<IDE) ) ? 1 : 0;
+			uint8_t _remote = ( sim_regs[_base] & (1<<RXRTR) ) ? 1 : 0;
+			_ret |= ( (_ext << 1) | _remote ) << 3;
+			_ret |= ( _f & 1 ) ? ( sim_regs[RXB0CTRL] & 0X01 ) : ( sim_regs[RXB1CTRL] & 0X07 );
+		}
+	}
+		break;
+
+	default:
+		if( ( _instruction & 0XF9 ) == MCP_READ_RX0_ID )
+			_ret = sim_regs[ (_addr++) & 0X7F ];
+		break;
+	}
+
+	if( _count < 0XFF )
+		_count++;
+
+	return _ret;
+}
+
+uint32_t pal_get_time_us(void)
+{
+	return (uint32_t)( _time_ns / 1000 );
+}
+
+// the simulated chip is driven from one thread, the locks have nothing to do
+void pal_lock(void)
+{
+}
+
+void pal_unlock(void)
+{
+}
+
+void pal_state_lock(void)
+{
+}
+
+void pal_state_unlock(void)
+{
+}
+
+
+
+#ifdef MCP_PAL_DYNAMIC
+
+/*
+ * 		!	 O P E R A T I O N S		T A B L E		!
+ */
+
+
+static void simOpInit(void *_ctx, void *_data, uint8_t _dir, uint8_t _idle, uint8_t _edge)
+{
+	(void)_ctx;
+	pal_spi_init( _data, _dir, _idle, _edge );
+}
+
+static void simOpSelect(void *_ctx)
+{
+	(void)_ctx;
+	pal_select_slave();
+}
+
+static void simOpDeselect(void *_ctx)
+{
+	(void)_ctx;
+	pal_deselect_slave();
+}
+
+static void simOpSend(void *_ctx, uint8_t _byt)
+{
+	(void)_ctx;
+	pal_spi_send( _byt );
+}
+
+static uint8_t simOpRead(void *_ctx)
+{
+	(void)_ctx;
+	return pal_spi_read();
+}
+
+static void simOpDelay(void *_ctx, uint32_t _us)
+{
+	(void)_ctx;
+	simAdvanceTime( _us );
+}
+
+static uint32_t simOpTime(void *_ctx)
+{
+	(void)_ctx;
+	return pal_get_time_us();
+}
+
+const MCP_PAL_OPS sim_pal_ops =
+{
+	simOpInit, simOpSelect, simOpDeselect, simOpSend, simOpRead, simOpDelay, simOpTime,
+	0, 0, 0, 0, 0, 0, 0
+};
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file mcp2515_sim.h
+ * @brief Register level model of the MCP2515 chip. The model implements the platform abstraction layer APIs
+ * (pal_select_slave(), pal_spi_send(), ...) so that it can be linked in place of mcp2515_driver_pal.c on a host.
+ * Every chip select window and every byte clocked over the simulated SPI port is counted.
+*/
+#ifndef MCP2515_SIM
+#define MCP2515_SIM
+
+#include "../mcp2515_driver.h"
+
+/**
+ * @brief Time added to the simulated clock for every chip select window, in nanoseconds.
+*/
+#define SIM_CS_OVERHEAD_NS 500
+
+/**
+ * @brief SPI traffic counters maintained by the simulator.
+*/
+typedef struct SIM_SPI_STATS
+{
+	uint32_t windows;	/* number of chip select windows */
+	uint32_t bytes;		/* number of bytes clocked in both directions (one per clock cycle of 8 bits) */
+}SIM_SPI_STATS;
+
+/**
+ * @brief The register map of the simulated chip. Exposed so that tools can inspect the chip state directly.
+*/
+extern uint8_t sim_regs[128];
+
+void simReset(void);
+
+void simGetStats(SIM_SPI_STATS *);
+
+void simClearStats(void);
+
+void simSetSpiClock(uint32_t);
+
+void simAdvanceTime(uint32_t);
+
+uint8_t simInjectFrame(const CAN_FRAME *);
+
+void simSetContention(uint8_t, uint8_t);
+
+void simSetBusTiming(uint8_t, uint8_t, uint8_t);
+
+void simSetBusTraffic(const CAN_FRAME *, uint32_t);
+
+void simSetTxHook(void (*)(uint8_t, const uint8_t *, void *), void *);
+
+void simSetStuckBits(uint8_t, uint8_t, uint8_t);
+
+#ifdef MCP_PAL_DYNAMIC
+#include "../mcp2515_pal_ops.h"
+
+/**
+ * @brief Operations table of the simulated chip, for builds with MCP_PAL_DYNAMIC. Its delay advances the simulated
+ * time.
+*/
+extern const MCP_PAL_OPS sim_pal_ops;
+#endif
+
+#endif
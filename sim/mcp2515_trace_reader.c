@@ -0,0 +1,58 @@
+/**
+ * @file mcp2515_trace_reader.c
+ * @brief Host side parser for the dumps written by traceDump().
+*/
+
+#include <string.h>
+
+#include "mcp2515_trace_reader.h"
+
+/**
+ * @brief This function checks the TRACE_MAGIC header of a dump.
+ *
+ * @param
+ * 1. _buf : the dump.
+ * 2. _len : length of the dump in bytes.
+ *
+ * @return
+ * 1 : IF THE HEADER IS VALID
+ * 0 : OTHERWISE
+ */
+uint8_t traceCheckHeader(const uint8_t *_buf, uint32_t _len)
+{
+	return _len >= TRACE_HEADER_SIZE && memcmp( _buf, TRACE_MAGIC, TRACE_HEADER_SIZE ) == 0;
+}
+
+/**
+ * @brief This function parses the record at a position of a dump and advances the position past it.
+ *
+ * @param
+ * 1. _buf : the dump.
+ * 2. _len : length of the dump in bytes.
+ * 3. _pos : position of the record, TRACE_HEADER_SIZE for the first one. Updated on success.
+ * 4. _rec : the parsed record.
+ *
+ * @return
+ * 1 : IF A COMPLETE RECORD WAS PARSED
+ * 0 : AT THE END OF THE DUMP OR ON A TRUNCATED RECORD
+ */
+uint8_t traceNextRecord(const uint8_t *_buf, uint32_t _len, uint32_t *_pos, TRACE_RECORD *_rec)
+{
+	uint32_t _p = *_pos;
+
+	if( _p + 5 > _len )
+		return 0;
+
+	uint8_t _n = _buf[_p + 4];
+	uint32_t _map = ( (uint32_t)_n + 7 ) / 8;
+	if( _p + 5 + _map + _n > _len )
+		return 0;
+
+	_rec->ts = (uint32_t)_buf[_p] | ( (uint32_t)_buf[_p+1] << 8 ) | ( (uint32_t)_buf[_p+2] << 16 ) | ( (uint32_t)_buf[_p+3] << 24 );
+	_rec->n = _n;
+	_rec->dir = &_buf[_p + 5];
+	_rec->bytes = &_buf[_p + 5 + _map];
+
+	*_pos = _p + 5 + _map + _n;
+	return 1;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file mcp2515_trace_reader.h
+ * @brief Host side parser for the dumps written by traceDump(). See mcp2515_trace.h for the record layout.
+*/
+#ifndef MCP2515_TRACE_READER
+#define MCP2515_TRACE_READER
+
+#include "../mcp2515_trace.h"
+
+/**
+ * @brief One chip select window of a trace dump. The pointers refer into the dump.
+*/
+typedef struct TRACE_RECORD
+{
+	uint32_t ts;			/* time stamp in microseconds */
+	uint8_t n;				/* number of bytes in the window */
+	const uint8_t *dir;		/* direction bitmap, bit i set when byte i was read from the chip */
+	const uint8_t *bytes;	/* the bytes of the window */
+}TRACE_RECORD;
+
+/**
+ * @brief Direction of byte i of a record : 1 when it was read from the chip.
+*/
+#define TRACE_IS_MISO(rec, i) ( ( (rec)->dir[(i) >> 3] >> ( (i) & 7 ) ) & 1 )
+
+uint8_t traceCheckHeader(const uint8_t *, uint32_t);
+
+uint8_t traceNextRecord(const uint8_t *, uint32_t, uint32_t *, TRACE_RECORD *);
+
+#endif
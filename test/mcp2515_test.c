@@ -0,0 +1,85 @@
+/**
+ * @file mcp2515_test.c
+ * @brief Runner of the host tests, see mcp2515_test.h. Exits with 1 when a check failed.
+ *
+ * Usage : mcp2515_test
+*/
+
+#include "mcp2515_test.h"
+
+uint32_t test_checks;
+uint32_t test_failures;
+
+CAN_FRAME test_bus[TEST_BUS_FRAMES];
+uint32_t test_bus_count;
+
+typedef struct TEST_SUITE
+{
+	const char *name;
+	void (*run)(void);
+}TEST_SUITE;
+
+static const TEST_SUITE _suites[] =
+{
+	{ "driver",   testDriver },
+	{ "isotp",    testIsoTP },
+	{ "j1939",    testJ1939 },
+	{ "routing",  testRouting },
+	{ "txq",      testTxQueue },
+	{ "modules",  testModules },
+};
+#define TEST_NUM_SUITES ( sizeof(_suites) / sizeof(_suites[0]) )
+
+
+
+/**
+ * @brief Transmit hook of the simulator, appends the frame to test_bus.
+*/
+static void testTxHook(uint8_t _buff, const uint8_t *_regs, void *_ctx)
+{
+	(void)_buff;
+	(void)_ctx;
+
+	if( test_bus_count < TEST_BUS_FRAMES )
+		canDecodeRaw( _regs, &test_bus[test_bus_count++] );
+}
+
+/**
+ * @brief Puts the simulated chip into its power on state with the masks and filters off, in the given mode, and
+ * forgets the captured frames.
+*/
+void testChip(MCP_CAN_MODE _mode)
+{
+	simReset();
+	simSetSpiClock( 10000000 );
+	simSetTxHook( testTxHook, 0 );
+	canDisableFilterRX(0);
+	canDisableFilterRX(1);
+	canRequestMode( _mode );
+	testBusReset();
+}
+
+void testBusReset(void)
+{
+	test_bus_count = 0;
+}
+
+int main(void)
+{
+#ifdef MCP_PAL_DYNAMIC
+	palUse( &sim_pal_ops );
+#endif
+
+	for(uint32_t i=0; i<TEST_NUM_SUITES; i++)
+	{
+		uint32_t _failures = test_failures;
+		uint32_t _checks = test_checks;
+
+		_suites[i].run();
+		printf("%-10s %4lu checks %s\n", _suites[i].name, (unsigned long)( test_checks - _checks ),
+			test_failures == _failures ? "ok" : "FAILED");
+	}
+
+	printf("%lu checks, %lu failures\n", (unsigned long)test_checks, (unsigned long)test_failures);
+	return test_failures ? 1 : 0;
+}
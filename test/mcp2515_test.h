@@ -0,0 +1,58 @@
+/**
+ * @file mcp2515_test.h
+ * @brief Host tests of the driver and its modules against the simulated chip. Each suite drives the real code with
+ * sim/mcp2515_sim.c in place of the platform abstraction layer and checks what reaches the bus and the application.
+ *
+ * The same sources are built twice by 'make test' : once with the PAL called directly, and once with MCP_PAL_DYNAMIC
+ * and MCP_SPI_TRACE, which adds the checks of the operations table and of the recorder.
+*/
+#ifndef MCP2515_TEST
+#define MCP2515_TEST
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../mcp2515_driver.h"
+#include "../sim/mcp2515_sim.h"
+
+extern uint32_t test_checks;
+extern uint32_t test_failures;
+
+/**
+ * @brief Counts a check and reports it when it fails, the suite goes on.
+*/
+#define CHECK(cond) \
+	do { \
+		test_checks++; \
+		if( !(cond) ) \
+		{ \
+			test_failures++; \
+			printf("  FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond); \
+		} \
+	} while(0)
+
+/**
+ * @brief Frames the chip put on the bus since testBusReset(), captured through simSetTxHook().
+*/
+#define TEST_BUS_FRAMES 1024
+
+extern CAN_FRAME test_bus[TEST_BUS_FRAMES];
+extern uint32_t test_bus_count;
+
+void testChip(MCP_CAN_MODE);
+
+void testBusReset(void);
+
+void testDriver(void);
+
+void testIsoTP(void);
+
+void testJ1939(void);
+
+void testRouting(void);
+
+void testTxQueue(void);
+
+void testModules(void);
+
+#endif
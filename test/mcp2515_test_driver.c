@@ -0,0 +1,172 @@
+/**
+ * @file mcp2515_test_driver.c
+ * @brief Tests of the core APIs : canInit() and its verification, the frame paths in loopback and the abort.
+*/
+
+#include "mcp2515_test.h"
+
+static CAN_FRAME _rx[4];
+static uint8_t _rx_count;
+
+static void testCollect(const CAN_FRAME *_f, void *_ctx)
+{
+	(void)_ctx;
+	if( _rx_count < 4 )
+		_rx[_rx_count++] = *_f;
+}
+
+static void testConfig(MCP_CONFIG *_cfg)
+{
+	memset( _cfg, 0, sizeof(*_cfg) );
+	_cfg->data_rate = 500;
+	_cfg->caninte = 0X03;
+	_cfg->mask[0] = 0X7FFUL << 18;
+	_cfg->mask[1] = 0X1FFFFFFFUL;
+	_cfg->filter[0] = 0X123UL << 18;
+	_cfg->filter[2] = 0X18FEF100UL;
+	_cfg->filter_ext = 0X04;
+	_cfg->rxb0ctrl = 0X04;
+	_cfg->mode = mcp_normal_mode;
+}
+
+/**
+ * @brief canInit() writes the whole configuration, reads it back and ends in the requested mode; a register that
+ * does not take its value, or a mode that is never entered, fails it within MCP_MODE_TIMEOUT_US.
+*/
+static void testInit(void)
+{
+	MCP_CONFIG _cfg;
+	testConfig( &_cfg );
+
+	simReset();
+	CHECK( canInit( &_cfg ) == 1 );
+	CHECK( canGetMode() == mcp_normal_mode );
+	CHECK( sim_regs[CANINTE] == 0X03 );
+	CHECK( sim_regs[RXM0SIDH] == 0XFF && ( sim_regs[RXM0SIDH + 1] & 0XE0 ) == 0XE0 );
+	CHECK( sim_regs[RXF0SIDH] == ( 0X123 >> 3 ) );
+	CHECK( sim_regs[RXF2SIDH + 1] & (1<<EXIDE) );
+	CHECK( sim_regs[RXB0CTRL] & (1<<BUKT) );
+
+	// a stuck bit in the middle of CNF2 and one in a filter
+	simSetStuckBits( CNF2, 0X10, ~sim_regs[CNF2] );
+	simReset();
+	CHECK( canInit( &_cfg ) == 0 );
+	simSetStuckBits( RXF0SIDH, 0X01, 0X01 );
+	simReset();
+	CHECK( canInit( &_cfg ) == 0 );
+
+	// a chip that never leaves configuration mode
+	simSetStuckBits( CANSTAT, 0XE0, mcp_configuration_mode << 5 );
+	simReset();
+	uint32_t _t0 = pal_get_time_us();
+	CHECK( canInit( &_cfg ) == 0 );
+	CHECK( pal_get_time_us() - _t0 >= MCP_MODE_TIMEOUT_US );
+	CHECK( pal_get_time_us() - _t0 < 2 * MCP_MODE_TIMEOUT_US );
+
+	simSetStuckBits( 0, 0, 0 );
+	simReset();
+	CHECK( canInit( &_cfg ) == 1 );
+
+	// a data rate without bit timing at MCP_CHIP_FREQ leaves the chip alone
+	_cfg.data_rate = 33;
+	CHECK( canInit( &_cfg ) == 0 && canGetMode() == mcp_normal_mode );
+}
+
+/**
+ * @brief Frames sent in loopback come back through canServiceRX() unaltered, standard, extended and remote.
+*/
+static void testLoopbackFrames(void)
+{
+	unsigned char _d[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	testChip( mcp_loopback_mode );
+	_rx_count = 0;
+
+	CHECK( canTransmit_wSID( 0, 0X123, 8, _d ) );
+	CHECK( canServiceRX( testCollect, 0 ) == 1 );
+	CHECK( canTransmit_wEID( 1, 0X18FEF100, 3, _d ) );
+	CHECK( canServiceRX( testCollect, 0 ) == 1 );
+	CHECK( canTransmitRemote_wSID( 2, 0X456 ) );
+	CHECK( canServiceRX( testCollect, 0 ) == 1 );
+	CHECK( canServiceRX( testCollect, 0 ) == 0 );
+
+	CHECK( _rx_count == 3 );
+	CHECK( _rx[0].type == can_standard && _rx[0].ID == 0X123 && _rx[0].DLC == 8 && !memcmp( _rx[0].DATA, _d, 8 ) );
+	CHECK( _rx[1].type == can_extended && _rx[1].ID == 0X18FEF100 && _rx[1].DLC == 3 && !memcmp( _rx[1].DATA, _d, 3 ) );
+	CHECK( _rx[2].type == can_standard && _rx[2].ID == 0X456 && _rx[2].isRemote );
+	CHECK( test_bus_count == 3 );
+}
+
+/**
+ * @brief canDecodeRaw() reads the remote flag from SRR or the RTR bit of DLC and keeps the DLC within 8.
+*/
+static void testDecodeRaw(void)
+{
+	CAN_FRAME _f;
+	uint8_t _std[13] = { 0X24, 0X60, 0, 0, 0X0F, 1, 2, 3, 4, 5, 6, 7, 8 };
+	uint8_t _ext[13] = { 0XC7, 0XEA, 0XF1, 0, 0X42, 9, 9 };
+
+	canDecodeRaw( _std, &_f );
+	CHECK( _f.type == can_standard && _f.ID == 0X123 && !_f.isRemote && _f.DLC == 8 && _f.DATA[7] == 8 );
+	_std[1] |= (1<<SRR);
+	canDecodeRaw( _std, &_f );
+	CHECK( _f.isRemote && _f.DLC == 0 && _f.DATA[0] == 0 );
+	_std[1] &= ~(1<<SRR);
+	_std[4] = (1<<RTR) | 2;
+	canDecodeRaw( _std, &_f );
+	CHECK( _f.isRemote && _f.DLC == 0 );
+
+	canDecodeRaw( _ext, &_f );
+	CHECK( _f.type == can_extended && _f.ID == 0X18FEF100 && _f.isRemote && _f.DLC == 0 );
+	_ext[4] = 2;
+	canDecodeRaw( _ext, &_f );
+	CHECK( !_f.isRemote && _f.DLC == 2 && _f.DATA[1] == 9 && _f.DATA[2] == 0 );
+}
+
+/**
+ * @brief The acceptance filters set with canSetMaskRX() and canSetFilterRX() keep other IDs out.
+*/
+static void testFilters(void)
+{
+	CAN_FRAME _f = { can_standard, 0, 0X124, 1, {0} };
+
+	testChip( mcp_configuration_mode );
+	canSetMaskRX( 0, 0X7FFUL << 18 );
+	canSetMaskRX( 1, 0X7FFUL << 18 );
+	canSetFilterRX( 0, can_standard, 0X123UL << 18 );
+	canEnableFilterRX( 0 );
+	canEnableFilterRX( 1 );
+	canRequestMode( mcp_normal_mode );
+	_rx_count = 0;
+
+	CHECK( simInjectFrame( &_f ) == 0 );
+	_f.ID = 0X123;
+	CHECK( simInjectFrame( &_f ) == 1 );
+	CHECK( canServiceRX( testCollect, 0 ) == 1 );
+	CHECK( _rx_count == 1 && _rx[0].ID == 0X123 );
+}
+
+/**
+ * @brief canAbortAll() clears the requests that cannot leave the chip.
+*/
+static void testAbort(void)
+{
+	unsigned char _d[8] = { 0 };
+
+	testChip( mcp_configuration_mode );
+	CHECK( canTransmit_wSID( 0, 0X100, 1, _d ) );
+	CHECK( canTransmit_wSID( 1, 0X101, 1, _d ) );
+	CHECK( !canIsFreeTX( 0 ) && !canIsFreeTX( 1 ) );
+	CHECK( canAbortAll() == 0X03 );
+	CHECK( canIsFreeTX( 0 ) && canIsFreeTX( 1 ) );
+	CHECK( test_bus_count == 0 );
+}
+
+void testDriver(void)
+{
+	testInit();
+	testLoopbackFrames();
+	testDecodeRaw();
+	testFilters();
+	testAbort();
+}
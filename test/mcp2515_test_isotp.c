@@ -0,0 +1,145 @@
+/**
+ * @file mcp2515_test_isotp.c
+ * @brief Tests of the ISO-TP transport : two links talk to each other through the chip in loopback mode.
+*/
+
+#include "mcp2515_test.h"
+#include "../mcp2515_isotp.h"
+
+#define TEST_ISOTP_LEN 4096
+
+static ISOTP_LINK _links[2];
+static unsigned char _tx[TEST_ISOTP_LEN];
+static unsigned char _rx[TEST_ISOTP_LEN];
+
+static uint8_t _tx_done;
+static uint8_t _rx_done;
+static ISOTP_RESULT _tx_result;
+static ISOTP_RESULT _rx_result;
+static uint32_t _rx_len;
+
+static void testSent(ISOTP_LINK *_l, ISOTP_RESULT _r, uint32_t _len, void *_ctx)
+{
+	(void)_l;
+	(void)_len;
+	(void)_ctx;
+	_tx_done = 1;
+	_tx_result = _r;
+}
+
+static void testReceived(ISOTP_LINK *_l, ISOTP_RESULT _r, uint32_t _len, void *_ctx)
+{
+	(void)_l;
+	(void)_ctx;
+	_rx_done = 1;
+	_rx_result = _r;
+	_rx_len = _len;
+}
+
+static void testBoth(const CAN_FRAME *_f, void *_ctx)
+{
+	(void)_ctx;
+	isotpRXHook( _f, &_links[0] );
+	isotpRXHook( _f, &_links[1] );
+}
+
+/**
+ * @brief Sends _len bytes from link 0 to link 1 with the given flow control of the receiver.
+ *
+ * @return
+ * THE NUMBER OF SERVICE PASSES, 0 IF THE TRANSFER DID NOT END.
+*/
+static uint32_t testTransfer(uint32_t _len, uint8_t _bs, uint8_t _st_min)
+{
+	testChip( mcp_loopback_mode );
+
+	isotpBegin( &_links[0], can_standard, 0X7E0, 0X7E8, 0 );
+	isotpBegin( &_links[1], can_standard, 0X7E8, 0X7E0, 1 );
+	isotpSetFlowControl( &_links[1], _bs, _st_min );
+	isotpSetReceiveBuffer( &_links[1], _rx, sizeof(_rx), testReceived, 0 );
+
+	for(uint32_t i=0; i<_len; i++)
+		_tx[i] = (unsigned char)( i * 7 + 3 );
+	memset( _rx, 0, sizeof(_rx) );
+	_tx_done = 0;
+	_rx_done = 0;
+
+	if( !isotpSend( &_links[0], _tx, _len, testSent, 0 ) )
+		return 0;
+
+	for(uint32_t _pass=1; _pass<100000; _pass++)
+	{
+		isotpService( _links, 2 );
+		canServiceRX( testBoth, 0 );
+		if( _tx_done && _rx_done )
+			return _pass;
+		simAdvanceTime( 10 );
+	}
+	return 0;
+}
+
+/**
+ * @brief A DLC above 8 carries 8 bytes : a single frame that does not fit is dropped and a consecutive frame adds
+ * 7 bytes, never more.
+*/
+static void testLongDLC(void)
+{
+	CAN_FRAME _sf = { can_standard, 0, 0X7E0, 15, { 0X0A, 1, 2, 3, 4, 5, 6, 7 } };
+	CAN_FRAME _ff = { can_standard, 0, 0X7E0, 8, { 0X10, 20, 1, 2, 3, 4, 5, 6 } };
+	CAN_FRAME _cf = { can_standard, 0, 0X7E0, 15, { 0X21, 7, 8, 9, 10, 11, 12, 13 } };
+
+	testChip( mcp_loopback_mode );
+	isotpBegin( &_links[1], can_standard, 0X7E8, 0X7E0, 1 );
+	isotpSetReceiveBuffer( &_links[1], _rx, sizeof(_rx), testReceived, 0 );
+	_rx_done = 0;
+
+	isotpRXHook( &_sf, &_links[1] );
+	CHECK( !_rx_done && _links[1].rx_state != isotp_rx_consecutive );
+
+	isotpRXHook( &_ff, &_links[1] );
+	isotpRXHook( &_cf, &_links[1] );
+	CHECK( !_rx_done && _links[1].rx_pos == 13 );
+	_cf.DATA[0] = 0X22;
+	_cf.DLC = 8;
+	isotpRXHook( &_cf, &_links[1] );
+	CHECK( _rx_done && _rx_result == isotp_ok && _rx_len == 20 && _rx[12] == 13 && _rx[19] == 13 );
+}
+
+void testIsoTP(void)
+{
+	// single frame
+	CHECK( testTransfer( 5, 0, 0 ) );
+	CHECK( _tx_result == isotp_ok && _rx_result == isotp_ok && _rx_len == 5 );
+	CHECK( !memcmp( _rx, _tx, 5 ) );
+	CHECK( test_bus_count == 1 && test_bus[0].ID == 0X7E0 && test_bus[0].DATA[0] == 0X05 );
+
+	// first frame, flow control with a block size, consecutive frames with wrapping sequence numbers
+	CHECK( testTransfer( 300, 8, 0 ) );
+	CHECK( _tx_result == isotp_ok && _rx_result == isotp_ok && _rx_len == 300 );
+	CHECK( !memcmp( _rx, _tx, 300 ) );
+	uint32_t _fc = 0;
+	for(uint32_t i=0; i<test_bus_count; i++)
+		if( test_bus[i].ID == 0X7E8 )
+			_fc++;
+	// 1 FF and 42 CF, a flow control after the FF and after every block of 8 but the last
+	CHECK( test_bus_count == 43 + _fc );
+	CHECK( _fc == 6 );
+
+	// 4096 bytes at 10 MHz : the SPI time per consecutive frame, both ends on one chip, polling included
+	SIM_SPI_STATS _s;
+	CHECK( testTransfer( TEST_ISOTP_LEN, 0, 0 ) );
+	simGetStats( &_s );
+	CHECK( _rx_result == isotp_ok && _rx_len == TEST_ISOTP_LEN && !memcmp( _rx, _tx, TEST_ISOTP_LEN ) );
+
+	uint32_t _cf = 0;
+	for(uint32_t i=0; i<test_bus_count; i++)
+		if( test_bus[i].ID == 0X7E0 && ( test_bus[i].DATA[0] & 0XF0 ) == ISOTP_CONSECUTIVE_FRAME )
+			_cf++;
+	double _us = ( (double)_s.bytes * 8 / 10 + (double)_s.windows * SIM_CS_OVERHEAD_NS / 1000 ) / _cf;
+	printf("  isotp %u bytes at 10 MHz : %lu CF, %lu windows, %lu bytes, %.1f us of SPI time per CF\n", TEST_ISOTP_LEN,
+		(unsigned long)_cf, (unsigned long)_s.windows, (unsigned long)_s.bytes, _us);
+	CHECK( _cf == ( TEST_ISOTP_LEN - 2 + 6 ) / 7 );
+	CHECK( _us < 40 );
+
+	testLongDLC();
+}
@@ -0,0 +1,352 @@
+/**
+ * @file mcp2515_test_j1939.c
+ * @brief Tests of the J1939 node : address claim, BAM and RTS/CTS in both directions, held connections included.
+ * The test plays the other nodes of the bus, reading what the chip sends through the transmit hook and injecting
+ * the answers.
+*/
+
+#include "mcp2515_test.h"
+#include "../mcp2515_j1939.h"
+
+#define TEST_PEER 0X30
+
+static J1939_NODE _node;
+static unsigned char _rx_bufs[2 * 64];
+
+static J1939_MSG _got;
+static unsigned char _got_data[64];
+static uint8_t _got_count;
+
+static uint8_t _done_count;
+static uint8_t _done_ok;
+
+static void testHandler(J1939_NODE *_n, const J1939_MSG *_msg, void *_ctx)
+{
+	(void)_n;
+	(void)_ctx;
+	_got = *_msg;
+	memcpy( _got_data, _msg->data, _msg->len < sizeof(_got_data) ? _msg->len : sizeof(_got_data) );
+	_got_count++;
+}
+
+static void testDone(J1939_NODE *_n, uint8_t _ok, void *_ctx)
+{
+	(void)_n;
+	(void)_ctx;
+	_done_count++;
+	_done_ok = _ok;
+}
+
+/**
+ * @brief Puts a frame of another node on the bus and lets the node receive it.
+*/
+static void testPeer(uint8_t _priority, uint32_t _pgn, uint8_t _da, uint8_t _sa, const unsigned char _d[8])
+{
+	CAN_FRAME _f = { can_extended, 0, j1939EncodeID( _priority, _pgn, _da, _sa ), 8, {0} };
+	memcpy( _f.DATA, _d, 8 );
+	simInjectFrame( &_f );
+	canServiceRX( j1939RXHook, &_node );
+}
+
+/**
+ * @brief Decodes a frame the node sent.
+*/
+static void testSent(uint32_t _i, J1939_MSG *_msg)
+{
+	j1939DecodeID( test_bus[_i].ID, _msg );
+	_msg->len = test_bus[_i].DLC;
+	_msg->data = test_bus[_i].DATA;
+}
+
+static void testNode(uint8_t _arbitrary)
+{
+	unsigned char _name[8] = { 0X01, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, _arbitrary ? 0X80 : 0X00 };
+
+	testChip( mcp_normal_mode );
+	j1939Begin( &_node, _name, 0X80, 0 );
+	j1939SetReceiveBuffers( &_node, _rx_bufs, 64 );
+	j1939SetDefaultHandler( &_node, testHandler, 0 );
+	_got_count = 0;
+	_done_count = 0;
+}
+
+static void testClaimed(void)
+{
+	j1939Claim( &_node );
+	simAdvanceTime( J1939_CLAIM_US );
+	j1939Service( &_node );
+	testBusReset();
+}
+
+/**
+ * @brief The claim is sent at once and the address is held after J1939_CLAIM_US; a contender with a lower NAME
+ * moves an arbitrary address capable node on and leaves the other one without address; a contender with a higher
+ * NAME is answered.
+*/
+static void testClaim(void)
+{
+	J1939_MSG _m;
+	unsigned char _lower[8] = { 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00 };
+	unsigned char _higher[8] = { 0X02, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, 0X81 };
+
+	testNode( 1 );
+	j1939Claim( &_node );
+	CHECK( _node.claim_state == j1939_claiming && _node.address == 0X80 );
+	CHECK( test_bus_count == 1 );
+	testSent( 0, &_m );
+	CHECK( _m.pgn == J1939_PGN_ADDRESS_CLAIMED && _m.sa == 0X80 && _m.da == J1939_GLOBAL_ADDRESS );
+	CHECK( !memcmp( _m.data, _node.name, 8 ) );
+
+	simAdvanceTime( J1939_CLAIM_US - 1000 );
+	j1939Service( &_node );
+	CHECK( _node.claim_state == j1939_claiming );
+	simAdvanceTime( 1000 );
+	j1939Service( &_node );
+	CHECK( _node.claim_state == j1939_claimed );
+
+	// a higher NAME on our address is told that the address is taken
+	testBusReset();
+	testPeer( 6, J1939_PGN_ADDRESS_CLAIMED, J1939_GLOBAL_ADDRESS, 0X80, _higher );
+	j1939Service( &_node );
+	CHECK( _node.address == 0X80 && _node.claim_state == j1939_claimed );
+	CHECK( test_bus_count == 1 );
+
+	// a lower NAME takes the address, the node claims the next one
+	testBusReset();
+	testPeer( 6, J1939_PGN_ADDRESS_CLAIMED, J1939_GLOBAL_ADDRESS, 0X80, _lower );
+	j1939Service( &_node );
+	CHECK( _node.address == 0X81 && _node.claim_state == j1939_claiming );
+	CHECK( test_bus_count == 1 );
+	testSent( 0, &_m );
+	CHECK( _m.pgn == J1939_PGN_ADDRESS_CLAIMED && _m.sa == 0X81 );
+	simAdvanceTime( J1939_CLAIM_US );
+	j1939Service( &_node );
+	CHECK( _node.claim_state == j1939_claimed );
+
+	// a node that is not arbitrary address capable gives up and says so from the null address
+	testNode( 0 );
+	testClaimed();
+	testPeer( 6, J1939_PGN_ADDRESS_CLAIMED, J1939_GLOBAL_ADDRESS, 0X80, _lower );
+	j1939Service( &_node );
+	CHECK( _node.claim_state == j1939_cannot_claim && _node.address == J1939_NULL_ADDRESS );
+	CHECK( test_bus_count == 1 );
+	testSent( 0, &_m );
+	CHECK( _m.sa == J1939_NULL_ADDRESS );
+	CHECK( !j1939Send( &_node, 6, 0XFEF1, J1939_GLOBAL_ADDRESS, _lower, 8, 0, 0 ) );
+}
+
+/**
+ * @brief Tells whether one of the six filters accepts the destination address _da in the PS byte.
+*/
+static uint8_t testFilterDA(uint8_t _da)
+{
+	const uint8_t _rxf[6] = { RXF0SIDH, RXF1SIDH, RXF2SIDH, RXF3SIDH, RXF4SIDH, RXF5SIDH };
+
+	for(uint8_t i=0; i<6; i++)
+		if( sim_regs[ _rxf[i] + 2 ] == _da )
+			return 1;
+	return 0;
+}
+
+/**
+ * @brief The filters follow an address change, programmed by j1939Service() and not by the receive hook.
+*/
+static void testClaimFilters(void)
+{
+	unsigned char _lower[8] = { 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00, 0X00 };
+	SIM_SPI_STATS _s;
+
+	testNode( 1 );
+	j1939SetDefaultHandler( &_node, 0, 0 );
+	j1939Subscribe( &_node, 0XFEF1, testHandler, 0 );
+	j1939ApplyFilters( &_node );
+	testClaimed();
+	CHECK( !_node.filters_pending );
+
+	// the claim is sent and the filters still show 0X80 when the hook returns
+	j1939Service( &_node );
+	CHECK( testFilterDA( 0X80 ) );
+	simClearStats();
+	testPeer( 6, J1939_PGN_ADDRESS_CLAIMED, J1939_GLOBAL_ADDRESS, 0X80, _lower );
+	simGetStats( &_s );
+	CHECK( _node.address == 0X81 && _node.filters_pending );
+	CHECK( test_bus_count == 1 );
+	CHECK( _s.windows < 16 );
+	CHECK( testFilterDA( 0X80 ) && !testFilterDA( 0X81 ) );
+
+	j1939Service( &_node );
+	CHECK( !_node.filters_pending );
+	CHECK( testFilterDA( 0X81 ) && !testFilterDA( 0X80 ) );
+	CHECK( canGetMode() == mcp_normal_mode );
+}
+
+/**
+ * @brief A BAM is announced, then its packets leave J1939_BAM_INTERVAL_US apart; a BAM from a peer is reassembled.
+*/
+static void testBAM(void)
+{
+	unsigned char _msg[20];
+	J1939_MSG _m;
+
+	for(uint8_t i=0; i<sizeof(_msg); i++)
+		_msg[i] = 0X40 + i;
+
+	testNode( 1 );
+	testClaimed();
+	CHECK( j1939Send( &_node, 6, 0XFEEC, J1939_GLOBAL_ADDRESS, _msg, sizeof(_msg), testDone, 0 ) );
+
+	for(uint8_t i=0; i<8 && _done_count == 0; i++)
+	{
+		j1939Service( &_node );
+		j1939Service( &_node );
+		simAdvanceTime( J1939_BAM_INTERVAL_US );
+	}
+	CHECK( _done_count == 1 && _done_ok );
+	CHECK( test_bus_count == 4 );
+	testSent( 0, &_m );
+	CHECK( _m.pgn == J1939_PGN_TP_CM && _m.da == J1939_GLOBAL_ADDRESS && _m.data[0] == J1939_TP_BAM );
+	CHECK( _m.data[1] == 20 && _m.data[2] == 0 && _m.data[3] == 3 );
+	CHECK( _m.data[5] == 0XEC && _m.data[6] == 0XFE && _m.data[7] == 0 );
+	for(uint8_t p=1; p<=3; p++)
+	{
+		testSent( p, &_m );
+		CHECK( _m.pgn == J1939_PGN_TP_DT && _m.data[0] == p );
+		for(uint8_t i=0; i<7; i++)
+			CHECK( _m.data[1 + i] == ( ( p - 1 ) * 7 + i < 20 ? _msg[( p - 1 ) * 7 + i] : 0XFF ) );
+	}
+
+	// the same message from a peer
+	unsigned char _cm[8] = { J1939_TP_BAM, 20, 0, 3, 0XFF, 0XEC, 0XFE, 0X00 };
+	testPeer( 7, J1939_PGN_TP_CM, J1939_GLOBAL_ADDRESS, TEST_PEER, _cm );
+	for(uint8_t p=1; p<=3; p++)
+	{
+		unsigned char _dt[8] = { p, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF };
+		for(uint8_t i=0; i<7 && ( p - 1 ) * 7 + i < 20; i++)
+			_dt[1 + i] = _msg[( p - 1 ) * 7 + i];
+		simAdvanceTime( J1939_BAM_INTERVAL_US );
+		testPeer( 7, J1939_PGN_TP_DT, J1939_GLOBAL_ADDRESS, TEST_PEER, _dt );
+	}
+	CHECK( _got_count == 1 );
+	CHECK( _got.pgn == 0XFEEC && _got.sa == TEST_PEER && _got.len == 20 && !memcmp( _got_data, _msg, 20 ) );
+	CHECK( _node.tp_errors == 0 );
+}
+
+/**
+ * @brief A message to one node waits for CTS before each window of packets and ends on EOMA; a message from a peer
+ * is paced with CTS and acknowledged.
+*/
+static void testRTS(void)
+{
+	unsigned char _msg[30];
+	J1939_MSG _m;
+
+	for(uint8_t i=0; i<sizeof(_msg); i++)
+		_msg[i] = 0X80 + i;
+
+	testNode( 1 );
+	testClaimed();
+	CHECK( j1939Send( &_node, 6, 0XEF00, TEST_PEER, _msg, sizeof(_msg), testDone, 0 ) );
+	j1939Service( &_node );
+	CHECK( test_bus_count == 1 );
+	testSent( 0, &_m );
+	CHECK( _m.pgn == J1939_PGN_TP_CM && _m.da == TEST_PEER && _m.data[0] == J1939_TP_RTS );
+	CHECK( _m.data[1] == 30 && _m.data[3] == 5 );
+
+	// nothing leaves before the CTS
+	j1939Service( &_node );
+	CHECK( test_bus_count == 1 );
+
+	// CTS for packets 1 to 2, then 3 to 5
+	unsigned char _cts[8] = { J1939_TP_CTS, 2, 1, 0XFF, 0XFF, 0X00, 0XEF, 0X00 };
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _cts );
+	for(uint8_t i=0; i<4; i++)
+		j1939Service( &_node );
+	CHECK( test_bus_count == 3 );
+	_cts[1] = 3;
+	_cts[2] = 3;
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _cts );
+	for(uint8_t i=0; i<4; i++)
+		j1939Service( &_node );
+	CHECK( test_bus_count == 6 );
+	for(uint8_t p=1; p<=5; p++)
+	{
+		testSent( p, &_m );
+		CHECK( _m.pgn == J1939_PGN_TP_DT && _m.da == TEST_PEER && _m.data[0] == p );
+	}
+	CHECK( _done_count == 0 );
+
+	unsigned char _eoma[8] = { J1939_TP_EOMA, 30, 0, 5, 0XFF, 0X00, 0XEF, 0X00 };
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _eoma );
+	CHECK( _done_count == 1 && _done_ok );
+
+	// a peer sends 30 bytes asking for 2 packets per CTS
+	testBusReset();
+	unsigned char _rts[8] = { J1939_TP_RTS, 30, 0, 5, 2, 0X00, 0XEF, 0X00 };
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _rts );
+	for(uint8_t p=1; p<=5; p++)
+	{
+		unsigned char _dt[8] = { p, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF };
+		for(uint8_t i=0; i<7 && ( p - 1 ) * 7 + i < 30; i++)
+			_dt[1 + i] = _msg[( p - 1 ) * 7 + i];
+		testPeer( 7, J1939_PGN_TP_DT, 0X80, TEST_PEER, _dt );
+		j1939Service( &_node );
+	}
+	CHECK( _got_count == 1 );
+	CHECK( _got.pgn == 0XEF00 && _got.sa == TEST_PEER && _got.da == 0X80 && _got.len == 30 );
+	CHECK( !memcmp( _got_data, _msg, 30 ) );
+
+	// CTS 2 from 1, 2 from 3, 1 from 5, then EOMA
+	CHECK( test_bus_count == 4 );
+	static const uint8_t _expect[3][2] = { { 2, 1 }, { 2, 3 }, { 1, 5 } };
+	for(uint8_t i=0; i<3; i++)
+	{
+		testSent( i, &_m );
+		CHECK( _m.pgn == J1939_PGN_TP_CM && _m.da == TEST_PEER && _m.data[0] == J1939_TP_CTS );
+		CHECK( _m.data[1] == _expect[i][0] && _m.data[2] == _expect[i][1] );
+	}
+	testSent( 3, &_m );
+	CHECK( _m.data[0] == J1939_TP_EOMA && _m.data[1] == 30 && _m.data[3] == 5 );
+}
+
+/**
+ * @brief A CTS that holds the connection is followed by a CTS within T4, or the transfer is aborted when T4 runs out.
+*/
+static void testHold(void)
+{
+	unsigned char _msg[30] = { 0 };
+	unsigned char _hold[8] = { J1939_TP_CTS, 0, 0XFF, 0XFF, 0XFF, 0X00, 0XEF, 0X00 };
+	unsigned char _cts[8] = { J1939_TP_CTS, 3, 1, 0XFF, 0XFF, 0X00, 0XEF, 0X00 };
+	J1939_MSG _m;
+
+	testNode( 1 );
+	testClaimed();
+	CHECK( j1939Send( &_node, 6, 0XEF00, TEST_PEER, _msg, sizeof(_msg), testDone, 0 ) );
+	j1939Service( &_node );
+	CHECK( test_bus_count == 1 );
+
+	// held, then resumed before T4
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _hold );
+	simAdvanceTime( J1939_T4_US - 50000 );
+	j1939Service( &_node );
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _cts );
+	for(uint8_t i=0; i<4; i++)
+		j1939Service( &_node );
+	CHECK( test_bus_count == 4 && _done_count == 0 );
+
+	// held again, T4 runs out before T3 would
+	testPeer( 7, J1939_PGN_TP_CM, 0X80, TEST_PEER, _hold );
+	simAdvanceTime( J1939_T4_US + 1000 );
+	j1939Service( &_node );
+	CHECK( _done_count == 1 && !_done_ok && test_bus_count == 5 );
+	testSent( 4, &_m );
+	CHECK( _m.pgn == J1939_PGN_TP_CM && _m.data[0] == J1939_TP_ABORT && _m.data[1] == 3 );
+}
+
+void testJ1939(void)
+{
+	testClaim();
+	testClaimFilters();
+	testBAM();
+	testRTS();
+	testHold();
+}
@@ -0,0 +1,918 @@
+/**
+ * @file mcp2515_test_modules.c
+ * @brief Tests of the other modules : signal decoding, cyclic scheduler, gateway, register snapshot, receive
+ * polling, monitor, frame capture, sleep and wake-up, data rate detection, self-test and the SPI transaction scheduler. With
+ * MCP_PAL_DYNAMIC and MCP_SPI_TRACE, the operations table and the recorder as well, and with MCP_PAL_LOCKING the
+ * device binding and the interrupt handler state of each thread.
+*/
+
+#include "mcp2515_test.h"
+#include "../mcp2515_signal.h"
+#include "../mcp2515_sched.h"
+#include "../mcp2515_gateway.h"
+#include "../mcp2515_snapshot.h"
+#include "../mcp2515_rxpoll.h"
+#include "../mcp2515_monitor.h"
+#include "../mcp2515_capture.h"
+#include "../mcp2515_power.h"
+#include "../mcp2515_autobaud.h"
+#include "../mcp2515_selftest.h"
+#include "../mcp2515_xfer.h"
+#ifdef MCP_PAL_LOCKING
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef MCP_SPI_TRACE
+#include "../sim/mcp2515_trace_reader.h"
+#endif
+
+static uint32_t _frames;
+
+static void testCount(const CAN_FRAME *_f, void *_ctx)
+{
+	(void)_f;
+	(void)_ctx;
+	_frames++;
+}
+
+static uint8_t testNear(SIG_VALUE _a, SIG_VALUE _b)
+{
+	SIG_VALUE _d = _a - _b;
+	return _d < 0.001f && _d > -0.001f;
+}
+
+/**
+ * @brief Little and big endian signals, signed and scaled, decoded one frame at a time and in a batch.
+*/
+static void testSignals(void)
+{
+	static const SIG_DEF _defs[4] =
+	{
+		{ 0, 16, SIG_LITTLE_ENDIAN, 0, 0.125f, 0 },		/* engine speed */
+		{ 16, 8, SIG_LITTLE_ENDIAN, 1, 1, -40 },		/* signed, offset */
+		{ 31, 12, SIG_BIG_ENDIAN, 0, 0.5f, 0 },			/* Motorola, starts at the MSB of byte 3 */
+		{ 60, 4, SIG_LITTLE_ENDIAN, 0, 1, 0 },
+	};
+	SIG_PLAN _plan[4];
+	SIG_MESSAGE _msgs[3];
+	SIG_VALUE _v[4];
+	SIG_VALUE _batch[3 * 4];
+	CAN_FRAME _f[3];
+
+	CHECK( sigCompile( _defs, 4, _plan ) );
+	sigMessage( &_msgs[0], can_standard, 0X300, _plan, 4 );
+	sigMessage( &_msgs[1], can_extended, 0X100, _plan, 1 );
+	sigMessage( &_msgs[2], can_standard, 0X100, _plan, 2 );
+	sigSort( _msgs, 3 );
+	const SIG_MESSAGE *_m = sigLookup( _msgs, 3, can_standard, 0X300 );
+	CHECK( _m && _m->id == 0X300 && _m->count == 4 );
+	CHECK( sigLookup( _msgs, 3, can_extended, 0X100 )->count == 1 );
+	CHECK( sigLookup( _msgs, 3, can_standard, 0X101 ) == 0 );
+
+	// 0X1F40 * 0.125 = 1000, 0XF6 = -10 - 40, 0XABC * 0.5 = 1374 in bytes 3 and 4, 0X9 in the top nibble
+	unsigned char _d[8] = { 0X40, 0X1F, 0XF6, 0XAB, 0XC0, 0X00, 0X00, 0X90 };
+	CHECK( sigDecode( _m, _d, _v ) == 4 );
+	CHECK( testNear( _v[0], 1000 ) );
+	CHECK( testNear( _v[1], -50 ) );
+	CHECK( testNear( _v[2], 1374 ) );
+	CHECK( testNear( _v[3], 9 ) );
+
+	for(uint8_t i=0; i<3; i++)
+	{
+		memcpy( _f[i].DATA, _d, 8 );
+		_f[i].DATA[0] = i;
+	}
+	CHECK( sigDecodeBatch( _m, _f[0].DATA, sizeof(CAN_FRAME), 3, _batch ) == 3 * 4 );
+	for(uint8_t i=0; i<3; i++)
+	{
+		sigDecode( _m, _f[i].DATA, _v );
+		CHECK( !memcmp( &_batch[4 * i], _v, sizeof(_v) ) );
+	}
+
+	// a signed 64 bit signal keeps its sign without any shift
+	static const SIG_DEF _wide[2] =
+	{
+		{ 0, 64, SIG_LITTLE_ENDIAN, 1, 1, 0 },
+		{ 0, 64, SIG_LITTLE_ENDIAN, 0, 1, 0 },
+	};
+	SIG_MESSAGE _w;
+	unsigned char _ones[8] = { 0XFE, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF };
+	CHECK( sigCompile( _wide, 2, _plan ) );
+	sigMessage( &_w, can_standard, 0X400, _plan, 2 );
+	CHECK( sigDecode( &_w, _ones, _v ) == 2 );
+	CHECK( testNear( _v[0], -2 ) );
+	CHECK( _v[1] > 1E18 );
+}
+
+/**
+ * @brief Messages leave at their period and phase, with the payload of the last update.
+*/
+static void testScheduler(void)
+{
+	static CAN_SCHEDULER _s;
+	SCHED_MSG _a, _b;
+	unsigned char _d[8] = { 1 };
+
+	testChip( mcp_normal_mode );
+	schedBegin( &_s, 0X07, 1000 );
+	CHECK( schedAdd( &_s, &_a, can_standard, 0X10, 1, _d, 10, 0 ) );
+	CHECK( schedAdd( &_s, &_b, can_extended, 0X1000, 1, _d, 25, 5 ) );
+
+	for(uint32_t t=0; t<100; t++)
+	{
+		if( t == 50 )
+		{
+			_d[0] = 2;
+			schedUpdate( &_a, 1, _d );
+		}
+		schedTick( &_s );
+		simAdvanceTime( 1000 );
+	}
+
+	uint32_t _na = 0, _nb = 0;
+	for(uint32_t i=0; i<test_bus_count; i++)
+	{
+		if( test_bus[i].ID == 0X10 )
+			_na++;
+		else if( test_bus[i].ID == 0X1000 && test_bus[i].type == can_extended )
+			_nb++;
+	}
+	CHECK( _na == 10 && _nb == 4 );
+	CHECK( _a.sent == 10 && _a.misses == 0 );
+	CHECK( test_bus[test_bus_count - 1].DATA[0] == 2 || test_bus[test_bus_count - 2].DATA[0] == 2 );
+}
+
+static void testSelectNone(void *_ctx)
+{
+	(void)_ctx;
+}
+
+/**
+ * @brief A routed frame is forwarded with its new ID, an unrouted one is only counted.
+*/
+static void testGateway(void)
+{
+	static CAN_GATEWAY _gw;
+	static GW_ROUTE _routes[1];
+	CAN_FRAME _f = { can_standard, 0, 0X120, 3, { 9, 8, 7 } };
+
+	testChip( mcp_normal_mode );
+	gwRoute( &_routes[0], 0, can_standard, 0X120, 0X7F0, 0X02 );
+	gwRewrite( &_routes[0], can_extended, 0X18FF0000 );
+	gwBegin( &_gw, _routes, 1 );
+	CHECK( gwAddBus( &_gw, testSelectNone, 0, 0 ) == 0 );
+	CHECK( gwAddBus( &_gw, testSelectNone, 0, 1 ) == 1 );
+
+	simInjectFrame( &_f );
+	gwService( &_gw );
+	_f.ID = 0X200;
+	simInjectFrame( &_f );
+	gwService( &_gw );
+	gwService( &_gw );
+
+	CHECK( test_bus_count == 1 );
+	CHECK( test_bus[0].type == can_extended && test_bus[0].ID == 0X18FF0000 && test_bus[0].DLC == 3 );
+	CHECK( test_bus[0].DATA[0] == 9 && test_bus[0].DATA[2] == 7 );
+	CHECK( _routes[0].forwarded == 1 && _gw.bus[0].unrouted == 1 );
+}
+
+/**
+ * @brief The snapshot reads back what the driver wrote and tells which registers changed.
+*/
+static void testSnapshot(void)
+{
+	MCP_SNAPSHOT _a, _b;
+	CAN_FRAME_TYPE _type;
+	uint8_t _addrs[8];
+
+	testChip( mcp_configuration_mode );
+	canSetFilterRX( 3, can_extended, 0X12345678 & 0X1FFFFFFF );
+	CHECK( canSnapshot( &_a, SNAP_ALL ) == 1 );
+	// canSetFilterRX() leaves the chip in normal mode
+	CHECK( snapGetMode( &_a ) == mcp_normal_mode );
+	CHECK( snapGetFilter( &_a, 3, &_type ) == ( 0X12345678 & 0X1FFFFFFF ) && _type == can_extended );
+
+	canSetMaskRX( 1, 0X7FFUL << 18 );
+	canSnapshot( &_b, SNAP_ALL );
+	CHECK( snapGetMask( &_b, 1 ) == ( 0X7FFUL << 18 ) );
+	CHECK( snapDiff( &_a, &_b, _addrs, 8 ) == 2 && _addrs[0] == RXM1SIDH );
+}
+
+/**
+ * @brief Under load the receive moves from the interrupt to polling, and back once the bus is quiet.
+*/
+static void testRxPoll(void)
+{
+	static CAN_RXPOLL _rxp;
+	CAN_FRAME _f = { can_standard, 0, 0X55, 0, {0} };
+
+	testChip( mcp_normal_mode );
+	rxpBegin( &_rxp, testCount, 0 );
+	_frames = 0;
+
+	for(uint8_t i=0; i<RXP_THRESHOLD; i++)
+	{
+		simInjectFrame( &_f );
+		CHECK( rxpInterrupt( &_rxp ) == 1 );
+	}
+	CHECK( _rxp.mode == rxp_polling );
+	simInjectFrame( &_f );
+	CHECK( rxpInterrupt( &_rxp ) == 0 );
+	CHECK( rxpPoll( &_rxp ) == 1 );
+	for(uint8_t i=0; i<RXP_IDLE_POLLS; i++)
+		rxpPoll( &_rxp );
+	CHECK( _rxp.mode == rxp_interrupt );
+	CHECK( _frames == RXP_THRESHOLD + 1 );
+}
+
+/**
+ * @brief The monitor time stamps the frames of the bus in order and puts the chip back as it found it.
+*/
+static void testMonitor(void)
+{
+	static CAN_MONITOR _mon;
+	static MON_FRAME _ring[8];
+	CAN_FRAME _f = { can_extended, 0, 0X1234, 1, { 0 } }, _out;
+	uint32_t _ts0, _ts1;
+
+	testChip( mcp_normal_mode );
+	monBegin( &_mon, _ring, 8 );
+	simInjectFrame( &_f );
+	monService( &_mon );
+	simAdvanceTime( 500 );
+	_f.DATA[0] = 1;
+	simInjectFrame( &_f );
+	monService( &_mon );
+
+	CHECK( monRead( &_mon, &_out, &_ts0 ) && _out.ID == 0X1234 && _out.DATA[0] == 0 );
+	CHECK( monRead( &_mon, &_out, &_ts1 ) && _out.DATA[0] == 1 );
+	CHECK( _ts1 - _ts0 >= 500 );
+	CHECK( !monRead( &_mon, &_out, 0 ) );
+	monEnd( &_mon );
+	CHECK( canGetMode() == mcp_normal_mode );
+}
+
+#define TEST_CAP_RECORDS 4
+
+static uint8_t _cap_file[4 * TEST_CAP_RECORDS * CAP_RECORD_SIZE];
+static uint32_t _cap_len;
+static uint32_t _cap_sinks;
+
+static void testCapSink(const uint8_t *_buf, uint32_t _len, void *_ctx)
+{
+	(void)_ctx;
+	if( _cap_len + _len <= sizeof(_cap_file) )
+		memcpy( &_cap_file[_cap_len], _buf, _len );
+	_cap_len += _len;
+	_cap_sinks++;
+}
+
+/**
+ * @brief Records decode to the frames and time stamps they were encoded from; the writer swaps its buffers when
+ * one is full, drops frames while both are, and writes everything in order once flushed.
+*/
+static void testCapture(void)
+{
+	static uint8_t _buf[2][TEST_CAP_RECORDS * CAP_RECORD_SIZE];
+	static CAP_WRITER _w;
+	uint8_t _hdr[CAP_HEADER_SIZE], _rec[CAP_RECORD_SIZE];
+	CAN_FRAME _in[3] =
+	{
+		{ can_standard, 0, 0X123, 3, { 0XDE, 0XAD, 0XBE, 0XEF } },
+		{ can_extended, 0, 0X18FEF100, 8, { 1, 2, 3, 4, 5, 6, 7, 8 } },
+		{ can_extended, 1, 0X18DAF110, 0, { 0 } },
+	};
+	CAN_FRAME _out;
+	uint64_t _ts;
+
+	capHeader( _hdr );
+	CHECK( !memcmp( _hdr, CAP_MAGIC, 8 ) && _hdr[8] == CAP_VERSION && _hdr[10] == CAP_RECORD_SIZE );
+
+	for(uint8_t i=0; i<3; i++)
+	{
+		capEncode( _rec, &_in[i], 0X123456789AULL + i );
+		capDecode( _rec, &_out, &_ts );
+		CHECK( _out.type == _in[i].type && _out.ID == _in[i].ID && _out.isRemote == _in[i].isRemote
+			&& _out.DLC == _in[i].DLC && !memcmp( _out.DATA, _in[i].DATA, _in[i].DLC ) && _ts == 0X123456789AULL + i );
+	}
+	// data bytes past the DLC are not stored
+	CHECK( _rec[16] == 0 && _out.DATA[7] == 0 );
+
+	// frame n carries ID n; the second time stamp wraps the 32 bit PAL time
+	_cap_len = 0;
+	_cap_sinks = 0;
+	capBegin( &_w, _buf[0], _buf[1], TEST_CAP_RECORDS, testCapSink, 0 );
+	_out = _in[0];
+	for(uint32_t n=0; n<2 * TEST_CAP_RECORDS; n++)
+	{
+		_out.ID = n;
+		CHECK( capWrite( &_w, &_out, n ? 0X10 + n : 0XFFFFFFF0 ) );
+	}
+	_out.ID = 2 * TEST_CAP_RECORDS;
+	CHECK( !capWrite( &_w, &_out, 0X100 ) && _w.dropped == 1 );
+	CHECK( _w.pending == TEST_CAP_RECORDS && _w.fill == TEST_CAP_RECORDS && !_cap_sinks );
+
+	CHECK( capService( &_w ) && !capService( &_w ) && _cap_sinks == 1 );
+	CHECK( _cap_len == TEST_CAP_RECORDS * CAP_RECORD_SIZE && _w.written == TEST_CAP_RECORDS );
+	_out.ID = 2 * TEST_CAP_RECORDS + 1;
+	CHECK( capWrite( &_w, &_out, 0X200 ) && _w.pending == TEST_CAP_RECORDS && _w.fill == 1 );
+
+	capFlush( &_w );
+	CHECK( _cap_sinks == 3 && _w.written == 2 * TEST_CAP_RECORDS + 1 && !_w.pending && !_w.fill );
+	CHECK( _cap_len == ( 2 * TEST_CAP_RECORDS + 1 ) * CAP_RECORD_SIZE );
+
+	uint32_t _bad = 0;
+	for(uint32_t n=0; n<=2 * TEST_CAP_RECORDS; n++)
+	{
+		capDecode( &_cap_file[n * CAP_RECORD_SIZE], &_out, &_ts );
+		if( _out.ID != ( n < 2 * TEST_CAP_RECORDS ? n : n + 1 ) )
+			_bad++;
+		if( n == 1 && _ts != 0X100000011ULL )
+			_bad++;
+	}
+	CHECK( !_bad );
+}
+
+/**
+ * @brief A frame on the bus wakes the sleeping chip up, which goes back to its mode with its configuration; a chip
+ * that does not enter its mode is reported instead of waited for.
+*/
+static void testPower(void)
+{
+	static PWR_CTX _pwr;
+	CAN_FRAME _f = { can_standard, 0, 0X10, 0, {0} };
+
+	testChip( mcp_configuration_mode );
+	canSetFilterRX( 0, can_standard, 0X10UL << 18 );
+	canRequestMode( mcp_normal_mode );
+	uint8_t _rxf0 = sim_regs[RXF0SIDH];
+
+	pwrBegin( &_pwr );
+	CHECK( pwrSleep( &_pwr, 0 ) );
+	CHECK( canGetMode() == mcp_sleep_mode );
+	CHECK( !pwrSleep( &_pwr, 0 ) );
+	CHECK( !pwrService( &_pwr ) );
+
+	simInjectFrame( &_f );
+	CHECK( pwrService( &_pwr ) == pwr_woke );
+	CHECK( canGetMode() == mcp_normal_mode );
+	CHECK( sim_regs[RXF0SIDH] == _rxf0 );
+	CHECK( _pwr.wakeups == 1 );
+
+	// a chip that stays in listen only mode after waking up is reported within MCP_MODE_TIMEOUT_US
+	CHECK( pwrSleep( &_pwr, 0 ) );
+	simSetStuckBits( CANSTAT, 0XE0, mcp_listen_only_mode << 5 );
+	uint32_t _t0 = pal_get_time_us();
+	CHECK( pwrWake( &_pwr ) == pwr_failed );
+	CHECK( pal_get_time_us() - _t0 < 2 * MCP_MODE_TIMEOUT_US );
+	CHECK( !pwrRestore( &_pwr ) && _pwr.wakeups == 1 );
+	simSetStuckBits( 0, 0, 0 );
+	CHECK( pwrRestore( &_pwr ) && canGetMode() == mcp_normal_mode && sim_regs[RXF0SIDH] == _rxf0 );
+}
+
+/**
+ * @brief The data rate of a bus with traffic is found among the candidates, skipping those that cannot be
+ * programmed; a silent bus gives up in the budget.
+*/
+static void testAutobaud(void)
+{
+	static const uint16_t _rates[4] = { 33, 500, 250, 125 };
+	static const uint16_t _none[2] = { 33, 7 };
+	BAUD_RESULT _res;
+	unsigned char _cnf[3];
+	CAN_FRAME _f = { can_standard, 0, 0X77, 0, {0} };
+
+	CHECK( !canGetBitTiming( 33, _cnf ) );
+	testChip( mcp_normal_mode );
+	CHECK( canGetBitTiming( 250, _cnf ) );
+	simSetBusTiming( _cnf[0], _cnf[1], _cnf[2] );
+	simSetBusTraffic( &_f, 2000 );
+	CHECK( baudDetect( &_res, _rates, 4, 1000000 ) );
+	CHECK( _res.rate == 250 && _res.rejected >= 1 && _res.tried == 2 );
+	CHECK( canGetMode() == mcp_listen_only_mode );
+
+	testChip( mcp_normal_mode );
+	uint32_t _t0 = pal_get_time_us();
+	CHECK( !baudDetect( &_res, _none, 2, 1000000 ) && _res.tried == 0 );
+	CHECK( pal_get_time_us() - _t0 < BAUD_WINDOW_US && canGetMode() == mcp_normal_mode );
+
+	simSetBusTraffic( 0, 0 );
+	_t0 = pal_get_time_us();
+	CHECK( !baudDetect( &_res, _rates, 4, 200000 ) );
+	CHECK( _res.rate == 0 && pal_get_time_us() - _t0 < 200000 + BAUD_WINDOW_US );
+	simSetBusTiming( 0, 0, 0 );
+}
+
+/**
+ * @brief Every frame of the loopback self-test comes back unaltered; frames from the bus fail the test without
+ * upsetting the count of the frames sent.
+*/
+static void testSelfTest(void)
+{
+	TEST_RESULT _res;
+	CAN_FRAME _stray = { can_standard, 0, 0X7FF, 2, { 0XFF, 0XFF } };
+
+	testChip( mcp_normal_mode );
+	CHECK( testLoopback( &_res, 50, 1000000 ) );
+	CHECK( _res.sent == 50 && _res.received == 50 && _res.corrupt == 0 && _res.lost == 0 && _res.passed );
+	CHECK( _res.unexpected == 0 );
+	CHECK( canGetMode() == mcp_normal_mode );
+#ifndef MCP_SPI_TRACE
+	CHECK( _res.spi_bytes == 0 && _res.bytes_per_frame == 0 );
+#else
+	CHECK( _res.spi_bytes && _res.bytes_per_frame );
+#endif
+
+	simSetBusTraffic( &_stray, 300 );
+	CHECK( !testLoopback( &_res, 50, 1000000 ) );
+	simSetBusTraffic( 0, 0 );
+	CHECK( _res.unexpected > 0 && !_res.passed );
+	CHECK( _res.received + _res.corrupt + _res.lost == 50 );
+	CHECK( _res.lost <= 50 );
+}
+
+static uint8_t _order[4];
+static uint8_t _order_n;
+
+static void testXferDone(CAN_XFER *_x, void *_ctx)
+{
+	(void)_x;
+	_order[_order_n++] = (uint8_t)(uintptr_t)_ctx;
+}
+
+/**
+ * @brief Windows are clocked by class, then by deadline, and do what their builders say.
+*/
+static void testXfer(void)
+{
+	static CAN_XFER_SCHED _s;
+	CAN_XFER _x[4];
+	uint8_t _val = 0X5A;
+
+	testChip( mcp_configuration_mode );
+	xferBegin( &_s );
+	memset( _x, 0, sizeof(_x) );
+	_order_n = 0;
+
+	xferWrite( &_x[0], xfer_config, RXF1SIDH, &_val, 1 );
+	xferRead( &_x[1], xfer_diag, RXF1SIDH, 1 );
+	xferReadStatus( &_x[2] );
+	xferBitModify( &_x[3], xfer_config, CANCTRL, 0XE0, mcp_loopback_mode << 5 );
+	for(uint8_t i=0; i<4; i++)
+	{
+		_x[i].done = testXferDone;
+		_x[i].ctx = (void *)(uintptr_t)i;
+	}
+
+	CHECK( xferSubmit( &_s, &_x[1], 0 ) );
+	CHECK( xferSubmit( &_s, &_x[3], 5000 ) );
+	CHECK( xferSubmit( &_s, &_x[0], 1000 ) );
+	CHECK( xferSubmit( &_s, &_x[2], 0 ) );
+	CHECK( !xferSubmit( &_s, &_x[2], 0 ) );
+	CHECK( xferRun( &_s, 0 ) == 4 );
+
+	// status first, then the config windows by deadline, then the diagnostic read that sees the write
+	CHECK( _order_n == 4 && _order[0] == 2 && _order[1] == 0 && _order[2] == 3 && _order[3] == 1 );
+	CHECK( _x[1].rx[0] == 0X5A );
+	CHECK( canGetMode() == mcp_loopback_mode );
+
+	XFER_STATS _st;
+	xferGetStats( &_s, xfer_config, &_st );
+	CHECK( _st.submitted == 2 && _st.completed == 2 && _st.depth == 0 && _st.max_depth == 2 );
+}
+
+static CAN_FRAME _kept;
+
+static void testKeep(const CAN_FRAME *_f, void *_ctx)
+{
+	(void)_ctx;
+	_kept = *_f;
+}
+
+/**
+ * @brief The mode, mask and filter windows write what canRequestMode(), canSetMaskRX() and canSetFilterRX() write;
+ * once attached, the scheduler drains the receive buffers for canServiceRX() ahead of the windows queued.
+*/
+static void testXferConfig(void)
+{
+	static CAN_XFER_SCHED _s;
+	CAN_XFER _x[5];
+	CAN_XFER _diag;
+	uint8_t _regs[12];
+	uint8_t _raw[13] = { 0 };
+	unsigned char _data[8] = { 0X11, 0X22 };
+
+	testChip( mcp_normal_mode );
+	xferBegin( &_s );
+	memset( _x, 0, sizeof(_x) );
+	xferRequestMode( &_x[0], mcp_configuration_mode );
+	xferSetMask( &_x[1], 1, 0X1FFFFF00 );
+	xferSetFilter( &_x[2], 2, can_extended, 0X18FEF100 );
+	xferSetFilter( &_x[3], 4, can_standard, 0X123UL << 18 );
+	xferRequestMode( &_x[4], mcp_normal_mode );
+	for(uint8_t i=0; i<5; i++)
+		CHECK( xferSubmit( &_s, &_x[i], 0 ) );
+	CHECK( xferRun( &_s, 0 ) == 5 );
+	CHECK( canGetMode() == mcp_normal_mode );
+
+	memcpy( _regs, &sim_regs[RXM1SIDH], 4 );
+	memcpy( _regs + 4, &sim_regs[RXF2SIDH], 4 );
+	memcpy( _regs + 8, &sim_regs[RXF4SIDH], 4 );
+	CHECK( _regs[0] == 0XFF && _regs[5] & (1<<EXIDE) && !( _regs[9] & (1<<EXIDE) ) );
+	memset( &sim_regs[RXM1SIDH], 0, 4 );
+	memset( &sim_regs[RXF2SIDH], 0, 4 );
+	memset( &sim_regs[RXF4SIDH], 0, 4 );
+	canSetMaskRX( 1, 0X1FFFFF00 );
+	canSetFilterRX( 2, can_extended, 0X18FEF100 );
+	canSetFilterRX( 4, can_standard, 0X123UL << 18 );
+	CHECK( !memcmp( _regs, &sim_regs[RXM1SIDH], 4 ) );
+	CHECK( !memcmp( _regs + 4, &sim_regs[RXF2SIDH], 4 ) );
+	CHECK( !memcmp( _regs + 8, &sim_regs[RXF4SIDH], 4 ) );
+
+	// numbers the chip does not have are refused, not written to another register
+	CHECK( !xferSetFilter( &_x[0], 6, can_standard, 0 ) && !xferSubmit( &_s, &_x[0], 0 ) );
+	CHECK( !xferSetMask( &_x[0], 2, 0 ) && !xferReadRX( &_x[0], 2 ) && !xferLoadTX( &_x[0], 3, _raw ) );
+	CHECK( !xferRead( &_x[0], xfer_diag, CANSTAT, XFER_MAX_RX + 1 )
+		&& !xferWrite( &_x[0], xfer_config, CANCTRL, _raw, XFER_MAX_TX - 1 ) );
+	CHECK( !xferSubmit( &_s, &_x[0], 0 ) );
+	CHECK( xferSetFilter( &_x[0], 5, can_standard, 0 ) && xferLoadTX( &_x[1], 2, _raw ) );
+	CHECK( _x[0].tx[1] == RXF5SIDH && _x[1].tx[0] == MCP_LOAD_TX0_ID + 4 );
+
+	// a frame comes back in loopback while a diagnostic window waits
+	testChip( mcp_loopback_mode );
+	xferBegin( &_s );
+	xferAttachRX( &_s );
+	memset( &_diag, 0, sizeof(_diag) );
+	xferRead( &_diag, xfer_diag, CANSTAT, 1 );
+	_diag.done = 0;
+	CHECK( xferSubmit( &_s, &_diag, 0 ) );
+	CHECK( canTransmit_wSID( 0, 0X321, 2, _data ) );
+	CHECK( canServiceRX( testKeep, 0 ) == 1 );
+	CHECK( _kept.type == can_standard && _kept.ID == 0X321 && _kept.DLC == 2 && _kept.DATA[1] == 0X22 );
+	CHECK( _diag.queued );
+
+	XFER_STATS _st;
+	xferGetStats( &_s, xfer_rx_drain, &_st );
+	CHECK( _st.submitted == 1 && _st.completed == 1 );
+	xferAttachRX( 0 );
+	CHECK( canTransmit_wSID( 0, 0X322, 2, _data ) );
+	CHECK( canServiceRX( testKeep, 0 ) == 1 && _kept.ID == 0X322 );
+	xferGetStats( &_s, xfer_rx_drain, &_st );
+	CHECK( _st.completed == 1 );
+	CHECK( xferRun( &_s, 0 ) == 1 );
+}
+
+#ifdef MCP_PAL_DYNAMIC
+static uint32_t _selects;
+
+static void testOpSelect(void *_ctx)
+{
+	_selects++;
+	((const MCP_PAL_OPS *)_ctx)->select( 0 );
+}
+
+/**
+ * @brief The core reaches the chip through the table given to palUse().
+*/
+static void testPalOps(void)
+{
+	MCP_PAL_OPS _ops = sim_pal_ops;
+	_ops.select = testOpSelect;
+	_ops.ctx = (void *)&sim_pal_ops;
+
+	testChip( mcp_normal_mode );
+	_selects = 0;
+	const MCP_PAL_OPS *_prev = palUse( &_ops );
+	canReadStatus();
+	canGetMode();
+	CHECK( palUse( _prev ) == &_ops );
+	canReadStatus();
+	CHECK( _selects == 2 );
+}
+
+#ifdef MCP_PAL_LOCKING
+#define TEST_DEV_WRITES 20000
+
+/* a device that checks every call comes from the thread that owns it */
+typedef struct TEST_DEV
+{
+	pthread_t owner;
+	uint32_t calls;
+	uint32_t foreign;
+	uint32_t locks;
+	uint32_t unlocks;
+}TEST_DEV;
+
+static void testDevCall(void *_ctx)
+{
+	TEST_DEV *_d = (TEST_DEV *)_ctx;
+	if( !pthread_equal( pthread_self(), _d->owner ) )
+		_d->foreign++;
+	_d->calls++;
+}
+
+static void testDevSend(void *_ctx, uint8_t _b)
+{
+	(void)_b;
+	testDevCall( _ctx );
+}
+
+static uint8_t testDevRead(void *_ctx)
+{
+	testDevCall( _ctx );
+	return 0;
+}
+
+static uint32_t testDevTime(void *_ctx)
+{
+	(void)_ctx;
+	return 0;
+}
+
+static void testDevLock(void *_ctx)
+{
+	TEST_DEV *_d = (TEST_DEV *)_ctx;
+	if( !pthread_equal( pthread_self(), _d->owner ) )
+		_d->foreign++;
+	_d->locks++;
+}
+
+static void testDevUnlock(void *_ctx)
+{
+	TEST_DEV *_d = (TEST_DEV *)_ctx;
+	if( !pthread_equal( pthread_self(), _d->owner ) )
+		_d->foreign++;
+	_d->unlocks++;
+}
+
+#ifdef MCP_SPI_TRACE
+/* the lock of the recorder, the threads of these tests record at the same time */
+static pthread_mutex_t _trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void testTraceLock(void *_ctx)
+{
+	pthread_mutex_lock( (pthread_mutex_t *)_ctx );
+}
+
+static void testTraceUnlock(void *_ctx)
+{
+	pthread_mutex_unlock( (pthread_mutex_t *)_ctx );
+}
+#endif
+
+static TEST_DEV _devs[2];
+static const MCP_PAL_OPS _dev_ops[2] =
+{
+	{ 0, testDevCall, testDevCall, testDevSend, testDevRead, 0, testDevTime, 0, 0, testDevLock, testDevUnlock, 0, 0,
+		&_devs[0] },
+	{ 0, testDevCall, testDevCall, testDevSend, testDevRead, 0, testDevTime, 0, 0, testDevLock, testDevUnlock, 0, 0,
+		&_devs[1] },
+};
+
+/**
+ * @brief Thread 0 writes to device 0; thread 1 writes to device 1 and points itself at device 0 and back between
+ * its writes.
+*/
+static void *testDevThread(void *_arg)
+{
+	uint8_t _i = (uint8_t)(uintptr_t)_arg;
+
+	_devs[_i].owner = pthread_self();
+	palUse( &_dev_ops[_i] );
+	for(uint32_t n=0; n<TEST_DEV_WRITES; n++)
+	{
+		if( _i )
+		{
+			palUse( &_dev_ops[0] );
+			palUse( &_dev_ops[1] );
+		}
+		canWriteRegister( CNF1, (uint8_t)n );
+		if( !( n & 63 ) )
+			sched_yield();
+	}
+	return 0;
+}
+
+/**
+ * @brief Each thread talks to the device it picked, whatever the other threads pick meanwhile.
+*/
+static void testPalThreads(void)
+{
+	pthread_t _t[2];
+
+	memset( _devs, 0, sizeof(_devs) );
+	for(uint8_t i=0; i<2; i++)
+		pthread_create( &_t[i], 0, testDevThread, (void *)(uintptr_t)i );
+	for(uint8_t i=0; i<2; i++)
+		pthread_join( _t[i], 0 );
+
+	// a WRITE of one register is one window of 3 bytes, under the lock of its device
+	for(uint8_t i=0; i<2; i++)
+	{
+		CHECK( _devs[i].foreign == 0 && _devs[i].calls == 5 * TEST_DEV_WRITES );
+		CHECK( _devs[i].locks == TEST_DEV_WRITES && _devs[i].unlocks == TEST_DEV_WRITES );
+	}
+	CHECK( palUse( &sim_pal_ops ) == &sim_pal_ops );
+}
+
+static volatile uint8_t _in_isr;
+static volatile uint8_t _thread_done;
+static uint32_t _isr_writes;
+
+/**
+ * @brief Thread 0 plays an interrupt handler of device 0 for as long as thread 1 writes to device 1.
+*/
+static void *testIsrThread(void *_arg)
+{
+	uint8_t _i = (uint8_t)(uintptr_t)_arg;
+
+	_devs[_i].owner = pthread_self();
+	palUse( &_dev_ops[_i] );
+	if( !_i )
+	{
+		canEnterISR();
+		_in_isr = 1;
+		while( !_thread_done )
+		{
+			canWriteRegister( CNF1, 0 );
+			_isr_writes++;
+			sched_yield();
+		}
+		canLeaveISR();
+		return 0;
+	}
+
+	while( !_in_isr )
+		sched_yield();
+	for(uint32_t n=0; n<TEST_DEV_WRITES; n++)
+		canWriteRegister( CNF1, (uint8_t)n );
+	_thread_done = 1;
+	return 0;
+}
+
+/**
+ * @brief A handler between canEnterISR() and canLeaveISR() skips the lock of its own transactions only.
+*/
+static void testPalIsr(void)
+{
+	pthread_t _t[2];
+
+	memset( _devs, 0, sizeof(_devs) );
+	_in_isr = 0;
+	_thread_done = 0;
+	_isr_writes = 0;
+	for(uint8_t i=0; i<2; i++)
+		pthread_create( &_t[i], 0, testIsrThread, (void *)(uintptr_t)i );
+	for(uint8_t i=0; i<2; i++)
+		pthread_join( _t[i], 0 );
+
+	CHECK( _isr_writes > 0 && _devs[0].calls == 5 * _isr_writes );
+	CHECK( _devs[0].locks == 0 && _devs[0].unlocks == 0 );
+	CHECK( _devs[1].locks == TEST_DEV_WRITES && _devs[1].unlocks == TEST_DEV_WRITES );
+	CHECK( _devs[0].foreign == 0 && _devs[1].foreign == 0 );
+}
+#endif
+#endif
+
+#ifdef MCP_SPI_TRACE
+/**
+ * @brief The recorder keeps every window with the direction of each byte, until it is paused.
+*/
+static void testTrace(void)
+{
+	static uint8_t _ring[512];
+	static uint8_t _dump[512];
+	TRACE_STATS _st;
+	TRACE_RECORD _rec;
+
+	testChip( mcp_normal_mode );
+	traceBegin( _ring, sizeof(_ring) );
+	canReadStatus();
+	canGetMode();
+	traceEnable( 0 );
+	canReadStatus();
+	// the counters go on while the recording is paused
+	traceGetStats( &_st );
+	CHECK( _st.windows == 3 && _st.bytes == 7 );
+
+	uint32_t _len = traceDump( _dump, sizeof(_dump) );
+	uint32_t _pos = TRACE_HEADER_SIZE;
+	CHECK( traceCheckHeader( _dump, _len ) );
+	CHECK( traceNextRecord( _dump, _len, &_pos, &_rec ) );
+	CHECK( _rec.n == 2 && _rec.bytes[0] == MCP_READ_STATUS && !TRACE_IS_MISO( &_rec, 0 ) && TRACE_IS_MISO( &_rec, 1 ) );
+	CHECK( traceNextRecord( _dump, _len, &_pos, &_rec ) );
+	CHECK( _rec.n == 3 && _rec.bytes[0] == MCP_READ && _rec.bytes[1] == CANSTAT );
+	CHECK( ( _rec.bytes[2] >> 5 ) == mcp_normal_mode );
+	CHECK( !traceNextRecord( _dump, _len, &_pos, &_rec ) );
+	traceBegin( 0, 0 );
+}
+
+#if defined(MCP_PAL_DYNAMIC) && defined(MCP_PAL_LOCKING)
+#define TEST_TRACE_WRITES 2000
+
+/* gives the other thread the processor in the middle of every window */
+static void testTraceSend(void *_ctx, uint8_t _b)
+{
+	testDevSend( _ctx, _b );
+	sched_yield();
+}
+
+static const MCP_PAL_OPS _trace_ops[2] =
+{
+	{ 0, testDevCall, testDevCall, testTraceSend, testDevRead, 0, testDevTime, 0, 0, testDevLock, testDevUnlock, 0, 0,
+		&_devs[0] },
+	{ 0, testDevCall, testDevCall, testTraceSend, testDevRead, 0, testDevTime, 0, 0, testDevLock, testDevUnlock, 0, 0,
+		&_devs[1] },
+};
+
+/**
+ * @brief Thread 0 writes CNF1 of device 0, thread 1 writes CNF2 of device 1, with a count as the value.
+*/
+static void *testTraceThread(void *_arg)
+{
+	uint8_t _i = (uint8_t)(uintptr_t)_arg;
+
+	_devs[_i].owner = pthread_self();
+	palUse( &_trace_ops[_i] );
+	for(uint32_t n=0; n<TEST_TRACE_WRITES; n++)
+		canWriteRegister( _i ? CNF2 : CNF1, (uint8_t)n );
+	return 0;
+}
+
+/**
+ * @brief Two threads on two devices record at the same time : every record is one whole window of one of them, and
+ * the windows of each thread are in the order it clocked them.
+*/
+static void testTraceThreads(void)
+{
+	// a WRITE of one register is a record of 9 bytes
+	static uint8_t _ring[2 * TEST_TRACE_WRITES * 9];
+	static uint8_t _dump[sizeof(_ring) + TRACE_HEADER_SIZE];
+	pthread_t _t[2];
+	uint32_t _next[2] = { 0, 0 };
+	uint32_t _bad = 0;
+	TRACE_STATS _st;
+	TRACE_RECORD _rec;
+
+	memset( _devs, 0, sizeof(_devs) );
+	traceSetLock( testTraceLock, testTraceUnlock, &_trace_mutex );
+	traceBegin( _ring, sizeof(_ring) );
+	for(uint8_t i=0; i<2; i++)
+		pthread_create( &_t[i], 0, testTraceThread, (void *)(uintptr_t)i );
+	for(uint8_t i=0; i<2; i++)
+		pthread_join( _t[i], 0 );
+
+	traceGetStats( &_st );
+	CHECK( _st.windows == 2 * TEST_TRACE_WRITES && _st.bytes == 6 * TEST_TRACE_WRITES && _st.dropped == 0 );
+
+	uint32_t _len = traceDump( _dump, sizeof(_dump) );
+	uint32_t _pos = TRACE_HEADER_SIZE;
+	while( traceNextRecord( _dump, _len, &_pos, &_rec ) )
+	{
+		uint8_t _i = ( _rec.n == 3 && _rec.bytes[1] == CNF2 );
+		if( _rec.n != 3 || ( _rec.dir[0] & 0X07 ) || _rec.bytes[0] != MCP_WRITE || ( !_i && _rec.bytes[1] != CNF1 ) ||
+			_rec.bytes[2] != (uint8_t)_next[_i] )
+			_bad++;
+		_next[_i]++;
+	}
+	CHECK( _bad == 0 );
+	CHECK( _next[0] == TEST_TRACE_WRITES && _next[1] == TEST_TRACE_WRITES );
+	CHECK( _devs[0].foreign == 0 && _devs[1].foreign == 0 );
+
+	traceSetLock( 0, 0, 0 );
+	traceBegin( 0, 0 );
+}
+#endif
+#endif
+
+void testModules(void)
+{
+	testSignals();
+	testScheduler();
+	testGateway();
+	testSnapshot();
+	testRxPoll();
+	testMonitor();
+	testCapture();
+	testPower();
+	testAutobaud();
+	testSelfTest();
+	testXfer();
+	testXferConfig();
+#ifdef MCP_PAL_DYNAMIC
+	testPalOps();
+#ifdef MCP_PAL_LOCKING
+#ifdef MCP_SPI_TRACE
+	traceSetLock( testTraceLock, testTraceUnlock, &_trace_mutex );
+#endif
+	testPalThreads();
+	testPalIsr();
+#endif
+#endif
+#ifdef MCP_SPI_TRACE
+	testTrace();
+#if defined(MCP_PAL_DYNAMIC) && defined(MCP_PAL_LOCKING)
+	testTraceThreads();
+#endif
+#endif
+}
@@ -0,0 +1,201 @@
+/**
+ * @file mcp2515_test_routing.c
+ * @brief Tests of the receive routing : the dispatch table and the latest value mailbox behind it, read while a second
+ * thread writes it.
+*/
+
+#include <pthread.h>
+#include <time.h>
+
+#include "mcp2515_test.h"
+#include "../mcp2515_dispatch.h"
+#include "../mcp2515_mailbox.h"
+
+static MB_SLOT _std_slots[MB_STD_SLOTS];
+static MB_SLOT _hash_slots[8];
+static CAN_MAILBOX _mb;
+
+static uint32_t _hits[4];
+static uint32_t _last_id[4];
+
+static void testCount(const CAN_FRAME *_f, void *_ctx)
+{
+	uint32_t _i = (uint32_t)(uintptr_t)_ctx;
+	_hits[_i]++;
+	_last_id[_i] = _f->ID;
+}
+
+static void testFrame(CAN_FRAME_TYPE _type, uint32_t _id, uint8_t _b0)
+{
+	CAN_FRAME _f = { _type, 0, _id, 2, { _b0, 0X5A } };
+	simInjectFrame( &_f );
+	canServiceRX( canDispatchRXHook, 0 );
+}
+
+/**
+ * @brief Exact and masked subscriptions, standard and extended, get their IDs and nothing else; the rest goes to
+ * the default handler; an unsubscribed ID falls back to it.
+*/
+static void testDispatch(void)
+{
+	testChip( mcp_normal_mode );
+	memset( _hits, 0, sizeof(_hits) );
+
+	canDispatchBegin();
+	uint8_t _exact = canSubscribe_wSID( 0X123, 0X7FF, testCount, (void *)0 );
+	uint8_t _range = canSubscribe_wSID( 0X300, 0X7F0, testCount, (void *)1 );
+	uint8_t _ext = canSubscribe_wEID( 0X18FEF100, 0X1FFFFFFF, testCount, (void *)2 );
+	canSetDefaultHandler( testCount, (void *)3 );
+	CHECK( _exact && _range && _ext && _exact != _range );
+
+	testFrame( can_standard, 0X123, 0 );
+	testFrame( can_standard, 0X305, 0 );
+	testFrame( can_standard, 0X30F, 0 );
+	testFrame( can_standard, 0X310, 0 );
+	testFrame( can_extended, 0X18FEF100, 0 );
+	testFrame( can_extended, 0X123, 0 );
+	CHECK( _hits[0] == 1 && _last_id[0] == 0X123 );
+	CHECK( _hits[1] == 2 && _last_id[1] == 0X30F );
+	CHECK( _hits[2] == 1 && _last_id[2] == 0X18FEF100 );
+	CHECK( _hits[3] == 2 && _last_id[3] == 0X123 );
+
+	canUnsubscribe( _exact );
+	testFrame( can_standard, 0X123, 0 );
+	CHECK( _hits[0] == 1 && _hits[3] == 3 );
+}
+
+/**
+ * @brief The mailbox keeps the latest frame of every ID with the count of frames seen, standard IDs in the direct
+ * table and extended ones in the hash table until it is full.
+*/
+static void testMailbox(void)
+{
+	CAN_FRAME _f;
+	uint32_t _ts;
+
+	testChip( mcp_normal_mode );
+	mbBegin( &_mb, _std_slots, _hash_slots, 8 );
+	canDispatchBegin();
+	canSubscribe_wSID( 0X200, 0X7FF, testCount, (void *)0 );
+	canSetDefaultHandler( mbRXHook, &_mb );
+
+	CHECK( mbRead( &_mb, can_standard, 0X100, &_f, 0 ) == 0 );
+	testFrame( can_standard, 0X100, 1 );
+	simAdvanceTime( 100 );
+	testFrame( can_standard, 0X100, 2 );
+	testFrame( can_standard, 0X200, 3 );
+	testFrame( can_extended, 0X100, 4 );
+
+	CHECK( mbRead( &_mb, can_standard, 0X100, &_f, &_ts ) == 2 );
+	CHECK( _f.type == can_standard && _f.ID == 0X100 && _f.DLC == 2 && _f.DATA[0] == 2 && _f.DATA[1] == 0X5A );
+	CHECK( _ts >= 100 );
+	CHECK( mbRead( &_mb, can_standard, 0X200, &_f, 0 ) == 0 );
+	CHECK( mbRead( &_mb, can_extended, 0X100, &_f, 0 ) == 1 );
+	CHECK( _f.type == can_extended && _f.DATA[0] == 4 );
+
+	for(uint32_t i=1; i<=16; i++)
+		testFrame( can_extended, 0X1000 + i, (uint8_t)i );
+	CHECK( _mb.dropped > 0 );
+	CHECK( _mb.hash_used + _mb.dropped == 17 );
+	CHECK( mbRead( &_mb, can_extended, 0X1001, &_f, 0 ) == 1 && _f.DATA[0] == 1 );
+	CHECK( mbRead( &_mb, can_extended, 0X1010, &_f, 0 ) == 0 );
+}
+
+#define TEST_MB_READS 20000
+
+static CAN_FRAME _read;
+static uint32_t _read_count;
+static volatile uint8_t _writing;
+static volatile uint32_t _reads;
+static uint32_t _writes;
+
+static void *testReader(void *_arg)
+{
+	(void)_arg;
+	_read_count = mbRead( &_mb, can_standard, 0X300, &_read, 0 );
+	return 0;
+}
+
+static void *testWriter(void *_arg)
+{
+	CAN_FRAME _f = { can_standard, 0, 0X301, 8, {0} };
+
+	// writes until the reader has taken enough copies, whatever the scheduling of the two threads
+	(void)_arg;
+	while( _reads < TEST_MB_READS )
+	{
+		_writes++;
+		memset( _f.DATA, (int)( _writes & 0XFF ), 8 );
+		mbUpdate( &_mb, &_f, _writes );
+	}
+	_writing = 0;
+	return 0;
+}
+
+/**
+ * @brief A reader that finds a write in progress waits for it and returns the new frame whole; a reader racing a
+ * writer never returns a frame mixed from two writes.
+*/
+static void testMailboxWriter(void)
+{
+	CAN_FRAME _f = { can_standard, 0, 0X300, 8, { 1, 1, 1, 1, 1, 1, 1, 1 } };
+	MB_SLOT *_slot = &_std_slots[0X300];
+	pthread_t _t;
+	struct timespec _pause = { 0, 20000000 };
+
+	mbBegin( &_mb, _std_slots, 0, 0 );
+	mbUpdate( &_mb, &_f, 0 );
+
+	// the writer stops half way through the data, as an interrupted mbUpdate() would
+	_slot->seq++;
+	for(uint8_t i=0; i<4; i++)
+		_slot->data[i] = 2;
+	memset( &_read, 0XEE, sizeof(_read) );
+	_read_count = 0;
+	pthread_create( &_t, 0, testReader, 0 );
+	nanosleep( &_pause, 0 );
+	for(uint8_t i=4; i<8; i++)
+		_slot->data[i] = 2;
+	_slot->seq++;
+	pthread_join( _t, 0 );
+
+	CHECK( _read_count == 2 );
+	CHECK( _read.ID == 0X300 && _read.DLC == 8 );
+	for(uint8_t i=0; i<8; i++)
+		CHECK( _read.DATA[i] == 2 );
+
+	// every copy taken during a stream of writes is one of them
+	uint32_t _bad = 0;
+	uint32_t _last = 0;
+	_reads = 0;
+	_writes = 0;
+	_writing = 1;
+	pthread_create( &_t, 0, testWriter, 0 );
+	while( _writing )
+	{
+		CAN_FRAME _out;
+		uint32_t _ts;
+		uint32_t _n = mbRead( &_mb, can_standard, 0X301, &_out, &_ts );
+		if( !_n )
+			continue;
+		_reads++;
+		for(uint8_t i=1; i<8; i++)
+			if( _out.DATA[i] != _out.DATA[0] )
+				_bad++;
+		if( _out.DATA[0] != ( _ts & 0XFF ) || _n != _ts || _n < _last )
+			_bad++;
+		_last = _n;
+	}
+	pthread_join( _t, 0 );
+
+	CHECK( _reads >= TEST_MB_READS );
+	CHECK( _bad == 0 );
+	CHECK( mbRead( &_mb, can_standard, 0X301, &_f, 0 ) == _writes );
+}
+
+void testRouting(void)
+{
+	testDispatch();
+	testMailbox();
+	testMailboxWriter();
+}
@@ -0,0 +1,155 @@
+/**
+ * @file mcp2515_test_txq.c
+ * @brief Tests of the transmit queue : completions, deadlines, cancel, abort and the one shot retransmissions.
+*/
+
+#include "mcp2515_test.h"
+#include "../mcp2515_txq.h"
+
+static CAN_TXQ _q;
+
+static TXQ_RESULT _done[8];
+static uint8_t _done_count;
+
+static void testDone(const TXQ_RESULT *_r, void *_ctx)
+{
+	(void)_ctx;
+	if( _done_count < 8 )
+		_done[_done_count] = *_r;
+	_done_count++;
+}
+
+static CAN_FRAME testFrame(uint32_t _id)
+{
+	CAN_FRAME _f = { can_standard, 0, _id, 1, { (unsigned char)_id } };
+	return _f;
+}
+
+/**
+ * @brief Frames given a single buffer leave in submission order and each completion is reported once, through the
+ * ring for frames without a callback.
+*/
+static void testCompletion(void)
+{
+	uint32_t _h[5];
+	TXQ_RESULT _r;
+
+	testChip( mcp_normal_mode );
+	txqBegin( &_q, 0X01 );
+
+	for(uint8_t i=0; i<5; i++)
+	{
+		CAN_FRAME _f = testFrame( 0X100 + i );
+		_h[i] = txqSubmit( &_q, &_f, 0, 0 );
+		CHECK( _h[i] );
+	}
+	for(uint8_t i=0; i<10; i++)
+		txqService( &_q );
+
+	CHECK( test_bus_count == 5 );
+	for(uint8_t i=0; i<5 && i<test_bus_count; i++)
+		CHECK( test_bus[i].ID == 0X100U + i && test_bus[i].DATA[0] == (uint8_t)( 0X100 + i ) );
+
+	for(uint8_t i=0; i<5; i++)
+	{
+		CHECK( txqPoll( &_q, &_r ) );
+		CHECK( _r.handle == _h[i] && _r.status == txq_sent && _r.id == 0X100U + i );
+	}
+	CHECK( !txqPoll( &_q, &_r ) );
+	CHECK( _q.buff_stats[0].sent == 5 );
+}
+
+/**
+ * @brief A frame past its deadline is reported expired and never reaches the bus, queued or loaded.
+*/
+static void testDeadline(void)
+{
+	CAN_FRAME _f = testFrame( 0X200 );
+
+	// the chip holds the frames in configuration mode
+	testChip( mcp_configuration_mode );
+	txqBegin( &_q, 0X01 );
+	_done_count = 0;
+
+	CHECK( txqSubmit_wDeadline( &_q, &_f, 1000, testDone, 0 ) );
+	_f.ID = 0X201;
+	CHECK( txqSubmit_wDeadline( &_q, &_f, 1000, testDone, 0 ) );
+	txqService( &_q );
+	CHECK( _done_count == 0 );
+
+	simAdvanceTime( 2000 );
+	txqService( &_q );
+	txqService( &_q );
+	CHECK( _done_count == 2 );
+	CHECK( _done[0].status == txq_expired && _done[1].status == txq_expired );
+
+	canRequestMode( mcp_normal_mode );
+	for(uint8_t i=0; i<4; i++)
+		txqService( &_q );
+	CHECK( test_bus_count == 0 );
+	CHECK( _done_count == 2 );
+}
+
+/**
+ * @brief txqCancel() reports a queued frame aborted at once; txqAbortAll() reports every frame aborted, loaded or not.
+*/
+static void testAbort(void)
+{
+	uint32_t _h[3];
+
+	testChip( mcp_configuration_mode );
+	txqBegin( &_q, 0X03 );
+	_done_count = 0;
+
+	for(uint8_t i=0; i<3; i++)
+	{
+		CAN_FRAME _f = testFrame( 0X300 + i );
+		_h[i] = txqSubmit( &_q, &_f, testDone, 0 );
+	}
+	txqService( &_q );
+
+	// two frames are in the transmit buffers, the third one is still queued
+	CHECK( txqCancel( &_q, _h[2] ) );
+	CHECK( !txqCancel( &_q, _h[2] ) );
+	CHECK( _done_count == 1 && _done[0].handle == _h[2] && _done[0].status == txq_aborted );
+	CHECK( txqAbortAll( &_q ) == 2 );
+	CHECK( _done_count == 3 );
+	CHECK( _done[1].status == txq_aborted && _done[2].status == txq_aborted );
+
+	canRequestMode( mcp_normal_mode );
+	txqService( &_q );
+	CHECK( test_bus_count == 0 );
+	CHECK( _done_count == 3 );
+}
+
+/**
+ * @brief In one shot mode the queue retransmits a frame that lost arbitration and counts every attempt.
+*/
+static void testOneShot(void)
+{
+	TXQ_POLICY _p = { 1, 0, 0, 0, 0 };
+	CAN_FRAME _f = testFrame( 0X400 );
+
+	testChip( mcp_normal_mode );
+	txqBegin( &_q, 0X01 );
+	txqSetPolicy( &_q, &_p );
+	_done_count = 0;
+
+	simSetContention( 2, 0 );
+	CHECK( txqSubmit( &_q, &_f, testDone, 0 ) );
+	for(uint8_t i=0; i<10 && !_done_count; i++)
+		txqService( &_q );
+	simSetContention( 0, 0 );
+
+	CHECK( _done_count == 1 );
+	CHECK( _done[0].status == txq_sent && _done[0].arb_lost == 2 && _done[0].retransmits == 2 );
+	CHECK( test_bus_count == 1 );
+}
+
+void testTxQueue(void)
+{
+	testCompletion();
+	testDeadline();
+	testAbort();
+	testOneShot();
+}
@@ -0,0 +1,61 @@
+/**
+ * @file mcp2515_test_record.c
+ * @brief First half of the replay test : runs the scenario against the simulated chip with MCP_SPI_TRACE and writes
+ * the dump to the file named on the command line.
+*/
+
+#include "mcp2515_test_scenario.h"
+#include "../../mcp2515_trace.h"
+#include "../../sim/mcp2515_sim.h"
+
+#define RECORD_RING_SIZE 65536
+
+static uint8_t _ring[RECORD_RING_SIZE];
+static uint8_t _dump[RECORD_RING_SIZE + TRACE_HEADER_SIZE];
+
+/**
+ * @brief Puts the frames the scenario expects from the bus into the simulated chip.
+*/
+static void recordBus(void)
+{
+	CAN_FRAME _std = { can_standard, 0, 0X123, 2, { 0X11, 0X22 } };
+	CAN_FRAME _ext = { can_extended, 0, 0X18FEF100, 8, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+
+	simInjectFrame( &_std );
+	simInjectFrame( &_ext );
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_STATS _s;
+
+	if( argc != 2 )
+	{
+		fprintf(stderr, "usage : %s dump\n", argv[0]);
+		return 2;
+	}
+
+	simReset();
+	traceBegin( _ring, sizeof(_ring) );
+	uint8_t _frames = scenarioRun( recordBus );
+	traceGetStats( &_s );
+	uint32_t _len = traceDump( _dump, sizeof(_dump) );
+
+	FILE *_f = fopen(argv[1], "wb");
+	if( !_f || fwrite(_dump, 1, _len, _f) != _len || fclose(_f) )
+	{
+		fprintf(stderr, "%s : cannot write %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	printf("record : %u of %u frames, %lu windows, %lu bytes, %lu dropped, %lu truncated\n", _frames, SCENARIO_FRAMES,
+		(unsigned long)_s.windows, (unsigned long)_s.bytes, (unsigned long)_s.dropped, (unsigned long)_s.truncated);
+
+	// a dump that lost windows cannot be replayed
+	if( _frames != SCENARIO_FRAMES || _s.dropped || _s.truncated )
+	{
+		printf("record FAILED\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file mcp2515_test_replay.c
+ * @brief Second half of the replay test : runs the scenario again with sim/mcp2515_replay.c answering from the dump
+ * written by mcp2515_test_record, and checks that the driver clocks the recorded bytes and receives the same frames.
+ * A copy of the dump with one byte sent by the driver changed has to be reported.
+*/
+
+#include <stdlib.h>
+
+#include "mcp2515_test_scenario.h"
+#include "../../sim/mcp2515_replay.h"
+
+/**
+ * @brief Replays a dump and prints the counters.
+ *
+ * @return
+ * 1 : IF THE SCENARIO WENT THROUGH AND CONSUMED THE DUMP WITHOUT A MISMATCH OR AN OVERRUN
+ * 0 : OTHERWISE
+ */
+static uint8_t replayRun(const char *_name, const uint8_t *_dump, uint32_t _len)
+{
+	REPLAY_STATS _s;
+
+	if( !replayBegin( _dump, _len ) )
+	{
+		printf("replay %s : bad header\n", _name);
+		return 0;
+	}
+	uint8_t _frames = scenarioRun( 0 );
+	uint8_t _done = replayDone();
+	replayGetStats( &_s );
+
+	printf("replay %s : %u of %u frames, %lu windows, %lu bytes, %lu mismatches, %lu overruns, %s\n", _name, _frames,
+		SCENARIO_FRAMES, (unsigned long)_s.windows, (unsigned long)_s.bytes, (unsigned long)_s.mismatches,
+		(unsigned long)_s.overruns, _done ? "dump consumed" : "dump left over");
+	return _frames == SCENARIO_FRAMES && !_s.mismatches && !_s.overruns && _done;
+}
+
+int main(int argc, char **argv)
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "usage : %s dump\n", argv[0]);
+		return 2;
+	}
+
+	FILE *_f = fopen(argv[1], "rb");
+	if( !_f )
+	{
+		fprintf(stderr, "%s : cannot open %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	fseek(_f, 0, SEEK_END);
+	long _size = ftell(_f);
+	fseek(_f, 0, SEEK_SET);
+	uint8_t *_dump = _size > 0 ? malloc((size_t)_size) : 0;
+	if( !_dump || fread(_dump, 1, (size_t)_size, _f) != (size_t)_size )
+	{
+		fprintf(stderr, "%s : cannot read %s\n", argv[0], argv[1]);
+		fclose(_f);
+		return 1;
+	}
+	fclose(_f);
+
+	uint8_t _ok = replayRun( "recorded", _dump, (uint32_t)_size );
+
+	// the instruction byte of the last window, always sent by the driver
+	uint32_t _pos = TRACE_HEADER_SIZE;
+	uint32_t _last = 0;
+	TRACE_RECORD _rec;
+	while( traceNextRecord( _dump, (uint32_t)_size, &_pos, &_rec ) )
+		if( _rec.n && !TRACE_IS_MISO( &_rec, 0 ) )
+			_last = (uint32_t)( _rec.bytes - _dump );
+	if( _last )
+	{
+		_dump[_last] ^= 0X01;
+		if( replayRun( "altered", _dump, (uint32_t)_size ) )
+			_ok = 0;
+	}
+	else
+		_ok = 0;
+
+	free(_dump);
+	printf(_ok ? "replay passed\n" : "replay FAILED\n");
+	return !_ok;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file mcp2515_test_scenario.c
+ * @brief Driver run shared by the record and replay tests : configuration, transmits in normal mode, frames from the
+ * bus, a frame sent and received in loopback mode, filter changes and an abort.
+*/
+
+#include "mcp2515_test_scenario.h"
+
+static const CAN_FRAME _expected[SCENARIO_FRAMES] =
+{
+	{ can_standard, 0, 0X123, 2, { 0X11, 0X22 } },
+	{ can_extended, 0, 0X18FEF100, 8, { 1, 2, 3, 4, 5, 6, 7, 8 } },
+	{ can_standard, 0, 0X123, 4, { 0XA0, 0XA1, 0XA2, 0XA3 } },
+};
+
+static uint8_t _received;
+static uint8_t _matched;
+
+/**
+ * @brief Receive hook, counts the frames that arrive as expected and in order.
+*/
+static void scenarioRX(const CAN_FRAME *_f, void *_ctx)
+{
+	(void)_ctx;
+
+	if( _received < SCENARIO_FRAMES )
+	{
+		const CAN_FRAME *_e = &_expected[_received];
+		if( _f->type == _e->type && _f->ID == _e->ID && _f->DLC == _e->DLC && !memcmp( _f->DATA, _e->DATA, _e->DLC ) )
+			_matched++;
+	}
+	_received++;
+}
+
+/**
+ * @brief This function runs the scenario. Nothing in it depends on the chip other than through the SPI bytes, so a
+ * replay of its recording has to take the same path.
+ *
+ * @param
+ * 1. _bus : called once the chip is configured, puts the first two expected frames on the bus. NULL when the chip
+ * answers from a recording.
+ *
+ * @return
+ * THE NUMBER OF FRAMES RECEIVED AS EXPECTED, SCENARIO_FRAMES WHEN THE RUN WENT THROUGH.
+ */
+uint8_t scenarioRun(void (*_bus)(void))
+{
+	MCP_CONFIG _cfg;
+	unsigned char _data[8] = { 0X10, 0X20, 0X30, 0X40, 0X50, 0X60, 0X70, 0X80 };
+	unsigned char _loop[8] = { 0XA0, 0XA1, 0XA2, 0XA3 };
+
+	_received = 0;
+	_matched = 0;
+
+	memset( &_cfg, 0, sizeof(_cfg) );
+	_cfg.data_rate = 500;
+	_cfg.caninte = 0X03;
+	_cfg.mask[0] = 0X7FFUL << 18;
+	_cfg.mask[1] = 0X1FFFFFFFUL;
+	_cfg.filter[0] = 0X123UL << 18;
+	_cfg.filter[2] = 0X18FEF100UL;
+	_cfg.filter_ext = 0X04;
+	_cfg.rxb0ctrl = 0X04;
+	_cfg.mode = mcp_normal_mode;
+	if( !canInit( &_cfg ) )
+		return 0;
+
+	canTransmit_wSID( 0, 0X321, 8, _data );
+	canTransmit_wEID( 1, 0X18FEF200, 3, _data );
+	if( _bus )
+		_bus();
+	canServiceRX( scenarioRX, 0 );
+
+	canRequestMode( mcp_loopback_mode );
+	canTransmit_wSID( 2, 0X123, 4, _loop );
+	canServiceRX( scenarioRX, 0 );
+
+	canRequestMode( mcp_configuration_mode );
+	canSetMaskRX( 1, 0X1FFFFF00UL );
+	canSetFilterRX( 3, can_extended, 0X18FEF200UL );
+	canRequestMode( mcp_normal_mode );
+	canAbortAll();
+	canReadStatus();
+
+	return _received == SCENARIO_FRAMES ? _matched : 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file mcp2515_test_scenario.h
+ * @brief Driver run shared by the record and replay tests. It is played once against the simulated chip with the SPI
+ * recorder, then against the dump with sim/mcp2515_replay.c, and has to clock the same bytes both times.
+*/
+#ifndef MCP2515_TEST_SCENARIO
+#define MCP2515_TEST_SCENARIO
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../mcp2515_driver.h"
+
+/**
+ * @brief Number of frames the scenario receives : the two put on the bus and the one sent in loopback mode.
+*/
+#define SCENARIO_FRAMES 3
+
+uint8_t scenarioRun(void (*)(void));
+
+#endif
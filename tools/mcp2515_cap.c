@@ -0,0 +1,259 @@
+/**
+ * @file mcp2515_cap.c
+ * @brief Command line tool for captures written by mcp2515_capture.c.
+ *
+ * Usage :
+ * 		mcp2515_cap info <capture>
+ * 		mcp2515_cap candump <capture> [interface]		capture to candump log text on stdout
+ * 		mcp2515_cap import <candump log> <capture>		candump log text to capture
+ * 		mcp2515_cap scan <capture> <id>[/<mask>] [from_us]	print the matching frames
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mcp2515_capture_reader.h"
+
+/**
+ * @brief Host time base, used by capRXHook() when the capture code is linked into a host program.
+*/
+uint32_t pal_get_time_us(void)
+{
+	struct timeval _tv;
+	gettimeofday( &_tv, 0 );
+	return (uint32_t)( (uint64_t)_tv.tv_sec * 1000000 + _tv.tv_usec );
+}
+
+static void printCandump(const CAN_FRAME *_f, uint64_t _ts, const char *_ifname)
+{
+	printf("(%lu.%06lu) %s ", (unsigned long)( _ts / 1000000 ), (unsigned long)( _ts % 1000000 ), _ifname);
+
+	if( _f->type == can_extended )
+		printf("%08lX#", (unsigned long)_f->ID);
+	else
+		printf("%03lX#", (unsigned long)_f->ID);
+
+	// a remote frame carries its DLC after the R when it is not 0, as candump prints it
+	if( _f->isRemote )
+	{
+		printf("R");
+		if( _f->DLC )
+			printf("%u", (unsigned)_f->DLC);
+	}
+	else
+		for(uint8_t i=0; i<_f->DLC; i++)
+			printf("%02X", _f->DATA[i]);
+	printf("\n");
+}
+
+static int hexNibble(char _c)
+{
+	if( _c >= '0' && _c <= '9' )
+		return _c - '0';
+	if( _c >= 'a' && _c <= 'f' )
+		return _c - 'a' + 10;
+	if( _c >= 'A' && _c <= 'F' )
+		return _c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * @brief Parses one candump log line : "(sec.usec) iface ID#DATA", "(sec.usec) iface ID#R" or
+ * "(sec.usec) iface ID#R<dlc>".
+*/
+static int parseCandump(const char *_line, CAN_FRAME *_f, uint64_t *_ts)
+{
+	unsigned long _sec, _usec;
+	char _ifname[32];
+	char _frame[64];
+
+	if( sscanf( _line, " (%lu.%lu) %31s %63s", &_sec, &_usec, _ifname, _frame ) != 4 )
+		return -1;
+
+	char *_hash = strchr( _frame, '#' );
+	if( !_hash )
+		return -1;
+
+	*_hash = 0;
+	size_t _idlen = strlen( _frame );
+	_f->ID = strtoul( _frame, 0, 16 );
+	_f->type = _idlen > 3 ? can_extended : can_standard;
+	_f->isRemote = 0;
+	_f->DLC = 0;
+	memset( _f->DATA, 0, 8 );
+
+	const char *_d = _hash + 1;
+	if( *_d == 'R' )
+	{
+		_f->isRemote = 1;
+		if( _d[1] >= '0' && _d[1] <= '8' )
+			_f->DLC = _d[1] - '0';
+	}
+	else
+	{
+		while( _d[0] && _d[1] && _f->DLC < 8 )
+		{
+			int _h = hexNibble( _d[0] );
+			int _l = hexNibble( _d[1] );
+			if( _h < 0 || _l < 0 )
+				return -1;
+			_f->DATA[_f->DLC++] = ( _h << 4 ) | _l;
+			_d += 2;
+		}
+	}
+
+	*_ts = (uint64_t)_sec * 1000000 + _usec;
+	return 0;
+}
+
+static int cmdInfo(const char *_path)
+{
+	CAP_READER _r;
+	if( capOpen( &_r, _path ) < 0 )
+	{
+		fprintf(stderr, "%s: not a capture\n", _path);
+		return 1;
+	}
+
+	printf("records   : %llu\n", (unsigned long long)_r.count);
+	if( _r.count )
+	{
+		uint64_t _first = CAP_RECORD_TS( CAP_RECORD( &_r, 0 ) );
+		uint64_t _last = CAP_RECORD_TS( CAP_RECORD( &_r, _r.count - 1 ) );
+		printf("first us  : %llu\n", (unsigned long long)_first);
+		printf("last us   : %llu\n", (unsigned long long)_last);
+		if( _last > _first )
+			printf("rate fps  : %.1f\n", (double)( _r.count - 1 ) * 1e6 / (double)( _last - _first ));
+	}
+	if( ( _r.size - CAP_HEADER_SIZE ) % CAP_RECORD_SIZE )
+		printf("trailing partial record ignored\n");
+
+	capClose( &_r );
+	return 0;
+}
+
+static int cmdCandump(const char *_path, const char *_ifname)
+{
+	CAP_READER _r;
+	CAN_FRAME _f;
+	uint64_t _ts;
+
+	if( capOpen( &_r, _path ) < 0 )
+	{
+		fprintf(stderr, "%s: not a capture\n", _path);
+		return 1;
+	}
+
+	for(uint64_t i=0; i<_r.count; i++)
+	{
+		capDecode( CAP_RECORD( &_r, i ), &_f, &_ts );
+		printCandump( &_f, _ts, _ifname );
+	}
+
+	capClose( &_r );
+	return 0;
+}
+
+static int cmdImport(const char *_in, const char *_out)
+{
+	FILE *_fi = fopen( _in, "r" );
+	if( !_fi )
+	{
+		perror( _in );
+		return 1;
+	}
+	FILE *_fo = fopen( _out, "wb" );
+	if( !_fo )
+	{
+		perror( _out );
+		fclose( _fi );
+		return 1;
+	}
+
+	uint8_t _hdr[CAP_HEADER_SIZE];
+	capHeader( _hdr );
+	fwrite( _hdr, 1, sizeof(_hdr), _fo );
+
+	char _line[256];
+	unsigned long _n = 0;
+	unsigned long _bad = 0;
+	while( fgets( _line, sizeof(_line), _fi ) )
+	{
+		CAN_FRAME _f;
+		uint64_t _ts;
+		uint8_t _rec[CAP_RECORD_SIZE];
+
+		if( parseCandump( _line, &_f, &_ts ) < 0 )
+		{
+			_bad++;
+			continue;
+		}
+		capEncode( _rec, &_f, _ts );
+		fwrite( _rec, 1, sizeof(_rec), _fo );
+		_n++;
+	}
+
+	fclose( _fi );
+	fclose( _fo );
+	fprintf(stderr, "%lu frames imported, %lu lines skipped\n", _n, _bad);
+	return 0;
+}
+
+static int cmdScan(const char *_path, const char *_spec, const char *_from)
+{
+	CAP_READER _r;
+	CAN_FRAME _f;
+	uint64_t _ts;
+
+	char *_end;
+	uint32_t _id = strtoul( _spec, &_end, 16 );
+	uint32_t _mask = *_end == '/' ? strtoul( _end + 1, 0, 16 ) : 0X1FFFFFFF;
+
+	if( capOpen( &_r, _path ) < 0 )
+	{
+		fprintf(stderr, "%s: not a capture\n", _path);
+		return 1;
+	}
+
+	uint64_t _start = _from ? capSeek( &_r, strtoull( _from, 0, 10 ) ) : 0;
+	unsigned long _hits = 0;
+
+	for(uint64_t i=_start; i<_r.count; i++)
+	{
+		const uint8_t *_rec = CAP_RECORD( &_r, i );
+		uint32_t _rid = (uint32_t)_rec[8] | ( (uint32_t)_rec[9] << 8 ) | ( (uint32_t)_rec[10] << 16 ) | ( (uint32_t)_rec[11] << 24 );
+
+		// only the ID is looked at until a record matches
+		if( ( _rid ^ _id ) & _mask )
+			continue;
+
+		capDecode( _rec, &_f, &_ts );
+		printCandump( &_f, _ts, "can0" );
+		_hits++;
+	}
+
+	fprintf(stderr, "%lu matching frames\n", _hits);
+	capClose( &_r );
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if( argc >= 3 && strcmp( argv[1], "info" ) == 0 )
+		return cmdInfo( argv[2] );
+	if( argc >= 3 && strcmp( argv[1], "candump" ) == 0 )
+		return cmdCandump( argv[2], argc >= 4 ? argv[3] : "can0" );
+	if( argc >= 4 && strcmp( argv[1], "import" ) == 0 )
+		return cmdImport( argv[2], argv[3] );
+	if( argc >= 4 && strcmp( argv[1], "scan" ) == 0 )
+		return cmdScan( argv[2], argv[3], argc >= 5 ? argv[4] : 0 );
+
+	fprintf(stderr,
+		"usage: %s info <capture>\n"
+		"       %s candump <capture> [interface]\n"
+		"       %s import <candump log> <capture>\n"
+		"       %s scan <capture> <id>[/<mask>] [from_us]\n", argv[0], argv[0], argv[0], argv[0]);
+	return 2;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file mcp2515_capture_reader.c
+ * @brief Host side reader for captures written by mcp2515_capture.c.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mcp2515_capture_reader.h"
+
+/**
+ * @brief This function maps a capture file and checks its header.
+ *
+ * @param
+ * 1. _r : the reader.
+ * 2. _path : path of the capture.
+ *
+ * @return
+ * 0 : ON SUCCESS
+ * -1 : IF THE FILE CANNOT BE MAPPED OR IS NOT A CAPTURE
+ */
+int capOpen(CAP_READER *_r, const char *_path)
+{
+	struct stat _st;
+
+	_r->base = 0;
+	_r->size = 0;
+	_r->count = 0;
+
+	int _fd = open( _path, O_RDONLY );
+	if( _fd < 0 )
+		return -1;
+
+	if( fstat( _fd, &_st ) < 0 || (size_t)_st.st_size < CAP_HEADER_SIZE )
+	{
+		close( _fd );
+		return -1;
+	}
+
+	void *_map = mmap( 0, _st.st_size, PROT_READ, MAP_SHARED, _fd, 0 );
+	close( _fd );
+	if( _map == MAP_FAILED )
+		return -1;
+
+	const uint8_t *_b = _map;
+	if( memcmp( _b, CAP_MAGIC, 8 ) != 0 || ( _b[10] | ( _b[11] << 8 ) ) != CAP_RECORD_SIZE )
+	{
+		munmap( _map, _st.st_size );
+		return -1;
+	}
+
+	// captures are scanned front to back far more often than randomly
+	madvise( _map, _st.st_size, MADV_SEQUENTIAL );
+
+	_r->base = _b;
+	_r->size = _st.st_size;
+	_r->count = ( _st.st_size - CAP_HEADER_SIZE ) / CAP_RECORD_SIZE;
+	return 0;
+}
+
+/**
+ * @brief This function unmaps a capture.
+ *
+ * @param
+ * 1. _r : the reader.
+ *
+ * @return
+ * NOTHING
+ */
+void capClose(CAP_READER *_r)
+{
+	if( _r->base )
+		munmap( (void *)_r->base, _r->size );
+	_r->base = 0;
+	_r->size = 0;
+	_r->count = 0;
+}
+
+/**
+ * @brief This function finds the first record with a time stamp not older than _ts by binary search. Records are
+ * appended in time order, so only O(log n) records are touched.
+ *
+ * @param
+ * 1. _r : the reader.
+ * 2. _ts : time stamp in microseconds.
+ *
+ * @return
+ * THE INDEX OF THE RECORD, count IF ALL RECORDS ARE OLDER.
+ */
+uint64_t capSeek(const CAP_READER *_r, uint64_t _ts)
+{
+	uint64_t _lo = 0;
+	uint64_t _hi = _r->count;
+
+	while( _lo < _hi )
+	{
+		uint64_t _mid = _lo + ( _hi - _lo ) / 2;
+		if( CAP_RECORD_TS( CAP_RECORD( _r, _mid ) ) < _ts )
+			_lo = _mid + 1;
+		else
+			_hi = _mid;
+	}
+
+	return _lo;
+}
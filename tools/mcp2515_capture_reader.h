@@ -0,0 +1,38 @@
+/**
+ * @file mcp2515_capture_reader.h
+ * @brief Host side reader for captures written by mcp2515_capture.c. The file is memory mapped and records are
+ * addressed by index, so captures of any size are opened in constant time and only the records actually
+ * touched are paged in.
+*/
+#ifndef MCP2515_CAPTURE_READER
+#define MCP2515_CAPTURE_READER
+
+#include <stddef.h>
+
+#include "../mcp2515_capture.h"
+
+typedef struct CAP_READER
+{
+	const uint8_t *base;	/* the mapped file */
+	size_t size;			/* size of the mapping in bytes */
+	uint64_t count;			/* number of complete records */
+}CAP_READER;
+
+/**
+ * @brief Address of record i of an open capture.
+*/
+#define CAP_RECORD(r, i) ( (r)->base + CAP_HEADER_SIZE + (size_t)(i) * CAP_RECORD_SIZE )
+
+/**
+ * @brief Time stamp of a record without decoding the rest of it.
+*/
+#define CAP_RECORD_TS(rec) ( (uint64_t)(rec)[0] | ( (uint64_t)(rec)[1] << 8 ) | ( (uint64_t)(rec)[2] << 16 ) | ( (uint64_t)(rec)[3] << 24 ) \
+	| ( (uint64_t)(rec)[4] << 32 ) | ( (uint64_t)(rec)[5] << 40 ) | ( (uint64_t)(rec)[6] << 48 ) | ( (uint64_t)(rec)[7] << 56 ) )
+
+int capOpen(CAP_READER *, const char *);
+
+void capClose(CAP_READER *);
+
+uint64_t capSeek(const CAP_READER *, uint64_t);
+
+#endif
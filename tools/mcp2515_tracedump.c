@@ -0,0 +1,246 @@
+/**
+ * @file mcp2515_tracedump.c
+ * @brief Decodes a trace dump written by traceDump() into human readable MCP2515 operations.
+ *
+ * Usage : mcp2515_tracedump [-r] <dump file>
+ * 		-r : also print the raw bytes of every window.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mcp2515_driver.h"
+#include "../sim/mcp2515_trace_reader.h"
+
+static const char *_reg_names[128] =
+{
+	[0X00] = "RXF0SIDH", [0X01] = "RXF0SIDL", [0X02] = "RXF0EID8", [0X03] = "RXF0EID0",
+	[0X04] = "RXF1SIDH", [0X05] = "RXF1SIDL", [0X06] = "RXF1EID8", [0X07] = "RXF1EID0",
+	[0X08] = "RXF2SIDH", [0X09] = "RXF2SIDL", [0X0A] = "RXF2EID8", [0X0B] = "RXF2EID0",
+	[0X0C] = "BFPCTRL", [0X0D] = "TXRTSCTRL",
+	[0X10] = "RXF3SIDH", [0X11] = "RXF3SIDL", [0X12] = "RXF3EID8", [0X13] = "RXF3EID0",
+	[0X14] = "RXF4SIDH", [0X15] = "RXF4SIDL", [0X16] = "RXF4EID8", [0X17] = "RXF4EID0",
+	[0X18] = "RXF5SIDH", [0X19] = "RXF5SIDL", [0X1A] = "RXF5EID8", [0X1B] = "RXF5EID0",
+	[0X1C] = "TEC", [0X1D] = "REC",
+	[0X20] = "RXM0SIDH", [0X21] = "RXM0SIDL", [0X22] = "RXM0EID8", [0X23] = "RXM0EID0",
+	[0X24] = "RXM1SIDH", [0X25] = "RXM1SIDL", [0X26] = "RXM1EID8", [0X27] = "RXM1EID0",
+	[0X28] = "CNF3", [0X29] = "CNF2", [0X2A] = "CNF1", [0X2B] = "CANINTE", [0X2C] = "CANINTF", [0X2D] = "EFLG",
+	[0X30] = "TXB0CTRL", [0X31] = "TXB0SIDH", [0X35] = "TXB0DLC", [0X36] = "TXB0D0",
+	[0X40] = "TXB1CTRL", [0X41] = "TXB1SIDH", [0X45] = "TXB1DLC", [0X46] = "TXB1D0",
+	[0X50] = "TXB2CTRL", [0X51] = "TXB2SIDH", [0X55] = "TXB2DLC", [0X56] = "TXB2D0",
+	[0X60] = "RXB0CTRL", [0X61] = "RXB0SIDH", [0X65] = "RXB0DLC", [0X66] = "RXB0D0",
+	[0X70] = "RXB1CTRL", [0X71] = "RXB1SIDH", [0X75] = "RXB1DLC", [0X76] = "RXB1D0",
+};
+
+static const char *_mode_names[8] = { "normal", "sleep", "loopback", "listen-only", "configuration", "?", "?", "?" };
+
+static void printReg(uint8_t _addr)
+{
+	_addr &= 0X7F;
+	if( ( _addr & 0X0F ) == 0X0E )
+		printf("CANSTAT");
+	else if( ( _addr & 0X0F ) == 0X0F )
+		printf("CANCTRL");
+	else if( _reg_names[_addr] )
+		printf("%s", _reg_names[_addr]);
+	else
+		printf("0x%02X", _addr);
+}
+
+static void printBytes(const uint8_t *_b, uint32_t _n)
+{
+	for(uint32_t i=0; i<_n; i++)
+		printf(" %02X", _b[i]);
+}
+
+/**
+ * @brief Prints a frame held in buffer register order SIDH, SIDL, EID8, EID0, DLC, D0..D7.
+*/
+static void printFrame(const uint8_t *_raw, uint32_t _n)
+{
+	if( _n < 2 )
+		return;
+
+	uint8_t _ext = _raw[1] & (1<<IDE);
+	uint32_t _id = ( (uint32_t)_raw[0] << 3 ) | ( _raw[1] >> 5 );
+	if( _ext )
+	{
+		if( _n < 4 )
+			return;
+		_id = ( _id << 18 ) | ( (uint32_t)( _raw[1] & 0X03 ) << 16 ) | ( (uint32_t)_raw[2] << 8 ) | _raw[3];
+		printf("  id=%08lX", (unsigned long)_id);
+	}
+	else
+		printf("  id=%03lX", (unsigned long)_id);
+
+	if( _n < 5 )
+		return;
+
+	uint8_t _dlc = _raw[4] & 0X0F;
+	if( _raw[4] & (1<<RTR) )
+		printf(" rtr");
+	printf(" dlc=%u", _dlc);
+
+	if( _dlc > 8 )
+		_dlc = 8;
+	if( _n > 5 )
+	{
+		printf(" data=");
+		for(uint32_t i=0; i<_dlc && 5 + i < _n; i++)
+			printf("%02X", _raw[5 + i]);
+	}
+}
+
+static void decode(const TRACE_RECORD *_r)
+{
+	const uint8_t *_b = _r->bytes;
+	uint8_t _n = _r->n;
+
+	if( _n == 0 )
+	{
+		printf("(empty window)");
+		return;
+	}
+
+	uint8_t _op = _b[0];
+
+	if( _op == MCP_RESET )
+		printf("RESET");
+	else if( _op == MCP_READ || _op == MCP_WRITE )
+	{
+		printf( _op == MCP_READ ? "READ  " : "WRITE " );
+		if( _n < 2 )
+			return;
+		printReg( _b[1] );
+		printf(" [%u]:", _n - 2);
+		printBytes( &_b[2], _n - 2 );
+
+		uint8_t _a = _b[1] & 0X7F;
+		if( _n > 2 && ( _a == (CANSTAT & 0X7F) || _a == (CANCTRL & 0X7F) ) )
+			printf("  mode=%s", _mode_names[ _b[2] >> 5 ]);
+		else if( _n > 3 && ( _a & 0X0F ) == 1 && _a >= TXB0SIDH && _a <= RXB1SIDH )
+			printFrame( &_b[2], _n - 2 );
+	}
+	else if( _op == MCP_BIT_MODIFY )
+	{
+		printf("MODIFY ");
+		if( _n < 4 )
+			return;
+		printReg( _b[1] );
+		printf(" mask=%02X data=%02X", _b[2], _b[3]);
+		if( ( _b[1] & 0X7F ) == (CANCTRL & 0X7F) && ( _b[2] & 0XE0 ) == 0XE0 )
+			printf("  mode=%s", _mode_names[ _b[3] >> 5 ]);
+	}
+	else if( ( _op & 0XF8 ) == 0X80 )
+	{
+		printf("RTS  ");
+		for(uint8_t i=0; i<3; i++)
+			if( _op & (1<<i) )
+				printf(" TX%u", i);
+	}
+	else if( _op == MCP_READ_STATUS )
+	{
+		printf("READ STATUS");
+		if( _n > 1 )
+			printf(" -> %02X", _b[1]);
+	}
+	else if( _op == MCP_RX_STATUS )
+	{
+		printf("RX STATUS");
+		if( _n > 1 )
+			printf(" -> %02X  rxb0=%u rxb1=%u filter=%u", _b[1], ( _b[1] >> 6 ) & 1, _b[1] >> 7, _b[1] & 0X07);
+	}
+	else if( ( _op & 0XF9 ) == MCP_READ_RX0_ID )
+	{
+		printf("READ RX%u %s:", ( _op >> 2 ) & 1, ( _op & 0X02 ) ? "DATA" : "ID");
+		printBytes( &_b[1], _n - 1 );
+		if( !( _op & 0X02 ) )
+			printFrame( &_b[1], _n - 1 );
+	}
+	else if( ( _op & 0XF8 ) == MCP_LOAD_TX0_ID && ( _op & 0X07 ) <= 5 )
+	{
+		printf("LOAD TX%u %s:", ( _op >> 1 ) & 3, ( _op & 1 ) ? "DATA" : "ID");
+		printBytes( &_b[1], _n - 1 );
+		if( !( _op & 1 ) )
+			printFrame( &_b[1], _n - 1 );
+	}
+	else
+		printf("UNKNOWN %02X", _op);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t _raw = 0;
+	const char *_path = 0;
+
+	for(int i=1; i<argc; i++)
+	{
+		if( strcmp( argv[i], "-r" ) == 0 )
+			_raw = 1;
+		else
+			_path = argv[i];
+	}
+
+	if( !_path )
+	{
+		fprintf(stderr, "usage: %s [-r] <dump file>\n", argv[0]);
+		return 2;
+	}
+
+	FILE *_f = fopen( _path, "rb" );
+	if( !_f )
+	{
+		perror( _path );
+		return 1;
+	}
+
+	fseek( _f, 0, SEEK_END );
+	long _size = ftell( _f );
+	fseek( _f, 0, SEEK_SET );
+
+	uint8_t *_buf = malloc( _size > 0 ? _size : 1 );
+	if( !_buf || fread( _buf, 1, _size, _f ) != (size_t)_size )
+	{
+		fprintf(stderr, "%s: read error\n", _path);
+		return 1;
+	}
+	fclose( _f );
+
+	if( !traceCheckHeader( _buf, _size ) )
+	{
+		fprintf(stderr, "%s: not a trace dump\n", _path);
+		return 1;
+	}
+
+	uint32_t _pos = TRACE_HEADER_SIZE;
+	uint32_t _windows = 0;
+	uint32_t _bytes = 0;
+	TRACE_RECORD _r;
+
+	while( traceNextRecord( _buf, _size, &_pos, &_r ) )
+	{
+		printf("%10lu  ", (unsigned long)_r.ts);
+		decode( &_r );
+		printf("\n");
+
+		if( _raw )
+		{
+			printf("%10s  ", "");
+			for(uint8_t i=0; i<_r.n; i++)
+				printf(" %s%02X", TRACE_IS_MISO( &_r, i ) ? "<" : ">", _r.bytes[i]);
+			printf("\n");
+		}
+
+		_windows++;
+		_bytes += _r.n;
+	}
+
+	if( _pos != (uint32_t)_size )
+		fprintf(stderr, "%s: truncated record at offset %lu\n", _path, (unsigned long)_pos);
+
+	printf("%lu windows, %lu bytes\n", (unsigned long)_windows, (unsigned long)_bytes);
+
+	free( _buf );
+	return 0;
+}